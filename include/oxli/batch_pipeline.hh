@@ -0,0 +1,362 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef BATCH_PIPELINE_HH
+#define BATCH_PIPELINE_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oxli.hh"
+#include "read_parsers.hh"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// reads handed to a pipeline worker at a time
+#define READ_BATCH_SIZE 1000
+
+namespace oxli
+{
+
+/**
+ * \struct ReadBatch
+ *
+ * \brief A run of consecutive reads taken from a parser.
+ *
+ * Workers may rewrite the reads in place, format their results into
+ * output and/or store numeric results for the writer in values; in-order
+ * pipelines then hand the batch to a single writer.
+ */
+struct ReadBatch {
+    /// Position of this batch in the input, counting from zero.
+    uint64_t id;
+    std::vector<read_parsers::Read> reads;
+    std::string output;
+    std::vector<float> values;
+
+    ReadBatch() : id(0) {}
+};
+
+/**
+ * \struct WorkerCounters
+ *
+ * \brief Progress of one pipeline worker.
+ *
+ * Each counter is only ever written by its own worker, so updates need no
+ * read-modify-write; other threads may read them at any time. Padded to a
+ * cache line so that workers do not contend.
+ */
+struct WorkerCounters {
+    std::atomic<uint64_t> n_reads;
+    std::atomic<uint64_t> n_consumed;
+    char _pad[64 - 2 * sizeof(std::atomic<uint64_t>)];
+
+    WorkerCounters() : n_reads(0), n_consumed(0) {}
+
+    void add(uint64_t reads, uint64_t consumed)
+    {
+        n_reads.store(n_reads.load(std::memory_order_relaxed) + reads,
+                      std::memory_order_relaxed);
+        n_consumed.store(n_consumed.load(std::memory_order_relaxed) + consumed,
+                         std::memory_order_relaxed);
+    }
+};
+
+/**
+ * \class ReadBatchPipeline
+ *
+ * \brief Parse reads in batches and process them on a pool of threads.
+ *
+ * Workers take turns filling a batch from the shared parser, then process
+ * it on their own. A worker is any callable
+ * `uint64_t worker(ReadBatch& batch, unsigned int thread_id)`
+ * returning the number of units (k-mers, corrected reads...) it consumed;
+ * thread_id is below n_threads(), so per-thread state can be kept in a
+ * vector indexed by it.
+ *
+ * run_in_order additionally hands each finished batch to
+ * `void writer(ReadBatch& batch)`, one batch at a time and in input order.
+ * Batches finished early wait in a reorder buffer of bounded size.
+ *
+ * With set_max_reads, a run stops reading after that many reads; the
+ * rest of the input is left to a later pipeline on the same parser.
+ *
+ * In paired mode batches are filled with get_next_read_pair(), so that
+ * each batch holds whole pairs, mates next to each other; any unpaired
+ * read is an error.
+ *
+ * The first exception thrown by the parser, a worker or the writer stops
+ * the pipeline and is rethrown from run / run_in_order.
+ */
+template<typename SeqIO>
+class ReadBatchPipeline
+{
+protected:
+    read_parsers::ReadParserPtr<SeqIO> _parser;
+    unsigned int _n_threads;
+    size_t _batch_size;
+    size_t _max_pending;
+    bool _paired;
+    uint64_t _max_reads;
+    std::unique_ptr<WorkerCounters[]> _counters;
+
+    std::mutex _input_lock;
+    uint64_t _next_batch;
+    uint64_t _n_filled;
+    std::exception_ptr _error;
+    std::atomic<bool> _failed;
+
+    std::mutex _output_lock;
+    std::condition_variable _output_room;
+    uint64_t _next_write;
+    std::map<uint64_t, ReadBatch> _pending;
+
+    struct _NoWriter {
+        void operator()(ReadBatch&) {}
+    };
+
+    bool _fill(ReadBatch& batch)
+    {
+        batch.reads.clear();
+        batch.output.clear();
+        batch.values.clear();
+
+        std::lock_guard<std::mutex> lock(_input_lock);
+        try {
+            while (!_failed && batch.reads.size() < _batch_size
+                    && !_parser->is_complete()
+                    && (_max_reads == 0 || _n_filled < _max_reads)) {
+                if (_paired) {
+                    read_parsers::ReadPair pair = _parser->get_next_read_pair();
+                    batch.reads.push_back(std::move(pair.first));
+                    batch.reads.push_back(std::move(pair.second));
+                    _n_filled += 2;
+                } else {
+                    batch.reads.push_back(_parser->get_next_read());
+                    ++_n_filled;
+                }
+            }
+        } catch (read_parsers::NoMoreReadsAvailable&) {
+            // a pair cut short by the end of input leaves an odd count
+            if (_paired && _parser->get_num_reads() % 2 != 0) {
+                _set_error(std::make_exception_ptr(
+                               read_parsers::InvalidReadPair(
+                                   "Unpaired read at end of input.")));
+                return false;
+            }
+        } catch (...) {
+            _set_error(std::current_exception());
+            return false;
+        }
+        if (batch.reads.empty()) {
+            return false;
+        }
+        batch.id = _next_batch++;
+        return true;
+    }
+
+    // must be called with _input_lock held; takes _output_lock
+    void _set_error(std::exception_ptr error)
+    {
+        if (!_error) {
+            _error = error;
+        }
+        _failed = true;
+
+        // wake up workers held back by the reorder buffer
+        std::lock_guard<std::mutex> lock(_output_lock);
+        _output_room.notify_all();
+    }
+
+    void _fail(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(_input_lock);
+        _set_error(error);
+    }
+
+    template<typename Writer>
+    void _write(ReadBatch& batch, Writer& writer)
+    {
+        std::unique_lock<std::mutex> lock(_output_lock);
+        ReadBatch& done = _pending[batch.id];
+        done.id = batch.id;
+        done.reads.swap(batch.reads);
+        done.output.swap(batch.output);
+        done.values.swap(batch.values);
+
+        auto it = _pending.begin();
+        while (it != _pending.end() && it->first == _next_write) {
+            writer(it->second);
+            it = _pending.erase(it);
+            ++_next_write;
+        }
+        _output_room.notify_all();
+
+        // Don't run too far ahead of a slow batch; the reorder buffer would
+        // otherwise grow without bound.
+        while (!_failed && _pending.size() >= _max_pending) {
+            _output_room.wait(lock);
+        }
+    }
+
+    template<typename Worker, typename Writer>
+    void _run(Worker& worker, Writer* writer)
+    {
+        #pragma omp parallel num_threads(_n_threads)
+        {
+#ifdef _OPENMP
+            unsigned int thread_id = omp_get_thread_num();
+#else
+            unsigned int thread_id = 0;
+#endif
+            ReadBatch batch;
+            batch.reads.reserve(_batch_size);
+
+            while (_fill(batch)) {
+                try {
+                    uint64_t n_consumed = worker(batch, thread_id);
+                    _counters[thread_id].add(batch.reads.size(), n_consumed);
+                    if (writer != NULL) {
+                        _write(batch, *writer);
+                    }
+                } catch (...) {
+                    _fail(std::current_exception());
+                    break;
+                }
+            }
+        }
+
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+public:
+    /// @param[in] n_threads  Worker threads; 0 means the OpenMP default.
+    ReadBatchPipeline(read_parsers::ReadParserPtr<SeqIO>& parser,
+                      unsigned int n_threads,
+                      size_t batch_size = READ_BATCH_SIZE)
+        : _parser(parser), _n_threads(n_threads), _batch_size(batch_size),
+          _paired(false), _max_reads(0), _next_batch(0), _n_filled(0),
+          _failed(false), _next_write(0)
+    {
+#ifdef _OPENMP
+        if (_n_threads == 0) {
+            _n_threads = omp_get_max_threads();
+        }
+#else
+        _n_threads = 1;
+#endif
+        if (_n_threads == 0) {
+            _n_threads = 1;
+        }
+        if (_batch_size == 0) {
+            throw InvalidValue("ReadBatchPipeline batch size must be > 0");
+        }
+        _max_pending = 4 * _n_threads;
+        _counters.reset(new WorkerCounters[_n_threads]);
+    }
+
+    /// Batch reads as whole pairs; call before running the pipeline.
+    void set_paired(bool paired)
+    {
+        _paired = paired;
+    }
+
+    /// Stop reading after max_reads reads (0, the default, reads them all);
+    /// call before running the pipeline.
+    void set_max_reads(uint64_t max_reads)
+    {
+        _max_reads = max_reads;
+    }
+
+    unsigned int n_threads() const
+    {
+        return _n_threads;
+    }
+
+    /// Progress of worker thread_id; safe to poll while the pipeline runs.
+    const WorkerCounters& worker_counters(unsigned int thread_id) const
+    {
+        return _counters[thread_id];
+    }
+
+    /// Reads processed so far, summed over all workers.
+    uint64_t n_reads() const
+    {
+        uint64_t n = 0;
+        for (unsigned int i = 0; i < _n_threads; ++i) {
+            n += _counters[i].n_reads.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    /// Units reported consumed by workers so far, summed over all workers.
+    uint64_t n_consumed() const
+    {
+        uint64_t n = 0;
+        for (unsigned int i = 0; i < _n_threads; ++i) {
+            n += _counters[i].n_consumed.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    template<typename Worker>
+    void run(Worker worker)
+    {
+        _NoWriter * no_writer = NULL;
+        _run(worker, no_writer);
+    }
+
+    template<typename Worker, typename Writer>
+    void run_in_order(Worker worker, Writer writer)
+    {
+        _run(worker, &writer);
+    }
+}; // class ReadBatchPipeline
+
+} // namespace oxli
+
+#endif // BATCH_PIPELINE_HH
@@ -0,0 +1,229 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef EXACT_COUNTER_HH
+#define EXACT_COUNTER_HH
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hashtable.hh"
+
+// default number of temporary files k-mers are spread over
+#define EXACT_COUNT_BUCKETS 64
+// hashes buffered per bucket by each thread before going to disk
+#define EXACT_COUNT_BUFFER 4096
+// (hash, count) pairs a thread sorts in memory at once while writing
+#define EXACT_SORT_CHUNK (4 * 1024 * 1024)
+
+namespace oxli
+{
+
+/**
+ * \class ExactCountStorage
+ *
+ * \brief Read-only, exact k-mer counts, kept in a sorted count file.
+ *
+ * A count file (type SAVED_EXACT_COUNTS) has the usual header, followed by
+ * the prefix bits p, the number of distinct k-mers n, an index of 2^p + 1
+ * uint64 offsets, then n uint64 hashes in increasing order and their n
+ * uint32 counts. index[i] is the position of the first hash whose top p
+ * bits are at least i, so a lookup binary-searches a single index range.
+ *
+ * The file is memory mapped rather than read in; lookups only page in the
+ * parts of it they touch. Counts above MAX_BIGCOUNT read as MAX_BIGCOUNT.
+ * ExactCountBuilder writes these files.
+ */
+class ExactCountStorage : public Storage
+{
+protected:
+    uint8_t _prefix_bits;
+    uint64_t _n_kmers;
+    const uint64_t * _index;
+    const HashIntoType * _hashes;
+    const uint32_t * _counts;
+
+    void * _map;
+    size_t _map_length;
+
+    void _unmap();
+public:
+    ExactCountStorage();
+    ~ExactCountStorage();
+
+    std::vector<uint64_t> get_tablesizes() const
+    {
+        return std::vector<uint64_t>(1, _n_kmers);
+    }
+    const size_t n_tables() const
+    {
+        return 1;
+    }
+    const uint64_t n_occupied() const
+    {
+        return _n_kmers;
+    }
+    const uint64_t n_unique_kmers() const
+    {
+        return _n_kmers;
+    }
+
+    void save(std::string, WordLength ksize);
+    void load(std::string, WordLength& ksize);
+
+    BoundedCounterType test_and_set_bits(HashIntoType)
+    {
+        throw oxli_exception("exact count tables are read-only");
+    }
+    bool add(HashIntoType)
+    {
+        throw oxli_exception("exact count tables are read-only");
+    }
+
+    const BoundedCounterType get_count(HashIntoType khash) const
+    {
+        uint64_t prefix = khash >> (64 - _prefix_bits);
+        const HashIntoType * begin = _hashes + _index[prefix];
+        const HashIntoType * end = _hashes + _index[prefix + 1];
+        const HashIntoType * it = std::lower_bound(begin, end, khash);
+        if (it == end || *it != khash) {
+            return 0;
+        }
+        uint32_t count = _counts[it - _hashes];
+        return count < MAX_BIGCOUNT ? count : MAX_BIGCOUNT;
+    }
+
+    Byte ** get_raw_tables()
+    {
+        return NULL;
+    }
+
+    // dist[c] is the number of distinct k-mers seen c times, with counts
+    // from MAX_BIGCOUNT up in dist[MAX_BIGCOUNT].
+    void abundance_distribution(std::vector<uint64_t>& dist) const;
+};
+
+
+/**
+ * \class ExactCounttable
+ *
+ * \brief A Counttable with exact counts, loaded from a count file.
+ *
+ * Hashes k-mers like Counttable, so hashes and counts can be compared
+ * between the two.
+ */
+class ExactCounttable : public oxli::MurmurHashtable
+{
+public:
+    explicit ExactCounttable(WordLength ksize)
+        : MurmurHashtable(ksize, new ExactCountStorage()) { };
+
+    using Hashtable::abundance_distribution;
+
+    void abundance_distribution(std::vector<uint64_t>& dist) const
+    {
+        static_cast<ExactCountStorage *>(store)->abundance_distribution(dist);
+    }
+};
+
+
+/**
+ * \class ExactCountBuilder
+ *
+ * \brief Count k-mers exactly, using disk rather than memory.
+ *
+ * In a first pass, consume_seqfile hashes the k-mers of reads as
+ * Counttable does, and each thread counts repeats within its buffered
+ * hashes before appending (hash, count) pairs to one of n_buckets temporary
+ * files, by the hashes' top bits. write() then sorts and counts the buckets
+ * on n_threads threads, one bucket per thread at a time, and concatenates
+ * them into an ExactCountStorage file. A bucket holding more than
+ * sort_chunk pairs is sorted in runs of sort_chunk pairs that are merged
+ * back on disk, so memory use stays around n_threads * sort_chunk pairs
+ * however skewed the input.
+ *
+ * The temporary files go in a fresh directory under tmpdir, which is
+ * removed with the builder.
+ */
+class ExactCountBuilder
+{
+protected:
+    WordLength _ksize;
+    unsigned int _n_threads;
+    unsigned int _bucket_bits;
+    uint64_t _sort_chunk;
+    std::string _dir;
+    std::vector<std::string> _bucket_names;
+    std::vector<FILE *> _buckets;
+    std::unique_ptr<std::mutex[]> _bucket_locks;
+    uint64_t _n_reads;
+    uint64_t _n_kmers;
+
+    void _append(unsigned int bucket, std::vector<HashIntoType>& hashes);
+    uint64_t _count_bucket(unsigned int bucket);
+    void _remove_files();
+public:
+    // n_buckets is rounded up to a power of two; n_threads == 0 means the
+    // OpenMP default.
+    ExactCountBuilder(WordLength ksize, const std::string& tmpdir,
+                      unsigned int n_buckets = EXACT_COUNT_BUCKETS,
+                      unsigned int n_threads = 1,
+                      uint64_t sort_chunk = EXACT_SORT_CHUNK);
+    ~ExactCountBuilder();
+
+    template<typename SeqIO>
+    void consume_seqfile(read_parsers::ReadParserPtr<SeqIO>& parser);
+
+    // Sort and count the buckets and write the count file; no more reads
+    // can be consumed afterwards. Returns the number of distinct k-mers.
+    uint64_t write(const std::string& filename);
+
+    uint64_t n_reads() const
+    {
+        return _n_reads;
+    }
+    uint64_t n_kmers() const
+    {
+        return _n_kmers;
+    }
+};
+
+} // namespace oxli
+
+#endif // EXACT_COUNTER_HH
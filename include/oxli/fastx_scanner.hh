@@ -0,0 +1,299 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef FASTX_SCANNER_HH
+#define FASTX_SCANNER_HH
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "oxli.hh"
+#include "read_parsers.hh"
+
+// bytes read from the input at a time
+#define FASTX_READ_SIZE (1024*1024)
+// output text FastxFilter and friends hand back at a time
+#define FASTX_OUTPUT_CHUNK (1024*1024)
+
+namespace oxli
+{
+
+namespace read_parsers
+{
+
+class FastxSource;
+
+/**
+ * \struct FastxRecord
+ *
+ * \brief A FASTA/FASTQ record, as views into a FastxScanner's buffer.
+ *
+ * The views are good until the scanner reads on. sequence and quality span
+ * the raw lines of a record, so for multi-line records they include the
+ * line breaks; length is the number of bases. Names and the ends of lines
+ * leave out any '\r'.
+ */
+struct FastxRecord {
+    uint64_t offset;        // of the record in the input
+    const char * text;      // the whole record, with its last line ending
+    size_t text_length;
+    const char * name;      // without the '>' or '@'
+    size_t name_length;
+    const char * sequence;
+    size_t sequence_span;
+    const char * quality;   // NULL for FASTA
+    size_t quality_span;
+    size_t length;
+
+    bool is_fastq() const
+    {
+        return quality != NULL;
+    }
+    bool is_multiline() const
+    {
+        return sequence_span != length;
+    }
+
+    std::string get_name() const
+    {
+        return std::string(name, name_length);
+    }
+    // The sequence and quality without line breaks.
+    std::string get_sequence() const;
+    std::string get_quality() const;
+
+    // Append the record to out as one line each of name, sequence and
+    // quality, like khmer.utils.write_record; name_suffix is added to the
+    // name.
+    void write_fastx(std::string& out, bool as_fasta = false,
+                     const char * name_suffix = "") const;
+};
+
+/**
+ * \class FastxScanner
+ *
+ * \brief Find the records of a FASTA/FASTQ file without parsing them.
+ *
+ * Reads the input in large blocks and splits it into records by searching
+ * for line breaks with memchr, which the C library vectorizes. Records come
+ * back as FastxRecord views into the block rather than as Reads, so
+ * nothing is copied or allocated per record.
+ *
+ * Files may be plain, gzip or bzip2 (including concatenated streams);
+ * standard input ("-") and other pipes may be plain or gzip. A byte range
+ * [begin, end) of an uncompressed file can be scanned on its own; begin
+ * must be the start of a record, as found by find_unit_start. Malformed
+ * input throws InvalidRead.
+ */
+class FastxScanner
+{
+protected:
+    // a record as offsets into the input
+    struct Span {
+        uint64_t begin, end;
+        uint64_t name_begin, name_end;
+        uint64_t seq_begin, seq_end;
+        uint64_t qual_begin, qual_end;
+        uint64_t length;
+    };
+
+    std::unique_ptr<FastxSource> _source;
+    std::vector<char> _buf;
+    uint64_t _base;   // offset of _buf[0]
+    size_t _len;
+    uint64_t _pos;
+    uint64_t _keep;   // text from here on stays in _buf
+    bool _eof;
+    char _marker;
+    uint64_t _n_records;
+
+    bool _have_pending;
+    Span _pending;
+
+    FastxScanner(FastxSource * source, uint64_t base, char marker);
+
+    const char * _at(uint64_t offset) const
+    {
+        return _buf.data() + (offset - _base);
+    }
+    bool _more();
+    bool _line(uint64_t& begin, uint64_t& end);
+    int _peek();
+    bool _scan(Span& span);
+    void _view(const Span& span, FastxRecord& record) const;
+
+public:
+    // A whole file: plain, gzip or bzip2, or "-" for stdin.
+    explicit FastxScanner(const std::string& filename);
+    // The bytes [begin, end) of an uncompressed file; end 0 reads to the
+    // end of the file.
+    FastxScanner(const std::string& filename, uint64_t begin, uint64_t end);
+    ~FastxScanner();
+
+    // The next record; false at the end of the input.
+    bool next(FastxRecord& record);
+
+    // The next unit as broken_paired_reader finds them: two records if the
+    // next two are mates (unless force_single), else one. Returns the
+    // number of records, 0 at the end of the input.
+    unsigned int next_unit(FastxRecord& first, FastxRecord& second,
+                           bool force_single = false);
+
+    // Records returned so far.
+    uint64_t n_records() const
+    {
+        return _n_records;
+    }
+
+    // Whether a file can be scanned in byte ranges: an uncompressed,
+    // regular file.
+    static bool is_seekable(const std::string& filename);
+
+    // The offset of the first record of an uncompressed file that starts
+    // at or after offset and can start a unit, i.e. is not possibly the
+    // second read of a pair (unless force_single); the file size if there
+    // is none.
+    static uint64_t find_unit_start(const std::string& filename,
+                                    uint64_t offset, bool force_single);
+}; // class FastxScanner
+
+// Count the records and bases of a file.
+void fastx_stats(const std::string& filename, uint64_t& n_records,
+                 uint64_t& n_bases);
+
+/**
+ * \class FastxFilter
+ *
+ * \brief Copy the records of a file with at least min_length bases.
+ *
+ * With drop_n, records whose sequence has an 'N' are dropped; with
+ * to_fasta, FASTQ records are written as FASTA. Output comes back from
+ * fill() in chunks, formatted as by FastxRecord::write_fastx.
+ */
+class FastxFilter
+{
+protected:
+    FastxScanner _scanner;
+    size_t _min_length;
+    bool _drop_n;
+    bool _to_fasta;
+    uint64_t _n_written;
+public:
+    FastxFilter(const std::string& filename, size_t min_length = 0,
+                bool drop_n = false, bool to_fasta = false);
+
+    // Append at least max_bytes of output to out, or all that is left;
+    // false once the input is used up.
+    bool fill(std::string& out, size_t max_bytes = FASTX_OUTPUT_CHUNK);
+
+    uint64_t n_read() const
+    {
+        return _scanner.n_records();
+    }
+    uint64_t n_written() const
+    {
+        return _n_written;
+    }
+};
+
+/**
+ * \class FastxInterleaver
+ *
+ * \brief Interleave the records of two files of left and right reads.
+ *
+ * Unless reformat is false, left names get a "/1" and right names a "/2"
+ * if they do not already mark their side, and the two must then look
+ * like a pair. Throws oxli_value_exception when they do not, or when the
+ * files hold different numbers of records.
+ */
+class FastxInterleaver
+{
+protected:
+    FastxScanner _left;
+    FastxScanner _right;
+    bool _reformat;
+    uint64_t _n_pairs;
+public:
+    FastxInterleaver(const std::string& left, const std::string& right,
+                     bool reformat = true);
+
+    bool fill(std::string& out, size_t max_bytes = FASTX_OUTPUT_CHUNK);
+
+    uint64_t n_pairs() const
+    {
+        return _n_pairs;
+    }
+};
+
+/**
+ * \class FastxPairSplitter
+ *
+ * \brief Split interleaved reads into left and right reads.
+ *
+ * Pairs are found as by broken_paired_reader. Reads that are not part of
+ * a pair go to the orphans if allow_orphans is set; otherwise they throw
+ * an oxli_value_exception.
+ */
+class FastxPairSplitter
+{
+protected:
+    FastxScanner _scanner;
+    bool _allow_orphans;
+    uint64_t _n_pairs;
+    uint64_t _n_orphans;
+public:
+    FastxPairSplitter(const std::string& filename, bool allow_orphans = false);
+
+    bool fill(std::string& left, std::string& right, std::string& orphans,
+              size_t max_bytes = FASTX_OUTPUT_CHUNK);
+
+    uint64_t n_pairs() const
+    {
+        return _n_pairs;
+    }
+    uint64_t n_orphans() const
+    {
+        return _n_orphans;
+    }
+};
+
+} // namespace read_parsers
+
+} // namespace oxli
+
+#endif // FASTX_SCANNER_HH
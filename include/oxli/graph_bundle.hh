@@ -0,0 +1,146 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef GRAPH_BUNDLE_HH
+#define GRAPH_BUNDLE_HH
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oxli.hh"
+
+// section types of a graph bundle
+#define BUNDLE_TABLE 1
+#define BUNDLE_TAGS 2
+#define BUNDLE_STOP_TAGS 3
+#define BUNDLE_PARTITION_MAP 4
+#define BUNDLE_LABELS 5
+
+namespace oxli
+{
+
+class Hashtable;
+class Hashgraph;
+class SubsetPartition;
+class LabelHash;
+
+/**
+ * \struct BundleSection
+ *
+ * \brief One entry of a graph bundle's section directory.
+ */
+struct BundleSection {
+    uint8_t type;
+    bool compressed;
+    /// zlib crc32 of the uncompressed section.
+    uint32_t crc;
+    /// Offset of the section data from the start of the bundle.
+    uint64_t offset;
+    /// Bytes the section takes up in the bundle.
+    uint64_t stored_length;
+    /// Bytes of the section once uncompressed.
+    uint64_t length;
+};
+
+/**
+ * \class GraphBundle
+ *
+ * \brief A graph and its tags, stop tags, partition map and labels in one
+ * file.
+ *
+ * A bundle (type SAVED_GRAPH_BUNDLE) has the usual header followed by the
+ * number of sections, padded to 16 bytes, then a directory of 32-byte
+ * entries: type, compression flag, two bytes of padding, crc32, offset,
+ * stored length and length. The sections themselves are the files that
+ * Hashtable::save, save_tagset, save_stop_tags, save_partitionmap and
+ * save_labels_and_tags write, each optionally deflated.
+ *
+ * Opening a bundle only reads its directory; a section is only read, and
+ * its checksum checked, when it is loaded or extracted. Sections are loaded
+ * straight from the bundle, inflating them on the fly.
+ */
+class GraphBundle
+{
+protected:
+    std::string _filename;
+    std::vector<BundleSection> _sections;
+
+public:
+    explicit GraphBundle(const std::string& filename);
+
+    /// True if filename starts with a graph bundle header.
+    static bool is_bundle(const std::string& filename);
+
+    const std::vector<BundleSection>& sections() const
+    {
+        return _sections;
+    }
+
+    bool has_section(uint8_t type) const;
+    const BundleSection& section(uint8_t type) const;
+
+    /// Write section type, uncompressed, to outfilename.
+    void extract_section(uint8_t type, const std::string& outfilename) const;
+
+    /// The first n bytes of section type, uncompressed; fewer if the
+    /// section is shorter.
+    std::string section_header(uint8_t type, size_t n) const;
+
+    /// Load the table into table, which must have the matching storage.
+    void load_table(Hashtable& table) const;
+    void load_tagset(Hashgraph& graph, bool clear_tags) const;
+    void load_stop_tags(Hashgraph& graph, bool clear_tags) const;
+    void load_partitionmap(SubsetPartition& subset) const;
+    void load_labels(LabelHash& labels) const;
+
+    /**
+     * Write a bundle out of existing files.
+     *
+     * @param[in] sections  (section type, file name) pairs; each type may
+     *                      appear once.
+     * @param[in] compress  Deflate the sections.
+     */
+    static void write(const std::string& filename,
+                      const std::vector<std::pair<uint8_t, std::string> >&
+                      sections,
+                      bool compress);
+};
+
+} // namespace oxli
+
+#endif // GRAPH_BUNDLE_HH
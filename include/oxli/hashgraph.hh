@@ -222,11 +222,14 @@ public:
     void print_tagset(std::string);
     void save_tagset(std::string);
     void load_tagset(std::string, bool clear_tags=true);
+    void load_tagset(std::istream&, const std::string&, bool clear_tags=true);
 
     // print, save and load the set of stop tags.
     void print_stop_tags(std::string);
     void save_stop_tags(std::string);
     void load_stop_tags(std::string filename, bool clear_tags=true);
+    void load_stop_tags(std::istream& infile, const std::string& filename,
+                        bool clear_tags=true);
 
     // @@
     void extract_unique_paths(std::string seq,
@@ -288,11 +291,33 @@ public:
 // Hashgraph-derived class with BitStorage.
 class Nodegraph : public Hashgraph
 {
+protected:
+    Nodegraph(WordLength ksize, Storage * s)
+        : Hashgraph(ksize, s) { } ;
 public:
     explicit Nodegraph(WordLength ksize, std::vector<uint64_t> sizes)
         : Hashgraph(ksize, new BitStorage(sizes)) { } ;
 
-    void update_from(const Nodegraph &other);
+    // Loads fixed-size and scalable nodegraph files alike, switching to
+    // the storage the file was saved from.  Loading from a stream keeps
+    // the current storage.
+    virtual void load(std::string filename);
+    using Hashgraph::load;
+
+    // false positive rate implied by the current occupancy
+    double estimated_fp_rate() const;
+    // number of Bloom filter slices; 1 unless the storage is scalable
+    unsigned int n_slices() const;
+};
+
+// Nodegraph whose Bloom filter grows as k-mers are added, keeping its
+// false positive rate below fp_rate; sizes are those of the first slice.
+class ScalableNodegraph : public Nodegraph
+{
+public:
+    explicit ScalableNodegraph(WordLength ksize, std::vector<uint64_t> sizes,
+                               double fp_rate)
+        : Nodegraph(ksize, new ScalableBitStorage(sizes, fp_rate)) { } ;
 };
 
 }
@@ -42,6 +42,7 @@ Contact: khmer-project@idyll.org
 #include <stdint.h>
 #include <string.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <queue>
@@ -55,6 +56,7 @@ Contact: khmer-project@idyll.org
 #include "oxli_exception.hh"
 #include "kmer_hash.hh"
 #include "read_parsers.hh"
+#include "snapshot.hh"
 #include "storage.hh"
 #include "subset.hh"
 
@@ -71,6 +73,8 @@ class FastxReader;
 }
 
 #define CALLBACK_PERIOD 100000
+// k-mers buffered per thread by write-combining consume_seqfile
+#define WRITE_COMBINE_BUFFER (64*1024)
 
 namespace oxli
 {
@@ -124,6 +128,15 @@ inline std::vector<uint64_t> get_n_primes_near_x(uint32_t n, uint64_t x)
 
 typedef std::unique_ptr<KmerHashIterator> KmerHashIteratorPtr;
 
+// k-mer coverage summary for one read; see Hashtable::coverage_profile.
+struct ReadCoverage {
+    std::string name;
+    BoundedCounterType median;
+    float average;
+    float stddev;
+    size_t length;
+};
+
 class Hashtable: public
     KmerFactory  		// Base class implementation of a Bloom ht.
 {
@@ -139,11 +152,15 @@ protected:
     HashIntoType    bitmask;
     unsigned int    _nbits_sub_1;
 
+    // buffer the k-mers of consume_seqfile and add them in batches
+    bool _write_combining;
+
 public:
     explicit Hashtable( WordLength ksize, Storage * s)
         : KmerFactory( ksize ), store(s),
           _max_count( MAX_KCOUNT ),
-          _max_bigcount( MAX_BIGCOUNT )
+          _max_bigcount( MAX_BIGCOUNT ),
+          _write_combining(false)
     {
         _init_bitstuff();
     }
@@ -246,6 +263,15 @@ public:
         return store->get_count(khash);
     }
 
+    // get_count and add for n hashes held in a flat array.
+    void get_counts(const HashIntoType * hashes, size_t n,
+                    BoundedCounterType * counts) const
+    {
+        store->get_counts(hashes, n, counts);
+    }
+    // returns the number of k-mers not seen before
+    uint64_t add_hashes(const HashIntoType * hashes, size_t n);
+
     virtual void save(std::string filename)
     {
         store->save(filename, _ksize);
@@ -255,10 +281,46 @@ public:
         store->load(filename, _ksize);
         _init_bitstuff();
     }
+    // Load from a stream positioned at the start of a saved table.
+    virtual void load(std::istream& infile, const std::string& filename)
+    {
+        store->load(infile, filename, _ksize);
+        _init_bitstuff();
+    }
+
+    // Add the counts of another table of the same type, k-mer size and
+    // table sizes into this one, saturating at the storage's maximum
+    // count; bit storage is unioned instead.  n_threads == 0 means the
+    // OpenMP default.
+    void update_from(const Hashtable& other, unsigned int n_threads = 1);
+
+    // As update_from, for a saved table; the file is streamed through in
+    // chunks rather than loaded whole.  Only supported for byte storage.
+    void update_from_file(std::string filename, unsigned int n_threads = 1);
+
+    // Start saving a point-in-time image of the table to filename in the
+    // background, while k-mers continue to be added; the caller owns the
+    // returned StorageSnapshot and checks it for completion.
+    StorageSnapshot * save_snapshot(std::string filename)
+    {
+        return new StorageSnapshot(*store, filename, _ksize);
+    }
 
     // count every k-mer in the string.
     unsigned int consume_string(const std::string &s);
 
+    // With write combining on, each thread in consume_seqfile collects
+    // the hashes of WRITE_COMBINE_BUFFER k-mers before adding them with
+    // Storage::add_batch, which writes each table in address order.
+    void set_write_combining(bool write_combining)
+    {
+        _write_combining = write_combining;
+    }
+    bool get_write_combining() const
+    {
+        return _write_combining;
+    }
+
     // Count every k-mer in a file containing nucleotide sequences.
     template<typename SeqIO>
     void consume_seqfile(
@@ -349,6 +411,15 @@ public:
         return store->get_use_bigcount();
     }
 
+    void set_conservative_update(bool b)
+    {
+        store->set_conservative_update(b);
+    }
+    bool get_conservative_update() const
+    {
+        return store->get_conservative_update();
+    }
+
     bool median_at_least(const std::string &s,
                          unsigned int cutoff);
 
@@ -357,6 +428,33 @@ public:
                           float &average,
                           float &stddev);
 
+    // as above, using counts as scratch space so that repeated calls
+    // don't allocate.
+    void get_median_count(const std::string &s,
+                          BoundedCounterType &median,
+                          float &average,
+                          float &stddev,
+                          std::vector<BoundedCounterType> &counts) const;
+
+    // get_median_count for every read at least k long, on n_threads
+    // threads. sink is called from one thread at a time, in input order.
+    // With max_reads > 0, stops after that many reads; call again with the
+    // same parser for the rest.
+    template<typename SeqIO>
+    void coverage_profile(
+        read_parsers::ReadParserPtr<SeqIO>& parser,
+        unsigned int n_threads,
+        std::function<void(const ReadCoverage&)> sink,
+        uint64_t max_reads = 0
+    );
+    template<typename SeqIO>
+    void coverage_profile(
+        read_parsers::ReadParserPtr<SeqIO>& parser,
+        unsigned int n_threads,
+        std::vector<ReadCoverage>& profile,
+        uint64_t max_reads = 0
+    );
+
     // number of unique k-mers
     const uint64_t n_unique_kmers() const
     {
@@ -391,10 +489,23 @@ public:
     void get_kmer_hashes_as_hashset(const std::string &s,
                                     SeenSet& hashes) const;
 
+    // return hash values for the k-mers of all sequences in one flat
+    // vector; those of seqs[i] are hashes[offsets[i]] up to
+    // hashes[offsets[i + 1]]. Sequences shorter than k have none.
+    void hash_sequences(const std::vector<std::string> &seqs,
+                        std::vector<HashIntoType> &hashes,
+                        std::vector<uint64_t> &offsets) const;
+
     // return counts of all k-mers in this string.
     void get_kmer_counts(const std::string &s,
                          std::vector<BoundedCounterType> &counts) const;
 
+    // write the counts of all k-mers in this string to counts, which must
+    // have room for s.length() - ksize() + 1 of them; returns the number
+    // written.
+    size_t get_kmer_counts(const std::string &s,
+                           BoundedCounterType * counts) const;
+
     // get access to raw tables.
     Byte ** get_raw_tables()
     {
@@ -417,6 +528,17 @@ public:
     uint64_t * abundance_distribution(std::string filename,
                                       Hashtable * tracking);
 
+    // calculate the exact abundance distribution of the distinct k-mer
+    // hashes in the given file, on n_threads threads; dist is resized to
+    // MAX_BIGCOUNT + 1 bins. No tracking table is needed: hashes are
+    // partitioned, sorted and de-duplicated in memory.
+    template<typename SeqIO>
+    void abundance_distribution(
+        read_parsers::ReadParserPtr<SeqIO>& parser,
+        unsigned int n_threads,
+        std::vector<uint64_t>& dist
+    );
+
     // return the index of the first position in the sequence with k-mer
     // abundance below min_abund.
     unsigned long trim_on_abundance(std::string seq,
@@ -427,6 +549,24 @@ public:
     unsigned long trim_below_abundance(std::string seq,
                                        BoundedCounterType max_abund) const;
 
+    // filter-abund: trim every read at its first k-mer below min_abund and
+    // write the survivors, in input order, to output. Reads shorter than k,
+    // or trimmed below k, are dropped. With variable_coverage, reads whose
+    // median k-mer abundance is below normalize_to are kept untrimmed. In
+    // paired mode a pair is written only if both mates survive.
+    template<typename SeqIO>
+    void trim_seqfile_on_abundance(
+        read_parsers::ReadParserPtr<SeqIO>& parser,
+        read_parsers::FastxWriter& output,
+        BoundedCounterType min_abund,
+        bool variable_coverage,
+        unsigned int normalize_to,
+        bool paired,
+        unsigned int n_threads,
+        unsigned int &total_reads,
+        unsigned int &n_kept
+    );
+
     // detect likely positions of errors
     std::vector<unsigned int> find_spectral_error_positions(std::string seq,
             BoundedCounterType min_abund) const;
@@ -584,6 +724,11 @@ public:
         store->load(filename, _ksize);
         _init_bitstuff();
     }
+    virtual void load(std::istream& infile, const std::string& filename)
+    {
+        store->load(infile, filename, _ksize);
+        _init_bitstuff();
+    }
 };
 
 
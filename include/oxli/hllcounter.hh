@@ -53,6 +53,8 @@ namespace read_parsers
     class FastxReader;
 }
 
+template<typename SeqIO> class ReadBatchPipeline;
+
 class HLLCounter
 {
 public:
@@ -60,6 +62,7 @@ public:
     HLLCounter(int p, WordLength ksize);
 
     void add(const std::string &);
+    void add_hash(HashIntoType);
     unsigned int consume_string(const std::string &);
     template<typename SeqIO>
     void consume_seqfile(std::string const &,
@@ -71,6 +74,12 @@ public:
                          bool,
                          unsigned int &,
                          unsigned long long &);
+    // Progress can be polled from pipeline's per-worker counters meanwhile.
+    template<typename SeqIO>
+    void consume_seqfile(ReadBatchPipeline<SeqIO>&,
+                         bool,
+                         unsigned int &,
+                         unsigned long long &);
     unsigned int check_and_process_read(std::string &,
                                         bool &);
     bool check_and_normalize_read(std::string &) const;
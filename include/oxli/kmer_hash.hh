@@ -109,6 +109,8 @@ HashIntoType _hash_forward(const char * kmer, WordLength k);
 
 std::string _revhash(HashIntoType hash, WordLength k);
 std::string _revcomp(const std::string& kmer);
+// reverse complement into out, reusing its storage.
+void _revcomp(const std::string& seq, std::string& out);
 
 // two-way hash functions, MurmurHash3.
 HashIntoType _hash_murmur(const std::string& kmer, const WordLength k);
@@ -116,6 +118,10 @@ HashIntoType _hash_murmur(const std::string& kmer, const WordLength k,
                           HashIntoType& h, HashIntoType& r);
 HashIntoType _hash_murmur_forward(const std::string& kmer,
                                   const WordLength k);
+// canonical MurmurHash3 of kmer[0..k), given its reverse complement
+// rc[0..k); identical to _hash_murmur but never allocates.
+HashIntoType _hash_murmur(const char * kmer, const char * rc,
+                          const WordLength k);
 
 // Cyclic hash, a rolling hash that is irreversible
 HashIntoType _hash_cyclic(const std::string& kmer, const WordLength k);
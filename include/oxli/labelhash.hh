@@ -192,6 +192,7 @@ public:
 
     void save_labels_and_tags(std::string);
     void load_labels_and_tags(std::string);
+    void load_labels_and_tags(std::istream&, const std::string&);
 
     void label_across_high_degree_nodes(const char * sequence,
                                         SeenSet& high_degree_nodes,
@@ -88,6 +88,10 @@ private:\
 
 #   define SAVED_SIGNATURE "OXLI"
 #   define SAVED_FORMAT_VERSION 4
+#   define SAVED_COMPACT_FORMAT_VERSION 5
+// counting tables (SAVED_COUNTING_HT and SAVED_SMALLCOUNT) with a flags
+// byte after the header; SAVED_FORMAT_VERSION ones still load
+#   define SAVED_COUNTING_FORMAT_VERSION 6
 #   define SAVED_COUNTING_HT 1
 #   define SAVED_HASHBITS 2
 #   define SAVED_TAGS 3
@@ -96,6 +100,13 @@ private:\
 #   define SAVED_LABELSET 6
 #   define SAVED_SMALLCOUNT 7
 #   define SAVED_QFCOUNT 8
+#   define SAVED_SCALABLE_HASHBITS 9
+#   define SAVED_EXACT_COUNTS 10
+#   define SAVED_GRAPH_BUNDLE 11
+
+// bits of the flags byte of SAVED_COUNTING_FORMAT_VERSION files
+#   define SAVED_FLAG_BIGCOUNT 1
+#   define SAVED_FLAG_CONSERVATIVE 2
 
 #   define TRAVERSAL_LEFT 0
 #   define TRAVERSAL_RIGHT 1
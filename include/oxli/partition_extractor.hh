@@ -0,0 +1,168 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef PARTITION_EXTRACTOR_HH
+#define PARTITION_EXTRACTOR_HH
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "oxli.hh"
+
+// spill buckets partitioned reads are sorted into
+#define PARTITION_EXTRACT_BUCKETS 64
+// bytes of reads a thread sorts in memory before spilling a sorted run
+#define PARTITION_EXTRACT_SORT_BUDGET (64 * 1024 * 1024)
+
+namespace oxli
+{
+
+/**
+ * \class PartitionExtractor
+ *
+ * \brief Split partition-annotated reads into group files by partition size.
+ *
+ * The native half of extract-partitions.py. consume() streams the .part
+ * files once, counting reads per partition and spilling assigned reads
+ * to on-disk bucket files keyed by partition ID; unassigned reads can be
+ * written out as they go by. develop_groups() then packs partitions with
+ * more than min_size reads, smallest first, into groups of just over
+ * max_size reads, and output_groups() writes one <prefix>.groupNNNN file
+ * per group, with reads in input order.
+ *
+ * Memory use is bounded by the number of partitions plus sort_budget
+ * bytes of reads per thread, however large the input or its largest
+ * partition: each bucket is sorted by group on its own, in runs of at most
+ * sort_budget bytes merged back together on disk, and each group file is
+ * merged from its runs in the sorted buckets.
+ */
+class PartitionExtractor
+{
+protected:
+    struct PartitionInfo {
+        uint64_t n_reads;
+        uint64_t first_read;   // input position of the partition's first read
+    };
+
+    // where one group's reads sit in a sorted spill bucket
+    struct GroupRun {
+        unsigned int group;
+        long begin;
+        long end;
+    };
+
+    std::string _prefix;
+    std::string _suffix;
+    uint64_t _min_size;
+    uint64_t _max_size;
+    uint8_t _compression;
+    unsigned int _n_buckets;
+    uint64_t _sort_budget;
+
+    std::unordered_map<PartitionID, PartitionInfo> _partitions;
+    std::unordered_map<PartitionID, unsigned int> _group_of;
+    unsigned int _n_groups;
+    bool _spilled;
+
+    uint64_t _total_seqs;
+    uint64_t _part_seqs;
+    uint64_t _toosmall_parts;
+    uint64_t _n_unassigned;
+
+    std::string _bucket_filename(unsigned int bucket, bool sorted) const;
+    std::string _group_filename(unsigned int group) const;
+    void _sort_bucket(unsigned int bucket, std::vector<GroupRun>& runs);
+    void _merge_group(unsigned int group,
+                      const std::vector<std::vector<GroupRun> >& runs);
+    void _remove_spill_files();
+
+public:
+    /// @param[in] suffix       Group files are <prefix>.groupNNNN.<suffix>.
+    /// @param[in] compression  A read_parsers::FastxWriter compression mode.
+    PartitionExtractor(const std::string& prefix,
+                       const std::string& suffix,
+                       uint64_t min_size,
+                       uint64_t max_size,
+                       uint8_t compression = 0,
+                       unsigned int n_buckets = PARTITION_EXTRACT_BUCKETS,
+                       uint64_t sort_budget = PARTITION_EXTRACT_SORT_BUDGET);
+    ~PartitionExtractor();
+
+    // Read every file, counting partition sizes. Assigned reads are
+    // spilled for output_groups() unless spill_reads is false; unassigned
+    // reads go to <prefix>.unassigned.<suffix> if output_unassigned.
+    void consume(const std::vector<std::string>& filenames,
+                 bool output_unassigned, bool spill_reads = true);
+
+    // one "size n_partitions cumulative_partitions cumulative_reads" line
+    // per partition size, unassigned reads included as partition 0.
+    void write_distribution(const std::string& filename) const;
+
+    // assign partitions to groups and tally total_seqs, part_seqs and
+    // toosmall_parts; returns the number of groups.
+    unsigned int develop_groups();
+
+    // write the group files, sorting and merging buckets on n_threads
+    // threads (0 means the OpenMP default).
+    void output_groups(unsigned int n_threads);
+
+    unsigned int n_groups() const
+    {
+        return _n_groups;
+    }
+    uint64_t total_seqs() const
+    {
+        return _total_seqs;
+    }
+    uint64_t part_seqs() const
+    {
+        return _part_seqs;
+    }
+    uint64_t toosmall_parts() const
+    {
+        return _toosmall_parts;
+    }
+    uint64_t n_unassigned() const
+    {
+        return _n_unassigned;
+    }
+}; // class PartitionExtractor
+
+} // namespace oxli
+
+#endif // PARTITION_EXTRACTOR_HH
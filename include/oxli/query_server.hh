@@ -0,0 +1,142 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef QUERY_SERVER_HH
+#define QUERY_SERVER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "oxli.hh"
+
+// largest number of items, and of sequence bytes, in one request
+#define QUERY_MAX_ITEMS (1 << 24)
+#define QUERY_MAX_BYTES (1ULL << 30)
+
+namespace oxli
+{
+class Hashtable;
+
+/**
+ * \class QueryServer
+ *
+ * \brief Answer batched k-mer queries on a table over a Unix socket.
+ *
+ * The table is loaded once by the caller and only read from here, so any
+ * number of clients can share it. serve() listens on socket_path and hands
+ * each connection to one of n_threads workers, which answers its requests
+ * in turn until the client disconnects; connections beyond n_threads wait
+ * for a free worker.
+ *
+ * Requests and responses are a 12 byte header followed by a body, all in
+ * native byte order:
+ *
+ *     request:   uint8 op, 3 bytes padding, uint32 param, uint32 n_items,
+ *                then n_items times (uint32 length, length bytes)
+ *     response:  uint8 status, 3 bytes padding, uint32 0, uint32 n,
+ *                then the result for each item
+ *
+ * QUERY_COUNT        items are k-mers; one uint32 count each.
+ * QUERY_MEDIAN       items are sequences; uint32 median, float average and
+ *                    float stddev of their k-mer counts each.
+ * QUERY_TRIM         items are sequences; one uint32 each, the length to
+ *                    trim the sequence to at its first k-mer with a count
+ *                    below param.
+ * QUERY_INFO         no items; a single uint32, the k-mer size.
+ * QUERY_SHUTDOWN     no items; answered, then serve() returns.
+ *
+ * If a request cannot be answered (a k-mer of the wrong length, a
+ * sequence shorter than k...) the status is QUERY_ERROR and the body is
+ * an n byte message; the connection stays usable. Malformed or oversized
+ * requests close the connection.
+ */
+class QueryServer
+{
+protected:
+    const Hashtable& _table;
+    std::string _socket_path;
+    unsigned int _n_threads;
+
+    int _listen_fd;
+    int _wake_fds[2];
+    std::atomic<bool> _stopping;
+
+    std::mutex _lock;
+    std::condition_variable _have_client;
+    std::deque<int> _waiting;
+    std::set<int> _active;
+
+    void _worker();
+    bool _serve_client(int fd);
+public:
+    enum Op {
+        QUERY_COUNT = 1,
+        QUERY_MEDIAN = 2,
+        QUERY_TRIM = 3,
+        QUERY_INFO = 4,
+        QUERY_SHUTDOWN = 5
+    };
+    enum Status {
+        QUERY_OK = 0,
+        QUERY_ERROR = 1
+    };
+
+    // n_threads == 0 means one worker per core.
+    QueryServer(const Hashtable& table, const std::string& socket_path,
+                unsigned int n_threads = 1);
+    ~QueryServer();
+
+    // Listen and answer queries until stop() or a QUERY_SHUTDOWN request;
+    // the socket file is removed on return.
+    void serve();
+
+    // Make serve() return; open connections are closed.  Safe to call from
+    // any thread, or from a signal handler.
+    void stop();
+
+    const std::string& socket_path() const
+    {
+        return _socket_path;
+    }
+};
+
+} // namespace oxli
+
+#endif // QUERY_SERVER_HH
@@ -44,6 +44,7 @@ Contact: khmer-project@idyll.org
 #include <limits>
 #include <memory>
 #include <queue>
+#include <ostream>
 #include <set>
 #include <string>
 #include <vector>
@@ -51,6 +52,7 @@ Contact: khmer-project@idyll.org
 #include "oxli.hh"
 #include "hashgraph.hh"
 #include "kmer_hash.hh"
+#include "read_parsers.hh"
 
 #define READ_ALIGNER_DEBUG 0
 
@@ -255,6 +257,22 @@ public:
     Alignment* Align(const std::string&);
     Alignment* AlignForward(const std::string&);
 
+    // Replace the read's sequence with its graph alignment, if the read
+    // aligns end-to-end; returns true if the sequence was changed.
+    bool CorrectRead(read_parsers::Read& read);
+
+    // Correct every read from the parser on n_threads worker threads and
+    // write the results to output, in input order. Each worker aligns with
+    // its own copy of this aligner; the Countgraph is shared read-only.
+    template<typename SeqIO>
+    void align_reads_parallel(
+        read_parsers::ReadParserPtr<SeqIO>& parser,
+        unsigned int n_threads,
+        std::ostream& output,
+        unsigned int &total_reads,
+        unsigned int &n_corrected
+    );
+
     ReadAligner(oxli::Countgraph* ch,
                 BoundedCounterType trusted_cutoff, double bits_theta)
         : bitmask(comp_bitmask(ch->ksize())),
@@ -38,15 +38,17 @@ Contact: khmer-project@idyll.org
 #ifndef READ_PARSERS_HH
 #define READ_PARSERS_HH
 
-#include <regex.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <iostream>
 #include <string>
 #include <utility>
 #include <memory>
+#include <vector>
 
 #include "oxli.hh"
 #include "oxli_exception.hh"
@@ -124,6 +126,26 @@ struct Read {
         }
     }
 
+    // Append the record to output; cheaper than an ostringstream.
+    inline void write_fastx(std::string& output) const
+    {
+        if (quality.length() != 0) {
+            output += '@';
+            output += name;
+            output += '\n';
+            output += sequence;
+            output += "\n+\n";
+            output += quality;
+            output += '\n';
+        } else {
+            output += '>';
+            output += name;
+            output += '\n';
+            output += sequence;
+            output += '\n';
+        }
+    }
+
     // Compute cleaned_seq from sequence. Call this after changing sequence.
     inline void set_clean_seq()
     {
@@ -135,23 +157,48 @@ struct Read {
 typedef std::pair<Read, Read> ReadPair;
 
 
+/*
+ * Read names of pairs, as broken_paired_reader and check_is_pair in Python
+ * tell them apart. A name is split at its first space or tab into an ID and
+ * a comment; the first and second reads of a pair are then named
+ *
+ *   "frag/1" and "frag/2" (the IDs must match up to their first '/'),
+ *   "frag 1:N:0:..." and "frag 2:N:0:..." (Casava 1.8), or
+ *   "acc frag/1" and "acc frag/2" (SRA fastq-dump).
+ *
+ * The checks neither allocate nor copy.
+ */
+bool check_is_pair(const char * name1, size_t length1,
+                   const char * name2, size_t length2);
+// Whether a name marks the first (left) or second (right) read of a pair.
+bool check_is_left(const char * name, size_t length);
+bool check_is_right(const char * name, size_t length);
+
+inline bool check_is_pair(const std::string& name1, const std::string& name2)
+{
+    return check_is_pair(name1.data(), name1.size(),
+                         name2.data(), name2.size());
+}
+inline bool check_is_left(const std::string& name)
+{
+    return check_is_left(name.data(), name.size());
+}
+inline bool check_is_right(const std::string& name)
+{
+    return check_is_right(name.data(), name.size());
+}
+
+
 template<typename SeqIO>
 class ReadParser
 {
 protected:
     std::unique_ptr<SeqIO> _parser;
-    regex_t _re_read_2_nosub;
-    regex_t _re_read_1;
-    regex_t _re_read_2;
-    void _init();
+    // error that cut short the last batch of get_next_read_pairs
+    std::exception_ptr _pending_error;
 
     ReadPair _get_next_read_pair_in_ignore_mode();
     ReadPair _get_next_read_pair_in_error_mode();
-    bool _is_valid_read_pair(
-        ReadPair &the_read_pair,
-        regmatch_t &match_1,
-        regmatch_t &match_2
-    );
 
 public:
     enum {
@@ -171,6 +218,12 @@ public:
 
     Read get_next_read();
     ReadPair get_next_read_pair(uint8_t mode = PAIR_MODE_ERROR_ON_UNPAIRED);
+    // Append up to n pairs to pairs, as get_next_read_pair finds them.
+    // Returns the number appended, which is less than n only at the end of
+    // the input or when a pair is bad: the pairs before it are returned,
+    // and its error is thrown by the next call.
+    size_t get_next_read_pairs(std::vector<ReadPair>& pairs, size_t n,
+                               uint8_t mode = PAIR_MODE_ERROR_ON_UNPAIRED);
 
     size_t get_num_reads();
     bool is_complete();
@@ -207,6 +260,46 @@ public:
 }; // class FastxReader
 
 
+/**
+ * \class FastxWriter
+ *
+ * \brief Write FASTA/FASTQ text to a plain or compressed file.
+ *
+ * A filename of "-" writes to stdout. With append, output is added to the
+ * end of an existing file; compressed output then becomes a multi-member
+ * stream, which gzip and bzip2 both read back as one.
+ */
+class FastxWriter
+{
+public:
+    enum {
+        COMPRESSION_NONE,
+        COMPRESSION_GZIP,
+        COMPRESSION_BZIP2
+    };
+
+    FastxWriter(const std::string& filename,
+                uint8_t compression = COMPRESSION_NONE,
+                bool append = false);
+    ~FastxWriter();
+
+    void write(const std::string& data);
+    void write(const Read& read);
+    void close();
+
+private:
+    std::string _filename;
+    uint8_t _compression;
+    FILE * _file;
+    // gzFile or BZFILE *, kept opaque so zlib and bzlib stay out of the
+    // public headers
+    void * _stream;
+
+    FastxWriter(const FastxWriter&);
+    FastxWriter& operator=(const FastxWriter&);
+}; // class FastxWriter
+
+
 inline PartitionID _parse_partition_id(std::string name)
 {
     PartitionID p = 0;
@@ -0,0 +1,188 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef RESERVOIR_SAMPLER_HH
+#define RESERVOIR_SAMPLER_HH
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "oxli.hh"
+#include "read_parsers.hh"
+
+// bytes of an uncompressed file sampled as one range
+#define SAMPLE_RANGE_SIZE (64ULL * 1024 * 1024)
+
+namespace oxli
+{
+
+namespace read_parsers
+{
+
+/**
+ * \struct SampleRange
+ *
+ * \brief The reservoirs of every sample, for one part of the input.
+ *
+ * Units (reads, or interleaved pairs) are copied as raw FASTA/FASTQ text
+ * into a single arena; slot s * sample_size + i of sample s points into it.
+ * A unit picked by several reservoirs at once is stored once. Units since
+ * replaced in every reservoir leave garbage behind, and the arena is
+ * compacted once that outweighs what was live after the last compaction.
+ */
+struct SampleRange {
+    struct Slot {
+        // orders units in the input: range index << 40 | unit in range
+        uint64_t key;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t n_reads;
+    };
+
+    std::string filename;
+    // byte range in the file; end is 0 to read to the end of the input
+    uint64_t begin;
+    uint64_t end;
+
+    uint64_t n_units;
+    uint64_t n_reads;
+    std::string arena;
+    uint64_t live_bytes;
+    std::vector<Slot> slots;
+
+    SampleRange(const std::string& _filename, uint64_t _begin, uint64_t _end)
+        : filename(_filename), begin(_begin), end(_end), n_units(0),
+          n_reads(0), live_bytes(0) {}
+
+    void clear()
+    {
+        n_units = n_reads = live_bytes = 0;
+        std::string().swap(arena);
+        std::vector<Slot>().swap(slots);
+    }
+};
+
+/**
+ * \class ReservoirSampler
+ *
+ * \brief Take uniform random samples of reads from FASTA/FASTQ files.
+ *
+ * Keeps n_samples independent samples of up to sample_size units each. A
+ * unit is one read or, unless force_single is set, an interleaved pair as
+ * recognized by broken_paired_reader. Only the first max_units units
+ * (0 means all) are sampled from.
+ *
+ * Records are scanned as raw text rather than parsed into Reads. Which
+ * units each reservoir takes is decided before they are read (Li's
+ * "Algorithm L"), so the others are skipped over without being copied or
+ * drawing random numbers.
+ *
+ * Uncompressed files are split into ranges of about range_size bytes, cut
+ * at unit boundaries, and sampled on several threads. As ranges finish
+ * they are merged into the overall sample in input order, each merge
+ * drawing on the two sides in proportion to the units left in them, which
+ * keeps the merged sample uniform; only ranges waiting to be merged hold
+ * memory. gzip and bzip2 files and standard input ("-") are sampled as a
+ * single range. Samples depend on the seed and range_size, but not on the
+ * number of threads; each is written in input order.
+ */
+class ReservoirSampler
+{
+protected:
+    uint64_t _sample_size;
+    unsigned int _n_samples;
+    bool _force_single;
+    uint64_t _max_units;
+    uint64_t _seed;
+    uint64_t _range_size;
+
+    std::vector<std::unique_ptr<SampleRange> > _ranges;
+    // the samples so far, merged from the ranges in order
+    SampleRange _merged;
+
+    void _split(const std::string& filename);
+    void _sample_range(SampleRange& range, size_t index,
+                       uint64_t max_units) const;
+    void _merge_range(SampleRange& range, size_t index);
+
+public:
+    ReservoirSampler(uint64_t sample_size, unsigned int n_samples = 1,
+                     bool force_single = false, uint64_t max_units = 0,
+                     uint64_t seed = 0,
+                     uint64_t range_size = SAMPLE_RANGE_SIZE);
+
+    // Sample from the files, on n_threads threads (0 means the OpenMP
+    // default). Replaces any earlier samples.
+    void sample(const std::vector<std::string>& filenames,
+                unsigned int n_threads = 1);
+
+    // Units and reads sampled from, across all files.
+    uint64_t n_units() const
+    {
+        return _merged.n_units;
+    }
+    uint64_t n_reads() const
+    {
+        return _merged.n_reads;
+    }
+    // Parts the input was split into by the last call to sample.
+    size_t n_ranges() const
+    {
+        return _ranges.size();
+    }
+
+    // Number of units in each sample.
+    size_t sample_length() const
+    {
+        return std::min(_sample_size, _merged.n_units);
+    }
+
+    // The raw FASTA/FASTQ text of unit i of the given sample.
+    std::string get_unit(unsigned int sample, size_t i) const;
+
+    // Write the given sample; returns the number of reads written.
+    uint64_t write_sample(unsigned int sample, FastxWriter& writer) const;
+}; // class ReservoirSampler
+
+} // namespace read_parsers
+
+} // namespace oxli
+
+#endif // RESERVOIR_SAMPLER_HH
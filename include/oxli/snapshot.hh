@@ -0,0 +1,96 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef SNAPSHOT_HH
+#define SNAPSHOT_HH
+
+#include <sys/types.h>
+#include <string>
+
+#include "oxli.hh"
+
+namespace oxli
+{
+class Storage;
+
+/**
+ * \class StorageSnapshot
+ *
+ * \brief Save a point-in-time image of a Storage in the background.
+ *
+ * The constructor forks. The child process sees the tables exactly as they
+ * were at the fork and saves them with Storage::save, while the parent
+ * returns at once and may keep adding k-mers: the kernel copies only the
+ * pages the parent writes to from then on. Adds that are in flight on
+ * other threads at the moment of the fork may be caught in some tables
+ * and not others, as with any concurrent reader of a CountMin sketch.
+ *
+ * The image is written to a hidden file next to outfilename (keeping its
+ * extension, so that ".gz" still selects compression) and renamed into
+ * place once complete, so a reader never sees a partial checkpoint.
+ *
+ * is_done() polls and wait() blocks for the child; wait() raises an
+ * oxli_file_exception carrying the child's error if the save failed. If
+ * neither has reported completion, the destructor waits for the child.
+ */
+class StorageSnapshot
+{
+protected:
+    pid_t _pid;
+    int _error_fd;
+    bool _finished;
+    bool _succeeded;
+    std::string _filename;
+    std::string _error;
+
+    void _reap(bool block);
+public:
+    StorageSnapshot(Storage& store, const std::string& outfilename,
+                    WordLength ksize);
+    ~StorageSnapshot();
+
+    const std::string& filename() const
+    {
+        return _filename;
+    }
+
+    bool is_done();
+    void wait();
+};
+
+} // namespace oxli
+
+#endif // SNAPSHOT_HH
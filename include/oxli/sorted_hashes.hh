@@ -0,0 +1,91 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef SORTED_HASHES_HH
+#define SORTED_HASHES_HH
+
+#include <stdint.h>
+#include <iosfwd>
+#include <vector>
+
+#include "oxli.hh"
+
+// hashes per independently decodable block
+#define SORTED_HASHES_BLOCK_SIZE 4096
+
+namespace oxli
+{
+
+/**
+ * Compact on-disk encoding of an ascending run of k-mer hashes, each
+ * optionally carrying an integer value (a partition ID or label). This is
+ * the body of SAVED_COMPACT_FORMAT_VERSION tag, stoptag, subset and label
+ * files:
+ *
+ *     uint64_t n_items
+ *     uint8_t  has_values
+ *     uint32_t block_size
+ *     uint64_t n_blocks
+ *     n_blocks x { uint64_t first_hash; uint64_t offset;
+ *                  uint8_t delta_bits; uint8_t value_bits }
+ *     uint64_t data_size
+ *     data
+ *
+ * Block b holds items [b * block_size, (b + 1) * block_size) and starts
+ * at offset in data. It is a little-endian bit stream of the differences
+ * between consecutive hashes after first_hash, delta_bits each, followed
+ * by the block's values at value_bits each, padded to a whole byte. Each
+ * block uses the narrowest width that fits its largest delta or value,
+ * so a set of n hashes spread over 64 bits costs about 67 - log2(n) bits
+ * per hash. Blocks decode independently, so loading runs on all OpenMP
+ * threads.
+ */
+
+/// hashes must be ascending; values is either empty or one per hash.
+void write_sorted_hashes(std::ostream& out,
+                         const std::vector<HashIntoType>& hashes,
+                         const std::vector<uint64_t>& values);
+
+/// Fills hashes (and values, if the file has them) in ascending order.
+/// Throws oxli_file_exception on malformed input; stream errors are left
+/// to the stream's own exception mask.
+void read_sorted_hashes(std::istream& in,
+                        std::vector<HashIntoType>& hashes,
+                        std::vector<uint64_t>& values);
+
+} // namespace oxli
+
+#endif // SORTED_HASHES_HH
@@ -39,12 +39,21 @@ Contact: khmer-project@idyll.org
 #define STORAGE_HH
 
 #include <cassert>
+#include <algorithm>
+#include <string.h>
 #include <array>
+#include <atomic>
+#include <iosfwd>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 using MuxGuard = std::lock_guard<std::mutex>;
 
+// spin locks serializing conservative updates, picked by k-mer hash
+#define CONSERVATIVE_LOCKS 1024
+
 #include "gqf.h"
+#include "table_alloc.hh"
 
 namespace oxli {
 typedef std::unordered_map<HashIntoType, BoundedCounterType> KmerCountMap;
@@ -58,25 +67,159 @@ class Storage
 protected:
     bool _supports_bigcount;
     bool _use_bigcount;
+    bool _supports_conservative;
+    bool _conservative;
+    // how this storage allocates its tables; fixed at construction
+    TableAllocPolicy _alloc_policy;
 
 public:
-    Storage() : _supports_bigcount(false), _use_bigcount(false) { } ;
+    Storage() : _supports_bigcount(false), _use_bigcount(false),
+        _supports_conservative(false), _conservative(false),
+        _alloc_policy(TableAllocator::current_policy()) { } ;
     virtual ~Storage() { }
     virtual std::vector<uint64_t> get_tablesizes() const = 0;
     virtual const size_t n_tables() const = 0;
     virtual void save(std::string, WordLength) = 0;
     virtual void load(std::string, WordLength&) = 0;
+    // Load a table saved by save() from a stream positioned at its start;
+    // the name is only used in error messages.
+    virtual void load(std::istream&, const std::string&, WordLength&);
     virtual const uint64_t n_occupied() const = 0;
     virtual const uint64_t n_unique_kmers() const = 0;
     virtual BoundedCounterType test_and_set_bits( HashIntoType khash ) = 0;
     virtual bool add(HashIntoType khash) = 0;
     virtual const BoundedCounterType get_count(HashIntoType khash) const = 0;
+    // get_count for n hashes at once, into counts
+    virtual void get_counts(const HashIntoType * hashes, size_t n,
+                            BoundedCounterType * counts) const;
+    // add for n hashes at once; returns the number of new k-mers
+    virtual uint64_t add_batch(const HashIntoType * hashes, size_t n);
     virtual Byte ** get_raw_tables() = 0;
 
+    // Hold off writers of any auxiliary structures while a StorageSnapshot
+    // forks; the tables themselves may keep changing.
+    virtual void lock_for_snapshot() { }
+    virtual void unlock_for_snapshot() { }
+
     void set_use_bigcount(bool b);
     bool get_use_bigcount();
+
+    // Conservative update: add() only increments the counters of a k-mer
+    // that hold its current (minimum) count.
+    void set_conservative_update(bool b);
+    bool get_conservative_update() const;
+
+    const TableAllocPolicy& alloc_policy() const
+    {
+        return _alloc_policy;
+    }
+};
+
+
+/*
+ * \class KmerLocks
+ *
+ * \brief Spin locks picked by k-mer hash.
+ *
+ * A conservative update reads the minimum of a k-mer's counters and then
+ * raises them past it. Two concurrent adds of the same k-mer could both
+ * read the same minimum and together raise it by only one, so they take
+ * the k-mer's lock; different k-mers mostly take different locks. Each
+ * lock is padded to a cache line so that threads taking different locks do
+ * not contend.
+ */
+class KmerLocks
+{
+    struct Lock {
+        uint32_t v;
+        char _pad[64 - sizeof(uint32_t)];
+    };
+    Lock _locks[CONSERVATIVE_LOCKS];
+public:
+    KmerLocks()
+    {
+        memset(_locks, 0, sizeof(_locks));
+    }
+
+    void lock(HashIntoType khash)
+    {
+        uint32_t * l = &_locks[khash % CONSERVATIVE_LOCKS].v;
+        while (!__sync_bool_compare_and_swap(l, 0, 1));
+    }
+    void unlock(HashIntoType khash)
+    {
+        __sync_lock_release(&_locks[khash % CONSERVATIVE_LOCKS].v);
+    }
+};
+
+/*
+ * \class RWSpinLock
+ *
+ * \brief A spin lock held by any number of readers or by one writer.
+ *
+ * A writer first sets the writer bit, which keeps new readers out, and
+ * then waits for the readers already in to leave, so a steady stream of
+ * lookups cannot starve inserts. Waiters yield rather than spin, as the
+ * holders may be waiting for a CPU.
+ */
+class RWSpinLock
+{
+    static const uint32_t WRITER = 1u << 31;
+    // number of readers in, plus WRITER while a writer holds or waits
+    std::atomic<uint32_t> _state;
+public:
+    RWSpinLock() : _state(0) { }
+
+    void lock()
+    {
+        uint32_t state = _state.load(std::memory_order_relaxed);
+        while ((state & WRITER) ||
+                !_state.compare_exchange_weak(state, state | WRITER,
+                                              std::memory_order_acquire)) {
+            std::this_thread::yield();
+            state = _state.load(std::memory_order_relaxed);
+        }
+        while (_state.load(std::memory_order_acquire) != WRITER) {
+            std::this_thread::yield();
+        }
+    }
+    void unlock()
+    {
+        _state.store(0, std::memory_order_release);
+    }
+
+    void lock_shared()
+    {
+        uint32_t state = _state.load(std::memory_order_relaxed);
+        while ((state & WRITER) ||
+                !_state.compare_exchange_weak(state, state + 1,
+                                              std::memory_order_acquire)) {
+            std::this_thread::yield();
+            state = _state.load(std::memory_order_relaxed);
+        }
+    }
+    void unlock_shared()
+    {
+        _state.fetch_sub(1, std::memory_order_release);
+    }
 };
 
+// scoped shared hold of an RWSpinLock; std::lock_guard takes it exclusively
+class SharedGuard
+{
+    RWSpinLock& _lock;
+public:
+    explicit SharedGuard(RWSpinLock& lock) : _lock(lock)
+    {
+        _lock.lock_shared();
+    }
+    ~SharedGuard()
+    {
+        _lock.unlock_shared();
+    }
+    SharedGuard(const SharedGuard&) = delete;
+    SharedGuard& operator=(const SharedGuard&) = delete;
+};
 
 /*
  * \class BitStorage
@@ -94,6 +237,7 @@ public:
 
 class BitStorage : public Storage
 {
+    friend class ScalableBitStorage;
 protected:
     std::vector<uint64_t> _tablesizes;
     size_t _n_tables;
@@ -101,6 +245,10 @@ protected:
     uint64_t _n_unique_kmers;
     Byte ** _counts;
 
+    // the tables and their occupancy, as laid out in a saved nodegraph
+    void _save_tables(std::ostream& outfile) const;
+    void _load_tables(std::istream& infile);
+
 public:
     BitStorage(std::vector<uint64_t>& tablesizes) :
         _tablesizes(tablesizes)
@@ -114,7 +262,7 @@ public:
     {
         if (_counts) {
             for (size_t i = 0; i < _n_tables; i++) {
-                delete[] _counts[i];
+                TableAllocator::release(_counts[i]);
                 _counts[i] = NULL;
             }
             delete[] _counts;
@@ -134,8 +282,7 @@ public:
             uint64_t tablesize = _tablesizes[i];
             uint64_t tablebytes = tablesize / 8 + 1;
 
-            _counts[i] = new Byte[tablebytes];
-            memset(_counts[i], 0, tablebytes);
+            _counts[i] = TableAllocator::allocate(tablebytes, _alloc_policy);
         }
     }
 
@@ -152,6 +299,7 @@ public:
 
     void save(std::string, WordLength ksize);
     void load(std::string, WordLength& ksize);
+    void load(std::istream&, const std::string&, WordLength& ksize);
 
     // count number of occupied bins
     const uint64_t n_occupied() const
@@ -225,7 +373,123 @@ public:
         return _counts;
     }
 
-    void update_from(const BitStorage&);
+    void get_counts(const HashIntoType * hashes, size_t n,
+                    BoundedCounterType * counts) const;
+    uint64_t add_batch(const HashIntoType * hashes, size_t n);
+
+    // Union with another BitStorage of the same table sizes, on n_threads
+    // threads (0 means the OpenMP default).
+    void update_from(const BitStorage&, unsigned int n_threads = 1);
+
+    // false positive rate implied by the occupancy of the first table
+    double estimated_fp_rate() const;
+};
+
+
+/*
+ * \class ScalableBitStorage
+ *
+ * \brief A Bloom filter that grows with the number of distinct k-mers.
+ *
+ * A scalable Bloom filter: a series of BitStorage slices, of which only
+ * the newest is written to.  Once the newest slice's first table is
+ * _max_fill full, a new slice twice its size and with one more table is
+ * started, so that slices are never filled past a fixed false positive
+ * rate and each one contributes a smaller rate than the last.  Queries
+ * check every slice.
+ *
+ * _max_fill is chosen from the target false positive rate and the number
+ * of tables in the first slice so that the rates of all slices sum to at
+ * most the target, however many slices are added (up to
+ * SCALABLE_MAX_SLICES, after which the last slice keeps filling).
+ *
+ * Adding k-mers is thread safe, as with BitStorage; a slice is published
+ * to other threads only once it is fully allocated.
+ */
+
+#define SCALABLE_MAX_SLICES 32
+
+class ScalableBitStorage : public Storage
+{
+protected:
+    double _fp_rate;
+    double _max_fill;
+    BitStorage * _slices[SCALABLE_MAX_SLICES];
+    uint64_t _grow_at[SCALABLE_MAX_SLICES];
+    std::atomic<unsigned int> _n_slices;
+    std::mutex _grow_lock;
+    std::vector<Byte *> _raw_tables;
+
+    void _add_slice(BitStorage * slice);
+    void _grow(unsigned int n_slices);
+    void _clear();
+
+public:
+    ScalableBitStorage(std::vector<uint64_t>& tablesizes, double fp_rate);
+    ~ScalableBitStorage();
+
+    // table sizes of all slices, oldest first
+    std::vector<uint64_t> get_tablesizes() const;
+    const size_t n_tables() const;
+
+    void save(std::string, WordLength ksize);
+    void load(std::string, WordLength& ksize);
+    void load(std::istream&, const std::string&, WordLength& ksize);
+
+    const uint64_t n_occupied() const;
+    const uint64_t n_unique_kmers() const;
+
+    inline
+    BoundedCounterType
+    test_and_set_bits( HashIntoType khash )
+    {
+        unsigned int n = _n_slices.load(std::memory_order_acquire);
+        for (unsigned int i = 0; i + 1 < n; i++) {
+            if (_slices[i]->get_count(khash)) {
+                return 0; // kmer already seen
+            }
+        }
+
+        BitStorage * current = _slices[n - 1];
+        if (!current->test_and_set_bits(khash)) {
+            return 0;
+        }
+        if (current->n_occupied() >= _grow_at[n - 1]) {
+            _grow(n);
+        }
+        return 1; // kmer not seen before
+    }
+
+    inline bool add(HashIntoType khash)
+    {
+        return test_and_set_bits(khash);
+    }
+
+    inline const BoundedCounterType get_count(HashIntoType khash) const
+    {
+        unsigned int n = _n_slices.load(std::memory_order_acquire);
+        for (unsigned int i = 0; i < n; i++) {
+            if (_slices[i]->get_count(khash)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // The tables of all slices, in the order of get_tablesizes(); only
+    // valid until the next slice is added.
+    Byte ** get_raw_tables()
+    {
+        return _raw_tables.data();
+    }
+
+    unsigned int n_slices() const
+    {
+        return _n_slices.load(std::memory_order_acquire);
+    }
+
+    // combined false positive rate of all slices at their occupancy
+    double estimated_fp_rate() const;
 };
 
 
@@ -253,6 +517,7 @@ protected:
     std::array<std::mutex, 32> mutexes;
     static constexpr uint8_t _max_count{15};
     Byte ** _counts;
+    KmerLocks _kmer_locks;
 
     // Compute index into the table, this retrieves the correct byte
     // which you then need to select the correct nibble from
@@ -273,11 +538,12 @@ protected:
 
 public:
     NibbleStorage(std::vector<uint64_t>& tablesizes) :
-        _tablesizes{tablesizes},
+        _tablesizes{tablesizes}, _n_tables{tablesizes.size()},
         _occupied_bins{0}, _n_unique_kmers{0}
     {
         // to allow more than 32 tables increase the size of mutex pool
         assert(_n_tables <= 32);
+        _supports_conservative = true;
         _allocate_counters();
     }
 
@@ -285,7 +551,7 @@ public:
     {
         if (_counts) {
             for (size_t i = 0; i < _n_tables; i++) {
-                delete[] _counts[i];
+                TableAllocator::release(_counts[i]);
                 _counts[i] = NULL;
             }
             delete[] _counts;
@@ -304,8 +570,7 @@ public:
             const uint64_t tablesize = _tablesizes[i];
             const uint64_t tablebytes = tablesize / 2 + 1;
 
-            _counts[i] = new Byte[tablebytes];
-            memset(_counts[i], 0, tablebytes);
+            _counts[i] = TableAllocator::allocate(tablebytes, _alloc_policy);
         }
     }
 
@@ -319,6 +584,9 @@ public:
 
     bool add(HashIntoType khash)
     {
+        if (_conservative) {
+            return _add_conservative(khash);
+        }
         bool is_new_kmer = false;
 
         for (unsigned int i = 0; i < _n_tables; i++) {
@@ -358,6 +626,49 @@ public:
         return is_new_kmer;
     }
 
+    // Raise every counter of khash below its minimum + 1 to minimum + 1.
+    // Counters are shared by other k-mers and only ever go up, so each
+    // nibble is set with a compare-and-swap of its byte.
+    bool _add_conservative(HashIntoType khash)
+    {
+        _kmer_locks.lock(khash);
+        const uint8_t min_count = get_count(khash);
+        const bool is_new_kmer = min_count == 0;
+        if (is_new_kmer) {
+            __sync_add_and_fetch(&_n_unique_kmers, 1);
+        }
+
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            Byte * const cell = _counts[i] + _table_index(khash, _tablesizes[i]);
+            const uint8_t mask = _mask(khash, _tablesizes[i]);
+            const uint8_t shift = _shift(khash, _tablesizes[i]);
+            if (min_count == _max_count) {
+                break;
+            }
+
+            const uint8_t target = (min_count + 1) << shift;
+            Byte current = *cell;
+            while ((current & mask) < target) {
+                const Byte updated = (current & ~mask) | target;
+                const Byte seen = __sync_val_compare_and_swap(cell, current,
+                                  updated);
+                if (seen == current) {
+                    // other k-mers share the bin, so only the add that
+                    // moves it from 0 counts it; first table only, as proxy
+                    // for all.
+                    if (i == 0 && (current & mask) == 0) {
+                        __sync_add_and_fetch(&_occupied_bins, 1);
+                    }
+                    break;
+                }
+                current = seen;
+            }
+        }
+        _kmer_locks.unlock(khash);
+
+        return is_new_kmer;
+    }
+
     // get the count for the given k-mer hash.
     const BoundedCounterType get_count(HashIntoType khash) const
     {
@@ -397,11 +708,17 @@ public:
     }
     void save(std::string outfilename, WordLength ksize);
     void load(std::string infilename, WordLength& ksize);
+    void load(std::istream& infile, const std::string& infilename,
+              WordLength& ksize);
 
     Byte ** get_raw_tables()
     {
         return _counts;
     }
+
+    // Add the counts of another NibbleStorage of the same table sizes,
+    // saturating at 15, on n_threads threads (0 means the OpenMP default).
+    void update_from(const NibbleStorage&, unsigned int n_threads = 1);
 };
 
 
@@ -413,6 +730,19 @@ public:
  class QFStorage : public Storage {
 protected:
   QF cf;
+  // the CQF does not support concurrent inserts, so inserts from several
+  // threads are serialized on this lock; lookups only share it
+  mutable RWSpinLock _lock;
+
+  const BoundedCounterType _get_count(HashIntoType khash) const {
+    return qf_count_key_value(&cf, khash % cf.range, 0);
+  }
+
+  bool _add(HashIntoType khash) {
+    bool is_new = _get_count(khash) == 0;
+    qf_insert(&cf, khash % cf.range, 0, 1);
+    return is_new;
+  }
 
 public:
   QFStorage(int size) {
@@ -427,21 +757,20 @@ public:
   ~QFStorage() { qf_destroy(&cf); }
 
   BoundedCounterType test_and_set_bits(HashIntoType khash) {
-    BoundedCounterType x = get_count(khash);
-    add(khash);
-    return !x;
+    std::lock_guard<RWSpinLock> g(_lock);
+    return _add(khash);
   }
 
   //
   bool add(HashIntoType khash) {
-      bool is_new = get_count(khash) == 0;
-      qf_insert(&cf, khash % cf.range, 0, 1);
-      return is_new;
+    std::lock_guard<RWSpinLock> g(_lock);
+    return _add(khash);
   }
 
   // get the count for the given k-mer hash.
   const BoundedCounterType get_count(HashIntoType khash) const {
-    return qf_count_key_value(&cf, khash % cf.range, 0);
+    SharedGuard g(_lock);
+    return _get_count(khash);
   }
 
   // Accessors for protected/private table info members
@@ -454,6 +783,10 @@ public:
   void save(std::string outfilename, WordLength ksize);
   void load(std::string infilename, WordLength &ksize);
 
+  // Add the counts of another QFStorage of the same size. The CQF does not
+  // support concurrent inserts, so this runs on one thread under the lock.
+  void update_from(const QFStorage&);
+
   Byte **get_raw_tables() { return nullptr; }
 };
 
@@ -477,6 +810,7 @@ class ByteStorageFileReader;
 class ByteStorageFileWriter;
 class ByteStorageGzFileReader;
 class ByteStorageGzFileWriter;
+class ByteStorageMerge;
 
 class ByteStorage : public Storage
 {
@@ -485,6 +819,7 @@ class ByteStorage : public Storage
     friend class ByteStorageFileWriter;
     friend class ByteStorageGzFileReader;
     friend class ByteStorageGzFileWriter;
+    friend class ByteStorageMerge;
     friend class CountGraph;
 protected:
     unsigned int    _max_count;
@@ -497,6 +832,7 @@ protected:
     uint64_t _occupied_bins;
 
     Byte ** _counts;
+    KmerLocks _kmer_locks;
 
     // initialize counts with empty hashtables.
     void _allocate_counters()
@@ -505,8 +841,8 @@ protected:
 
         _counts = new Byte*[_n_tables];
         for (size_t i = 0; i < _n_tables; i++) {
-            _counts[i] = new Byte[_tablesizes[i]];
-            memset(_counts[i], 0, _tablesizes[i]);
+            _counts[i] = TableAllocator::allocate(_tablesizes[i],
+                                                  _alloc_policy);
         }
     }
 public:
@@ -519,6 +855,7 @@ public:
         _n_unique_kmers(0), _occupied_bins(0)
     {
         _supports_bigcount = true;
+        _supports_conservative = true;
         _allocate_counters();
     }
 
@@ -528,7 +865,7 @@ public:
         if (_counts) {
             for (size_t i = 0; i < _n_tables; i++) {
                 if (_counts[i]) {
-                    delete[] _counts[i];
+                    TableAllocator::release(_counts[i]);
                     _counts[i] = NULL;
                 }
             }
@@ -560,6 +897,13 @@ public:
 
     void save(std::string, WordLength);
     void load(std::string, WordLength&);
+    void load(std::istream&, const std::string&, WordLength&);
+
+    // Add the counts of another ByteStorage of the same table sizes,
+    // saturating at the maximum count, on n_threads threads (0 means the
+    // OpenMP default). K-mers in either bigcount map get the sum of their
+    // counts, up to the maximum bigcount.
+    void update_from(const ByteStorage&, unsigned int n_threads = 1);
 
     inline BoundedCounterType test_and_set_bits(HashIntoType khash)
     {
@@ -570,6 +914,9 @@ public:
 
     inline bool add(HashIntoType khash)
     {
+        if (_conservative) {
+            return _add_conservative(khash);
+        }
         bool is_new_kmer = false;
         unsigned int  n_full	  = 0;
 
@@ -605,16 +952,65 @@ public:
 
         // if all tables are full for this position, then add in bigcounts.
         if (n_full == _n_tables && _use_bigcount) {
-            while (!__sync_bool_compare_and_swap(&_bigcount_spin_lock, 0, 1));
-            if (_bigcounts[khash] == 0) {
-                _bigcounts[khash] = _max_count + 1;
-            } else {
-                if (_bigcounts[khash] < _max_bigcount) {
-                    _bigcounts[khash] += 1;
+            _add_bigcount(khash);
+        }
+
+        if (is_new_kmer) {
+            __sync_add_and_fetch(&_n_unique_kmers, 1);
+        }
+
+        return is_new_kmer;
+    }
+
+    inline void _add_bigcount(HashIntoType khash)
+    {
+        while (!__sync_bool_compare_and_swap(&_bigcount_spin_lock, 0, 1));
+        if (_bigcounts[khash] == 0) {
+            _bigcounts[khash] = _max_count + 1;
+        } else {
+            if (_bigcounts[khash] < _max_bigcount) {
+                _bigcounts[khash] += 1;
+            }
+        }
+        __sync_bool_compare_and_swap( &_bigcount_spin_lock, 1, 0 );
+    }
+
+    // Raise every counter of khash below its minimum + 1 to minimum + 1,
+    // leaving the others alone. Counters are shared by other k-mers and
+    // only ever go up, so each is raised with a compare-and-swap loop.
+    inline bool _add_conservative(HashIntoType khash)
+    {
+        _kmer_locks.lock(khash);
+        Byte min_count = _max_count;
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            min_count = std::min(min_count, _counts[i][khash % _tablesizes[i]]);
+        }
+        const bool is_new_kmer = min_count == 0;
+
+        if (min_count < _max_count) {
+            const Byte target = min_count + 1;
+            for (unsigned int i = 0; i < _n_tables; i++) {
+                Byte * const count = _counts[i] + khash % _tablesizes[i];
+                Byte current = *count;
+                while (current < target) {
+                    const Byte seen = __sync_val_compare_and_swap(count,
+                                      current, target);
+                    if (seen == current) {
+                        // other k-mers share the bin, so only the add that
+                        // moves it from 0 counts it; first table only, as
+                        // proxy for all.
+                        if (i == 0 && current == 0) {
+                            __sync_add_and_fetch(&_occupied_bins, 1);
+                        }
+                        break;
+                    }
+                    current = seen;
                 }
             }
-            __sync_bool_compare_and_swap( &_bigcount_spin_lock, 1, 0 );
+        } else if (_use_bigcount) {
+            _add_bigcount(khash);
         }
+        _kmer_locks.unlock(khash);
 
         if (is_new_kmer) {
             __sync_add_and_fetch(&_n_unique_kmers, 1);
@@ -623,6 +1019,15 @@ public:
         return is_new_kmer;
     }
 
+    void lock_for_snapshot()
+    {
+        while (!__sync_bool_compare_and_swap(&_bigcount_spin_lock, 0, 1));
+    }
+    void unlock_for_snapshot()
+    {
+        __sync_bool_compare_and_swap(&_bigcount_spin_lock, 1, 0);
+    }
+
     // get the count for the given k-mer hash.
     inline const BoundedCounterType get_count(HashIntoType khash) const
     {
@@ -647,6 +1052,11 @@ public:
         }
         return min_count;
     }
+
+    void get_counts(const HashIntoType * hashes, size_t n,
+                    BoundedCounterType * counts) const;
+    uint64_t add_batch(const HashIntoType * hashes, size_t n);
+
     // Get direct access to the counts.
     //
     // Note:
@@ -667,9 +1077,22 @@ public:
     static void load(const std::string &infilename,
                      WordLength &ksize,
                      ByteStorage &store);
+    // Uncompressed tables only; gzip is up to the stream.
+    static void load(std::istream &infile,
+                     const std::string &infilename,
+                     WordLength &ksize,
+                     ByteStorage &store);
     static void save(const std::string &outfilename,
                      const WordLength ksize,
                      const ByteStorage &store);
+    // Add the counts saved in infilename to store, as
+    // ByteStorage::update_from would, reading the file in chunks rather
+    // than loading it whole. If the file turns out to be truncated or
+    // incompatible part way through, store is left partially updated.
+    static void merge(const std::string &infilename,
+                      const WordLength ksize,
+                      ByteStorage &store,
+                      unsigned int n_threads = 1);
 };
 
 class ByteStorageFileReader : public ByteStorageFile
@@ -678,6 +1101,10 @@ public:
     ByteStorageFileReader(const std::string &infilename,
                           WordLength &ksize,
                           ByteStorage &store);
+    ByteStorageFileReader(std::istream &infile,
+                          const std::string &infilename,
+                          WordLength &ksize,
+                          ByteStorage &store);
 };
 
 class ByteStorageGzFileReader : public ByteStorageFile
@@ -39,15 +39,21 @@ Contact: khmer-project@idyll.org
 #define SUBSET_HH
 
 #include <stddef.h>
+#include <iosfwd>
 #include <queue>
 #include <string>
+#include <vector>
 
 #include "oxli.hh"
 
+// tags traversed by find_knots between updates of the stop tags
+#define KNOT_ROUND_SIZE 1024
+
 namespace oxli
 {
 class Countgraph;
 class Hashgraph;
+struct ReadBatch;
 
 struct pre_partition_info {
     HashIntoType kmer;
@@ -72,6 +78,11 @@ protected:
     PartitionID * _join_partitions_by_tags(const SeenSet& tagged_kmers,
                                            const HashIntoType kmer);
 
+    uint64_t _annotate_partitions(ReadBatch& batch,
+                                  bool output_unassigned,
+                                  PartitionSet& partitions,
+                                  size_t& n_singletons) const;
+
 public:
     explicit SubsetPartition(Hashgraph * ht);
 
@@ -97,6 +108,7 @@ public:
 
     void merge(SubsetPartition *);
     void merge_from_disk(std::string);
+    void merge_from_disk(std::istream&, const std::string&);
     void _merge_from_disk_consolidate(PartitionPtrMap&);
 
     void save_partitionmap(std::string outfile);
@@ -143,11 +155,25 @@ public:
     void count_partitions(size_t& n_partitions,
                           size_t& n_unassigned);
 
+    // Write the reads in infilename to outputfilename, in input order,
+    // with their partition ID appended to the name. Reads are annotated
+    // on n_threads threads (0 means the OpenMP default). Returns the number
+    // of partitions plus unassigned tags seen.
     size_t output_partitioned_file(const std::string &infilename,
                                    const std::string &outputfilename,
                                    bool output_unassigned=false,
                                    CallbackFn callback=0,
-                                   void * callback_data=0);
+                                   void * callback_data=0,
+                                   unsigned int n_threads=1);
+
+    // As above for several files at once; files are spread over the
+    // threads when there are enough of them.
+    void output_partitioned_files(
+        const std::vector<std::string> &infilenames,
+        const std::vector<std::string> &outputfilenames,
+        std::vector<size_t>& n_partitions,
+        bool output_unassigned=false,
+        unsigned int n_threads=1);
 
     void partition_sizes(PartitionCountMap &cm,
                          unsigned int& n_unassigned) const;
@@ -162,11 +188,37 @@ public:
             unsigned int, Countgraph&);
 
     void repartition_a_partition(const SeenSet& partition_tags);
+
+    // Collect the tags of the largest partition, leaving the partition
+    // map as it is.
+    void largest_partition_tags(SeenSet& partition_tags) const;
+
+    // Traverse up to distance from each of partition_tags on n_threads
+    // threads (0 means the OpenMP default). K-mers met in traversals of at
+    // least threshold k-mers are counted in counting, and those seen more
+    // than frequency times become stop tags of the graph. Tags are taken
+    // KNOT_ROUND_SIZE at a time, and stop tags found in one round prune the
+    // traversals of the next. Returns the number of new stop tags.
+    unsigned long long find_knots(const SeenSet& partition_tags,
+                                  unsigned int distance,
+                                  unsigned int threshold,
+                                  unsigned int frequency,
+                                  Countgraph& counting,
+                                  unsigned int n_threads=1);
+
+    // find_knots from the tags of the largest partition.
+    unsigned long long find_knots_in_largest_partition(unsigned int distance,
+            unsigned int threshold,
+            unsigned int frequency,
+            Countgraph& counting,
+            unsigned int n_threads=1);
     void _clear_partition(PartitionID, SeenSet& partition_tags);
 
     void _merge_other(HashIntoType tag,
                       PartitionID other_partition,
                       PartitionPtrMap& diskp_to_pp);
+    void _merge_compact_pmap(std::istream& infile,
+                             const std::string& other_filename);
 
     void report_on_partitions();
 };
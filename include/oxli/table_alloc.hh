@@ -0,0 +1,129 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#ifndef TABLE_ALLOC_HH
+#define TABLE_ALLOC_HH
+
+#include <stdint.h>
+
+#include "oxli.hh"
+
+namespace oxli
+{
+
+// how the pages backing a storage table are obtained
+typedef enum {
+    // plain heap allocation
+    TABLE_PAGES_DEFAULT = 0,
+    // anonymous mapping advised for transparent huge pages
+    TABLE_PAGES_HUGE = 1,
+    // anonymous mapping from the 1 GB hugetlbfs pool; falls back to
+    // TABLE_PAGES_HUGE when no such pages are reserved
+    TABLE_PAGES_HUGE_1G = 2
+} TablePages;
+
+/**
+ * \struct TableAllocPolicy
+ *
+ * \brief How Storage classes allocate their count tables.
+ *
+ * numa_interleave spreads a table's pages round-robin over all online NUMA
+ * nodes, so that random accesses from threads on every socket see the same
+ * average latency. n_threads threads zero the table after allocation; with
+ * the default first-touch placement this also spreads the pages over the
+ * nodes those threads run on. 0 means the OpenMP default.
+ */
+struct TableAllocPolicy {
+    TablePages pages;
+    bool numa_interleave;
+    unsigned int n_threads;
+
+    TableAllocPolicy()
+        : pages(TABLE_PAGES_DEFAULT), numa_interleave(false), n_threads(1) {}
+};
+
+/**
+ * \class TableAllocator
+ *
+ * \brief Allocate and release zeroed storage tables.
+ *
+ * Each Storage captures current_policy() when it is created and allocates
+ * all of its tables, including those read by load(), with it. The current
+ * policy is the one set by the innermost TableAllocScope on the calling
+ * thread, and the process default otherwise.
+ *
+ * Small tables, and all tables on platforms without anonymous mappings, are
+ * heap allocated whatever the policy. Tables from allocate() must be freed
+ * with release().
+ */
+class TableAllocator
+{
+public:
+    static TableAllocPolicy get_default_policy();
+    static void set_default_policy(const TableAllocPolicy& policy);
+
+    static TableAllocPolicy current_policy();
+
+    /// Allocate nbytes of zeroed memory according to policy.
+    static Byte * allocate(uint64_t nbytes, const TableAllocPolicy& policy);
+
+    /// Free a table from allocate(); NULL is ignored.
+    static void release(Byte * table);
+
+    /// The kind of pages actually backing a table from allocate().
+    static TablePages allocated_pages(const Byte * table);
+};
+
+/**
+ * \class TableAllocScope
+ *
+ * \brief Override the current allocation policy of this thread while the
+ * scope lives, e.g. for a single constructor call.
+ */
+class TableAllocScope
+{
+protected:
+    bool _had_policy;
+    TableAllocPolicy _saved;
+
+public:
+    explicit TableAllocScope(const TableAllocPolicy& policy);
+    ~TableAllocScope();
+};
+
+} // namespace oxli
+
+#endif // TABLE_ALLOC_HH
@@ -65,12 +65,18 @@ from khmer._khmer import ReadParser  # sandbox/to-casava-1.8-fastq.py
 from khmer._khmer import FILETYPES
 
 from khmer._oxli.graphs import (Counttable, QFCounttable, Nodetable,
-                                CyclicCounttable,
+                                CyclicCounttable, ExactCounttable,
+                                ExactCountBuilder, GraphBundle,
                                 SmallCounttable, Countgraph, SmallCountgraph,
-                                Nodegraph)
+                                Nodegraph, ScalableNodegraph, QueryServer,
+                                TableAllocation, set_table_allocation,
+                                get_table_allocation)
 from khmer._oxli.labeling import GraphLabels
-from khmer._oxli.legacy_partitioning import SubsetPartition, PrePartitionInfo
-from khmer._oxli.parsing import FastxParser
+from khmer._oxli.legacy_partitioning import (SubsetPartition, PrePartitionInfo,
+                                             PartitionExtractor)
+from khmer._oxli.parsing import (FastxParser, ReservoirSampler, FastxFilter,
+                                 FastxInterleaver, FastxPairSplitter,
+                                 fastx_stats)
 from khmer._oxli.readaligner import ReadAligner
 
 from khmer._oxli.utils import get_n_primes_near_x, is_prime
@@ -160,10 +166,11 @@ def extract_countgraph_info(filename):
             signature, = unpack('4s', countgraph.read(4))
             version, = unpack('B', countgraph.read(1))
             ht_type, = unpack('B', countgraph.read(1))
+            # version 4 small count tables have no flags byte
+            if ht_type != FILETYPES['SMALLCOUNT'] or version >= 6:
+                flags, = unpack('B', countgraph.read(1))
             if ht_type != FILETYPES['SMALLCOUNT']:
-                use_bigcount, = unpack('B', countgraph.read(1))
-            else:
-                use_bigcount = None
+                use_bigcount = flags & 1
             ksize, = unpack('I', countgraph.read(uint_size))
             n_tables, = unpack('B', countgraph.read(1))
             occupied, = unpack('Q', countgraph.read(ulonglong_size))
@@ -186,13 +193,17 @@ def calc_expected_collisions(graph, force=False, max_false_pos=.2):
     Keyword argument:
     graph: the countgraph or nodegraph object to inspect
     """
-    sizes = graph.hashsizes()
-    n_ht = float(len(sizes))
-    occupancy = float(graph.n_occupied())
-    min_size = min(sizes)
-
-    fp_one = occupancy / min_size
-    fp_all = fp_one ** n_ht
+    if hasattr(graph, 'estimated_fp_rate'):
+        # scalable nodegraphs sum the rates of their slices
+        fp_all = graph.estimated_fp_rate()
+    else:
+        sizes = graph.hashsizes()
+        n_ht = float(len(sizes))
+        occupancy = float(graph.n_occupied())
+        min_size = min(sizes)
+
+        fp_one = occupancy / min_size
+        fp_all = fp_one ** n_ht
 
     if fp_all > max_false_pos:
         print("**", file=sys.stderr)
@@ -2,12 +2,14 @@ from libcpp cimport bool
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.set cimport set
+from libcpp.utility cimport pair
 from libcpp.memory cimport unique_ptr, shared_ptr, weak_ptr
 from libc.stdint cimport uint8_t, uint32_t, uint64_t, uintptr_t
 
 from khmer._oxli.oxli_types cimport *
 from khmer._oxli.hashing cimport Kmer, CpKmer, KmerSet, CpKmerFactory, CpKmerIterator
-from khmer._oxli.parsing cimport CpReadParser, CpSequence, FastxParserPtr
+from khmer._oxli.parsing cimport (CpReadParser, CpSequence, CpFastxWriter,
+                                  FastxParserPtr)
 from khmer._oxli.legacy_partitioning cimport (CpSubsetPartition, cp_pre_partition_info,
                                    SubsetPartition)
 from khmer._oxli.utils cimport oxli_raise_py_error
@@ -37,22 +39,65 @@ cdef extern from "oxli/storage.hh":
         bool get_use_bigcount()
 
 
+cdef extern from "oxli/table_alloc.hh" namespace "oxli" nogil:
+    ctypedef enum TablePages:
+        TABLE_PAGES_DEFAULT,
+        TABLE_PAGES_HUGE,
+        TABLE_PAGES_HUGE_1G
+
+    cdef cppclass CpTableAllocPolicy "oxli::TableAllocPolicy":
+        TablePages pages
+        bool numa_interleave
+        unsigned int n_threads
+
+        CpTableAllocPolicy()
+
+    cdef cppclass CpTableAllocator "oxli::TableAllocator":
+        @staticmethod
+        CpTableAllocPolicy get_default_policy()
+        @staticmethod
+        void set_default_policy(const CpTableAllocPolicy&)
+
+    cdef cppclass CpTableAllocScope "oxli::TableAllocScope":
+        CpTableAllocScope(const CpTableAllocPolicy&)
+
+
+cdef extern from "oxli/snapshot.hh" namespace "oxli" nogil:
+    cdef cppclass CpStorageSnapshot "oxli::StorageSnapshot":
+        const string& filename() const
+        bool is_done()
+        void wait() except +oxli_raise_py_error
+
+
 cdef extern from "oxli/hashtable.hh" namespace "oxli" nogil:
+    cdef struct CpReadCoverage "oxli::ReadCoverage":
+        string name
+        BoundedCounterType median
+        float average
+        float stddev
+        size_t length
+
     cdef cppclass CpHashtable "oxli::Hashtable" (CpKmerFactory):
         const WordLength ksize() const
         HashIntoType hash_dna(const char *) except +oxli_raise_py_error
         HashIntoType hash_dna_top_strand(const char *) except +oxli_raise_py_error
         HashIntoType hash_dna_bottom_strand(const char *) except +oxli_raise_py_error
         string unhash_dna(HashIntoType) except +oxli_raise_py_error
-        void count(const char *)
-        void count(HashIntoType)
-        bool add(const char *)
-        bool add(HashIntoType)
+        void count(const char *) except +oxli_raise_py_error
+        void count(HashIntoType) except +oxli_raise_py_error
+        bool add(const char *) except +oxli_raise_py_error
+        bool add(HashIntoType) except +oxli_raise_py_error
         const BoundedCounterType get_count(const char *) except +oxli_raise_py_error
         const BoundedCounterType get_count(HashIntoType) except +oxli_raise_py_error
-        void save(string)
+        void get_counts(const HashIntoType *, size_t,
+                        BoundedCounterType *) const
+        uint64_t add_hashes(const HashIntoType *, size_t) except +oxli_raise_py_error
+        void save(string) except +oxli_raise_py_error
         void load(string) except +oxli_raise_py_error
-        uint32_t consume_string(const string &)
+        CpStorageSnapshot * save_snapshot(string) except +oxli_raise_py_error
+        void update_from(const CpHashtable &, unsigned int) except +oxli_raise_py_error
+        void update_from_file(string, unsigned int) except +oxli_raise_py_error
+        uint32_t consume_string(const string &) except +oxli_raise_py_error
         bool check_and_normalize_read(string &) const
         uint32_t check_and_process_read(string &, bool &)
 
@@ -79,29 +124,51 @@ cdef extern from "oxli/hashtable.hh" namespace "oxli" nogil:
 
         void set_use_bigcount(bool) except +ValueError
         bool get_use_bigcount()
-        bool median_at_least(const string &, uint32_t cutoff)
+        void set_conservative_update(bool) except +ValueError
+        bool get_conservative_update()
+        void set_write_combining(bool)
+        bool get_write_combining()
+        bool median_at_least(const string &, uint32_t cutoff) except +oxli_raise_py_error
         void get_median_count(const string &, BoundedCounterType &,
                               float &, float &) except +oxli_raise_py_error
+        void coverage_profile[SeqIO](shared_ptr[CpReadParser[SeqIO]]&,
+                                     unsigned int,
+                                     vector[CpReadCoverage]&,
+                                     uint64_t) except +oxli_raise_py_error
+        void trim_seqfile_on_abundance[SeqIO](shared_ptr[CpReadParser[SeqIO]]&,
+                                              CpFastxWriter&,
+                                              BoundedCounterType, bool,
+                                              unsigned int, bool, unsigned int,
+                                              unsigned int&,
+                                              unsigned int&) except +oxli_raise_py_error
         const uint64_t n_unique_kmers() const
         const uint64_t n_occupied() const
         vector[uint64_t] get_tablesizes() const
         const uintptr_t n_tables() const
-        void get_kmers(const string &, vector[string] &)
-        void get_kmer_hashes(const string &, vector[HashIntoType] &) const
+        void get_kmers(const string &, vector[string] &) except +oxli_raise_py_error
+        void get_kmer_hashes(const string &,
+                             vector[HashIntoType] &) except +oxli_raise_py_error
         void get_kmer_hashes_as_hashset(const string &,
                                         set[HashIntoType]) const
         void get_kmer_counts(const string &,
-                             vector[BoundedCounterType] &) const
+                             vector[BoundedCounterType] &) except +oxli_raise_py_error
+        size_t get_kmer_counts(const string &,
+                               BoundedCounterType *) except +oxli_raise_py_error
+        void hash_sequences(const vector[string] &, vector[HashIntoType] &,
+                            vector[uint64_t] &) except +oxli_raise_py_error
         uint8_t ** get_raw_tables()
-        BoundedCounterType get_min_count(const string &)
-        BoundedCounterType get_max_count(const string &)
+        BoundedCounterType get_min_count(const string &) except +oxli_raise_py_error
+        BoundedCounterType get_max_count(const string &) except +oxli_raise_py_error
         uint64_t * abundance_distribution[SeqIO](string, CpHashtable *) except +oxli_raise_py_error
         uint64_t * abundance_distribution[SeqIO](shared_ptr[CpReadParser[SeqIO]]&,
                                           CpHashtable *) except +oxli_raise_py_error
-        uint64_t trim_on_abundance(string, BoundedCounterType) const
-        uint64_t trim_below_abundance(string, BoundedCounterType) const
+        void abundance_distribution[SeqIO](shared_ptr[CpReadParser[SeqIO]]&,
+                                           unsigned int,
+                                           vector[uint64_t]&) except +oxli_raise_py_error
+        uint64_t trim_on_abundance(string, BoundedCounterType) except +oxli_raise_py_error
+        uint64_t trim_below_abundance(string, BoundedCounterType) except +oxli_raise_py_error
         vector[uint32_t] find_spectral_error_positions(string,
-                                                       BoundedCounterType)
+                                                       BoundedCounterType) except +oxli_raise_py_error
 
     cdef cppclass CpMurmurHashtable "oxli::MurmurHashtable" (CpHashtable):
         CpMurmurHashtable(WordLength, CpStorage *)
@@ -125,6 +192,65 @@ cdef extern from "oxli/hashtable.hh" namespace "oxli" nogil:
         CpQFCounttable(WordLength, uint64_t) except +oxli_raise_py_error
 
 
+cdef extern from "oxli/exact_counter.hh" namespace "oxli" nogil:
+    cdef uint64_t EXACT_SORT_CHUNK "EXACT_SORT_CHUNK"
+
+    cdef cppclass CpExactCounttable "oxli::ExactCounttable" (CpMurmurHashtable):
+        CpExactCounttable(WordLength)
+        void abundance_distribution(vector[uint64_t] &)
+
+    cdef cppclass CpExactCountBuilder "oxli::ExactCountBuilder":
+        CpExactCountBuilder(WordLength, const string &, unsigned int,
+                            unsigned int, uint64_t) except +oxli_raise_py_error
+        void consume_seqfile[SeqIO](shared_ptr[CpReadParser[SeqIO]]&) except +oxli_raise_py_error
+        uint64_t write(const string &) except +oxli_raise_py_error
+        uint64_t n_reads()
+        uint64_t n_kmers()
+
+
+cdef extern from "oxli/graph_bundle.hh":
+    cdef uint8_t BUNDLE_TABLE
+    cdef uint8_t BUNDLE_TAGS
+    cdef uint8_t BUNDLE_STOP_TAGS
+    cdef uint8_t BUNDLE_PARTITION_MAP
+    cdef uint8_t BUNDLE_LABELS
+
+cdef extern from "oxli/graph_bundle.hh" namespace "oxli" nogil:
+    cdef struct CpBundleSection "oxli::BundleSection":
+        uint8_t type
+        bool compressed
+        uint32_t crc
+        uint64_t offset
+        uint64_t stored_length
+        uint64_t length
+
+    cdef cppclass CpGraphBundle "oxli::GraphBundle":
+        CpGraphBundle(const string &) except +oxli_raise_py_error
+        @staticmethod
+        bool is_bundle(const string &)
+        vector[CpBundleSection] sections() const
+        bool has_section(uint8_t) const
+        void extract_section(uint8_t, const string &) except +oxli_raise_py_error
+        string section_header(uint8_t, size_t) except +oxli_raise_py_error
+        void load_table(CpHashtable &) except +oxli_raise_py_error
+        void load_tagset(CpHashgraph &, bool) except +oxli_raise_py_error
+        void load_stop_tags(CpHashgraph &, bool) except +oxli_raise_py_error
+        void load_partitionmap(CpSubsetPartition &) except +oxli_raise_py_error
+        void load_labels(CpLabelHash &) except +oxli_raise_py_error
+        @staticmethod
+        void write(const string &, const vector[pair[uint8_t, string]] &,
+                   bool) except +oxli_raise_py_error
+
+
+cdef extern from "oxli/query_server.hh" namespace "oxli" nogil:
+    cdef cppclass CpQueryServer "oxli::QueryServer":
+        CpQueryServer(const CpHashtable&, const string&,
+                      unsigned int) except +oxli_raise_py_error
+        void serve() except +oxli_raise_py_error
+        void stop()
+        const string& socket_path() const
+
+
 cdef extern from "oxli/hashgraph.hh" namespace "oxli" nogil:
     cdef cppclass CpHashgraph "oxli::Hashgraph" (CpHashtable):
         set[HashIntoType] all_tags
@@ -202,8 +328,12 @@ cdef extern from "oxli/hashgraph.hh" namespace "oxli" nogil:
 
     cdef cppclass CpNodegraph "oxli::Nodegraph" (CpHashgraph):
         CpNodegraph(WordLength, vector[uint64_t])
+        double estimated_fp_rate() const
+        unsigned int n_slices() const
 
-        void update_from(const CpNodegraph &) except +oxli_raise_py_error
+    cdef cppclass CpScalableNodegraph "oxli::ScalableNodegraph" (CpNodegraph):
+        CpScalableNodegraph(WordLength, vector[uint64_t],
+                            double) except +oxli_raise_py_error
 
 
 cdef extern from "oxli/labelhash.hh" namespace "oxli":
@@ -244,6 +374,14 @@ cdef extern from "oxli/labelhash.hh" namespace "oxli":
                                              const Label)
 
 
+cdef class TableAllocation:
+    cdef CpTableAllocPolicy _policy
+
+
+cdef class Snapshot:
+    cdef unique_ptr[CpStorageSnapshot] _this
+
+
 cdef class Hashtable:
     cdef shared_ptr[CpHashtable] _ht_this
 
@@ -253,6 +391,8 @@ cdef class Hashtable:
     cdef bytes _valid_sequence(self, str sequence)
     cdef CpKmer _build_kmer(self, object kmer) except *
     cdef FastxParserPtr _get_parser(self, object parser_or_filename) except *
+    cdef tuple _coverage_chunk(self, object parser, int n_threads,
+                               uint64_t max_reads)
     cdef list _get_raw_tables(self, uint8_t **, vector[uint64_t])
 
 
@@ -260,6 +400,14 @@ cdef class QFCounttable(Hashtable):
     cdef shared_ptr[CpQFCounttable] _qf_this
 
 
+cdef class ExactCounttable(Hashtable):
+    cdef shared_ptr[CpExactCounttable] _et_this
+
+
+cdef class ExactCountBuilder:
+    cdef unique_ptr[CpExactCountBuilder] _this
+
+
 cdef class SmallCounttable(Hashtable):
     cdef shared_ptr[CpSmallCounttable] _st_this
 
@@ -288,9 +436,25 @@ cdef class Nodegraph(Hashgraph):
     cdef shared_ptr[CpNodegraph] _ng_this
 
 
+cdef class ScalableNodegraph(Nodegraph):
+    cdef shared_ptr[CpScalableNodegraph] _sng_this
+
+
 cdef class Countgraph(Hashgraph):
     cdef shared_ptr[CpCountgraph] _cg_this
 
 
 cdef class SmallCountgraph(Hashgraph):
     cdef shared_ptr[CpSmallCountgraph] _sg_this
+
+
+cdef class GraphBundle:
+    cdef unique_ptr[CpGraphBundle] _this
+    cdef readonly str filename
+    cdef object _graph
+    cdef object _loaded
+
+
+cdef class QueryServer:
+    cdef unique_ptr[CpQueryServer] _this
+    cdef readonly Hashtable table
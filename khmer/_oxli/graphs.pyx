@@ -1,9 +1,14 @@
+from array import array
 from math import log
+import os
+import tempfile
 
 from cython.operator cimport dereference as deref
+from cpython cimport array as carray
 from cpython.buffer cimport (PyBuffer_FillInfo, PyBUF_FULL_RO)
-from libc.stdint cimport uint64_t
+from libc.stdint cimport uint8_t, uint64_t
 from libc.stdint cimport uintptr_t as size_t
+from libc.string cimport memcpy
 
 from libcpp.memory cimport shared_ptr, make_shared
 from libcpp.vector cimport vector
@@ -14,11 +19,15 @@ from khmer._oxli.utils cimport _bstring, is_str, is_num
 from khmer._oxli.utils import get_n_primes_near_x
 from khmer._oxli.parsing cimport (CpFastxReader, CPyReadParser_Object,
                                   get_parser, CpReadParser, FastxParser,
-                                  FastxParserPtr)
+                                  FastxParserPtr, CpFastxWriter,
+                                  _fastx_compression)
 from khmer._oxli.hashset cimport HashSet
 from khmer._oxli.legacy_partitioning cimport (CpSubsetPartition, SubsetPartition,
                                    cp_pre_partition_info, PrePartitionInfo)
-from khmer._oxli.oxli_types cimport MAX_BIGCOUNT, HashIntoType
+from khmer._oxli.oxli_types cimport (MAX_BIGCOUNT, HashIntoType,
+                                      SAVED_COUNTING_HT, SAVED_HASHBITS,
+                                      SAVED_SMALLCOUNT,
+                                      SAVED_SCALABLE_HASHBITS)
 from khmer._oxli.traversal cimport Traverser
 
 from khmer._khmer import ReadParser
@@ -28,6 +37,123 @@ CYTHON_TABLES = (Hashtable, Nodetable, Counttable, CyclicCounttable,
                  QFCounttable, Nodegraph, Countgraph, SmallCountgraph)
 
 
+cdef carray.array _COUNTS_TEMPLATE = array('H')
+cdef carray.array _HASHES_TEMPLATE = array('Q')
+
+
+cdef carray.array _array_from_vector(const void * values, size_t n):
+    cdef carray.array result = carray.clone(_HASHES_TEMPLATE, n, False)
+    if n:
+        memcpy(result.data.as_ulonglongs, values, n * sizeof(uint64_t))
+    return result
+
+
+cdef enum _ReadOp:
+    READ_OP_CONSUME
+    READ_OP_MIN_COUNT
+    READ_OP_MAX_COUNT
+    READ_OP_MEDIAN_COUNT
+    READ_OP_MEDIAN_AT_LEAST
+    READ_OP_TRIM_ON_ABUNDANCE
+    READ_OP_TRIM_BELOW_ABUNDANCE
+
+
+_READ_OPS = {'consume': READ_OP_CONSUME,
+             'get_min_count': READ_OP_MIN_COUNT,
+             'get_max_count': READ_OP_MAX_COUNT,
+             'get_median_count': READ_OP_MEDIAN_COUNT,
+             'median_at_least': READ_OP_MEDIAN_AT_LEAST,
+             'trim_on_abundance': READ_OP_TRIM_ON_ABUNDANCE,
+             'trim_below_abundance': READ_OP_TRIM_BELOW_ABUNDANCE}
+
+
+_TABLE_PAGES = {'default': TABLE_PAGES_DEFAULT,
+                'huge': TABLE_PAGES_HUGE,
+                'huge-1g': TABLE_PAGES_HUGE_1G}
+
+
+cdef class TableAllocation:
+    """How the counter tables of a graph or table are allocated.
+
+    pages is 'default' for the heap, 'huge' for transparent huge pages or
+    'huge-1g' for 1 GB hugetlbfs pages (falling back to 'huge' when none are
+    reserved). numa_interleave spreads each table round-robin over all NUMA
+    nodes. n_threads threads zero new tables; 0 means the OpenMP default.
+    Tables smaller than a huge page always come from the heap.
+    """
+
+    def __cinit__(self, pages='default', numa_interleave=False,
+                  unsigned int n_threads=1):
+        if pages not in _TABLE_PAGES:
+            raise ValueError("pages must be one of {}, not {!r}".format(
+                             ", ".join(sorted(_TABLE_PAGES)), pages))
+        self._policy.pages = _TABLE_PAGES[pages]
+        self._policy.numa_interleave = numa_interleave
+        self._policy.n_threads = n_threads
+
+    @property
+    def pages(self):
+        for name, value in _TABLE_PAGES.items():
+            if value == self._policy.pages:
+                return name
+
+    @property
+    def numa_interleave(self):
+        return self._policy.numa_interleave
+
+    @property
+    def n_threads(self):
+        return self._policy.n_threads
+
+    def __repr__(self):
+        return ("TableAllocation(pages={!r}, numa_interleave={}, "
+                "n_threads={})".format(self.pages, self.numa_interleave,
+                                       self.n_threads))
+
+
+cdef CpTableAllocScope * _alloc_scope(TableAllocation alloc):
+    if alloc is None:
+        return NULL
+    return new CpTableAllocScope(alloc._policy)
+
+
+def set_table_allocation(pages='default', numa_interleave=False,
+                         n_threads=1):
+    """Set how tables created without an explicit alloc are allocated."""
+    cdef TableAllocation alloc = TableAllocation(pages, numa_interleave,
+                                                 n_threads)
+    CpTableAllocator.set_default_policy(alloc._policy)
+
+
+def get_table_allocation():
+    """Return the TableAllocation used for tables created without alloc."""
+    cdef TableAllocation alloc = TableAllocation()
+    alloc._policy = CpTableAllocator.get_default_policy()
+    return alloc
+
+
+cdef class Snapshot:
+    """A table image being saved in the background by a child process.
+
+    Returned by `Hashtable.save_snapshot`; the table may keep changing while
+    the image is written. The file appears under its final name only once it
+    is complete.
+    """
+
+    @property
+    def filename(self):
+        return deref(self._this).filename()
+
+    def is_done(self):
+        """Return True once the snapshot has finished, successfully or not."""
+        return deref(self._this).is_done()
+
+    def wait(self):
+        """Block until the snapshot is written; raise OSError on failure."""
+        with nogil:
+            deref(self._this).wait()
+
+
 cdef class Hashtable:
 
     cpdef bytes sanitize_seq_kmer(self, object kmer):
@@ -142,77 +268,305 @@ cdef class Hashtable:
 
     def get_kmers(self, str sequence):
         """Generate an ordered list of all k-mers in sequence."""
-        cdef bytes data = self._valid_sequence(sequence)
+        cdef string data = self._valid_sequence(sequence)
         cdef vector[string] kmers
-        deref(self._ht_this).get_kmers(data, kmers)
+        with nogil:
+            deref(self._ht_this).get_kmers(data, kmers)
         return kmers
 
     def consume(self, str sequence):
         """Increment the counts of all of the k-mers in the sequence."""
-        cdef bytes data = self._valid_sequence(sequence)
-        return deref(self._ht_this).consume_string(data)
+        cdef string data = self._valid_sequence(sequence)
+        cdef uint32_t n_consumed
+        with nogil:
+            n_consumed = deref(self._ht_this).consume_string(data)
+        return n_consumed
 
     def get_kmer_counts(self, str sequence):
         """Retrieve an ordered list of the counts of all k-mers in sequence."""
-        cdef bytes data = self._valid_sequence(sequence)
+        cdef string data = self._valid_sequence(sequence)
         cdef vector[BoundedCounterType] counts
-        deref(self._ht_this).get_kmer_counts(data, counts)
+        with nogil:
+            deref(self._ht_this).get_kmer_counts(data, counts)
         return counts
 
     def get_min_count(self, str sequence):
         """Get the smallest count of all the k-mers in the string."""
-        cdef bytes data = self._valid_sequence(sequence)
-        return deref(self._ht_this).get_min_count(data)
+        cdef string data = self._valid_sequence(sequence)
+        cdef BoundedCounterType count
+        with nogil:
+            count = deref(self._ht_this).get_min_count(data)
+        return count
 
     def get_max_count(self, str sequence):
         """Get the larget count of all the k-mers in the string."""
-        cdef bytes data = self._valid_sequence(sequence)
-        return deref(self._ht_this).get_max_count(data)
+        cdef string data = self._valid_sequence(sequence)
+        cdef BoundedCounterType count
+        with nogil:
+            count = deref(self._ht_this).get_max_count(data)
+        return count
 
     def get_median_count(self, str sequence):
         """median, average, and stddev of the k-mer counts in sequence."""
-        cdef bytes data = self._valid_sequence(sequence)
+        cdef string data = self._valid_sequence(sequence)
         cdef BoundedCounterType med = 0
         cdef float average = 0
         cdef float stddev = 0
 
-        deref(self._ht_this).get_median_count(data, med, average, stddev)
+        with nogil:
+            deref(self._ht_this).get_median_count(data, med, average, stddev)
         return (med, average, stddev)
 
+    def coverage_profile(self, object parser_or_filename, int n_threads=1,
+                         uint64_t chunk_size=100000):
+        """median, average, and stddev of the k-mer counts in each read.
+
+        Returns an iterator over (name, median, average, stddev, length)
+        tuples in input order, computed on n_threads threads. Reads are
+        profiled chunk_size at a time, so memory use does not grow with the
+        input. Reads shorter than k are skipped; non-ACGT bases count as A.
+        """
+        if chunk_size == 0:
+            raise ValueError("chunk_size must be > 0")
+        if is_str(parser_or_filename):
+            parser_or_filename = FastxParser(parser_or_filename)
+        # check the argument now rather than on the first row
+        self._get_parser(parser_or_filename)
+        return self._iter_coverage(parser_or_filename, n_threads, chunk_size)
+
+    def _iter_coverage(self, parser, int n_threads, uint64_t chunk_size):
+        complete = False
+        while not complete:
+            rows, complete = self._coverage_chunk(parser, n_threads,
+                                                  chunk_size)
+            for row in rows:
+                yield row
+
+    cdef tuple _coverage_chunk(self, object parser, int n_threads,
+                               uint64_t max_reads):
+        cdef FastxParserPtr _parser = self._get_parser(parser)
+        cdef vector[CpReadCoverage] profile
+        with nogil:
+            deref(self._ht_this).coverage_profile[CpFastxReader](\
+                _parser, n_threads, profile, max_reads
+            )
+
+        rows = [(c.name, c.median, c.average, c.stddev, c.length)
+                for c in profile]
+        return rows, deref(_parser).is_complete()
+
+    def trim_seqfile_on_abundance(self, object parser_or_filename,
+                                  str output_filename, int cutoff,
+                                  bool variable_coverage=False,
+                                  int normalize_to=20, bool paired=False,
+                                  int n_threads=1, compression=None,
+                                  bool append=False):
+        """Trim reads at the first k-mer below cutoff, writing the survivors.
+
+        Reads are processed on n_threads threads and written to
+        output_filename ('-' for stdout) in input order; compression may be
+        None, 'gzip' or 'bzip2'. See trim_on_abundance and median_at_least
+        for the trimming and variable_coverage rules. With paired, reads
+        must come in pairs and a pair is kept only if both mates are.
+
+        Returns (total reads, reads kept).
+        """
+        cdef uint8_t _compression = _fastx_compression(compression)
+        cdef FastxParserPtr _parser = self._get_parser(parser_or_filename)
+        cdef CpFastxWriter * writer = new CpFastxWriter(
+            _bstring(output_filename), _compression, append)
+        cdef unsigned int total_reads = 0
+        cdef unsigned int n_kept = 0
+        try:
+            with nogil:
+                deref(self._ht_this).trim_seqfile_on_abundance[CpFastxReader](\
+                    _parser, deref(writer), cutoff, variable_coverage,
+                    normalize_to, paired, n_threads, total_reads, n_kept
+                )
+            writer.close()
+        finally:
+            del writer
+
+        return total_reads, n_kept
+
     def median_at_least(self, str sequence, int median):
         '''Check if median k-mer count is at least the given value.'''
-        cdef bytes data = self._valid_sequence(sequence)
-        return <bool>deref(self._ht_this).median_at_least(data, median)
+        cdef string data = self._valid_sequence(sequence)
+        cdef bool at_least
+        with nogil:
+            at_least = deref(self._ht_this).median_at_least(data, median)
+        return at_least
 
     def get_kmer_hashes(self, str sequence):
         """Retrieve hashes of all k-mers in sequence.
 
         Hashes are returned in the same order as k-mers appear in sequence.
         """
-        cdef bytes data = self._valid_sequence(sequence)
+        cdef string data = self._valid_sequence(sequence)
         cdef vector[HashIntoType] hashes
-        deref(self._ht_this).get_kmer_hashes(data, hashes)
+        with nogil:
+            deref(self._ht_this).get_kmer_hashes(data, hashes)
         return hashes
 
+    # Batch methods: k-mer hashes and counts go in and out as contiguous
+    # buffers of uint64 and uint16 values, such as array.array('Q') and
+    # array.array('H') or numpy arrays of those types, and the work happens
+    # without the GIL.
+
+    def get_counts(self, const HashIntoType[::1] hashes):
+        """Retrieve the counts of many k-mer hashes at once.
+
+        Returns an array.array('H') of counts in the order of hashes.
+        """
+        cdef size_t n = hashes.shape[0]
+        cdef carray.array counts = carray.clone(_COUNTS_TEMPLATE, n, False)
+        if n:
+            with nogil:
+                deref(self._ht_this).get_counts(
+                    &hashes[0], n, <BoundedCounterType *>counts.data.as_ushorts)
+        return counts
+
+    def add_hashes(self, const HashIntoType[::1] hashes):
+        """Increment the counts of many k-mer hashes at once.
+
+        Returns the number of k-mers not seen before.
+        """
+        cdef size_t n = hashes.shape[0]
+        cdef uint64_t n_new = 0
+        if n:
+            with nogil:
+                n_new = deref(self._ht_this).add_hashes(&hashes[0], n)
+        return n_new
+
+    def hash_sequences(self, sequences):
+        """Hash the k-mers of many sequences into one flat array.
+
+        Returns (hashes, offsets), two array.array('Q'); the k-mer hashes of
+        sequences[i] are hashes[offsets[i]:offsets[i + 1]]. Sequences shorter
+        than k have no k-mers.
+        """
+        cdef vector[string] _sequences
+        for sequence in sequences:
+            _sequences.push_back(_bstring(sequence))
+        cdef vector[HashIntoType] _hashes
+        cdef vector[uint64_t] _offsets
+        with nogil:
+            deref(self._ht_this).hash_sequences(_sequences, _hashes, _offsets)
+        return (_array_from_vector(_hashes.data(), _hashes.size()),
+                _array_from_vector(_offsets.data(), _offsets.size()))
+
+    def get_kmer_counts_into(self, str sequence,
+                             BoundedCounterType[::1] out):
+        """Write the counts of all k-mers in sequence into out.
+
+        out must have room for len(sequence) - k + 1 counts; returns the
+        number of counts written.
+        """
+        cdef string data = self._valid_sequence(sequence)
+        cdef size_t n_kmers = data.length() - self.ksize() + 1
+        if <size_t>out.shape[0] < n_kmers:
+            raise ValueError("output buffer holds {} counts but sequence "
+                             "has {} k-mers".format(out.shape[0], n_kmers))
+        with nogil:
+            n_kmers = deref(self._ht_this).get_kmer_counts(data, &out[0])
+        return n_kmers
+
     def trim_on_abundance(self, str sequence, int abundance):
         """Trim sequence at first k-mer below the given abundance."""
-        cdef bytes data = self._valid_sequence(sequence)
-        trimmed_at = deref(self._ht_this).trim_on_abundance(data, abundance)
+        cdef string data = self._valid_sequence(sequence)
+        cdef uint64_t trimmed_at
+        with nogil:
+            trimmed_at = deref(self._ht_this).trim_on_abundance(data, abundance)
         return sequence[:trimmed_at], trimmed_at
 
     def trim_below_abundance(self, str sequence, int abundance):
         """Trim sequence at first k-mer above the given abundance."""
-        cdef bytes data = self._valid_sequence(sequence)
-        cdef int trimmed_at = deref(self._ht_this).trim_below_abundance(data, abundance)
+        cdef string data = self._valid_sequence(sequence)
+        cdef uint64_t trimmed_at
+        with nogil:
+            trimmed_at = deref(self._ht_this).trim_below_abundance(data, abundance)
         return sequence[:trimmed_at], trimmed_at
 
     def find_spectral_error_positions(self, str sequence, int max_count):
         """Identify positions of low-abundance k-mers."""
-        cdef bytes data = self._valid_sequence(sequence)
-        posns = (deref(self._ht_this).find_spectral_error_positions(data,
-                                                                   max_count))
+        cdef string data = self._valid_sequence(sequence)
+        cdef vector[uint32_t] posns
+        with nogil:
+            posns = deref(self._ht_this).find_spectral_error_positions(
+                data, max_count)
         return posns
 
+    def process_reads(self, reads, str op, int param=0):
+        """Apply one of the per-read methods to many reads at once.
+
+        op names the method: 'consume', 'get_min_count', 'get_max_count',
+        'get_median_count', 'median_at_least', 'trim_on_abundance' or
+        'trim_below_abundance'; param is its count argument, where it takes
+        one. Reads are validated up front, then processed in a single pass
+        without the GIL, so several Python threads can share a table. The
+        Bloom filter and CountMin tables update their counters atomically;
+        QFCounttable serializes inserts on a lock, while lookups from several
+        threads still run side by side.
+
+        Returns a list with what the method returns for each read.
+        """
+        if op not in _READ_OPS:
+            raise ValueError("unknown read operation {!r}; expected one "
+                             "of {}".format(op, ', '.join(sorted(_READ_OPS))))
+        cdef _ReadOp _op = _READ_OPS[op]
+        reads = list(reads)
+        cdef vector[string] _reads
+        _reads.reserve(len(reads))
+        for read in reads:
+            _reads.push_back(self._valid_sequence(read))
+
+        cdef size_t n = _reads.size()
+        cdef size_t i
+        cdef vector[uint64_t] values = vector[uint64_t](n)
+        cdef vector[float] averages
+        cdef vector[float] stddevs
+        cdef BoundedCounterType med
+        cdef float average, stddev
+        if _op == READ_OP_MEDIAN_COUNT:
+            averages.resize(n)
+            stddevs.resize(n)
+
+        with nogil:
+            for i in range(n):
+                if _op == READ_OP_CONSUME:
+                    values[i] = deref(self._ht_this).consume_string(_reads[i])
+                elif _op == READ_OP_MIN_COUNT:
+                    values[i] = deref(self._ht_this).get_min_count(_reads[i])
+                elif _op == READ_OP_MAX_COUNT:
+                    values[i] = deref(self._ht_this).get_max_count(_reads[i])
+                elif _op == READ_OP_MEDIAN_COUNT:
+                    med = 0
+                    average = 0
+                    stddev = 0
+                    deref(self._ht_this).get_median_count(
+                        _reads[i], med, average, stddev)
+                    values[i] = med
+                    averages[i] = average
+                    stddevs[i] = stddev
+                elif _op == READ_OP_MEDIAN_AT_LEAST:
+                    values[i] = deref(self._ht_this).median_at_least(
+                        _reads[i], param)
+                elif _op == READ_OP_TRIM_ON_ABUNDANCE:
+                    values[i] = deref(self._ht_this).trim_on_abundance(
+                        _reads[i], param)
+                else:
+                    values[i] = deref(self._ht_this).trim_below_abundance(
+                        _reads[i], param)
+
+        if _op == READ_OP_MEDIAN_COUNT:
+            return [(values[i], averages[i], stddevs[i]) for i in range(n)]
+        elif _op == READ_OP_MEDIAN_AT_LEAST:
+            return [values[i] != 0 for i in range(n)]
+        elif _op in (READ_OP_TRIM_ON_ABUNDANCE, READ_OP_TRIM_BELOW_ABUNDANCE):
+            return [(read[:values[i]], values[i])
+                    for i, read in enumerate(reads)]
+        return [values[i] for i in range(n)]
+
     cdef FastxParserPtr _get_parser(self, object parser_or_filename) except *:
         cdef FastxParserPtr _parser
         if isinstance(parser_or_filename, FastxParser):
@@ -280,18 +634,31 @@ cdef class Hashtable:
         return total_reads, n_consumed
 
     def abundance_distribution(self, object parser_or_filename,
-                               Hashtable tracking):
-        """Calculate the k-mer abundance distribution over input reads."""
+                               Hashtable tracking=None, int n_threads=1):
+        """Calculate the k-mer abundance distribution over input reads.
+
+        Without a tracking table, distinct k-mers are found exactly on
+        n_threads threads rather than through tracking's Bloom filter.
+        """
         cdef FastxParserPtr _parser = self._get_parser(parser_or_filename)
-        cdef CpHashtable * _tracking = tracking._ht_this.get()
+        cdef CpHashtable * _tracking
         cdef uint64_t * x
+        cdef vector[uint64_t] dist
+        if tracking is None:
+            with nogil:
+                deref(self._ht_this).abundance_distribution[CpFastxReader](\
+                    _parser, n_threads, dist
+                )
+            return [dist[i] for i in range(MAX_BIGCOUNT + 1)]
+
+        _tracking = tracking._ht_this.get()
         with nogil:
             x = deref(self._ht_this).abundance_distribution[CpFastxReader](\
                 _parser, _tracking
             )
 
         abunds = []
-        for i in range(MAX_BIGCOUNT):
+        for i in range(MAX_BIGCOUNT + 1):
             abunds.append(x[i])
         return abunds
 
@@ -299,10 +666,42 @@ cdef class Hashtable:
         """Save the graph to the specified file."""
         deref(self._ht_this).save(_bstring(file_name))
 
+    def save_snapshot(self, file_name):
+        """Save a point-in-time image of the table in the background.
+
+        Returns a `Snapshot` at once; k-mers may keep being added while it is
+        written. Call `wait()` on it before relying on the file.
+        """
+        cdef Snapshot snapshot = Snapshot()
+        snapshot._this.reset(deref(self._ht_this).save_snapshot(
+            _bstring(file_name)))
+        return snapshot
+
+    def update(self, Hashtable other, n_threads=1):
+        """Add the counts of another table of the same type and sizes.
+
+        Counts saturate at the table's maximum; presence tables are unioned.
+        """
+        cdef CpHashtable * _other = other._ht_this.get()
+        cdef unsigned int _n_threads = n_threads
+        with nogil:
+            deref(self._ht_this).update_from(deref(_other), _n_threads)
+
+    def update_from_file(self, file_name, n_threads=1):
+        """Add the counts of a saved table of the same type and sizes.
+
+        The file is streamed rather than loaded whole; only supported for
+        Countgraph and Counttable.
+        """
+        cdef string _file_name = _bstring(file_name)
+        cdef unsigned int _n_threads = n_threads
+        with nogil:
+            deref(self._ht_this).update_from_file(_file_name, _n_threads)
+
     @classmethod
-    def load(cls, file_name):
+    def load(cls, file_name, TableAllocation alloc=None):
         """Load the graph from the specified file."""
-        cdef Hashtable table = cls(1, 1, 1)
+        cdef Hashtable table = cls(1, 1, 1, alloc=alloc)
         deref(table._ht_this).load(_bstring(file_name))
         return table
 
@@ -324,6 +723,27 @@ cdef class Hashtable:
     def get_use_bigcount(self):
         return deref(self._ht_this).get_use_bigcount()
 
+    def set_conservative_update(self, conservative):
+        """Only increment the counters of a k-mer that hold its current
+        count.
+
+        Counts are still never underestimated, but k-mers sharing counters
+        with more abundant ones are overcounted less, so smaller tables
+        reach the same accuracy. The setting is saved with the table.
+        """
+        deref(self._ht_this).set_conservative_update(<bool>conservative)
+
+    def get_conservative_update(self):
+        return deref(self._ht_this).get_conservative_update()
+
+    def set_write_combining(self, write_combining):
+        """Buffer the k-mers of consume_seqfile in each thread and add them
+        in batches that walk the tables in address order."""
+        deref(self._ht_this).set_write_combining(<bool>write_combining)
+
+    def get_write_combining(self):
+        return deref(self._ht_this).get_write_combining()
+
     def get_kmer_hashes_as_hashset(self, str sequence):
         cdef HashSet hashes = HashSet(self.ksize())
         deref(self._ht_this).get_kmer_hashes_as_hashset(_bstring(sequence),
@@ -389,52 +809,189 @@ cdef class QFCounttable(Hashtable):
         deref(table._qf_this).load(_bstring(file_name))
         return table
 
+cdef class ExactCounttable(Hashtable):
+    """Exact k-mer counts, read from a count file made by ExactCountBuilder.
+
+    K-mers are hashed as in Counttable. The table is read-only: methods that
+    add k-mers raise an error. The count file is memory mapped rather than
+    read in, so loading is quick and lookups only read the parts of the file
+    they need. Counts saturate at 65535.
+
+    Parameters
+    ----------
+    k : integer
+        k-mer size
+    """
+
+    def __cinit__(self, int k):
+        if type(self) is ExactCounttable:
+            self._et_this = make_shared[CpExactCounttable](k)
+            self._ht_this = <shared_ptr[CpHashtable]>self._et_this
+
+    @classmethod
+    def load(cls, file_name):
+        """Load the counts from the specified file."""
+        cdef ExactCounttable table = cls(1)
+        deref(table._et_this).load(_bstring(file_name))
+        return table
+
+    def estimated_fp_rate(self):
+        """Counts are exact, so there are no false positives."""
+        return 0.0
+
+    def abundance_distribution(self, object parser_or_filename=None,
+                               Hashtable tracking=None, int n_threads=1):
+        """Calculate the k-mer abundance distribution.
+
+        Without input reads, the distribution is that of all k-mers in the
+        table, taken straight from their counts.
+        """
+        if parser_or_filename is not None:
+            return Hashtable.abundance_distribution(self, parser_or_filename,
+                                                    tracking, n_threads)
+        cdef vector[uint64_t] dist
+        with nogil:
+            deref(self._et_this).abundance_distribution(dist)
+        return [dist[i] for i in range(MAX_BIGCOUNT + 1)]
+
+
+cdef class ExactCountBuilder:
+    """Count k-mers exactly, spilling them to disk rather than memory.
+
+    consume_seqfile hashes the k-mers of reads and spreads them over
+    n_buckets temporary files under tmpdir (by default the system temporary
+    directory), with repeats counted in per-thread buffers first; write then
+    sorts and counts the buckets on n_threads threads and makes a count file
+    for ExactCounttable. Buckets are sorted sort_chunk (hash, count) pairs
+    at a time and merged on disk, so memory use is about n_threads *
+    sort_chunk * 16 bytes however large or repetitive the input.
+
+    Parameters
+    ----------
+    ksize : integer
+        k-mer size
+    """
+
+    def __cinit__(self, int ksize, tmpdir=None, int n_buckets=64,
+                  int n_threads=1, uint64_t sort_chunk=EXACT_SORT_CHUNK):
+        if n_buckets < 1:
+            raise ValueError("n_buckets must be at least 1")
+        if tmpdir is None:
+            tmpdir = tempfile.gettempdir()
+        self._this.reset(new CpExactCountBuilder(ksize, _bstring(tmpdir),
+                                                 n_buckets, n_threads,
+                                                 sort_chunk))
+
+    def consume_seqfile(self, object parser_or_filename):
+        """Add the k-mers of a file or parser of reads.
+
+        Returns (number of reads, number of k-mers) taken from it.
+        """
+        cdef FastxParserPtr _parser
+        if isinstance(parser_or_filename, FastxParser):
+            _parser = (<FastxParser>parser_or_filename)._this
+        elif isinstance(parser_or_filename, ReadParser):
+            _parser = (<CPyReadParser_Object*>parser_or_filename).parser
+        elif is_str(parser_or_filename):
+            _parser = get_parser[CpFastxReader](_bstring(parser_or_filename))
+        else:
+            raise TypeError('argument does not appear to be a parser or a '
+                            'filename: {}'.format(parser_or_filename))
+
+        cdef uint64_t n_reads = deref(self._this).n_reads()
+        cdef uint64_t n_kmers = deref(self._this).n_kmers()
+        with nogil:
+            deref(self._this).consume_seqfile[CpFastxReader](_parser)
+        return (deref(self._this).n_reads() - n_reads,
+                deref(self._this).n_kmers() - n_kmers)
+
+    def write(self, str output_filename):
+        """Write the count file; returns the number of distinct k-mers.
+
+        No more reads can be added afterwards.
+        """
+        cdef string _filename = _bstring(output_filename)
+        cdef uint64_t n_distinct
+        with nogil:
+            n_distinct = deref(self._this).write(_filename)
+        return n_distinct
+
+    def n_reads(self):
+        """Number of reads consumed."""
+        return deref(self._this).n_reads()
+
+    def n_kmers(self):
+        """Number of k-mers consumed, counting repeats."""
+        return deref(self._this).n_kmers()
+
+
 cdef class Counttable(Hashtable):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None,
+                  bool conservative=False):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is Counttable:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._ct_this = make_shared[CpCounttable](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._ct_this = make_shared[CpCounttable](k, _primes)
+            finally:
+                del scope
             self._ht_this = <shared_ptr[CpHashtable]>self._ct_this
+            if conservative:
+                deref(self._ht_this).set_conservative_update(True)
 
 
 cdef class CyclicCounttable(Hashtable):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is CyclicCounttable:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._cct_this = make_shared[CpCyclicCounttable](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._cct_this = make_shared[CpCyclicCounttable](k, _primes)
+            finally:
+                del scope
             self._ht_this = <shared_ptr[CpHashtable]>self._cct_this
 
 
 cdef class SmallCounttable(Hashtable):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None,
+                  bool conservative=False):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is SmallCounttable:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._st_this = make_shared[CpSmallCounttable](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._st_this = make_shared[CpSmallCounttable](k, _primes)
+            finally:
+                del scope
             self._ht_this = <shared_ptr[CpHashtable]>self._st_this
+            if conservative:
+                deref(self._ht_this).set_conservative_update(True)
 
     def get_raw_tables(self):
         cdef uint8_t ** table_ptrs = deref(self._st_this).get_raw_tables()
@@ -447,16 +1004,21 @@ cdef class SmallCounttable(Hashtable):
 cdef class Nodetable(Hashtable):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is Nodetable:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._nt_this = make_shared[CpNodetable](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._nt_this = make_shared[CpNodetable](k, _primes)
+            finally:
+                del scope
             self._ht_this = <shared_ptr[CpHashtable]>self._nt_this
 
 
@@ -695,13 +1257,36 @@ cdef class Hashgraph(Hashtable):
         return pi
 
     def output_partitions(self, str filename, str output, bool
-                                output_unassigned=False):
+                                output_unassigned=False, int n_threads=1):
         '''Write out sequences in given filename to another file, annotating '''
         '''with partition IDs.'''
-        n_partitions = deref(deref(self._hg_this).partition).\
-                            output_partitioned_file(_bstring(filename),
-                                                    _bstring(output),
-                                                    output_unassigned)
+        cdef string _filename = _bstring(filename)
+        cdef string _output = _bstring(output)
+        cdef size_t n_partitions
+        with nogil:
+            n_partitions = deref(deref(self._hg_this).partition).\
+                            output_partitioned_file(_filename, _output,
+                                                    output_unassigned,
+                                                    <CallbackFn>NULL, NULL,
+                                                    n_threads)
+        return n_partitions
+
+    def output_partitions_multi(self, list filenames, list outputs,
+                                bool output_unassigned=False,
+                                int n_threads=1):
+        '''As output_partitions, for several files at once.
+
+        With at least n_threads files, the files are annotated
+        concurrently; otherwise one after the other, each on all threads.
+        Returns the partition count for each file.
+        '''
+        cdef vector[string] _filenames = [_bstring(f) for f in filenames]
+        cdef vector[string] _outputs = [_bstring(f) for f in outputs]
+        cdef vector[size_t] n_partitions
+        with nogil:
+            deref(deref(self._hg_this).partition).\
+                output_partitioned_files(_filenames, _outputs, n_partitions,
+                                         output_unassigned, n_threads)
         return n_partitions
 
     def load_partitionmap(self, str filename):
@@ -773,6 +1358,34 @@ cdef class Hashgraph(Hashtable):
                                               deref(counts._cg_this))
         return next_largest
 
+    def find_knots(self, Countgraph counts not None,
+                         unsigned int distance,
+                         unsigned int threshold,
+                         unsigned int frequency,
+                         SubsetPartition subs=None,
+                         unsigned int n_threads=1):
+        '''Find highly connected k-mers in the largest partition.
+
+        Traverses from the tags of the largest partition on n_threads
+        threads, and adds k-mers in knots to the stop tags; the partition
+        map is left as it is. Returns the number of new stop tags.
+        '''
+
+        cdef shared_ptr[CpSubsetPartition] subs_ptr
+        if subs is None:
+            subs_ptr = deref(self._hg_this).partition
+        else:
+            subs_ptr = subs._this
+
+        cdef unsigned long long n_stop_tags
+        with nogil:
+            n_stop_tags = deref(subs_ptr).\
+                find_knots_in_largest_partition(distance, threshold,
+                                                frequency,
+                                                deref(counts._cg_this),
+                                                n_threads)
+        return n_stop_tags
+
     def load_stop_tags(self, object filename, clear_tags=False):
         '''Load the set of stop tags.'''
         deref(self._hg_this).load_stop_tags(_bstring(filename), clear_tags)
@@ -817,18 +1430,26 @@ cdef class Hashgraph(Hashtable):
 cdef class Countgraph(Hashgraph):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None,
+                  bool conservative=False):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is Countgraph:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._cg_this = make_shared[CpCountgraph](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._cg_this = make_shared[CpCountgraph](k, _primes)
+            finally:
+                del scope
             self._hg_this = <shared_ptr[CpHashgraph]>self._cg_this
             self._ht_this = <shared_ptr[CpHashtable]>self._hg_this
+            if conservative:
+                deref(self._ht_this).set_conservative_update(True)
 
     def do_subset_partition_with_abundance(self, BoundedCounterType min_count,
                                                  BoundedCounterType max_count,
@@ -858,18 +1479,26 @@ cdef class Countgraph(Hashgraph):
 cdef class SmallCountgraph(Hashgraph):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, TableAllocation alloc=None,
+                  bool conservative=False):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is SmallCountgraph:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._sg_this = make_shared[CpSmallCountgraph](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._sg_this = make_shared[CpSmallCountgraph](k, _primes)
+            finally:
+                del scope
             self._hg_this = <shared_ptr[CpHashgraph]>self._sg_this
             self._ht_this = <shared_ptr[CpHashtable]>self._hg_this
+            if conservative:
+                deref(self._ht_this).set_conservative_update(True)
 
     def get_raw_tables(self):
         cdef uint8_t ** table_ptrs = deref(self._sg_this).get_raw_tables()
@@ -883,18 +1512,282 @@ cdef class SmallCountgraph(Hashgraph):
 cdef class Nodegraph(Hashgraph):
 
     def __cinit__(self, int k, uint64_t starting_size, int n_tables,
-                  primes=None):
+                  primes=None, alloc=None, *args, **kwargs):
         if primes is None:
             primes = list()
         cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
         if type(self) is Nodegraph:
             if primes:
                 _primes = primes
             else:
                 _primes = get_n_primes_near_x(n_tables, starting_size)
-            self._ng_this = make_shared[CpNodegraph](k, _primes)
+            scope = _alloc_scope(alloc)
+            try:
+                self._ng_this = make_shared[CpNodegraph](k, _primes)
+            finally:
+                del scope
             self._hg_this = <shared_ptr[CpHashgraph]>self._ng_this
             self._ht_this = <shared_ptr[CpHashtable]>self._hg_this
 
-    def update(self, Nodegraph other):
-        deref(self._ng_this).update_from(deref(other._ng_this))
+    def estimated_fp_rate(self):
+        """False positive rate implied by the current table occupancy."""
+        return deref(self._ng_this).estimated_fp_rate()
+
+    def n_slices(self):
+        """Number of Bloom filter slices; more than one only for a
+        ScalableNodegraph, or a graph loaded from one's file."""
+        return deref(self._ng_this).n_slices()
+
+
+cdef class ScalableNodegraph(Nodegraph):
+    """A Nodegraph that grows as k-mers are added.
+
+    Instead of fixing the table size up front, a new, twice as large Bloom
+    filter slice is added whenever the current one fills up, so memory use
+    follows the number of distinct k-mers while the false positive rate of
+    all slices together stays below fp_rate. starting_size and n_tables
+    size the first slice; each later slice has one more table.
+    """
+
+    def __cinit__(self, int k, uint64_t starting_size, int n_tables,
+                  double fp_rate=0.01, primes=None,
+                  TableAllocation alloc=None):
+        if primes is None:
+            primes = list()
+        cdef vector[uint64_t] _primes
+        cdef CpTableAllocScope * scope
+        if not 0 < fp_rate < 1:
+            raise ValueError("fp_rate must be between 0 and 1")
+        if type(self) is ScalableNodegraph:
+            if primes:
+                _primes = primes
+            else:
+                _primes = get_n_primes_near_x(n_tables, starting_size)
+            scope = _alloc_scope(alloc)
+            try:
+                self._sng_this = make_shared[CpScalableNodegraph](k, _primes,
+                                                                  fp_rate)
+            finally:
+                del scope
+            self._ng_this = <shared_ptr[CpNodegraph]>self._sng_this
+            self._hg_this = <shared_ptr[CpHashgraph]>self._ng_this
+            self._ht_this = <shared_ptr[CpHashtable]>self._hg_this
+
+
+# section names of a GraphBundle, in the order they are written
+_BUNDLE_SECTIONS = [('table', BUNDLE_TABLE), ('tagset', BUNDLE_TAGS),
+                    ('stoptags', BUNDLE_STOP_TAGS),
+                    ('partitionmap', BUNDLE_PARTITION_MAP),
+                    ('labels', BUNDLE_LABELS)]
+
+
+cdef class GraphBundle:
+    """A graph with its tags, stop tags, partition map and labels in one file.
+
+    Each section is one of the files save, save_tagset, save_stop_tags,
+    save_partitionmap and save_labels_and_tags would write, stored deflated
+    or as is, with its length and crc32. Opening a bundle only reads the
+    section directory; the graph and each other section are read, and their
+    checksums checked, the first time they are asked for, so a script only
+    pays for the sections it uses.
+
+    Parameters
+    ----------
+    filename : str
+        bundle written by `GraphBundle.write`
+    """
+
+    def __cinit__(self, str filename):
+        self._this.reset(new CpGraphBundle(_bstring(filename)))
+        self.filename = filename
+        self._graph = None
+        self._loaded = []
+
+    @staticmethod
+    def is_bundle(str filename):
+        """True if filename is a graph bundle."""
+        return CpGraphBundle.is_bundle(_bstring(filename))
+
+    @staticmethod
+    def write(str filename, Hashgraph graph not None, tagset=True,
+              stop_tags=True, partitionmap=False, labels=None,
+              compress=True):
+        """Save graph and the chosen sections to a bundle.
+
+        Tags and stop tags are only saved if the graph has any. labels is a
+        GraphLabels on graph; its labels are saved along with their tags.
+        """
+        cdef vector[pair[uint8_t, string]] sections
+        cdef pair[uint8_t, string] section
+        cdef string _filename = _bstring(filename)
+        cdef bool _compress = compress
+        cdef CpHashgraph * ptr = graph._hg_this.get()
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            savers = [('table', BUNDLE_TABLE, graph.save)]
+            if tagset and deref(ptr).n_tags() > 0:
+                savers.append(('tagset', BUNDLE_TAGS, graph.save_tagset))
+            if stop_tags and deref(ptr).stop_tags.size() > 0:
+                savers.append(('stoptags', BUNDLE_STOP_TAGS,
+                               graph.save_stop_tags))
+            if partitionmap:
+                savers.append(('partitionmap', BUNDLE_PARTITION_MAP,
+                               graph.save_partitionmap))
+            if labels is not None:
+                if labels.graph is not graph:
+                    raise ValueError("labels must be on the bundled graph")
+                savers.append(('labels', BUNDLE_LABELS,
+                               labels.save_labels_and_tags))
+
+            for name, stype, save in savers:
+                path = os.path.join(tmpdir, name)
+                save(path)
+                section.first = stype
+                section.second = _bstring(path)
+                sections.push_back(section)
+
+            with nogil:
+                CpGraphBundle.write(_filename, sections, _compress)
+
+    def sections(self):
+        """Names of the sections in the bundle."""
+        cdef set[uint8_t] present
+        cdef CpBundleSection sec
+        for sec in deref(self._this).sections():
+            present.insert(sec.type)
+        return [name for name, stype in _BUNDLE_SECTIONS
+                if present.count(stype)]
+
+    def __contains__(self, str name):
+        return deref(self._this).has_section(self._section_type(name))
+
+    def section_info(self, str name):
+        """Return (compressed, stored length, length, crc32) of a section."""
+        cdef uint8_t stype = self._section_type(name)
+        cdef CpBundleSection sec
+        for sec in deref(self._this).sections():
+            if sec.type == stype:
+                return (sec.compressed, sec.stored_length, sec.length,
+                        sec.crc)
+        raise KeyError(name)
+
+    def _section_type(self, str name):
+        for sname, stype in _BUNDLE_SECTIONS:
+            if sname == name:
+                return stype
+        raise ValueError("unknown graph bundle section: {}".format(name))
+
+    def _check_section(self, str name):
+        if name not in self:
+            raise KeyError("graph bundle {} has no {} section".format(
+                self.filename, name))
+
+    @property
+    def graph(self):
+        """The graph, loaded on first use."""
+        if self._graph is not None:
+            return self._graph
+        self._check_section('table')
+        header = deref(self._this).section_header(BUNDLE_TABLE, 6)
+        if len(header) < 6:
+            raise OSError("graph bundle {} has a truncated table".format(
+                self.filename))
+        ht_type = header[5]
+        if ht_type == SAVED_HASHBITS:
+            cls = Nodegraph
+        elif ht_type == SAVED_COUNTING_HT:
+            cls = Countgraph
+        elif ht_type == SAVED_SMALLCOUNT:
+            cls = SmallCountgraph
+        elif ht_type == SAVED_SCALABLE_HASHBITS:
+            cls = ScalableNodegraph
+        else:
+            raise ValueError("graph bundle {} holds a table of unknown type "
+                             "{}".format(self.filename, ht_type))
+        cdef Hashgraph graph = cls(1, 1, 1)
+        cdef CpHashgraph * ptr = graph._hg_this.get()
+        with nogil:
+            deref(self._this).load_table(deref(ptr))
+        self._graph = graph
+        return graph
+
+    def _needs_loading(self, str name, Hashgraph graph):
+        # sections only need loading into the bundle's own graph once
+        return graph is not self._graph or name not in self._loaded
+
+    def _mark_loaded(self, str name, Hashgraph graph):
+        if graph is self._graph:
+            self._loaded.append(name)
+
+    def load_tagset(self, Hashgraph graph=None):
+        """Load the tags into graph, by default the bundled graph."""
+        self._check_section('tagset')
+        if graph is None:
+            graph = self.graph
+        if self._needs_loading('tagset', graph):
+            deref(self._this).load_tagset(deref(graph._hg_this), True)
+            self._mark_loaded('tagset', graph)
+        return graph
+
+    def load_stop_tags(self, Hashgraph graph=None):
+        """Load the stop tags into graph, by default the bundled graph."""
+        self._check_section('stoptags')
+        if graph is None:
+            graph = self.graph
+        if self._needs_loading('stoptags', graph):
+            deref(self._this).load_stop_tags(deref(graph._hg_this), False)
+            self._mark_loaded('stoptags', graph)
+        return graph
+
+    def load_partitionmap(self, Hashgraph graph=None):
+        """Load the partition map into graph, by default the bundled graph.
+
+        The partition map does not need the graph's k-mers, so e.g.
+        `Nodegraph(bundle_ksize, 1, 1)` will do.
+        """
+        self._check_section('partitionmap')
+        if graph is None:
+            graph = self.graph
+        if self._needs_loading('partitionmap', graph):
+            deref(self._this).load_partitionmap(
+                deref(deref(graph._hg_this).partition))
+            self._mark_loaded('partitionmap', graph)
+        return graph
+
+    def load_labels(self, Hashgraph graph=None):
+        """Return a GraphLabels on graph, by default the bundled graph, with
+        the bundled labels and their tags."""
+        from khmer._oxli.labeling import GraphLabels
+        self._check_section('labels')
+        if graph is None:
+            graph = self.graph
+        return GraphLabels._load_bundled(self, graph)
+
+
+cdef class QueryServer:
+    """Serve batched k-mer queries on a table over a Unix domain socket.
+
+    The table is only read, so one loaded table can answer any number of
+    clients; see `khmer.query_client.QueryClient`. Each connection is
+    handled by one of n_threads workers.
+    """
+
+    def __cinit__(self, Hashtable table, socket_path, n_threads=1):
+        self.table = table
+        self._this.reset(new CpQueryServer(deref(table._ht_this),
+                                           _bstring(socket_path), n_threads))
+
+    @property
+    def socket_path(self):
+        return deref(self._this).socket_path()
+
+    def serve(self):
+        """Answer queries until `stop()` is called or a client asks the
+        server to shut down."""
+        with nogil:
+            deref(self._this).serve()
+
+    def stop(self):
+        """Make `serve()` return; safe to call from another thread."""
+        deref(self._this).stop()
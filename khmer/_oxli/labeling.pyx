@@ -1,7 +1,8 @@
 from cython.operator cimport dereference as deref
 from libcpp.memory cimport make_shared, shared_ptr
 
-from khmer._oxli.graphs cimport Nodegraph, Hashgraph
+from khmer._oxli.graphs cimport Nodegraph, Hashgraph, GraphBundle
+from khmer._oxli.graphs cimport CpLabelHash as CpBundleLabelHash
 from khmer._oxli.hashset cimport HashSet
 from khmer._oxli.utils cimport _bstring
 from khmer._oxli.utils import get_n_primes_near_x
@@ -140,6 +141,14 @@ cdef class GraphLabels:
         deref(gl._lh_this).load_labels_and_tags(_bstring(filename))
         return gl
 
+    @staticmethod
+    def _load_bundled(GraphBundle bundle, Hashgraph graph):
+        # the bundle declares LabelHash on its own side of the cimports
+        cdef GraphLabels gl = GraphLabels(graph)
+        cdef CpBundleLabelHash * lh = <CpBundleLabelHash *> gl._lh_this.get()
+        deref(bundle._this).load_labels(deref(lh))
+        return gl
+
     @staticmethod
     def NodeGraphLabels(int k, uint64_t starting_size, int n_tables, primes=[]):
         cdef vector[uint64_t] _primes
@@ -1,8 +1,9 @@
 from libcpp cimport bool
 from libcpp.string cimport string
 from libcpp.set cimport set
-from libcpp.memory cimport shared_ptr, weak_ptr
-from libc.stdint cimport uintptr_t as size_t
+from libcpp.vector cimport vector
+from libcpp.memory cimport shared_ptr, weak_ptr, unique_ptr
+from libc.stdint cimport uintptr_t as size_t, uint8_t, uint64_t
 
 from khmer._oxli.oxli_types cimport *
 from khmer._oxli.hashing cimport CpKmer
@@ -65,6 +66,17 @@ cdef extern from "oxli/subset.hh" nogil:
         size_t output_partitioned_file(string &, 
                                        string &, 
                                        bool) except +oxli_raise_py_error
+        size_t output_partitioned_file(string &,
+                                       string &,
+                                       bool,
+                                       CallbackFn,
+                                       void *,
+                                       unsigned int) except +oxli_raise_py_error
+        void output_partitioned_files(vector[string] &,
+                                      vector[string] &,
+                                      vector[size_t] &,
+                                      bool,
+                                      unsigned int) except +oxli_raise_py_error
 
         void partition_sizes(PartitionCountMap&, unsigned int &) const
         void partition_size_distribution(PartitionCountDistribution &,
@@ -76,10 +88,42 @@ cdef extern from "oxli/subset.hh" nogil:
                                                          unsigned int,
                                                          CpCountgraph&)
         void repartition_a_partition(const HashIntoTypeSet &) except +oxli_raise_py_error
+        void largest_partition_tags(HashIntoTypeSet &) except +oxli_raise_py_error
+        unsigned long long find_knots(const HashIntoTypeSet &,
+                                      unsigned int,
+                                      unsigned int,
+                                      unsigned int,
+                                      CpCountgraph&,
+                                      unsigned int) except +oxli_raise_py_error
+        unsigned long long find_knots_in_largest_partition(unsigned int,
+                                                           unsigned int,
+                                                           unsigned int,
+                                                           CpCountgraph&,
+                                                           unsigned int) except +oxli_raise_py_error
         void _clear_partition(PartitionID, HashIntoTypeSet &)
         void _merge_other(HashIntoType, PartitionID, PartitionPtrMap &)
         void report_on_partitions()
         
+cdef extern from "oxli/partition_extractor.hh" nogil:
+    cdef unsigned int PARTITION_EXTRACT_BUCKETS
+    cdef uint64_t PARTITION_EXTRACT_SORT_BUDGET
+
+    cdef cppclass CpPartitionExtractor "oxli::PartitionExtractor":
+        CpPartitionExtractor(const string&, const string&, uint64_t, uint64_t,
+                             uint8_t, unsigned int,
+                             uint64_t) except +oxli_raise_py_error
+
+        void consume(const vector[string]&, bool, bool) except +oxli_raise_py_error
+        void write_distribution(const string&) except +oxli_raise_py_error
+        unsigned int develop_groups()
+        void output_groups(unsigned int) except +oxli_raise_py_error
+
+        unsigned int n_groups() const
+        uint64_t total_seqs() const
+        uint64_t part_seqs() const
+        uint64_t toosmall_parts() const
+        uint64_t n_unassigned() const
+
 cdef class PrePartitionInfo:
     cdef shared_ptr[cp_pre_partition_info] _this
     @staticmethod
@@ -90,3 +134,7 @@ cdef class PrePartitionInfo:
 
 cdef class SubsetPartition:
     cdef shared_ptr[CpSubsetPartition] _this
+
+
+cdef class PartitionExtractor:
+    cdef unique_ptr[CpPartitionExtractor] _this
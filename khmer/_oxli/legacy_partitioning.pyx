@@ -3,6 +3,7 @@ from cython.operator cimport dereference as deref
 from libcpp.memory cimport make_shared
 
 from khmer._oxli.utils cimport _bstring
+from khmer._oxli.parsing cimport _fastx_compression
 from khmer._oxli.graphs cimport CpHashgraph, CpCountgraph, Hashgraph, Countgraph
 
 cdef class PrePartitionInfo:
@@ -87,3 +88,63 @@ cdef class SubsetPartition:
 
     def _validate_partitionmap(self):
         deref(self._this)._validate_pmap()
+
+
+cdef class PartitionExtractor:
+    '''Split partition-annotated reads into group files by partition size.
+
+    Reads are spilled to bucket files next to the output while they are
+    counted, so memory use does not grow with the input. Each thread sorts
+    at most sort_budget bytes of reads in memory at a time. Group files are
+    named <prefix>.groupNNNN.<suffix>; compression may be None, 'gzip' or
+    'bzip2'.
+    '''
+
+    def __cinit__(self, str prefix, str suffix='fa', int min_size=5,
+                  int max_size=1000000, compression=None,
+                  int n_buckets=PARTITION_EXTRACT_BUCKETS,
+                  uint64_t sort_budget=PARTITION_EXTRACT_SORT_BUDGET):
+        self._this.reset(new CpPartitionExtractor(
+            _bstring(prefix), _bstring(suffix), min_size, max_size,
+            _fastx_compression(compression), n_buckets, sort_budget))
+
+    def consume(self, list filenames, bool output_unassigned=False,
+                bool spill_reads=True):
+        '''Count reads per partition, spilling reads for output_groups.'''
+        cdef vector[string] _filenames = [_bstring(f) for f in filenames]
+        with nogil:
+            deref(self._this).consume(_filenames, output_unassigned,
+                                      spill_reads)
+
+    def write_distribution(self, str filename):
+        '''Write the partition size distribution to filename.'''
+        deref(self._this).write_distribution(_bstring(filename))
+
+    def develop_groups(self):
+        '''Assign partitions to groups; returns the number of groups.'''
+        return deref(self._this).develop_groups()
+
+    def output_groups(self, int n_threads=1):
+        '''Write out the group files.'''
+        with nogil:
+            deref(self._this).output_groups(n_threads)
+
+    @property
+    def n_groups(self):
+        return deref(self._this).n_groups()
+
+    @property
+    def total_seqs(self):
+        return deref(self._this).total_seqs()
+
+    @property
+    def part_seqs(self):
+        return deref(self._this).part_seqs()
+
+    @property
+    def toosmall_parts(self):
+        return deref(self._this).toosmall_parts()
+
+    @property
+    def n_unassigned(self):
+        return deref(self._this).n_unassigned()
@@ -7,6 +7,10 @@ from libcpp.string cimport string
 
 cdef extern from "oxli/oxli.hh":
     cdef int MAX_BIGCOUNT
+    cdef int SAVED_COUNTING_HT
+    cdef int SAVED_HASHBITS
+    cdef int SAVED_SMALLCOUNT
+    cdef int SAVED_SCALABLE_HASHBITS
 
 cdef extern from "oxli/oxli.hh" namespace "oxli":
     ctypedef unsigned long long int HashIntoType
@@ -1,12 +1,13 @@
 # -*- coding: UTF-8 -*-
 
 
-from libc.stdint cimport uintptr_t
+from libc.stdint cimport uintptr_t, uint8_t, uint64_t
 
 from libcpp cimport bool
 from libcpp.memory cimport unique_ptr, shared_ptr, weak_ptr
 from libcpp.utility cimport pair
 from libcpp.string cimport string
+from libcpp.vector cimport vector
 
 from khmer._oxli.utils cimport oxli_raise_py_error
 
@@ -63,6 +64,8 @@ cdef extern from  "oxli/read_parsers.hh" namespace "oxli::read_parsers":
         CpSequence get_next_read()
         CpSequencePair get_next_read_pair()
         CpSequencePair get_next_read_pair(uint8_t)
+        size_t get_next_read_pairs(vector[CpSequencePair]&, size_t,
+                                   uint8_t) except +oxli_raise_py_error
 
         uintptr_t get_num_reads()
         bool is_complete()
@@ -84,11 +87,78 @@ cdef extern from  "oxli/read_parsers.hh" namespace "oxli::read_parsers":
         void close()
 
 
+    cdef cppclass CpFastxWriter "oxli::read_parsers::FastxWriter":
+        CpFastxWriter(const string&) except +oxli_raise_py_error
+        CpFastxWriter(const string&, uint8_t, bool) except +oxli_raise_py_error
+
+        void write(const string&) except +oxli_raise_py_error
+        void write(const CpSequence&) except +oxli_raise_py_error
+        void close() except +oxli_raise_py_error
+
+    cdef uint8_t FASTX_COMPRESSION_NONE "oxli::read_parsers::FastxWriter::COMPRESSION_NONE"
+    cdef uint8_t FASTX_COMPRESSION_GZIP "oxli::read_parsers::FastxWriter::COMPRESSION_GZIP"
+    cdef uint8_t FASTX_COMPRESSION_BZIP2 "oxli::read_parsers::FastxWriter::COMPRESSION_BZIP2"
+
+    cdef uint8_t PAIR_MODE_IGNORE_UNPAIRED "oxli::read_parsers::ReadParser<oxli::read_parsers::FastxReader>::PAIR_MODE_IGNORE_UNPAIRED"
+    cdef uint8_t PAIR_MODE_ERROR_ON_UNPAIRED "oxli::read_parsers::ReadParser<oxli::read_parsers::FastxReader>::PAIR_MODE_ERROR_ON_UNPAIRED"
+
+    bool cp_check_is_pair "oxli::read_parsers::check_is_pair" (const string&,
+                                                                const string&)
+    bool cp_check_is_left "oxli::read_parsers::check_is_left" (const string&)
+    bool cp_check_is_right "oxli::read_parsers::check_is_right" (const string&)
+
     shared_ptr[CpReadParser[SeqIO]] get_parser[SeqIO](const string&) except +oxli_raise_py_error
     ctypedef shared_ptr[CpReadParser[CpFastxReader]] FastxParserPtr
     ctypedef weak_ptr[CpReadParser[CpFastxReader]] WeakFastxParserPtr
 
 
+cdef extern from "oxli/reservoir_sampler.hh":
+    cdef uint64_t SAMPLE_RANGE_SIZE
+
+
+cdef extern from "oxli/reservoir_sampler.hh" namespace "oxli::read_parsers" nogil:
+    cdef cppclass CpReservoirSampler "oxli::read_parsers::ReservoirSampler":
+        CpReservoirSampler(uint64_t, unsigned int, bool, uint64_t, uint64_t,
+                           uint64_t) except +oxli_raise_py_error
+
+        void sample(const vector[string]&,
+                    unsigned int) except +oxli_raise_py_error
+        uint64_t n_units() const
+        uint64_t n_reads() const
+        size_t n_ranges() const
+        size_t sample_length() const
+        string get_unit(unsigned int, size_t) except +oxli_raise_py_error
+        uint64_t write_sample(unsigned int,
+                              CpFastxWriter&) except +oxli_raise_py_error
+
+
+cdef extern from "oxli/fastx_scanner.hh" namespace "oxli::read_parsers" nogil:
+    void cp_fastx_stats "oxli::read_parsers::fastx_stats" (
+        const string&, uint64_t&, uint64_t&) except +oxli_raise_py_error
+
+    cdef cppclass CpFastxFilter "oxli::read_parsers::FastxFilter":
+        CpFastxFilter(const string&, size_t, bool,
+                      bool) except +oxli_raise_py_error
+
+        bool fill(string&) except +oxli_raise_py_error
+        uint64_t n_read() const
+        uint64_t n_written() const
+
+    cdef cppclass CpFastxInterleaver "oxli::read_parsers::FastxInterleaver":
+        CpFastxInterleaver(const string&, const string&,
+                           bool) except +oxli_raise_py_error
+
+        bool fill(string&) except +oxli_raise_py_error
+        uint64_t n_pairs() const
+
+    cdef cppclass CpFastxPairSplitter "oxli::read_parsers::FastxPairSplitter":
+        CpFastxPairSplitter(const string&, bool) except +oxli_raise_py_error
+
+        bool fill(string&, string&, string&) except +oxli_raise_py_error
+        uint64_t n_pairs() const
+        uint64_t n_orphans() const
+
+
 cdef extern from "khmer/_cpy_khmer.hh":
     ctypedef struct CPyReadParser_Object "khmer::khmer_ReadParser_Object":
         FastxParserPtr parser
@@ -128,6 +198,7 @@ cdef class FastxParser:
 
     cpdef bool is_complete(self)
     cdef Sequence _next(self)
+    cdef list _next_pairs(self, size_t n, uint8_t mode)
 
 
 cdef class SanitizedFastxParser(FastxParser):
@@ -137,6 +208,7 @@ cdef class SanitizedFastxParser(FastxParser):
 
     cpdef bool is_complete(self)
     cdef Sequence _next(self)
+    cdef list _next_pairs(self, size_t n, uint8_t mode)
 
 
 cdef class SplitPairedReader:
@@ -160,6 +232,22 @@ cdef class BrokenPairedReader:
     cdef tuple _next(self)
 
 
+cdef class ReservoirSampler:
+    cdef unique_ptr[CpReservoirSampler] _this
+
+
+cdef class FastxFilter:
+    cdef unique_ptr[CpFastxFilter] _this
+
+
+cdef class FastxInterleaver:
+    cdef unique_ptr[CpFastxInterleaver] _this
+
+
+cdef class FastxPairSplitter:
+    cdef unique_ptr[CpFastxPairSplitter] _this
+
+
 cpdef tuple _split_left_right(unicode s)
 
 cdef tuple _cppstring_split_left_right(string& s)
@@ -175,3 +263,5 @@ cdef inline bool is_valid(const char base, string& alphabet)
 cdef inline bool sanitize_sequence(string& sequence,
                                    string& alphabet,
                                    bool convert_n)
+
+cdef uint8_t _fastx_compression(object compression) except 255
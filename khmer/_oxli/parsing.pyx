@@ -3,9 +3,12 @@
 
 from cython.operator cimport dereference as deref
 cimport cython
+from cpython.bytes cimport PyBytes_FromStringAndSize
 from libcpp cimport bool
 from libcpp.string cimport string
+from libcpp.vector cimport vector
 
+import random
 import sys
 
 from khmer._oxli.utils cimport _bstring, _ustring
@@ -164,6 +167,17 @@ class UnpairedReadsError(ValueError):
         self.read2 = r2
 
 
+cdef uint8_t _fastx_compression(object compression) except 255:
+    '''FastxWriter compression mode for None, 'gzip' or 'bzip2'.'''
+    if compression is None:
+        return FASTX_COMPRESSION_NONE
+    elif compression == 'gzip':
+        return FASTX_COMPRESSION_GZIP
+    elif compression == 'bzip2':
+        return FASTX_COMPRESSION_BZIP2
+    raise ValueError('unknown compression: {}'.format(compression))
+
+
 cdef inline bool is_valid(const char base, string& alphabet):
     cdef char b
     for b in alphabet:
@@ -205,6 +219,31 @@ cdef class FastxParser:
             seq = self._next()
             yield seq
 
+    cdef list _next_pairs(self, size_t n, uint8_t mode):
+        cdef vector[CpSequencePair] pairs
+        deref(self._this).get_next_read_pairs(pairs, n, mode)
+        return [(Sequence._wrap(p.first), Sequence._wrap(p.second))
+                for p in pairs]
+
+    def iter_read_pairs(self, bool ignore_unpaired=False,
+                        size_t batch_size=1000):
+        '''Iterate over (first, second) pairs of reads, named as
+        check_is_pair expects. Reads that are not part of a pair raise a
+        ValueError, or are skipped if ignore_unpaired is set. Pairs are read
+        batch_size at a time.'''
+        cdef uint8_t mode = PAIR_MODE_ERROR_ON_UNPAIRED
+        if ignore_unpaired:
+            mode = PAIR_MODE_IGNORE_UNPAIRED
+        cdef list pairs
+        while True:
+            # a batch cut short by a bad pair raises on the next call, even
+            # when the bad pair ends the input
+            pairs = self._next_pairs(batch_size, mode)
+            if not pairs and self.is_complete():
+                break
+            for read_pair in pairs:
+                yield read_pair
+
 
 cdef class SanitizedFastxParser(FastxParser):
 
@@ -238,6 +277,19 @@ cdef class SanitizedFastxParser(FastxParser):
             if seq is not None:
                 yield seq
 
+    cdef list _next_pairs(self, size_t n, uint8_t mode):
+        cdef list pairs = []
+        cdef Sequence first, second
+        for first, second in FastxParser._next_pairs(self, n, mode):
+            if sanitize_sequence(first._obj.sequence, self._alphabet,
+                                 self.convert_n) and \
+               sanitize_sequence(second._obj.sequence, self._alphabet,
+                                 self.convert_n):
+                pairs.append((first, second))
+            else:
+                self.n_bad += 1
+        return pairs
+
 
 cdef class SplitPairedReader:
 
@@ -406,6 +458,177 @@ cdef class BrokenPairedReader:
             return 1, first, second, None
 
 
+cdef class ReservoirSampler:
+    '''Uniform random samples of reads from FASTA/FASTQ files.
+
+    Keeps n_samples independent samples of up to sample_size units, where a
+    unit is a read or, unless force_single is set, an interleaved pair as
+    broken_paired_reader would find it. Only the first max_units units (0
+    for all) are sampled from. Uncompressed files are split into ranges of
+    about range_size bytes that are sampled in parallel; samples depend on
+    the seed and range_size, but not on the number of threads. A random
+    seed is used if none is given.
+    '''
+
+    def __cinit__(self, sample_size, unsigned int n_samples=1,
+                  bool force_single=False, max_units=0, seed=None,
+                  range_size=SAMPLE_RANGE_SIZE):
+        if seed is None:
+            seed = random.getrandbits(64)
+        self._this.reset(new CpReservoirSampler(
+            sample_size, n_samples, force_single, max_units,
+            seed & 0xffffffffffffffff, range_size))
+
+    def sample(self, filenames, unsigned int n_threads=1):
+        '''Sample from the files, replacing any earlier samples.'''
+        cdef vector[string] _filenames = [_bstring(f) for f in filenames]
+        with nogil:
+            deref(self._this).sample(_filenames, n_threads)
+
+    @property
+    def n_units(self):
+        return deref(self._this).n_units()
+
+    @property
+    def n_reads(self):
+        return deref(self._this).n_reads()
+
+    @property
+    def n_ranges(self):
+        return deref(self._this).n_ranges()
+
+    def __len__(self):
+        return deref(self._this).sample_length()
+
+    def get_sample(self, unsigned int sample=0):
+        '''The raw FASTA/FASTQ text of each unit of a sample.'''
+        return [deref(self._this).get_unit(sample, i)
+                for i in range(deref(self._this).sample_length())]
+
+    def write_sample(self, unsigned int sample, str filename,
+                     compression=None):
+        '''Write a sample to filename ("-" for stdout); compression may be
+        None, 'gzip' or 'bzip2'. Returns the number of reads written.'''
+        cdef unique_ptr[CpFastxWriter] writer
+        writer.reset(new CpFastxWriter(_bstring(filename),
+                                       _fastx_compression(compression),
+                                       False))
+        n_reads = deref(self._this).write_sample(sample, deref(writer))
+        deref(writer).close()
+        return n_reads
+
+
+cdef _write_text(fileobj, const string& text):
+    '''Write text to a binary or a text file object, as write_record does.'''
+    if text.empty():
+        return
+    data = PyBytes_FromStringAndSize(text.data(), text.size())
+    try:
+        fileobj.write(data)
+    except TypeError:
+        fileobj.write(data.decode('ascii'))
+
+
+def fastx_stats(str filename):
+    '''The number of records and of bases in a FASTA/FASTQ file.'''
+    cdef string _filename = _bstring(filename)
+    cdef uint64_t n_records = 0, n_bases = 0
+    with nogil:
+        cp_fastx_stats(_filename, n_records, n_bases)
+    return n_records, n_bases
+
+
+cdef class FastxFilter:
+    '''Copy the records of a FASTA/FASTQ file that have at least min_length
+    bases, leaving out those with an 'N' if drop_n is set, and writing FASTQ
+    as FASTA if to_fasta is set. Records are written as write_record does.
+    '''
+
+    def __cinit__(self, str filename, size_t min_length=0,
+                  bool drop_n=False, bool to_fasta=False):
+        self._this.reset(new CpFastxFilter(_bstring(filename), min_length,
+                                           drop_n, to_fasta))
+
+    def write_to(self, fileobj):
+        '''Write the records kept to a binary or a text file object.'''
+        cdef string text
+        cdef bool more = True
+        while more:
+            with nogil:
+                more = deref(self._this).fill(text)
+            _write_text(fileobj, text)
+            text.clear()
+
+    @property
+    def n_read(self):
+        return deref(self._this).n_read()
+
+    @property
+    def n_written(self):
+        return deref(self._this).n_written()
+
+
+cdef class FastxInterleaver:
+    '''Interleave the records of a file of left reads with those of a file
+    of right reads. Unless reformat is False, names get a '/1' or '/2' if
+    they don't already say which side they are, and each two records must
+    look like a pair; a ValueError is raised if they don't, or if the files
+    hold different numbers of records.
+    '''
+
+    def __cinit__(self, str left, str right, bool reformat=True):
+        self._this.reset(new CpFastxInterleaver(_bstring(left),
+                                                _bstring(right), reformat))
+
+    def write_to(self, fileobj):
+        '''Write the interleaved records to a binary or text file object.'''
+        cdef string text
+        cdef bool more = True
+        while more:
+            with nogil:
+                more = deref(self._this).fill(text)
+            _write_text(fileobj, text)
+            text.clear()
+
+    @property
+    def n_pairs(self):
+        return deref(self._this).n_pairs()
+
+
+cdef class FastxPairSplitter:
+    '''Split interleaved reads into left and right reads, finding pairs as
+    broken_paired_reader does. Reads without a mate are orphans; unless
+    allow_orphans is set, they raise a ValueError.
+    '''
+
+    def __cinit__(self, str filename, bool allow_orphans=False):
+        self._this.reset(new CpFastxPairSplitter(_bstring(filename),
+                                                 allow_orphans))
+
+    def write_to(self, left, right, orphans=None):
+        '''Write left and right reads, and any orphans, to file objects.'''
+        cdef string text1, text2, text0
+        cdef bool more = True
+        while more:
+            with nogil:
+                more = deref(self._this).fill(text1, text2, text0)
+            _write_text(left, text1)
+            _write_text(right, text2)
+            if orphans is not None:
+                _write_text(orphans, text0)
+            text1.clear()
+            text2.clear()
+            text0.clear()
+
+    @property
+    def n_pairs(self):
+        return deref(self._this).n_pairs()
+
+    @property
+    def n_orphans(self):
+        return deref(self._this).n_orphans()
+
+
 cpdef tuple _split_left_right(unicode s):
     cdef string cppstr = s.encode('UTF-8')
     return _cppstring_split_left_right(cppstr)
@@ -449,32 +672,7 @@ cdef int _check_is_pair(Sequence first, Sequence second):
         if first.quality is not second.quality:
             return -1
 
-    cdef unicode lhs1, rhs1, lhs2, rhs2
-    lhs1, rhs1 = _cppstring_split_left_right(first._obj.name)
-    lhs2, rhs2 = _cppstring_split_left_right(second._obj.name)
-
-    # handle 'name/1'
-    cdef unicode subpart1, subpart2
-    if lhs1.endswith('/1') and lhs2.endswith('/2'):
-        subpart1 = lhs1.split('/', 1)[0]
-        subpart2 = lhs2.split('/', 1)[0]
-
-        if subpart1 and subpart1 == subpart2:
-            return 1
-
-    # handle '@name 1:rst'
-    elif lhs1 == lhs2 and rhs1.startswith('1:') and rhs2.startswith('2:'):
-        return 1
-
-    # handle @name seq/1
-    elif lhs1 == lhs2 and rhs1.endswith('/1') and rhs2.endswith('/2'):
-        subpart1 = rhs1.split('/', 1)[0]
-        subpart2 = rhs2.split('/', 1)[0]
-
-        if subpart1 and subpart1 == subpart2:
-            return 1
-
-    return 0
+    return 1 if cp_check_is_pair(first._obj.name, second._obj.name) else 0
 
 
 def check_is_pair(first, second):
@@ -495,17 +693,7 @@ cpdef bool check_is_left(s):
 
     Handles both Casava formats: seq/1 and 'seq::... 1::...'
     """
-    cdef unicode lhs, rhs
-    lhs, rhs = _split_left_right(_ustring(s))
-    if lhs.endswith('/1'):              # handle 'name/1'
-        return True
-    elif rhs.startswith('1:'):          # handle '@name 1:rst'
-        return True
-
-    elif rhs.endswith('/1'):            # handles '@name seq/1'
-        return True
-
-    return False
+    return cp_check_is_left(_bstring(s))
 
 
 cpdef bool check_is_right(s):
@@ -515,15 +703,5 @@ cpdef bool check_is_right(s):
 
     Handles both Casava formats: seq/2 and 'seq::... 2::...'
     """
-    cdef unicode lhs, rhs
-    lhs, rhs = _split_left_right(_ustring(s))
-    if lhs.endswith('/2'):              # handle 'name/2'
-        return True
-    elif rhs.startswith('2:'):          # handle '@name 2:rst'
-        return True
-
-    elif rhs.endswith('/2'):            # handles '@name seq/2'
-        return True
-
-    return False
+    return cp_check_is_right(_bstring(s))
 
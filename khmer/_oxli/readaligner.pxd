@@ -8,6 +8,8 @@ from libc.stdint cimport uintptr_t as size_t
 
 from khmer._oxli.oxli_types cimport *
 from khmer._oxli.graphs cimport CpCountgraph, Countgraph
+from khmer._oxli.parsing cimport CpReadParser, CpSequence, ostream
+from khmer._oxli.utils cimport oxli_raise_py_error
 
 cdef extern from "oxli/read_aligner.hh" namespace "oxli" nogil:
 
@@ -82,6 +84,11 @@ cdef extern from "oxli/read_aligner.hh" namespace "oxli" nogil:
         
         Alignment* Align(const string&)
         Alignment* AlignForward(const string&)
+        bool CorrectRead(CpSequence&) except +oxli_raise_py_error
+        void align_reads_parallel[SeqIO](shared_ptr[CpReadParser[SeqIO]]&,
+                                         unsigned int, ostream&,
+                                         unsigned int &,
+                                         unsigned int &) except +oxli_raise_py_error
 
         CpReadAligner(CpCountgraph *, BoundedCounterType trusted_cutoff,
                       double bits_theta)
@@ -8,7 +8,8 @@ import json
 from math import log
 
 from khmer._oxli.graphs cimport Countgraph
-from khmer._oxli.utils cimport _flatten_fill, _fill
+from khmer._oxli.parsing cimport CpFastxReader, FastxParserPtr, ofstream
+from khmer._oxli.utils cimport _bstring, _flatten_fill, _fill
 
 cdef class ReadAligner:
     '''
@@ -108,6 +109,30 @@ cdef class ReadAligner:
         return (score, alignment.upper(), read_alignment.upper(),
                 truncated, covs)
 
+    def align_reads_parallel(self, object parser_or_filename,
+                             str output_filename, int n_threads=1):
+        '''Correct all reads from a parser or file on n_threads threads.
+
+        Each read that aligns end-to-end is replaced by its graph alignment.
+        Reads are written to output_filename in input order, so read pairs
+        stay together. Returns (total_reads, n_corrected).
+        '''
+        cdef FastxParserPtr _parser = self.graph._get_parser(parser_or_filename)
+        cdef bytes _output_filename = _bstring(output_filename)
+        cdef unsigned int _n_threads = n_threads
+        cdef unsigned int total_reads = 0
+        cdef unsigned int n_corrected = 0
+        cdef ofstream * _output = new ofstream(_output_filename)
+        try:
+            with nogil:
+                deref(self._aln_this).align_reads_parallel[CpFastxReader](
+                    _parser, _n_threads, deref(_output), total_reads,
+                    n_corrected
+                )
+        finally:
+            del _output
+        return total_reads, n_corrected
+
     @staticmethod
     cdef double * _default_transition_probabilities():
         return trans_default
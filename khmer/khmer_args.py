@@ -466,6 +466,17 @@ def build_graph_args(descr=None, epilog=None, parser=None, citations=None):
                        help='maximum amount of memory to use for data ' +
                        'structure')
 
+    help = ('back large tables with transparent huge pages ("huge") or 1 GB '
+            'hugetlbfs pages ("huge-1g") to cut TLB misses'
+            if expert_help else argparse.SUPPRESS)
+    parser.add_argument('--table-pages', choices=['default', 'huge',
+                                                  'huge-1g'],
+                        default='default', help=help)
+    help = ('interleave large tables over all NUMA nodes'
+            if expert_help else argparse.SUPPRESS)
+    parser.add_argument('--numa-interleave', default=False,
+                        action='store_true', help=help)
+
     return parser
 
 
@@ -484,6 +495,10 @@ def build_nodegraph_args(descr=None, epilog=None, parser=None, citations=None):
     """Build an ArgumentParser with args for nodegraph based scripts."""
     parser = build_graph_args(descr=descr, epilog=epilog, parser=parser,
                               citations=citations)
+    parser.add_argument('--scalable', default=False, action='store_true',
+                        help='grow the nodegraph as k-mers are added, keeping '
+                        'the false positive rate below --fp-rate; -M/-x then '
+                        'only size the first slice')
 
     return parser
 
@@ -513,9 +528,21 @@ def calculate_graphsize(args, graphtype, multiplier=1.0):
     return tablesize
 
 
+def configure_table_allocation(args):
+    """Apply the table allocation options to all tables made from now on.
+
+    Tables are zeroed on --threads threads where a script has that option.
+    """
+    khmer.set_table_allocation(
+        pages=getattr(args, 'table_pages', 'default'),
+        numa_interleave=getattr(args, 'numa_interleave', False),
+        n_threads=getattr(args, 'threads', 1))
+
+
 def create_nodegraph(args, ksize=None, multiplier=1.0, fp_rate=0.01):
     """Create and return a nodegraph."""
     args = _check_fp_rate(args, fp_rate)
+    configure_table_allocation(args)
 
     if hasattr(args, 'force'):
         if args.n_tables > 20:
@@ -535,12 +562,18 @@ def create_nodegraph(args, ksize=None, multiplier=1.0, fp_rate=0.01):
         sys.exit(1)
 
     tablesize = calculate_graphsize(args, 'nodegraph', multiplier)
+    if getattr(args, 'scalable', False):
+        if getattr(args, 'fp_rate', None):
+            fp_rate = args.fp_rate
+        return khmer.ScalableNodegraph(ksize, tablesize, args.n_tables,
+                                       fp_rate=fp_rate)
     return khmer.Nodegraph(ksize, tablesize, args.n_tables)
 
 
 def create_countgraph(args, ksize=None, multiplier=1.0, fp_rate=0.1):
     """Create and return a countgraph."""
     args = _check_fp_rate(args, fp_rate)
+    configure_table_allocation(args)
 
     if hasattr(args, 'force'):
         if args.n_tables > 20:
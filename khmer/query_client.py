@@ -0,0 +1,132 @@
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+"""Client for the k-mer query server started by serve-graph.py."""
+import socket
+import struct
+
+QUERY_COUNT = 1
+QUERY_MEDIAN = 2
+QUERY_TRIM = 3
+QUERY_INFO = 4
+QUERY_SHUTDOWN = 5
+
+QUERY_OK = 0
+
+_HEADER = struct.Struct('=B3xII')
+_LENGTH = struct.Struct('=I')
+_MEDIAN = struct.Struct('=Iff')
+
+
+class QueryClient(object):
+    """Send batched k-mer queries to a running query server.
+
+    Each method takes a list of k-mers or sequences and answers for all of
+    them in one round trip, so pass reads in batches rather than one at a
+    time. Errors reported by the server raise ValueError.
+    """
+
+    def __init__(self, socket_path):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            self._sock.connect(socket_path)
+        except OSError:
+            self._sock.close()
+            raise
+        self._ksize = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def close(self):
+        """Disconnect from the server."""
+        self._sock.close()
+
+    def _recv_exactly(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._sock.recv(size - len(data))
+            if not chunk:
+                raise OSError("query server closed the connection")
+            data.extend(chunk)
+        return bytes(data)
+
+    def _request(self, code, items=(), param=0):
+        parts = [_HEADER.pack(code, param, len(items))]
+        for item in items:
+            if not isinstance(item, bytes):
+                item = item.encode('utf-8')
+            parts.append(_LENGTH.pack(len(item)))
+            parts.append(item)
+        self._sock.sendall(b''.join(parts))
+
+        status, _, size = _HEADER.unpack(self._recv_exactly(_HEADER.size))
+        if status != QUERY_OK:
+            message = self._recv_exactly(size)
+            raise ValueError(message.decode('utf-8', 'replace'))
+        return size
+
+    def ksize(self):
+        """Return the k-mer size of the served table."""
+        if self._ksize is None:
+            self._request(QUERY_INFO)
+            self._ksize, = _LENGTH.unpack(self._recv_exactly(_LENGTH.size))
+        return self._ksize
+
+    def get_counts(self, kmers):
+        """Return the count of each k-mer in kmers."""
+        size = self._request(QUERY_COUNT, kmers)
+        data = self._recv_exactly(size * _LENGTH.size)
+        return list(struct.unpack('={}I'.format(size), data))
+
+    def get_median_counts(self, sequences):
+        """Return (median, average, stddev) of the k-mer counts of each
+        sequence, as Hashtable.get_median_count does."""
+        size = self._request(QUERY_MEDIAN, sequences)
+        data = self._recv_exactly(size * _MEDIAN.size)
+        return list(_MEDIAN.iter_unpack(data))
+
+    def trim_on_abundance(self, sequences, abundance):
+        """Return, for each sequence, the position of its first k-mer with a
+        count below abundance, as Hashtable.trim_on_abundance does."""
+        size = self._request(QUERY_TRIM, sequences, abundance)
+        data = self._recv_exactly(size * _LENGTH.size)
+        return list(struct.unpack('={}I'.format(size), data))
+
+    def shutdown(self):
+        """Ask the server to stop, then disconnect."""
+        self._request(QUERY_SHUTDOWN)
+        self.close()
@@ -60,6 +60,9 @@ def build_parser(parser):
     parser.add_argument('--no-build-tagset', '-n', default=False,
                         action='store_true', dest='no_build_tagset',
                         help='Do NOT construct tagset while loading sequences')
+    parser.add_argument('--bundle', default=False, action='store_true',
+                        help='Save the nodegraph and tagset together as one '
+                        'graph bundle, in output_nodegraph_filename')
     parser.add_argument('output_filename',
                         metavar='output_nodegraph_filename', help='output'
                         ' k-mer nodegraph filename.')
@@ -102,12 +105,18 @@ def main(args):
     print('Total number of unique k-mers: {0}'.format(
         nodegraph.n_unique_kmers()), file=sys.stderr)
 
-    print('saving k-mer nodegraph in', base, file=sys.stderr)
-    nodegraph.save(base)
+    if args.bundle:
+        print('saving k-mer nodegraph and tagset in bundle', base,
+              file=sys.stderr)
+        khmer.GraphBundle.write(base, nodegraph,
+                                tagset=not args.no_build_tagset)
+    else:
+        print('saving k-mer nodegraph in', base, file=sys.stderr)
+        nodegraph.save(base)
 
-    if not args.no_build_tagset:
-        print('saving tagset in', base + '.tagset', file=sys.stderr)
-        nodegraph.save_tagset(base + '.tagset')
+        if not args.no_build_tagset:
+            print('saving tagset in', base + '.tagset', file=sys.stderr)
+            nodegraph.save_tagset(base + '.tagset')
 
     info_fp = open(base + '.info', 'w')
     info_fp.write('%d unique k-mers' % nodegraph.n_unique_kmers())
@@ -123,7 +132,7 @@ def main(args):
           file=info_fp)
 
     print('wrote to ' + base + '.info and ' + base, file=sys.stderr)
-    if not args.no_build_tagset:
+    if not args.no_build_tagset and not args.bundle:
         print('and ' + base + '.tagset', file=sys.stderr)
 
     sys.exit(0)
@@ -0,0 +1,137 @@
+#! /usr/bin/env python
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2010-2015, Michigan State University.
+# Copyright (C) 2015, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=missing-docstring
+"""
+Compare the counting error of standard and conservative-update tables.
+
+For each table size, count the k-mers of the input files into Counttable and
+SmallCounttable with and without conservative update, then compare every
+k-mer occurrence in the input against its exact count. Prints one
+tab-separated line per table: table type, update mode, table size, memory
+in bytes, mean overcount and fraction of k-mer occurrences overcounted.
+
+% python sandbox/countmin-accuracy.py -k 20 data/100k-surrendered.fa
+"""
+
+import argparse
+import os
+import shutil
+import sys
+import tempfile
+
+import khmer
+from khmer import ReadParser
+
+TABLE_TYPES = (('Counttable', khmer.Counttable, 1.0),
+               ('SmallCounttable', khmer.SmallCounttable, 0.5))
+BATCH_SIZE = 10000
+
+
+def get_parser():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.
+                                     RawDescriptionHelpFormatter)
+    parser.add_argument('input_filenames', nargs='+')
+    parser.add_argument('-k', '--ksize', type=int, default=20)
+    parser.add_argument('-N', '--n_tables', type=int, default=4)
+    parser.add_argument('--sizes', type=float, nargs='+',
+                        default=[1e5, 3e5, 1e6, 3e6],
+                        help='sizes of each table to try')
+    return parser
+
+
+def read_batches(filenames):
+    batch = []
+    for filename in filenames:
+        for read in ReadParser(filename):
+            batch.append(read.cleaned_seq)
+            if len(batch) == BATCH_SIZE:
+                yield batch
+                batch = []
+    if batch:
+        yield batch
+
+
+def measure(table, exact, filenames):
+    n_kmers = 0
+    n_over = 0
+    total_over = 0
+    for batch in read_batches(filenames):
+        hashes, _ = table.hash_sequences(batch)
+        for estimate, truth in zip(table.get_counts(hashes),
+                                   exact.get_counts(hashes)):
+            if estimate > truth:
+                n_over += 1
+                total_over += estimate - truth
+        n_kmers += len(hashes)
+    return total_over / max(n_kmers, 1), n_over / max(n_kmers, 1)
+
+
+def main():
+    args = get_parser().parse_args()
+
+    tmpdir = tempfile.mkdtemp()
+    try:
+        exact_filename = os.path.join(tmpdir, 'exact.counts')
+        builder = khmer.ExactCountBuilder(args.ksize, tmpdir)
+        for filename in args.input_filenames:
+            builder.consume_seqfile(filename)
+        n_distinct = builder.write(exact_filename)
+        exact = khmer.ExactCounttable.load(exact_filename)
+        print('# {} distinct {}-mers, {} in total'.format(
+            n_distinct, args.ksize, builder.n_kmers()), file=sys.stderr)
+
+        print('table\tupdate\tsize\tbytes\tmean_overcount\tfrac_overcounted')
+        for size in args.sizes:
+            size = int(size)
+            for name, table_type, bytes_per_entry in TABLE_TYPES:
+                for conservative in (False, True):
+                    table = table_type(args.ksize, size, args.n_tables,
+                                       conservative=conservative)
+                    for filename in args.input_filenames:
+                        table.consume_seqfile(filename)
+                    mean_over, frac_over = measure(table, exact,
+                                                   args.input_filenames)
+                    n_bytes = int(sum(table.hashsizes()) * bytes_per_entry)
+                    print('{}\t{}\t{}\t{}\t{:.4f}\t{:.4f}'.format(
+                        name, 'conservative' if conservative else 'standard',
+                        size, n_bytes, mean_over, frac_over))
+    finally:
+        shutil.rmtree(tmpdir)
+
+
+if __name__ == '__main__':
+    main()
@@ -49,7 +49,8 @@ import textwrap
 import os
 from khmer import Countgraph
 from khmer.kfile import check_input_files
-from khmer.khmer_args import (sanitize_help, KhmerArgumentParser)
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
 from khmer.khmer_logger import (configure_logging, log_info, log_error,
                                 log_warn)
 
@@ -86,8 +87,12 @@ def get_parser():
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Continue even if specified input files '
                         'do not exist or are empty.')
+    parser.add_argument('--exact', default=False, action='store_true',
+                        help='Find distinct k-mers exactly, on --threads '
+                        'threads, instead of with a tracking Nodegraph')
     parser.add_argument('-q', '--quiet', dest='quiet', default=False,
                         action='store_true')
+    add_threading_args(parser)
     return parser
 
 
@@ -114,8 +119,10 @@ def main():
 
     kmer_size = countgraph.ksize()
     hashsizes = countgraph.hashsizes()
-    tracking = khmer.Nodegraph(  # pylint: disable=protected-access
-        kmer_size, 1, 1, primes=hashsizes)
+    tracking = None
+    if not args.exact:
+        tracking = khmer.Nodegraph(  # pylint: disable=protected-access
+            kmer_size, 1, 1, primes=hashsizes)
 
     log_info('K: {ksize}', ksize=kmer_size)
     log_info('outputting to {output}', output=args.output_histogram_filename)
@@ -133,7 +140,7 @@ def main():
 
     log_info('preparing hist...')
     abundances = countgraph.abundance_distribution(
-        args.input_sequence_filename, tracking)
+        args.input_sequence_filename, tracking, n_threads=args.threads)
     total = sum(abundances)
 
     if 0 == total:
@@ -47,9 +47,10 @@ Use '-h' for parameter help.
 import os
 import textwrap
 import sys
-from khmer import __version__, Nodegraph
+from khmer import __version__, GraphBundle, Nodegraph
 from khmer.kfile import check_input_files, check_space
-from khmer.khmer_args import (sanitize_help, KhmerArgumentParser)
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
 
 DEFAULT_K = 32
 
@@ -58,8 +59,12 @@ def get_parser():
     epilog = """\
     Load in a partitionmap (generally produced by :program:`partition-graph.py`
     or :program:`merge-partitions.py`) and annotate the sequences in the given
-    files with their partition IDs. Use :program:`extract-partitions.py` to
-    extract sequences into separate group files.
+    files with their partition IDs. If graphbase is a graph bundle holding a
+    partition map, only that section of it is read. Use
+    :program:`extract-partitions.py` to extract sequences into separate group
+    files. With :option:`--threads`,
+    several input files are annotated at once, or reads from one file are
+    annotated in parallel; output is always in input order.
 
     Example (results will be in ``random-20-a.fa.part``)::
 
@@ -81,6 +86,7 @@ def get_parser():
                         'annotate.')
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
+    add_threading_args(parser)
     return parser
 
 
@@ -91,7 +97,16 @@ def main():
     filenames = args.input_filenames
     nodegraph = Nodegraph(ksize, 1, 1)
 
+    # only the partition map is read out of a graph bundle, not the graph
+    bundle = None
+    if GraphBundle.is_bundle(args.graphbase):
+        bundle = GraphBundle(args.graphbase)
+        if 'partitionmap' not in bundle:
+            bundle = None
+
     partitionmap_file = args.graphbase + '.pmap.merged'
+    if bundle is not None:
+        partitionmap_file = args.graphbase
 
     check_input_files(partitionmap_file, args.force)
     for _ in filenames:
@@ -100,12 +115,16 @@ def main():
     check_space(filenames, args.force)
 
     print('loading partition map from:', partitionmap_file, file=sys.stderr)
-    nodegraph.load_partitionmap(partitionmap_file)
-
-    for infile in filenames:
-        print('outputting partitions for', infile, file=sys.stderr)
-        outfile = os.path.basename(infile) + '.part'
-        part_count = nodegraph.output_partitions(infile, outfile)
+    if bundle is not None:
+        bundle.load_partitionmap(nodegraph)
+    else:
+        nodegraph.load_partitionmap(partitionmap_file)
+
+    outfiles = [os.path.basename(infile) + '.part' for infile in filenames]
+    print('outputting partitions for', ', '.join(filenames), file=sys.stderr)
+    part_counts = nodegraph.output_partitions_multi(filenames, outfiles,
+                                                    n_threads=args.threads)
+    for infile, outfile, part_count in zip(filenames, outfiles, part_counts):
         print('output %d partitions for %s' % (
             part_count, infile), file=sys.stderr)
         print('partitions are in', outfile, file=sys.stderr)
@@ -50,14 +50,14 @@ The output file contains sequence id, median, average, stddev, and seq length.
 NOTE: All 'N's in the input sequences are converted to 'A's.
 """
 import argparse
-import screed
 import sys
 import csv
 import textwrap
 
 from khmer import __version__, Countgraph
 from khmer.kfile import check_input_files, check_space
-from khmer.khmer_args import (sanitize_help, KhmerArgumentParser)
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
 
 
 def get_parser():
@@ -89,6 +89,7 @@ def get_parser():
                         type=argparse.FileType('w'))
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
+    add_threading_args(parser)
     return parser
 
 
@@ -107,22 +108,17 @@ def main():
 
     print('loading k-mer countgraph from', htfile, file=sys.stderr)
     countgraph = Countgraph.load(htfile)
-    ksize = countgraph.ksize()
     print('writing to', output.name, file=sys.stderr)
 
     output = csv.writer(output)
     # write headers:
     output.writerow(['name', 'median', 'average', 'stddev', 'seqlen'])
 
-    for record in screed.open(input_filename):
-        seq = record.sequence.upper()
-        if 'N' in seq:
-            seq = seq.replace('N', 'A')
-
-        if ksize <= len(seq):
-            medn, ave, stdev = countgraph.get_median_count(seq)
-            ave, stdev = [round(x, 9) for x in (ave, stdev)]
-            output.writerow([record.name, medn, ave, stdev, len(seq)])
+    profile = countgraph.coverage_profile(input_filename,
+                                          n_threads=args.threads)
+    for name, medn, ave, stdev, seqlen in profile:
+        ave, stdev = [round(x, 9) for x in (ave, stdev)]
+        output.writerow([name, medn, ave, stdev, seqlen])
 
 
 if __name__ == '__main__':
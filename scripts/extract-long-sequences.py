@@ -47,11 +47,10 @@ length.
 Use '-h' for parameter help.
 """
 import argparse
-import screed
 import textwrap
 import sys
 from khmer import __version__
-from khmer.utils import write_record
+from khmer import FastxFilter
 from khmer.kfile import add_output_compression_type, get_file_writer
 from khmer.khmer_args import sanitize_help, KhmerArgumentParser
 
@@ -83,9 +82,7 @@ def main():
     args = sanitize_help(get_parser()).parse_args()
     outfp = get_file_writer(args.output, args.gzip, args.bzip)
     for filename in args.input_filenames:
-        for record in screed.open(filename):
-            if len(record['sequence']) >= args.length:
-                write_record(record, outfp)
+        FastxFilter(filename, min_length=args.length).write_to(outfp)
     print('wrote to: ' + args.output.name, file=sys.stderr)
 
 
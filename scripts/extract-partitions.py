@@ -50,14 +50,13 @@ by output_unassigned...
 import sys
 import screed
 import textwrap
-from contextlib import contextmanager
 import khmer
 
+from khmer import PartitionExtractor
 from khmer.kfile import (check_input_files, check_space,
-                         add_output_compression_type,
-                         get_file_writer)
-from khmer.khmer_args import sanitize_help, KhmerArgumentParser
-from khmer.utils import write_record
+                         add_output_compression_type)
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
 
 DEFAULT_MAX_SIZE = int(1e6)
 DEFAULT_THRESHOLD = 5
@@ -85,6 +84,10 @@ def get_parser():
     distribution in <base>.dist. The columns are: (1) number of reads,
     (2) count of partitions with n reads, (3) cumulative sum of partitions,
     (4) cumulative sum of reads.)
+
+    Reads are spilled to temporary <base>.spillN files while partitions are
+    counted, so memory use does not grow with the input; the group files
+    are then written on :option:`--threads` threads.
     """
     parser = KhmerArgumentParser(
         description="Separate sequences that are annotated with partitions "
@@ -108,146 +111,10 @@ def get_parser():
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
     add_output_compression_type(parser)
+    add_threading_args(parser)
     return parser
 
 
-@contextmanager
-def PartitionedReader(filename_list, quiet=False, single=False):
-    yield PartitionedReadIterator(filename_list, quiet, single)
-
-
-def PartitionedReadIterator(filename_list, quiet=False, single=False):
-    """
-    Generator to do boilerplate output of statistics.
-
-    Uses a list of input files and verbosity
-    Returns reads and partition IDs
-    """
-    for filename in filename_list:
-        for index, read, pid in read_partition_file(filename):
-            if not quiet:
-                if index % 100000 == 0:
-                    print('...x2', index, file=sys.stderr)
-            yield read, pid
-            if single:
-                break  # only yield a single read from each file
-
-
-class PartitionExtractor(object):
-    """
-    Does extraction, processing and accounting of partitioned reads.
-
-    Contains methods for self_maintenance  and output production
-    """
-
-    def __init__(self, file_list, min_size, max_size):
-        # We'll make our own generator! With files! And...
-        self.file_list = file_list
-        self.n_unassigned = 0
-        self.count = {}
-
-        self.divvy = None
-        self.group_n = 0
-        self.group_d = {}
-        self.min_size = min_size
-        self.max_size = max_size
-
-    def process_unassigned(self, outfp=None):
-        """
-        Process unassigned reads.
-
-        Can optionally output said reads if outfp is given
-        Also develops counts of partition IDs--necessary for further processing
-        """
-        with PartitionedReader(self.file_list) as reader:
-            for read, pid in reader:
-                self.count[pid] = self.count.get(pid, 0) + 1
-
-                if pid == 0:
-                    self.n_unassigned += 1
-                    if outfp:
-                        write_record(read, outfp)
-
-    def output_histogram(self, dist_filename):
-        """Output histogram of partition counts to the given filename."""
-        # develop histogram of partition sizes
-        dist = {}
-        for _, size in list(self.count.items()):
-            dist[size] = dist.get(size, 0) + 1
-
-        # output histogram
-        distfp = open(dist_filename, 'w')
-
-        total = 0
-        wtotal = 0
-        for counter, index in sorted(dist.items()):
-            total += index
-            wtotal += counter * index
-            distfp.write('%d %d %d %d\n' % (counter, index, total, wtotal))
-        distfp.close()
-
-    def develop_groups(self):
-        """Processing method that divides up the partitions into groups."""
-        if 0 in self.count:            # eliminate unpartitioned sequences
-            del self.count[0]
-
-        # sort groups by size
-        self.divvy = sorted(list(self.count.items()), key=lambda y: y[1])
-        self.divvy = [y for y in self.divvy if y[1] > self.min_size]
-
-        # divvy up into different groups, based on having max_size sequences
-        # in each group.
-        total = 0
-        group = set()
-        for partition_id, n_reads in self.divvy:
-            group.add(partition_id)
-            total += n_reads
-
-            if total > self.max_size:
-                for partition_id in group:
-                    self.group_d[partition_id] = self.group_n
-
-                self.group_n += 1
-                group = set()
-                total = 0
-
-        if group:
-            for partition_id in group:
-                self.group_d[partition_id] = self.group_n
-            self.group_n += 1
-
-    class ReadGroupGenerator(object):
-        """
-        Generator that yields partitioned reads and their group.
-
-        Takes PartitionExtractor and PartitionedReadIterator objects
-        """
-
-        def __init__(self, extractor):
-            self.extractor = extractor
-
-            self.total_seqs = 0
-            self.part_seqs = 0
-            self.toosmall_parts = 0
-
-        def __call__(self, reader):
-            for read, partition_id in reader:
-                self.total_seqs += 1
-                if partition_id == 0:
-                    continue
-
-                try:
-                    group_n = self.extractor.group_d[partition_id]
-                except KeyError:
-                    assert self.extractor.count[partition_id] <=\
-                        self.extractor.min_size
-                    self.toosmall_parts += 1
-                    continue
-
-                yield read, group_n
-                self.part_seqs += 1
-
-
 def main():
     args = sanitize_help(get_parser()).parse_args()
 
@@ -282,72 +149,57 @@ def main():
     suffix = None
     is_fastq = None
 
-    with PartitionedReader(args.part_filenames, True, True) as reader:
-        for read, _ in reader:
+    for filename in args.part_filenames:
+        for _, read, _ in read_partition_file(filename):
             if is_fastq is None:
                 is_fastq = hasattr(read, 'quality')
             else:
                 assert hasattr(read, 'quality') == is_fastq,\
                     "Input files must have consistent format."
+            break  # only check a single read from each file
 
     if is_fastq:
         suffix = "fq"
     else:
         suffix = "fa"
 
-    # remember folks, generators exhaust themseleves
-    extractor = PartitionExtractor(args.part_filenames,
-                                   args.min_part_size,
-                                   args.max_size)
+    compression = None
+    if args.gzip:
+        compression = 'gzip'
+    elif args.bzip:
+        compression = 'bzip2'
 
-    if args.output_unassigned:
-        ofile = open('%s.unassigned.%s' % (args.prefix, suffix), 'wb')
-        unassigned_fp = get_file_writer(ofile, args.gzip, args.bzip)
-        extractor.process_unassigned(unassigned_fp)
-        unassigned_fp.close()
-    else:
-        extractor.process_unassigned()
+    extractor = PartitionExtractor(args.prefix, suffix, args.min_part_size,
+                                   args.max_size, compression)
+    extractor.consume(args.part_filenames, args.output_unassigned,
+                      args.output_groups)
 
-    extractor.output_histogram(distfilename)
+    extractor.write_distribution(distfilename)
 
     if not args.output_groups:
         sys.exit(0)
 
     extractor.develop_groups()
 
-    print('%d groups' % extractor.group_n, file=sys.stderr)
-    if extractor.group_n == 0:
+    print('%d groups' % extractor.n_groups, file=sys.stderr)
+    if extractor.n_groups == 0:
         print('nothing to output; exiting!', file=sys.stderr)
         return
 
-    # open a bunch of output files for the different groups
-    group_fps = {}
-    for index in range(extractor.group_n):
-        fname = '%s.group%04d.%s' % (args.prefix, index, suffix)
-        group_fp = get_file_writer(open(fname, 'wb'), args.gzip,
-                                   args.bzip)
-        group_fps[index] = group_fp
-
     # write 'em all out!
-    # refresh the generator
-    read_generator = PartitionExtractor.ReadGroupGenerator(extractor)
-
-    with PartitionedReader(args.part_filenames) as reader:
-        for read, group_n in read_generator(reader):
-            outfp = group_fps[group_n]
-            write_record(read, outfp)
+    extractor.output_groups(args.threads)
 
     print('---', file=sys.stderr)
-    print('Of %d total seqs,' % read_generator.total_seqs, file=sys.stderr)
+    print('Of %d total seqs,' % extractor.total_seqs, file=sys.stderr)
     print('extracted %d partitioned seqs into group files,' %
-          read_generator.part_seqs, file=sys.stderr)
+          extractor.part_seqs, file=sys.stderr)
     print('discarded %d sequences from small partitions (see -m),' %
-          read_generator.toosmall_parts, file=sys.stderr)
+          extractor.toosmall_parts, file=sys.stderr)
     print('and found %d unpartitioned sequences (see -U).' %
           extractor.n_unassigned, file=sys.stderr)
     print('', file=sys.stderr)
     print('Created %d group files named %s.groupXXXX.%s' %
-          (len(group_fps),
+          (extractor.n_groups,
            args.prefix,
            suffix), file=sys.stderr)
 
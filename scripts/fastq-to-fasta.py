@@ -43,11 +43,10 @@ Convert FASTQ files to FASTA format.
 Use '-h' for parameter help.
 """
 import sys
-import screed
 from khmer import __version__
+from khmer import FastxFilter
 from khmer.kfile import (add_output_compression_type, get_file_writer,
                          describe_file_handle)
-from khmer.utils import write_record
 from khmer.khmer_args import sanitize_help, KhmerArgumentParser
 from khmer.khmer_args import FileType as khFileType
 
@@ -75,20 +74,10 @@ def main():
 
     print('fastq from ', args.input_sequence, file=sys.stderr)
     outfp = get_file_writer(args.output, args.gzip, args.bzip)
-    n_count = 0
-    for n, record in enumerate(screed.open(args.input_sequence)):
-        if n % 10000 == 0:
-            print('...', n, file=sys.stderr)
-
-        sequence = record['sequence']
-
-        if 'N' in sequence:
-            if not args.n_keep:
-                n_count += 1
-                continue
-
-        del record['quality']
-        write_record(record, outfp)
+    fastx_filter = FastxFilter(args.input_sequence, drop_n=not args.n_keep,
+                               to_fasta=True)
+    fastx_filter.write_to(outfp)
+    n_count = fastx_filter.n_read - fastx_filter.n_written
 
     print('\n' + 'lines from ' + args.input_sequence, file=sys.stderr)
 
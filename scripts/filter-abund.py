@@ -50,16 +50,14 @@ import textwrap
 import khmer
 
 from khmer import __version__
-from khmer import ReadParser, Countgraph
-from khmer.utils import (broken_paired_reader, write_record)
+from khmer import Countgraph
 from khmer.khmer_args import (add_threading_args, KhmerArgumentParser,
                               sanitize_help, check_argument_range)
 from khmer.khmer_args import FileType as khFileType
 from khmer.kfile import (check_input_files, check_space,
-                         add_output_compression_type, get_file_writer)
+                         add_output_compression_type)
 from khmer.khmer_logger import (configure_logging, log_info, log_error,
                                 log_warn)
-from khmer.trimming import (trim_record)
 
 DEFAULT_NORMALIZE_LIMIT = 20
 DEFAULT_CUTOFF = 2
@@ -72,6 +70,10 @@ def get_parser():
     the input sequences are from RNAseq or metagenome sequencing then
     :option:`--variable-coverage` should be used.
 
+    Reads are trimmed on :option:`--threads` threads and written in input
+    order. With :option:`--paired`, each input file must hold interleaved
+    pairs, and a pair is only written if both reads survive trimming.
+
     Example::
 
         load-into-counting.py -k 20 -x 5e7 countgraph data/100k-filtered.fa
@@ -98,6 +100,9 @@ def get_parser():
                         help='Base the variable-coverage cutoff on this median'
                         ' k-mer abundance.',
                         default=DEFAULT_NORMALIZE_LIMIT)
+    parser.add_argument('--paired', action='store_true', default=False,
+                        help='Require interleaved pairs; keep or drop both '
+                        'reads of a pair together.')
     parser.add_argument('-o', '--output', dest='single_output_file',
                         type=khFileType('wb'),
                         metavar="optional_output_filename",
@@ -135,32 +140,35 @@ def main():
 
     log_info("K: {ksize}", ksize=ksize)
 
+    compression = None
+    if args.gzip:
+        compression = 'gzip'
+    elif args.bzip:
+        compression = 'bzip2'
+
+    # the output file is written by the trimming pipeline itself
     if args.single_output_file:
         outfile = args.single_output_file.name
-        outfp = get_file_writer(args.single_output_file, args.gzip, args.bzip)
+        if isinstance(outfile, str) and outfile != '<stdout>':
+            args.single_output_file.close()
+        else:  # stdout; leave it open
+            args.single_output_file.flush()
+            outfile = '-'
 
     # the filtering loop
-    for infile in infiles:
+    for n, infile in enumerate(infiles):
         log_info('filtering {infile}', infile=infile)
         if not args.single_output_file:
             outfile = os.path.basename(infile) + '.abundfilt'
-            outfp = open(outfile, 'wb')
-            outfp = get_file_writer(outfp, args.gzip, args.bzip)
-
-        paired_iter = broken_paired_reader(ReadParser(infile),
-                                           min_length=ksize,
-                                           force_single=True)
-
-        for n, is_pair, read1, read2 in paired_iter:
-            assert not is_pair
-            assert read2 is None
 
-            trimmed_record, _ = trim_record(countgraph, read1, args.cutoff,
-                                            args.variable_coverage,
-                                            args.normalize_to)
-            if trimmed_record:
-                write_record(trimmed_record, outfp)
+        total, kept = countgraph.trim_seqfile_on_abundance(
+            '-' if infile == '/dev/stdin' else infile, outfile, args.cutoff,
+            variable_coverage=args.variable_coverage,
+            normalize_to=args.normalize_to, paired=args.paired,
+            n_threads=args.threads, compression=compression,
+            append=bool(args.single_output_file and n > 0))
 
+        log_info('kept {kept} of {total} reads', kept=kept, total=total)
         log_info('output in {outfile}', outfile=outfile)
 
 
@@ -47,10 +47,11 @@ import os
 import textwrap
 import khmer
 import sys
-from khmer import Nodegraph, SubsetPartition
+from khmer import GraphBundle, Nodegraph
 from khmer.kfile import check_input_files, check_space
 from khmer import khmer_args
-from khmer.khmer_args import (build_counting_args, sanitize_help)
+from khmer.khmer_args import (build_counting_args, add_threading_args,
+                               sanitize_help)
 
 # counting hash parameters.
 DEFAULT_COUNTING_HT_SIZE = 3e6                # number of bytes
@@ -76,21 +77,18 @@ EXCURSION_KMER_COUNT_THRESHOLD = 2
 def get_parser():
     epilog = """\
     Load an k-mer nodegraph/tagset pair created by
-    :program:`load-graph.py`, and a set of pmap files created by
-    :program:`partition-graph.py`. Go through each pmap file,
-    select the largest partition in each, and do the same kind of traversal as
-    in :program:`make-initial-stoptags.py` from each of the waypoints in that
-    partition; this should identify all of the Highly Connected Kmers in that
-    partition. These HCKs are output to ``<graphbase>.stoptags`` after each
-    pmap file.
+    :program:`load-graph.py`, or a graph bundle made with its
+    :option:`--bundle`, and a set of pmap files created by
+    :program:`partition-graph.py`. The pmap files are merged, and
+    the same kind of traversal as in :program:`make-initial-stoptags.py` is
+    done from each of the waypoints in the largest partition, on
+    :option:`--threads` threads; this should identify all of the Highly
+    Connected Kmers in that partition. These HCKs are output to
+    ``<graphbase>.stoptags``. Without pmap files, the partition map of a graph
+    bundle is used.
 
     Parameter choice is reasonably important. See the pipeline in
     :doc:`partitioning-big-data` for an example run.
-
-    This script is not very scalable and may blow up memory and die horribly.
-    You should be able to use the intermediate stoptags to restart the
-    process, and if you eliminate the already-processed pmap files, you can
-    continue where you left off.
     """
     parser = build_counting_args(
         descr="Find all highly connected k-mers.",
@@ -101,6 +99,7 @@ def get_parser():
                         'files.')
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Continue past warnings')
+    add_threading_args(parser)
     return parser
 
 
@@ -115,8 +114,18 @@ def main():
 
     graphbase = args.graphbase
 
-    # @RamRS: This might need some more work
-    infiles = [graphbase, graphbase + '.tagset']
+    # a graph bundle holds the tagset, and maybe stoptags, itself
+    bundle = None
+    if GraphBundle.is_bundle(graphbase):
+        bundle = GraphBundle(graphbase)
+        if 'tagset' not in bundle:
+            print('ERROR: graph bundle %s has no tagset; rebuild it without '
+                  '--no-build-tagset' % graphbase, file=sys.stderr)
+            sys.exit(1)
+        infiles = [graphbase]
+    else:
+        # @RamRS: This might need some more work
+        infiles = [graphbase, graphbase + '.tagset']
     if os.path.exists(graphbase + '.stoptags'):
         infiles.append(graphbase + '.stoptags')
     for _ in infiles:
@@ -124,22 +133,34 @@ def main():
 
     check_space(infiles, args.force)
 
-    print('loading k-mer nodegraph %s' % graphbase, file=sys.stderr)
-    graph = Nodegraph.load(graphbase)
+    if bundle is not None:
+        print('loading k-mer nodegraph and tagset from bundle %s' %
+              graphbase, file=sys.stderr)
+        graph = bundle.graph
+        bundle.load_tagset()
+    else:
+        print('loading k-mer nodegraph %s' % graphbase, file=sys.stderr)
+        graph = Nodegraph.load(graphbase)
 
-    print('loading tagset %s.tagset...' % graphbase, file=sys.stderr)
-    graph.load_tagset(graphbase + '.tagset')
+        print('loading tagset %s.tagset...' % graphbase, file=sys.stderr)
+        graph.load_tagset(graphbase + '.tagset')
 
     initial_stoptags = False    # @CTB regularize with make-initial
     if os.path.exists(graphbase + '.stoptags'):
         print('loading stoptags %s.stoptags' % graphbase, file=sys.stderr)
         graph.load_stop_tags(graphbase + '.stoptags')
         initial_stoptags = True
+    elif bundle is not None and 'stoptags' in bundle:
+        print('loading bundled stoptags', file=sys.stderr)
+        bundle.load_stop_tags()
+        initial_stoptags = True
 
     pmap_files = glob.glob(args.graphbase + '.subset.*.pmap')
+    if not pmap_files and (bundle is None or 'partitionmap' not in bundle):
+        print('ERROR: no pmap files found for %s' % graphbase,
+              file=sys.stderr)
+        sys.exit(1)
 
-    print('loading %d pmap files (first one: %s)' %
-          (len(pmap_files), pmap_files[0]), file=sys.stderr)
     print('---', file=sys.stderr)
     print('output stoptags will be in',
           graphbase + '.stoptags', file=sys.stderr)
@@ -154,34 +175,29 @@ def main():
     counting = khmer_args.create_countgraph(args, ksize=ksize)
 
     # load & merge
-    for index, subset_file in enumerate(pmap_files):
-        print('<-', subset_file, file=sys.stderr)
-        subset = SubsetPartition.load(subset_file, graph)
-
-        print('** repartitioning subset... %s' % subset_file, file=sys.stderr)
-        graph.repartition_largest_partition(counting,
-                                            EXCURSION_DISTANCE,
-                                            EXCURSION_KMER_THRESHOLD,
-                                            EXCURSION_KMER_COUNT_THRESHOLD,
-                                            subs=subset)
-
-        print('** merging subset... %s' % subset_file, file=sys.stderr)
-        graph.merge_subset(subset)
-
-        print('** repartitioning, round 2... %s' %
-              subset_file, file=sys.stderr)
-        size = \
-            graph.repartition_largest_partition(counting,
-                                                EXCURSION_DISTANCE,
-                                                EXCURSION_KMER_THRESHOLD,
-                                                EXCURSION_KMER_COUNT_THRESHOLD)
-
-        print('** repartitioned size:', size, file=sys.stderr)
-
-        print('saving stoptags binary', file=sys.stderr)
-        graph.save_stop_tags(graphbase + '.stoptags')
+    if pmap_files:
+        print('merging %d pmap files (first one: %s)' %
+              (len(pmap_files), pmap_files[0]), file=sys.stderr)
+        for subset_file in pmap_files:
+            print('<-', subset_file, file=sys.stderr)
+            graph.merge_subset_from_disk(subset_file)
+    else:
+        print('loading bundled partition map', file=sys.stderr)
+        bundle.load_partitionmap()
+
+    print('** finding knots on %d threads...' % args.threads,
+          file=sys.stderr)
+    n_stop_tags = graph.find_knots(counting,
+                                   EXCURSION_DISTANCE,
+                                   EXCURSION_KMER_THRESHOLD,
+                                   EXCURSION_KMER_COUNT_THRESHOLD,
+                                   n_threads=args.threads)
+    print('** found %d new stoptags' % n_stop_tags, file=sys.stderr)
+
+    print('saving stoptags binary', file=sys.stderr)
+    graph.save_stop_tags(graphbase + '.stoptags')
+    for subset_file in pmap_files:
         os.rename(subset_file, subset_file + '.processed')
-        print('(%d of %d)\n' % (index, len(pmap_files)), file=sys.stderr)
 
     print('done!', file=sys.stderr)
 
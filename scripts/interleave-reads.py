@@ -45,22 +45,15 @@ and interleave them.
 By default, output is sent to stdout; or use -o. Use '-h' for parameter help.
 """
 
-import screed
 import sys
 import textwrap
 from khmer import __version__
+from khmer import FastxInterleaver
 from khmer.kfile import check_input_files, check_space
 from khmer.khmer_args import sanitize_help, KhmerArgumentParser
 from khmer.khmer_args import FileType as khFileType
 from khmer.kfile import (add_output_compression_type, get_file_writer,
                          describe_file_handle)
-from khmer.utils import (write_record_pair, check_is_left, check_is_right,
-                         check_is_pair)
-
-try:
-    from itertools import zip_longest
-except ImportError:
-    from itertools import izip_longest as zip_longest
 
 
 def get_parser():
@@ -111,39 +104,15 @@ def main():
 
     outfp = get_file_writer(args.output, args.gzip, args.bzip)
 
-    counter = 0
-    screed_iter_1 = screed.open(s1_file)
-    screed_iter_2 = screed.open(s2_file)
-    for read1, read2 in zip_longest(screed_iter_1, screed_iter_2):
-        if read1 is None or read2 is None:
-            print(("ERROR: Input files contain different number"
-                   " of records."), file=sys.stderr)
-            sys.exit(1)
-
-        if counter % 100000 == 0:
-            print('...', counter, 'pairs', file=sys.stderr)
-        counter += 1
-
-        name1 = read1.name
-        name2 = read2.name
-
-        if not args.no_reformat:
-            if not check_is_left(name1):
-                name1 += '/1'
-            if not check_is_right(name2):
-                name2 += '/2'
-
-            read1.name = name1
-            read2.name = name2
-
-            if not check_is_pair(read1, read2):
-                print("ERROR: This doesn't look like paired data! "
-                      "%s %s" % (read1.name, read2.name), file=sys.stderr)
-                sys.exit(1)
-
-        write_record_pair(read1, read2, outfp)
+    interleaver = FastxInterleaver(s1_file, s2_file,
+                                   reformat=not args.no_reformat)
+    try:
+        interleaver.write_to(outfp)
+    except ValueError as err:
+        print('ERROR: %s' % err, file=sys.stderr)
+        sys.exit(1)
 
-    print('final: interleaved %d pairs' % counter, file=sys.stderr)
+    print('final: interleaved %d pairs' % interleaver.n_pairs, file=sys.stderr)
     print('output written to', describe_file_handle(outfp), file=sys.stderr)
 
 
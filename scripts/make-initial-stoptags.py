@@ -45,7 +45,8 @@ import textwrap
 import khmer
 from khmer import Nodegraph
 from khmer import khmer_args
-from khmer.khmer_args import (build_counting_args, sanitize_help)
+from khmer.khmer_args import (build_counting_args, add_threading_args,
+                               sanitize_help)
 from khmer.kfile import check_input_files
 
 DEFAULT_SUBSET_SIZE = int(1e4)
@@ -96,6 +97,7 @@ def get_parser():
                         'filenames')
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exists')
+    add_threading_args(parser)
     return parser
 
 
@@ -138,13 +140,13 @@ def main():
     print('doing pre-partitioning from', start, 'to', end, file=sys.stderr)
     subset = nodegraph.do_subset_partition(start, end)
 
-    # now, repartition...
-    print('repartitioning to find HCKs.', file=sys.stderr)
-    nodegraph.repartition_largest_partition(counting,
-                                            EXCURSION_DISTANCE,
-                                            EXCURSION_KMER_THRESHOLD,
-                                            EXCURSION_KMER_COUNT_THRESHOLD,
-                                            subs=subset)
+    # now, traverse the largest partition to find HCKs...
+    print('finding HCKs on %d threads.' % args.threads, file=sys.stderr)
+    nodegraph.find_knots(counting,
+                         EXCURSION_DISTANCE,
+                         EXCURSION_KMER_THRESHOLD,
+                         EXCURSION_KMER_COUNT_THRESHOLD,
+                         subs=subset, n_threads=args.threads)
 
     print('saving stop tags', file=sys.stderr)
     nodegraph.save_stop_tags(graphbase + '.stoptags')
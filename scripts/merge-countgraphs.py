@@ -0,0 +1,120 @@
+#! /usr/bin/env python
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the University of California nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=invalid-name,missing-docstring
+"""
+Merge several k-mer countgraphs into one by adding their counts.
+
+% python scripts/merge-countgraphs.py -o <output> <countgraph1> [ ... ]
+
+Use '-h' for parameter help.
+"""
+import sys
+import textwrap
+
+from khmer import Countgraph, SmallCountgraph, calc_expected_collisions
+from khmer.kfile import check_input_files, check_space, check_file_writable
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
+
+
+def get_parser():
+    epilog = """\
+    Add up the counts of any number of k-mer countgraphs, e.g. ones built
+    from different read files by separate :program:`load-into-counting.py`
+    runs, and save the result as a single countgraph.  All inputs must have
+    been built with the same k-mer size, number of tables and table size.
+    Counts that would overflow are capped, as when counting.
+
+    The first countgraph is loaded into memory and every other one is
+    streamed from disk and added in chunks, so merging needs little more
+    memory than a single countgraph.
+
+    Example::
+
+        load-into-counting.py -k 20 -x 5e7 a.ct data/reads-1.fa
+        load-into-counting.py -k 20 -x 5e7 b.ct data/reads-2.fa
+        merge-countgraphs.py -o merged.ct a.ct b.ct
+    """
+    parser = KhmerArgumentParser(
+        description='Merge k-mer countgraphs by adding their counts.',
+        epilog=textwrap.dedent(epilog))
+
+    parser.add_argument('input_countgraphs', metavar='input_count_graph'
+                        '_filename', nargs='+',
+                        help='input k-mer countgraph filenames')
+    parser.add_argument('-o', '--output', metavar='output_count_graph'
+                        '_filename', required=True,
+                        help='output k-mer countgraph filename')
+    parser.add_argument('--small-count', default=False, action='store_true',
+                        help='Inputs were built with --small-count; they '
+                        'are loaded into memory one at a time.')
+    parser.add_argument('-f', '--force', default=False, action='store_true',
+                        help='Overwrite output file if it exists')
+    add_threading_args(parser)
+    return parser
+
+
+def main():
+    args = sanitize_help(get_parser()).parse_args()
+
+    for infile in args.input_countgraphs:
+        check_input_files(infile, args.force)
+
+    check_space(args.input_countgraphs[:1], args.force)
+    check_file_writable(args.output)
+
+    graph_type = SmallCountgraph if args.small_count else Countgraph
+
+    first = args.input_countgraphs[0]
+    print('loading k-mer countgraph from', first, file=sys.stderr)
+    countgraph = graph_type.load(first)
+
+    for infile in args.input_countgraphs[1:]:
+        print('adding k-mer countgraph from', infile, file=sys.stderr)
+        if args.small_count:
+            countgraph.update(graph_type.load(infile), n_threads=args.threads)
+        else:
+            countgraph.update_from_file(infile, n_threads=args.threads)
+
+    print('saving merged k-mer countgraph to', args.output, file=sys.stderr)
+    countgraph.save(args.output)
+
+    fp_rate = calc_expected_collisions(countgraph, args.force,
+                                       max_false_pos=.2)
+    print('fp rate estimated to be %1.3f' % fp_rate, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -76,7 +76,8 @@ class WithDiagnostics(object):
     uses a Normalizer object.
     """
 
-    def __init__(self, norm, report_fp=None, report_frequency=100000):
+    def __init__(self, norm, report_fp=None, report_frequency=100000,
+                 checkpoint=None):
         self.norm = norm
         self.report_fp = report_fp
         if report_fp:
@@ -89,6 +90,10 @@ class WithDiagnostics(object):
         self.next_report_at = self.report_frequency
         self.last_report_at = self.report_frequency
 
+        self.checkpoint = checkpoint
+        if checkpoint:
+            self.next_checkpoint_at = checkpoint.frequency
+
     def __call__(self, reader, ifilename):
         norm = self.norm
         report_fp = self.report_fp
@@ -127,6 +132,10 @@ class WithDiagnostics(object):
                                       kept=kept),
                               file=report_fp)
                         report_fp.flush()
+
+                if self.checkpoint and total >= self.next_checkpoint_at:
+                    self.next_checkpoint_at += self.checkpoint.frequency
+                    self.checkpoint()
         finally:
             self.total = total
             self.kept = kept
@@ -179,6 +188,30 @@ class Normalizer(object):
                 yield record
 
 
+class Checkpointer(object):
+    """Save the countgraph periodically without pausing diginorm."""
+
+    def __init__(self, countgraph, filename, frequency):
+        self.countgraph = countgraph
+        self.filename = filename
+        self.frequency = frequency
+        self.snapshot = None
+
+    def __call__(self):
+        """Start a background snapshot, unless the last is still running."""
+        if self.snapshot is not None and not self.snapshot.is_done():
+            return
+        self.finish()
+        log_info('... checkpointing countgraph to {name}', name=self.filename)
+        self.snapshot = self.countgraph.save_snapshot(self.filename)
+
+    def finish(self):
+        """Wait for the snapshot in progress, if any."""
+        if self.snapshot is not None:
+            snapshot, self.snapshot = self.snapshot, None
+            snapshot.wait()
+
+
 @contextmanager
 def catch_io_errors(ifile, out, single_out, force, corrupt_files):
     """Context manager to do boilerplate handling of IOErrors."""
@@ -223,6 +256,8 @@ def get_parser():
     files.  Note that these graphs are are in the same format as those
     produced by :program:`load-into-counting.py` and consumed by
     :program:`abundance-dist.py`.
+    :option:`--checkpoint-frequency` additionally saves it every N reads as a
+    checkpoint, written in the background so that processing doesn't pause.
 
     To append reads to an output file (rather than overwriting it), send output
     to STDOUT with `--output -` and use UNIX file redirection syntax (`>>`) to
@@ -275,6 +310,11 @@ def get_parser():
     parser.add_argument('-s', '--savegraph', metavar="filename", default=None,
                         help='save the k-mer countgraph to disk after all '
                         'reads are loaded.')
+    parser.add_argument('--checkpoint-frequency', metavar='N', type=int,
+                        default=0,
+                        help='with -s/--savegraph, also save the countgraph '
+                        'every N reads, in the background while reads '
+                        'continue to be processed')
     parser.add_argument('-R', '--report',
                         help='write progress report to report_filename',
                         metavar='report_filename', type=argparse.FileType('w'))
@@ -332,6 +372,9 @@ def main():  # pylint: disable=too-many-branches,too-many-statements
     if args.savegraph is not None:
         graphsize = calculate_graphsize(args, 'countgraph')
         check_space_for_graph(args.savegraph, graphsize, args.force)
+    elif args.checkpoint_frequency:
+        log_error('ERROR: --checkpoint-frequency requires -s/--savegraph')
+        sys.exit(1)
 
     # load or create counting table.
     if args.loadgraph:
@@ -344,7 +387,12 @@ def main():  # pylint: disable=too-many-branches,too-many-statements
 
     # create an object to handle diginorm of all files
     norm = Normalizer(args.cutoff, countgraph)
-    with_diagnostics = WithDiagnostics(norm, report_fp, args.report_frequency)
+    checkpoint = None
+    if args.checkpoint_frequency > 0:
+        checkpoint = Checkpointer(countgraph, args.savegraph,
+                                  args.checkpoint_frequency)
+    with_diagnostics = WithDiagnostics(norm, report_fp, args.report_frequency,
+                                       checkpoint)
 
     # make a list of all filenames and if they're paired or not;
     # if we don't know if they're paired, default to allowing but not
@@ -400,6 +448,8 @@ def main():  # pylint: disable=too-many-branches,too-many-statements
              umers=countgraph.n_unique_kmers())
 
     if args.savegraph is not None:
+        if checkpoint:
+            checkpoint.finish()
         log_info('...saving to {name}', name=args.savegraph)
         countgraph.save(args.savegraph)
 
@@ -48,7 +48,7 @@ import threading
 import textwrap
 import sys
 
-from khmer import Nodegraph
+from khmer import GraphBundle, Nodegraph
 from khmer.khmer_args import (add_threading_args, sanitize_help,
                               KhmerArgumentParser)
 from khmer.kfile import check_input_files
@@ -67,7 +67,8 @@ DEFAULT_N_THREADS = 4
 def get_parser():
     epilog = """\
     The resulting partition maps are saved as ``${basename}.subset.#.pmap``
-    files.
+    files. basename may also be a graph bundle made by :program:`load-graph.py`
+    :option:`--bundle`; its stop tags, if any, are loaded too.
     """
     parser = KhmerArgumentParser(
         description="Partition a sequence graph based upon waypoint "
@@ -75,7 +76,7 @@ def get_parser():
         citations=['graph'])
 
     parser.add_argument('basename', help="basename of the input k-mer "
-                        "nodegraph  + tagset files")
+                        "nodegraph  + tagset files, or a graph bundle")
     parser.add_argument('-S', '--stoptags', metavar='filename', default='',
                         help="Use stoptags in this file during partitioning")
     parser.add_argument('-s', '--subset-size', default=DEFAULT_SUBSET_SIZE,
@@ -94,7 +95,16 @@ def main():
     args = sanitize_help(get_parser()).parse_args()
     basename = args.basename
 
-    filenames = [basename, basename + '.tagset']
+    bundle = None
+    if GraphBundle.is_bundle(basename):
+        bundle = GraphBundle(basename)
+        if 'tagset' not in bundle:
+            print('ERROR: graph bundle %s has no tagset; rebuild it without '
+                  '--no-build-tagset' % basename, file=sys.stderr)
+            sys.exit(1)
+        filenames = [basename]
+    else:
+        filenames = [basename, basename + '.tagset']
     for _ in filenames:
         check_input_files(_, args.force)
 
@@ -105,9 +115,18 @@ def main():
         print('stoptag file:', args.stoptags, file=sys.stderr)
     print('--', file=sys.stderr)
 
-    print('loading nodegraph %s' % basename, file=sys.stderr)
-    nodegraph = Nodegraph.load(basename)
-    nodegraph.load_tagset(basename + '.tagset')
+    if bundle is not None:
+        print('loading nodegraph and tagset from bundle %s' % basename,
+              file=sys.stderr)
+        nodegraph = bundle.graph
+        bundle.load_tagset()
+        if 'stoptags' in bundle:
+            print('loading bundled stoptags', file=sys.stderr)
+            bundle.load_stop_tags()
+    else:
+        print('loading nodegraph %s' % basename, file=sys.stderr)
+        nodegraph = Nodegraph.load(basename)
+        nodegraph.load_tagset(basename + '.tagset')
 
     # do we want to load stop tags, and do they exist?
     if args.stoptags:
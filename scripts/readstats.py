@@ -45,9 +45,9 @@ Use '-h' for parameter help.
 import argparse
 import sys
 import csv
-import screed
 import textwrap
 
+from khmer import fastx_stats
 from khmer.khmer_args import sanitize_help, KhmerArgumentParser
 
 
@@ -158,14 +158,7 @@ class StdFormatter(object):
 
 def analyze_file(filename):
     """Run over the given file and count base pairs and sequences."""
-    bps = 0
-    seqs = 0
-    input_iter = screed.open(filename)
-    for record in input_iter:
-        if seqs % 100000 == 0:
-            print('...', filename, seqs, file=sys.stderr)
-        bps += len(record.sequence)
-        seqs += 1
+    seqs, bps = fastx_stats(filename)
     return bps, seqs
 
 
@@ -178,7 +171,7 @@ def main():
     for filename in args.filenames:
         try:
             bps, seqs = analyze_file(filename)
-        except (IOError, OSError, EOFError) as exc:
+        except (IOError, OSError, EOFError, ValueError) as exc:
             print('ERROR in opening %s:' % filename, file=sys.stderr)
             print('     ', str(exc), file=sys.stderr)
             continue
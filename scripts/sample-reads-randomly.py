@@ -48,16 +48,14 @@ Reads FASTQ and FASTA input, retains format for output.
 
 import argparse
 import os.path
-import random
 import textwrap
 import sys
 
 from khmer import __version__
-from khmer import ReadParser
-from khmer.kfile import (check_input_files, add_output_compression_type,
-                         get_file_writer)
-from khmer.khmer_args import sanitize_help, KhmerArgumentParser
-from khmer.utils import write_record, broken_paired_reader
+from khmer import ReservoirSampler
+from khmer.kfile import check_input_files, add_output_compression_type
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
 
 DEFAULT_NUM_READS = int(1e5)
 DEFAULT_MAX_READS = int(1e8)
@@ -71,6 +69,8 @@ def get_parser():
     reservoir sampling.  Stop after first 100m sequences
     (:option:`-M`/:option:`--max_reads`). By default take one subsample,
     but take :option:`-S`/:option:`--samples` samples if specified.
+    Interleaved read pairs are kept together and count as one sequence
+    unless :option:`--force_single` is given.
 
     The output is placed in :option:`-o`/:option:`--output` <file>
     (for a single sample) or in ``<file>.subset.0`` to ``<file>.subset.S-1``
@@ -78,6 +78,10 @@ def get_parser():
 
     This script uses the `reservoir sampling
     <http://en.wikipedia.org/wiki/Reservoir_sampling>`__ algorithm.
+    Uncompressed input files are split into parts that are sampled on
+    :option:`-T`/:option:`--threads` threads and then merged; the samples
+    taken for a given :option:`-R`/:option:`--random-seed` do not depend
+    on the number of threads.
     """
 
     parser = KhmerArgumentParser(
@@ -101,6 +105,7 @@ def get_parser():
                         metavar="filename", default=None)
     parser.add_argument('-f', '--force', default=False, action='store_true',
                         help='Overwrite output file if it exits')
+    add_threading_args(parser)
     add_output_compression_type(parser)
     return parser
 
@@ -117,10 +122,6 @@ def main():
     for name in args.filenames:
         check_input_files(name, args.force)
 
-    # seed the random number generator?
-    if args.random_seed:
-        random.seed(args.random_seed)
-
     # bound n_samples
     num_samples = max(args.num_samples, 1)
 
@@ -144,11 +145,6 @@ def main():
             sys.exit(1)
         output_filename = os.path.basename(filename) + '.subset'
 
-    filename = args.filenames[0]
-    if filename in ('/dev/stdin', '-'):
-        # seqan only treats '-' as "read from stdin"
-        filename = '-'
-
     if num_samples == 1:
         print('Subsampling %d reads using reservoir sampling.' %
               args.num_reads, file=sys.stderr)
@@ -163,65 +159,48 @@ def main():
               % output_filename, file=sys.stderr)
         print('', file=sys.stderr)
 
-    reads = []
-    for _ in range(num_samples):
-        reads.append([])
-
-    # read through all the sequences and load/resample the reservoir
-    for filename in args.filenames:
+    # the sampler reads '-' as stdin
+    filenames = ['-' if filename == '/dev/stdin' else filename
+                 for filename in args.filenames]
+    for filename in filenames:
         print('opening', filename, 'for reading', file=sys.stderr)
 
-        for count, (_, _, rcrd1, rcrd2) in enumerate(broken_paired_reader(
-                ReadParser(filename), force_single=args.force_single)):
-            if count % 10000 == 0:
-                print('...', count, 'reads scanned', file=sys.stderr)
-                if count >= args.max_reads:
-                    print('reached upper limit of %d reads' %
-                          args.max_reads, '(see -M); exiting', file=sys.stderr)
-                    break
-
-            # collect first N reads
-            if count < args.num_reads:
-                for sample in range(num_samples):
-                    reads[sample].append((rcrd1, rcrd2))
-            else:
-                for sample in range(num_samples):
-                    assert len(reads[sample]) <= count
+    sampler = ReservoirSampler(args.num_reads, num_samples,
+                               force_single=args.force_single,
+                               max_units=max(args.max_reads, 0),
+                               seed=args.random_seed)
+    sampler.sample(filenames, args.threads)
 
-                # use reservoir sampling to replace reads at random
-                # see http://en.wikipedia.org/wiki/Reservoir_sampling
+    print('...', sampler.n_reads, 'reads scanned', file=sys.stderr)
+    if args.max_reads > 0 and sampler.n_units >= args.max_reads:
+        print('reached upper limit of %d reads' % args.max_reads,
+              '(see -M); exiting', file=sys.stderr)
 
-                for n in range(num_samples):
-                    guess = random.randint(1, count)
-                    if guess <= args.num_reads:
-                        reads[n][guess - 1] = (rcrd1, rcrd2)
+    compression = None
+    if args.gzip:
+        compression = 'gzip'
+    elif args.bzip:
+        compression = 'bzip2'
 
     # output all the subsampled reads:
-    if len(reads) == 1:
+    if num_samples == 1:
         print('Writing %d sequences to %s' %
-              (len(reads[0]), output_filename), file=sys.stderr)
-
-        output_file = args.output_file
-        if not output_file:
-            output_file = open(output_filename, 'wb')
+              (len(sampler), output_filename), file=sys.stderr)
 
-        output_file = get_file_writer(output_file, args.gzip, args.bzip)
+        if args.output_file:
+            if output_filename == '<stdout>':
+                args.output_file.flush()
+                output_filename = '-'
+            else:
+                args.output_file.close()
 
-        for records in reads[0]:
-            write_record(records[0], output_file)
-            if records[1] is not None:
-                write_record(records[1], output_file)
+        sampler.write_sample(0, output_filename, compression)
     else:
         for n in range(num_samples):
             n_filename = output_filename + '.%d' % n
             print('Writing %d sequences to %s' %
-                  (len(reads[n]), n_filename), file=sys.stderr)
-            output_file = get_file_writer(open(n_filename, 'wb'), args.gzip,
-                                          args.bzip)
-            for records in reads[n]:
-                write_record(records[0], output_file)
-                if records[1] is not None:
-                    write_record(records[1], output_file)
+                  (len(sampler), n_filename), file=sys.stderr)
+            sampler.write_sample(n, n_filename, compression)
 
 
 if __name__ == '__main__':
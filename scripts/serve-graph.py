@@ -0,0 +1,134 @@
+#! /usr/bin/env python
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the University of California nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=invalid-name,missing-docstring
+"""
+Load a k-mer graph once and answer k-mer queries on it over a local socket.
+
+% python scripts/serve-graph.py <graph> <socket>
+
+Use '-h' for parameter help.
+"""
+import gzip
+import sys
+import textwrap
+import threading
+
+import khmer
+from khmer import Countgraph, SmallCountgraph, Nodegraph, QueryServer
+from khmer.kfile import check_input_files
+from khmer.khmer_args import (sanitize_help, KhmerArgumentParser,
+                              add_threading_args)
+
+GRAPH_TYPES = {
+    khmer.FILETYPES['COUNTING_HT']: Countgraph,
+    khmer.FILETYPES['SMALLCOUNT']: SmallCountgraph,
+    khmer.FILETYPES['HASHBITS']: Nodegraph,
+}
+
+
+def get_parser():
+    epilog = """\
+    Load a countgraph or nodegraph once and keep it in memory, answering
+    batched count, median-count and trim queries from other processes over
+    a Unix domain socket, until interrupted or asked to shut down.  Query it
+    from Python with :class:`khmer.query_client.QueryClient`::
+
+        from khmer.query_client import QueryClient
+        with QueryClient('counts.sock') as client:
+            medians = client.get_median_counts(sequences)
+
+    Each connection is served by one of --threads worker threads; further
+    connections wait for a free worker.
+
+    Example::
+
+        load-into-counting.py -k 20 -x 5e7 counts.ct data/reads.fa
+        serve-graph.py -T 8 counts.ct counts.sock
+    """
+    parser = KhmerArgumentParser(
+        description='Serve k-mer queries on a graph over a local socket.',
+        epilog=textwrap.dedent(epilog))
+
+    parser.add_argument('graph', metavar='input_graph_filename',
+                        help='countgraph or nodegraph to serve')
+    parser.add_argument('socket', metavar='socket_path',
+                        help='Unix domain socket to listen on')
+    parser.add_argument('-f', '--force', default=False, action='store_true',
+                        help='Continue past file existence checks')
+    add_threading_args(parser)
+    return parser
+
+
+def load_graph(filename):
+    opener = gzip.open if filename.endswith('.gz') else open
+    with opener(filename, 'rb') as graph_file:
+        header = graph_file.read(6)
+    if len(header) < 6 or header[:4] != b'OXLI' or \
+            header[5] not in GRAPH_TYPES:
+        raise ValueError("'{}' is not a countgraph or nodegraph "
+                         "file".format(filename))
+    return GRAPH_TYPES[header[5]].load(filename)
+
+
+def main():
+    args = sanitize_help(get_parser()).parse_args()
+
+    check_input_files(args.graph, args.force)
+
+    print('loading k-mer graph from', args.graph, file=sys.stderr)
+    try:
+        graph = load_graph(args.graph)
+    except (OSError, ValueError) as err:
+        print('** ERROR:', err, file=sys.stderr)
+        sys.exit(1)
+
+    server = QueryServer(graph, args.socket, n_threads=args.threads)
+    print('serving queries on', args.socket, file=sys.stderr)
+
+    # serve from a second thread so that Ctrl-C still reaches this one
+    serving = threading.Thread(target=server.serve)
+    serving.start()
+    try:
+        while serving.is_alive():
+            serving.join(1)
+    except KeyboardInterrupt:
+        server.stop()
+        serving.join()
+
+    print('shut down', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
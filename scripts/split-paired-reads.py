@@ -49,11 +49,9 @@ import os
 import textwrap
 
 from khmer import __version__
-from khmer import ReadParser
+from khmer import FastxPairSplitter
 from khmer.khmer_args import sanitize_help, KhmerArgumentParser
 from khmer.khmer_args import FileType as khFileType
-from khmer.utils import (write_record, broken_paired_reader,
-                         UnpairedReadsError)
 from khmer.kfile import (check_input_files, check_space,
                          add_output_compression_type,
                          get_file_writer, describe_file_handle)
@@ -162,33 +160,20 @@ def main():
         fp_out0 = get_file_writer(args.output_orphaned, args.gzip, args.bzip)
         out0 = describe_file_handle(args.output_orphaned)
 
-    counter1 = 0
-    counter2 = 0
-    counter3 = 0
-    index = None
-
     # walk through all the reads in broken-paired mode.
-    paired_iter = broken_paired_reader(ReadParser(infile),
-                                       require_paired=not args.output_orphaned)
-
+    splitter = FastxPairSplitter(infile,
+                                 allow_orphans=bool(args.output_orphaned))
     try:
-        for index, is_pair, record1, record2 in paired_iter:
-            if index % 10000 == 0:
-                print('...', index, file=sys.stderr)
-
-            if is_pair:
-                write_record(record1, fp_out1)
-                counter1 += 1
-                write_record(record2, fp_out2)
-                counter2 += 1
-            elif args.output_orphaned:
-                write_record(record1, fp_out0)
-                counter3 += 1
-    except UnpairedReadsError as e:
-        print("Unpaired reads found starting at {name}; exiting".format(
-            name=e.read1.name), file=sys.stderr)
+        if args.output_orphaned:
+            splitter.write_to(fp_out1, fp_out2, fp_out0)
+        else:
+            splitter.write_to(fp_out1, fp_out2)
+    except ValueError as err:
+        print("{}; exiting".format(err), file=sys.stderr)
         sys.exit(1)
 
+    counter1 = counter2 = splitter.n_pairs
+    counter3 = splitter.n_orphans
     print("DONE; split %d sequences (%d left, %d right, %d orphans)" %
           (counter1 + counter2, counter1, counter2, counter3), file=sys.stderr)
     print("/1 reads in %s" % out1, file=sys.stderr)
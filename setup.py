@@ -153,7 +153,10 @@ BUILD_DEPENDS = [path_join("include", "khmer", bn + ".hh") for bn in [
 BUILD_DEPENDS.extend(path_join("include", "oxli", bn + ".hh") for bn in [
     "khmer", "kmer_hash", "hashtable", "labelhash", "hashgraph",
     "hllcounter", "oxli_exception", "read_aligner", "subset", "read_parsers",
-    "kmer_filters", "traversal", "assembler", "alphabets", "storage"])
+    "kmer_filters", "traversal", "assembler", "alphabets", "storage",
+    "batch_pipeline", "partition_extractor", "sorted_hashes", "snapshot",
+    "query_server", "table_alloc", "exact_counter",
+    "graph_bundle", "reservoir_sampler", "fastx_scanner"])
 
 SOURCES = [path_join("src", "khmer", bn + ".cc") for bn in [
     "_cpy_khmer", "_cpy_utils", "_cpy_readparsers"
@@ -162,7 +165,9 @@ SOURCES.extend(path_join("src", "oxli", bn + ".cc") for bn in [
     "read_parsers", "kmer_hash", "hashtable", "hashgraph",
     "labelhash", "subset", "read_aligner",
     "hllcounter", "traversal", "kmer_filters", "assembler", "alphabets",
-    "storage"])
+    "storage", "partition_extractor", "sorted_hashes", "snapshot",
+    "query_server", "table_alloc", "exact_counter",
+    "graph_bundle", "reservoir_sampler", "fastx_scanner"])
 
 SOURCES.extend(path_join("third-party", "smhasher", bn + ".cc") for bn in [
     "MurmurHash3"])
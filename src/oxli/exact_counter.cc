@@ -0,0 +1,711 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <queue>
+#include <sstream> // IWYU pragma: keep
+
+#include "oxli/batch_pipeline.hh"
+#include "oxli/exact_counter.hh"
+#include "oxli/oxli_exception.hh"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// signature, version, type, ksize, prefix bits, number of k-mers
+#define EXACT_HEADER_SIZE 16
+// largest index of a count file, in prefix bits
+#define EXACT_MAX_PREFIX_BITS 24
+// hashes copied at a time while writing a count file
+#define EXACT_COPY_CHUNK (1024*1024)
+
+using namespace oxli;
+using namespace oxli::read_parsers;
+
+namespace
+{
+
+// index of a storage with nothing loaded: one prefix bit, no k-mers
+const uint64_t empty_index[3] = { 0, 0, 0 };
+
+unsigned int count_threads(unsigned int n_threads)
+{
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#else
+    n_threads = 1;
+#endif
+    return n_threads ? n_threads : 1;
+}
+
+std::string file_error(const std::string& what, const std::string& path)
+{
+    return what + " " + path + ": " + strerror(errno);
+}
+
+void write_file(FILE * fp, const void * data, size_t size, size_t n,
+                const std::string& path)
+{
+    if (n && fwrite(data, size, n, fp) != n) {
+        throw oxli_file_exception(file_error("Error writing", path));
+    }
+}
+
+void read_file(FILE * fp, void * data, size_t size, size_t n,
+               const std::string& path)
+{
+    if (n && fread(data, size, n, fp) != n) {
+        throw oxli_file_exception(file_error("Error reading", path));
+    }
+}
+
+FILE * open_file(const std::string& path, const char * mode)
+{
+    FILE * fp = fopen(path.c_str(), mode);
+    if (fp == NULL) {
+        throw oxli_file_exception(file_error("Cannot open", path));
+    }
+    return fp;
+}
+
+// a file closed when it goes out of scope, unless close() was called
+class ScopedFile
+{
+    FILE * _fp;
+    std::string _path;
+public:
+    ScopedFile(const std::string& path, const char * mode)
+        : _fp(open_file(path, mode)), _path(path) { }
+    ~ScopedFile()
+    {
+        if (_fp != NULL) {
+            fclose(_fp);
+        }
+    }
+
+    FILE * get()
+    {
+        return _fp;
+    }
+    const std::string& path() const
+    {
+        return _path;
+    }
+    void close()
+    {
+        FILE * fp = _fp;
+        _fp = NULL;
+        if (fclose(fp) != 0) {
+            throw oxli_file_exception(file_error("Error writing", _path));
+        }
+    }
+};
+
+// Bucket files and sorted runs hold (hash, count) pairs.
+struct HashCount {
+    HashIntoType hash;
+    uint64_t count;
+};
+
+// false at a clean end of file
+bool read_pair(FILE * fp, HashCount& pair, const std::string& path)
+{
+    if (fread(&pair, sizeof(pair), 1, fp) == 1) {
+        return true;
+    }
+    if (feof(fp)) {
+        return false;
+    }
+    throw oxli_file_exception(file_error("Error reading", path));
+}
+
+// sort pairs by hash and sum the counts of equal hashes, in place
+void sort_and_combine(std::vector<HashCount>& pairs)
+{
+    std::sort(pairs.begin(), pairs.end(),
+    [](const HashCount& a, const HashCount& b) {
+        return a.hash < b.hash;
+    });
+    size_t m = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (m > 0 && pairs[m - 1].hash == pairs[i].hash) {
+            pairs[m - 1].count += pairs[i].count;
+        } else {
+            pairs[m++] = pairs[i];
+        }
+    }
+    pairs.resize(m);
+}
+
+// Writes a bucket's distinct hashes, in order, and their counts to
+// <name>.hashes and <name>.counts.
+class CountWriter
+{
+    ScopedFile _hashes_file, _counts_file;
+    std::vector<HashIntoType> _hashes;
+    std::vector<uint32_t> _counts;
+    uint64_t _n;
+
+    void _flush()
+    {
+        write_file(_hashes_file.get(), _hashes.data(), sizeof(HashIntoType),
+                   _hashes.size(), _hashes_file.path());
+        write_file(_counts_file.get(), _counts.data(), sizeof(uint32_t),
+                   _counts.size(), _counts_file.path());
+        _hashes.clear();
+        _counts.clear();
+    }
+public:
+    explicit CountWriter(const std::string& name)
+        : _hashes_file(name + ".hashes", "wb"),
+          _counts_file(name + ".counts", "wb"), _n(0) { }
+
+    void add(HashIntoType hash, uint64_t count)
+    {
+        _hashes.push_back(hash);
+        _counts.push_back(std::min(count, (uint64_t) UINT32_MAX));
+        _n++;
+        if (_hashes.size() >= EXACT_COPY_CHUNK) {
+            _flush();
+        }
+    }
+
+    // returns the number of distinct hashes written
+    uint64_t close()
+    {
+        _flush();
+        _hashes_file.close();
+        _counts_file.close();
+        return _n;
+    }
+};
+
+} // anonymous namespace
+
+
+ExactCountStorage::ExactCountStorage()
+    : _prefix_bits(1), _n_kmers(0), _index(empty_index), _hashes(NULL),
+      _counts(NULL), _map(NULL), _map_length(0)
+{
+}
+
+ExactCountStorage::~ExactCountStorage()
+{
+    _unmap();
+}
+
+void ExactCountStorage::_unmap()
+{
+    if (_map != NULL) {
+        munmap(_map, _map_length);
+        _map = NULL;
+        _map_length = 0;
+    }
+    _prefix_bits = 1;
+    _n_kmers = 0;
+    _index = empty_index;
+    _hashes = NULL;
+    _counts = NULL;
+}
+
+void ExactCountStorage::save(std::string outfilename, WordLength ksize)
+{
+    // Write beside the destination and rename over it, in case it is the
+    // file mapped here.
+    std::string tmpname = outfilename + ".tmp";
+    FILE * fp = open_file(tmpname, "wb");
+    try {
+        unsigned char header[EXACT_HEADER_SIZE];
+        memcpy(header, SAVED_SIGNATURE, 4);
+        header[4] = SAVED_FORMAT_VERSION;
+        header[5] = SAVED_EXACT_COUNTS;
+        header[6] = ksize;
+        header[7] = _prefix_bits;
+        memcpy(header + 8, &_n_kmers, sizeof(_n_kmers));
+
+        write_file(fp, header, 1, EXACT_HEADER_SIZE, tmpname);
+        write_file(fp, _index, sizeof(uint64_t),
+                   (1ULL << _prefix_bits) + 1, tmpname);
+        write_file(fp, _hashes, sizeof(HashIntoType), _n_kmers, tmpname);
+        write_file(fp, _counts, sizeof(uint32_t), _n_kmers, tmpname);
+        if (fclose(fp) != 0) {
+            fp = NULL;
+            throw oxli_file_exception(file_error("Error writing", tmpname));
+        }
+    } catch (...) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        unlink(tmpname.c_str());
+        throw;
+    }
+    if (rename(tmpname.c_str(), outfilename.c_str()) != 0) {
+        unlink(tmpname.c_str());
+        throw oxli_file_exception(file_error("Cannot write", outfilename));
+    }
+}
+
+void ExactCountStorage::load(std::string infilename, WordLength& ksize)
+{
+    int fd = open(infilename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw oxli_file_exception(
+            file_error("Cannot open k-mer count file:", infilename));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw oxli_file_exception(
+            file_error("Cannot open k-mer count file:", infilename));
+    }
+    size_t length = st.st_size;
+    if (length < EXACT_HEADER_SIZE) {
+        close(fd);
+        throw oxli_file_exception("Truncated k-mer count file: " + infilename);
+    }
+    void * map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw oxli_file_exception(
+            file_error("Cannot map k-mer count file:", infilename));
+    }
+
+    const unsigned char * data = (const unsigned char *) map;
+    unsigned char version = data[4], ht_type = data[5];
+    uint8_t prefix_bits = data[7];
+    uint64_t n_kmers;
+    memcpy(&n_kmers, data + 8, sizeof(n_kmers));
+
+    std::ostringstream err;
+    if (!(std::string((const char *) data, 4) == SAVED_SIGNATURE)) {
+        err << "Does not start with signature for a oxli file: 0x";
+        for(size_t i=0; i < 4; ++i) {
+            err << std::hex << (int) data[i];
+        }
+        err << " Should be: " << SAVED_SIGNATURE;
+    } else if (!(version == SAVED_FORMAT_VERSION)) {
+        err << "Incorrect file format version " << (int) version
+            << " while reading k-mer count file from " << infilename
+            << "; should be " << (int) SAVED_FORMAT_VERSION;
+    } else if (!(ht_type == SAVED_EXACT_COUNTS)) {
+        err << "Incorrect file format type " << (int) ht_type
+            << " expected " << (int) SAVED_EXACT_COUNTS
+            << " while reading k-mer count file from " << infilename;
+    } else if (prefix_bits == 0 || prefix_bits > EXACT_MAX_PREFIX_BITS ||
+               length != EXACT_HEADER_SIZE +
+               ((1ULL << prefix_bits) + 1) * sizeof(uint64_t) +
+               n_kmers * (sizeof(HashIntoType) + sizeof(uint32_t))) {
+        err << "Corrupt k-mer count file: " << infilename;
+    }
+    if (!err.str().empty()) {
+        munmap(map, length);
+        throw oxli_file_exception(err.str());
+    }
+
+    _unmap();
+    ksize = data[6];
+    _map = map;
+    _map_length = length;
+    _prefix_bits = prefix_bits;
+    _n_kmers = n_kmers;
+    _index = (const uint64_t *) (data + EXACT_HEADER_SIZE);
+    _hashes = (const HashIntoType *) (_index + (1ULL << prefix_bits) + 1);
+    _counts = (const uint32_t *) (_hashes + n_kmers);
+}
+
+void ExactCountStorage::abundance_distribution(std::vector<uint64_t>& dist)
+const
+{
+    dist.assign(MAX_BIGCOUNT + 1, 0);
+    for (uint64_t i = 0; i < _n_kmers; i++) {
+        dist[std::min(_counts[i], (uint32_t) MAX_BIGCOUNT)]++;
+    }
+}
+
+
+ExactCountBuilder::ExactCountBuilder(WordLength ksize,
+                                     const std::string& tmpdir,
+                                     unsigned int n_buckets,
+                                     unsigned int n_threads,
+                                     uint64_t sort_chunk)
+    : _ksize(ksize), _n_threads(n_threads), _bucket_bits(0),
+      _sort_chunk(sort_chunk), _n_reads(0), _n_kmers(0)
+{
+    if (n_buckets == 0 || n_buckets > (1U << 16)) {
+        throw InvalidValue("number of buckets must be between 1 and 65536");
+    }
+    if (sort_chunk == 0) {
+        throw InvalidValue("sort chunk must hold at least one k-mer");
+    }
+    while ((1U << _bucket_bits) < n_buckets) {
+        _bucket_bits++;
+    }
+    n_buckets = 1U << _bucket_bits;
+
+    std::string pattern = tmpdir + "/oxli-exact-XXXXXX";
+    std::vector<char> dir(pattern.begin(), pattern.end());
+    dir.push_back('\0');
+    if (mkdtemp(dir.data()) == NULL) {
+        throw oxli_file_exception(
+            file_error("Cannot create temporary directory in", tmpdir));
+    }
+    _dir = dir.data();
+
+    _bucket_locks.reset(new std::mutex[n_buckets]);
+    try {
+        for (unsigned int b = 0; b < n_buckets; b++) {
+            std::ostringstream name;
+            name << _dir << "/bucket-" << b;
+            _bucket_names.push_back(name.str());
+            _buckets.push_back(open_file(name.str(), "w+b"));
+        }
+    } catch (...) {
+        _remove_files();
+        throw;
+    }
+}
+
+ExactCountBuilder::~ExactCountBuilder()
+{
+    _remove_files();
+}
+
+void ExactCountBuilder::_remove_files()
+{
+    for (FILE * fp : _buckets) {
+        fclose(fp);
+    }
+    _buckets.clear();
+    for (const std::string& name : _bucket_names) {
+        unlink(name.c_str());
+        unlink((name + ".hashes").c_str());
+        unlink((name + ".counts").c_str());
+    }
+    _bucket_names.clear();
+    rmdir(_dir.c_str());
+}
+
+void ExactCountBuilder::_append(unsigned int bucket,
+                                std::vector<HashIntoType>& hashes)
+{
+    // Repeats within the buffer are counted here, so a highly repeated
+    // k-mer costs one pair per buffer rather than one per occurrence.
+    std::sort(hashes.begin(), hashes.end());
+    std::vector<HashCount> pairs;
+    for (size_t i = 0; i < hashes.size(); ) {
+        size_t j = i + 1;
+        while (j < hashes.size() && hashes[j] == hashes[i]) {
+            j++;
+        }
+        pairs.push_back(HashCount{hashes[i], j - i});
+        i = j;
+    }
+
+    std::lock_guard<std::mutex> lock(_bucket_locks[bucket]);
+    write_file(_buckets[bucket], pairs.data(), sizeof(HashCount),
+               pairs.size(), _bucket_names[bucket]);
+}
+
+uint64_t ExactCountBuilder::_count_bucket(unsigned int bucket)
+{
+    FILE * fp = _buckets[bucket];
+    const std::string& name = _bucket_names[bucket];
+    if (fseek(fp, 0, SEEK_END) != 0) {
+        throw oxli_file_exception(file_error("Error reading", name));
+    }
+    uint64_t n_pairs = ftell(fp) / sizeof(HashCount);
+    rewind(fp);
+
+    CountWriter out(name);
+    std::vector<HashCount> pairs;
+    if (n_pairs <= _sort_chunk) {
+        pairs.resize(n_pairs);
+        read_file(fp, pairs.data(), sizeof(HashCount), n_pairs, name);
+        sort_and_combine(pairs);
+        for (const HashCount& pair : pairs) {
+            out.add(pair.hash, pair.count);
+        }
+        return out.close();
+    }
+
+    // Too many pairs to sort at once: sort runs of sort_chunk pairs into
+    // files of their own, then merge the runs.
+    std::vector<std::string> run_names;
+    std::vector<FILE *> runs;
+    try {
+        for (uint64_t left = n_pairs; left > 0; ) {
+            uint64_t n = std::min(left, _sort_chunk);
+            pairs.resize(n);
+            read_file(fp, pairs.data(), sizeof(HashCount), n, name);
+            left -= n;
+            sort_and_combine(pairs);
+            run_names.push_back(name + ".run" +
+                                std::to_string(run_names.size()));
+            ScopedFile run(run_names.back(), "wb");
+            write_file(run.get(), pairs.data(), sizeof(HashCount),
+                       pairs.size(), run.path());
+            run.close();
+        }
+        std::vector<HashCount>().swap(pairs);
+
+        std::vector<HashCount> heads(run_names.size());
+        auto later = [&heads](size_t a, size_t b) {
+            return heads[a].hash > heads[b].hash;
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)>
+        queue(later);
+        for (size_t i = 0; i < run_names.size(); i++) {
+            runs.push_back(open_file(run_names[i], "rb"));
+            if (read_pair(runs[i], heads[i], run_names[i])) {
+                queue.push(i);
+            }
+        }
+
+        HashCount current = { 0, 0 };
+        while (!queue.empty()) {
+            size_t i = queue.top();
+            queue.pop();
+            if (current.count > 0 && heads[i].hash == current.hash) {
+                current.count += heads[i].count;
+            } else {
+                if (current.count > 0) {
+                    out.add(current.hash, current.count);
+                }
+                current = heads[i];
+            }
+            if (read_pair(runs[i], heads[i], run_names[i])) {
+                queue.push(i);
+            }
+        }
+        if (current.count > 0) {
+            out.add(current.hash, current.count);
+        }
+    } catch (...) {
+        for (FILE * run : runs) {
+            fclose(run);
+        }
+        for (const std::string& run_name : run_names) {
+            unlink(run_name.c_str());
+        }
+        throw;
+    }
+
+    for (FILE * run : runs) {
+        fclose(run);
+    }
+    for (const std::string& run_name : run_names) {
+        unlink(run_name.c_str());
+    }
+    return out.close();
+}
+
+template<typename SeqIO>
+void ExactCountBuilder::consume_seqfile(ReadParserPtr<SeqIO>& parser)
+{
+    if (_buckets.empty()) {
+        throw oxli_exception("k-mer counts have already been written");
+    }
+
+    typedef std::vector<HashIntoType> HashBuffer;
+    ReadBatchPipeline<SeqIO> pipeline(parser, _n_threads);
+    const unsigned int n_buckets = _buckets.size();
+    const unsigned int shift = 64 - _bucket_bits;
+    std::vector<std::vector<HashBuffer> > buffers(
+        pipeline.n_threads(), std::vector<HashBuffer>(n_buckets));
+
+    pipeline.run([&](ReadBatch& batch, unsigned int t) -> uint64_t {
+        uint64_t n = 0;
+        for (auto& read : batch.reads)
+        {
+            read.set_clean_seq();
+            MurmurKmerHashIterator kmers(read.cleaned_seq.c_str(), _ksize);
+
+            while (!kmers.done()) {
+                HashIntoType kmer = kmers.next();
+                unsigned int b = _bucket_bits ? kmer >> shift : 0;
+                HashBuffer& buffer = buffers[t][b];
+                buffer.push_back(kmer);
+                if (buffer.size() >= EXACT_COUNT_BUFFER) {
+                    _append(b, buffer);
+                    buffer.clear();
+                }
+                n++;
+            }
+        }
+        return n;
+    });
+
+    for (auto& thread_buffers : buffers) {
+        for (unsigned int b = 0; b < n_buckets; b++) {
+            _append(b, thread_buffers[b]);
+        }
+    }
+    _n_reads += pipeline.n_reads();
+    _n_kmers += pipeline.n_consumed();
+}
+
+uint64_t ExactCountBuilder::write(const std::string& filename)
+{
+    if (_buckets.empty()) {
+        throw oxli_exception("k-mer counts have already been written");
+    }
+
+    // Sort and count each bucket into a file of distinct hashes and one of
+    // their counts.
+    const long n_buckets = _buckets.size();
+    std::vector<uint64_t> n_distinct(n_buckets, 0);
+    std::exception_ptr error;
+    std::mutex error_lock;
+
+    #pragma omp parallel for schedule(dynamic, 1) \
+        num_threads(count_threads(_n_threads))
+    for (long b = 0; b < n_buckets; b++) {
+        try {
+            n_distinct[b] = _count_bucket(b);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_lock);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Buckets follow each other in hash order, so concatenating them gives
+    // the sorted hashes of the count file; its index is filled in on the
+    // way and written last.
+    uint64_t n_kmers = 0;
+    for (uint64_t n : n_distinct) {
+        n_kmers += n;
+    }
+    uint8_t prefix_bits = 1;
+    while (prefix_bits < EXACT_MAX_PREFIX_BITS &&
+            (n_kmers >> (prefix_bits + 3)) > 0) {
+        prefix_bits++;
+    }
+    std::vector<uint64_t> index((1ULL << prefix_bits) + 1, 0);
+
+    FILE * out = open_file(filename, "wb");
+    try {
+        unsigned char header[EXACT_HEADER_SIZE];
+        memcpy(header, SAVED_SIGNATURE, 4);
+        header[4] = SAVED_FORMAT_VERSION;
+        header[5] = SAVED_EXACT_COUNTS;
+        header[6] = _ksize;
+        header[7] = prefix_bits;
+        memcpy(header + 8, &n_kmers, sizeof(n_kmers));
+        write_file(out, header, 1, EXACT_HEADER_SIZE, filename);
+        write_file(out, index.data(), sizeof(uint64_t), index.size(),
+                   filename);
+
+        std::vector<HashIntoType> chunk;
+        uint64_t pos = 0, next_prefix = 0;
+        for (long b = 0; b < n_buckets; b++) {
+            std::string name = _bucket_names[b] + ".hashes";
+            ScopedFile in(name, "rb");
+            for (uint64_t left = n_distinct[b]; left > 0; ) {
+                chunk.resize(std::min(left, (uint64_t) EXACT_COPY_CHUNK));
+                read_file(in.get(), chunk.data(), sizeof(HashIntoType),
+                          chunk.size(), name);
+                for (HashIntoType kmer : chunk) {
+                    uint64_t prefix = kmer >> (64 - prefix_bits);
+                    while (next_prefix <= prefix) {
+                        index[next_prefix++] = pos;
+                    }
+                    pos++;
+                }
+                write_file(out, chunk.data(), sizeof(HashIntoType),
+                           chunk.size(), filename);
+                left -= chunk.size();
+            }
+        }
+        while (next_prefix < index.size()) {
+            index[next_prefix++] = pos;
+        }
+
+        std::vector<uint32_t> counts;
+        for (long b = 0; b < n_buckets; b++) {
+            std::string name = _bucket_names[b] + ".counts";
+            ScopedFile in(name, "rb");
+            for (uint64_t left = n_distinct[b]; left > 0; ) {
+                counts.resize(std::min(left, (uint64_t) EXACT_COPY_CHUNK));
+                read_file(in.get(), counts.data(), sizeof(uint32_t),
+                          counts.size(), name);
+                write_file(out, counts.data(), sizeof(uint32_t),
+                           counts.size(), filename);
+                left -= counts.size();
+            }
+        }
+
+        if (fseek(out, EXACT_HEADER_SIZE, SEEK_SET) != 0) {
+            throw oxli_file_exception(file_error("Error writing", filename));
+        }
+        write_file(out, index.data(), sizeof(uint64_t), index.size(),
+                   filename);
+        if (fclose(out) != 0) {
+            out = NULL;
+            throw oxli_file_exception(file_error("Error writing", filename));
+        }
+    } catch (...) {
+        if (out != NULL) {
+            fclose(out);
+        }
+        unlink(filename.c_str());
+        _remove_files();
+        throw;
+    }
+
+    _remove_files();
+    return n_kmers;
+}
+
+template void ExactCountBuilder::consume_seqfile<FastxReader>(
+    ReadParserPtr<FastxReader>& parser);
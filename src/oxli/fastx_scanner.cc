@@ -0,0 +1,741 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include "bzlib.h"
+#include "zlib.h"
+#include "oxli/oxli_exception.hh"
+#include "oxli/fastx_scanner.hh"
+
+using namespace oxli;
+using namespace oxli::read_parsers;
+
+namespace oxli
+{
+namespace read_parsers
+{
+
+class FastxSource
+{
+public:
+    virtual ~FastxSource() { }
+    // Read up to size bytes; 0 at the end of the input.
+    virtual size_t read(char * buf, size_t size) = 0;
+};
+
+} // namespace read_parsers
+} // namespace oxli
+
+namespace
+{
+
+std::string file_error(const std::string& what, const std::string& path)
+{
+    std::string err = what + " " + path + ": ";
+    err += strerror(errno);
+    return err;
+}
+
+enum { INPUT_PLAIN, INPUT_GZIP, INPUT_BZIP2 };
+
+// Tell plain, gzip and bzip2 files apart by their first bytes.
+int input_type(const std::string& filename)
+{
+    FILE * fp = fopen(filename.c_str(), "rb");
+    if (fp == NULL) {
+        throw oxli_file_exception(file_error("Cannot open", filename));
+    }
+    unsigned char magic[3] = { 0, 0, 0 };
+    size_t n = fread(magic, 1, 3, fp);
+    fclose(fp);
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return INPUT_GZIP;
+    }
+    if (n == 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h') {
+        return INPUT_BZIP2;
+    }
+    return INPUT_PLAIN;
+}
+
+// The bytes [begin, end) of a plain file; end 0 reads to the end.
+class FileSource : public FastxSource
+{
+    std::string _filename;
+    FILE * _fp;
+    uint64_t _left;
+public:
+    FileSource(const std::string& filename, uint64_t begin, uint64_t end)
+        : _filename(filename), _left(end ? end - begin : UINT64_MAX)
+    {
+        _fp = fopen(filename.c_str(), "rb");
+        if (_fp == NULL) {
+            throw oxli_file_exception(file_error("Cannot open", filename));
+        }
+        if (begin && fseeko(_fp, begin, SEEK_SET) != 0) {
+            fclose(_fp);
+            throw oxli_file_exception(file_error("Cannot seek in", filename));
+        }
+    }
+    ~FileSource()
+    {
+        fclose(_fp);
+    }
+
+    size_t read(char * buf, size_t size)
+    {
+        size = std::min<uint64_t>(size, _left);
+        size_t n = fread(buf, 1, size, _fp);
+        if (n < size && ferror(_fp)) {
+            throw oxli_file_exception(file_error("Error reading", _filename));
+        }
+        _left -= n;
+        return n;
+    }
+};
+
+// Also reads plain text, which zlib passes through unchanged.
+class GzipSource : public FastxSource
+{
+    std::string _filename;
+    gzFile _gz;
+public:
+    explicit GzipSource(const std::string& filename) : _filename(filename)
+    {
+        if (filename == "-") {
+            _gz = gzdopen(dup(STDIN_FILENO), "rb");
+        } else {
+            _gz = gzopen(filename.c_str(), "rb");
+        }
+        if (_gz == NULL) {
+            throw oxli_file_exception(file_error("Cannot open", filename));
+        }
+        gzbuffer(_gz, FASTX_READ_SIZE);
+    }
+    ~GzipSource()
+    {
+        gzclose(_gz);
+    }
+
+    size_t read(char * buf, size_t size)
+    {
+        int n = gzread(_gz, buf, size);
+        if (n < 0) {
+            throw oxli_file_exception("Error decompressing " + _filename);
+        }
+        return n;
+    }
+};
+
+// Reads every bzip2 stream of a (possibly concatenated) file.
+class Bzip2Source : public FastxSource
+{
+    std::string _filename;
+    FILE * _fp;
+    BZFILE * _bz;
+    bool _done;
+
+    void _open(void * unused, int n_unused)
+    {
+        int bzerror;
+        _bz = BZ2_bzReadOpen(&bzerror, _fp, 0, 0, unused, n_unused);
+        if (bzerror != BZ_OK) {
+            _bz = NULL;
+            throw oxli_file_exception("Cannot decompress " + _filename);
+        }
+    }
+public:
+    explicit Bzip2Source(const std::string& filename)
+        : _filename(filename), _bz(NULL), _done(false)
+    {
+        _fp = fopen(filename.c_str(), "rb");
+        if (_fp == NULL) {
+            throw oxli_file_exception(file_error("Cannot open", filename));
+        }
+        try {
+            _open(NULL, 0);
+        } catch (...) {
+            fclose(_fp);
+            throw;
+        }
+    }
+    ~Bzip2Source()
+    {
+        int bzerror;
+        if (_bz) {
+            BZ2_bzReadClose(&bzerror, _bz);
+        }
+        fclose(_fp);
+    }
+
+    size_t read(char * buf, size_t size)
+    {
+        while (!_done) {
+            int bzerror;
+            int n = BZ2_bzRead(&bzerror, _bz, buf, size);
+            if (bzerror == BZ_OK && n > 0) {
+                return n;
+            }
+            if (bzerror != BZ_STREAM_END) {
+                throw oxli_file_exception("Error decompressing " + _filename);
+            }
+
+            // carry whatever was read past this stream into the next one
+            void * unused;
+            int n_unused;
+            BZ2_bzReadGetUnused(&bzerror, _bz, &unused, &n_unused);
+            char rest[BZ_MAX_UNUSED];
+            memcpy(rest, unused, n_unused);
+            BZ2_bzReadClose(&bzerror, _bz);
+            _bz = NULL;
+
+            if (n_unused == 0) {
+                int c = fgetc(_fp);
+                if (c == EOF) {
+                    _done = true;
+                } else {
+                    ungetc(c, _fp);
+                }
+            }
+            if (!_done) {
+                _open(rest, n_unused);
+            }
+            if (n > 0) {
+                return n;
+            }
+        }
+        return 0;
+    }
+};
+
+FastxSource * open_source(const std::string& filename)
+{
+    // pipes can't be peeked at without losing what was read
+    struct stat st;
+    if (filename == "-" || (stat(filename.c_str(), &st) == 0
+                            && !S_ISREG(st.st_mode))) {
+        return new GzipSource(filename);
+    }
+    int type = input_type(filename);
+    if (type == INPUT_GZIP) {
+        return new GzipSource(filename);
+    } else if (type == INPUT_BZIP2) {
+        return new Bzip2Source(filename);
+    }
+    return new FileSource(filename, 0, 0);
+}
+
+// Append the text [begin, begin + length) without line breaks.
+void append_unwrapped(std::string& out, const char * begin, size_t length)
+{
+    const char * end = begin + length;
+    while (begin < end) {
+        const char * nl = (const char *) memchr(begin, '\n', end - begin);
+        const char * line_end = nl ? nl : end;
+        const char * text_end = line_end;
+        if (text_end > begin && text_end[-1] == '\r') {
+            --text_end;
+        }
+        out.append(begin, text_end - begin);
+        begin = nl ? nl + 1 : end;
+    }
+}
+
+} // anonymous namespace
+
+
+std::string FastxRecord::get_sequence() const
+{
+    std::string seq;
+    seq.reserve(length);
+    append_unwrapped(seq, sequence, sequence_span);
+    return seq;
+}
+
+std::string FastxRecord::get_quality() const
+{
+    std::string qual;
+    if (quality) {
+        qual.reserve(length);
+        append_unwrapped(qual, quality, quality_span);
+    }
+    return qual;
+}
+
+void FastxRecord::write_fastx(std::string& out, bool as_fasta,
+                              const char * name_suffix) const
+{
+    bool fastq = is_fastq() && !as_fasta;
+    out += fastq ? '@' : '>';
+    out.append(name, name_length);
+    out += name_suffix;
+    out += '\n';
+    if (is_multiline()) {
+        append_unwrapped(out, sequence, sequence_span);
+    } else {
+        out.append(sequence, sequence_span);
+    }
+    out += '\n';
+    if (fastq) {
+        out += "+\n";
+        if (quality_span != length) {
+            append_unwrapped(out, quality, quality_span);
+        } else {
+            out.append(quality, quality_span);
+        }
+        out += '\n';
+    }
+}
+
+
+FastxScanner::FastxScanner(FastxSource * source, uint64_t base, char marker)
+    : _source(source), _base(base), _len(0), _pos(base), _keep(base),
+      _eof(false), _marker(marker), _n_records(0), _have_pending(false)
+{
+}
+
+FastxScanner::FastxScanner(const std::string& filename)
+    : FastxScanner(open_source(filename), 0, 0)
+{
+}
+
+FastxScanner::FastxScanner(const std::string& filename, uint64_t begin,
+                           uint64_t end)
+    : FastxScanner(new FileSource(filename, begin, end), begin, 0)
+{
+}
+
+FastxScanner::~FastxScanner()
+{
+}
+
+bool FastxScanner::_more()
+{
+    if (_eof) {
+        return false;
+    }
+    size_t drop = _keep - _base;
+    if (drop) {
+        memmove(_buf.data(), _buf.data() + drop, _len - drop);
+        _len -= drop;
+        _base += drop;
+    }
+    if (_buf.size() - _len < FASTX_READ_SIZE) {
+        _buf.resize(std::max(2 * _buf.size(), _len + FASTX_READ_SIZE));
+    }
+    size_t n = _source->read(&_buf[_len], _buf.size() - _len);
+    if (n == 0) {
+        _eof = true;
+        return false;
+    }
+    _len += n;
+    return true;
+}
+
+// The line at the current position, without its line ending; false at
+// the end of the input.
+bool FastxScanner::_line(uint64_t& begin, uint64_t& end)
+{
+    if (_pos == _base + _len && !_more()) {
+        return false;
+    }
+    begin = _pos;
+    uint64_t from = _pos;
+    while (true) {
+        const char * start = _at(from);
+        const char * nl = (const char *) memchr(start, '\n',
+                                                _base + _len - from);
+        if (nl) {
+            end = from + (nl - start);
+            _pos = end + 1;
+            break;
+        }
+        from = _base + _len;
+        if (!_more()) {
+            end = _pos = _base + _len;
+            break;
+        }
+    }
+    if (end > begin && *_at(end - 1) == '\r') {
+        --end;
+    }
+    return true;
+}
+
+int FastxScanner::_peek()
+{
+    if (_pos == _base + _len && !_more()) {
+        return -1;
+    }
+    return (unsigned char) *_at(_pos);
+}
+
+// The next record, skipping blank lines; false at the end of the input.
+bool FastxScanner::_scan(Span& span)
+{
+    uint64_t begin = 0, end = 0;
+    int c;
+    while ((c = _peek()) == '\n' || c == '\r') {
+        _line(begin, end);
+    }
+    if (c < 0) {
+        return false;
+    }
+
+    span.begin = _pos;
+    _line(begin, end);
+    if (!_marker && (c == '>' || c == '@')) {
+        _marker = c;
+    }
+    if (c != _marker) {
+        throw InvalidRead("Expected a FASTA/FASTQ header at \""
+                          + std::string(_at(begin), end - begin) + "\"");
+    }
+    span.name_begin = begin + 1;
+    span.name_end = end;
+    span.seq_begin = span.seq_end = _pos;
+    span.length = 0;
+
+    if (_marker == '>') {
+        while ((c = _peek()) >= 0 && c != '>') {
+            _line(begin, end);
+            if (end > begin) {
+                span.seq_end = end;
+                span.length += end - begin;
+            }
+        }
+        span.qual_begin = span.qual_end = 0;
+    } else {
+        while (true) {
+            if (!_line(begin, end)) {
+                throw InvalidRead("Truncated FASTQ record");
+            }
+            if (end > begin && *_at(begin) == '+') {
+                break;
+            }
+            if (end > begin && *_at(begin) == '@') {
+                throw InvalidRead("FASTQ record without a '+' line");
+            }
+            span.seq_end = end;
+            span.length += end - begin;
+        }
+        span.qual_begin = span.qual_end = _pos;
+        uint64_t qual_length = 0;
+        while (qual_length < span.length) {
+            if (!_line(begin, end)) {
+                throw InvalidRead("Truncated FASTQ record");
+            }
+            span.qual_end = end;
+            qual_length += end - begin;
+        }
+        if (qual_length != span.length) {
+            throw InvalidRead("FASTQ quality and sequence lengths differ");
+        }
+    }
+    span.end = _pos;
+    return true;
+}
+
+void FastxScanner::_view(const Span& span, FastxRecord& record) const
+{
+    record.offset = span.begin;
+    record.text = _at(span.begin);
+    record.text_length = span.end - span.begin;
+    record.name = _at(span.name_begin);
+    record.name_length = span.name_end - span.name_begin;
+    record.sequence = _at(span.seq_begin);
+    record.sequence_span = span.seq_end - span.seq_begin;
+    if (_marker == '@') {
+        record.quality = _at(span.qual_begin);
+        record.quality_span = span.qual_end - span.qual_begin;
+    } else {
+        record.quality = NULL;
+        record.quality_span = 0;
+    }
+    record.length = span.length;
+}
+
+bool FastxScanner::next(FastxRecord& record)
+{
+    Span span;
+    if (_have_pending) {
+        span = _pending;
+        _have_pending = false;
+        _keep = span.begin;
+    } else {
+        _keep = _pos;
+        if (!_scan(span)) {
+            return false;
+        }
+    }
+    ++_n_records;
+    _view(span, record);
+    return true;
+}
+
+unsigned int FastxScanner::next_unit(FastxRecord& first, FastxRecord& second,
+                                     bool force_single)
+{
+    Span span1, span2;
+    if (_have_pending) {
+        span1 = _pending;
+        _have_pending = false;
+        _keep = span1.begin;
+    } else {
+        _keep = _pos;
+        if (!_scan(span1)) {
+            return 0;
+        }
+    }
+    ++_n_records;
+
+    unsigned int n_records = 1;
+    if (!force_single && _scan(span2)) {
+        if (check_is_pair(_at(span1.name_begin),
+                          span1.name_end - span1.name_begin,
+                          _at(span2.name_begin),
+                          span2.name_end - span2.name_begin)) {
+            ++_n_records;
+            n_records = 2;
+        } else {
+            _pending = span2;
+            _have_pending = true;
+        }
+    }
+
+    // the buffer may have moved while looking for the second record
+    _view(span1, first);
+    if (n_records == 2) {
+        _view(span2, second);
+    }
+    return n_records;
+}
+
+bool FastxScanner::is_seekable(const std::string& filename)
+{
+    struct stat st;
+    return filename != "-" && stat(filename.c_str(), &st) == 0
+           && S_ISREG(st.st_mode) && input_type(filename) == INPUT_PLAIN;
+}
+
+uint64_t FastxScanner::find_unit_start(const std::string& filename,
+                                       uint64_t offset, bool force_single)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        throw oxli_file_exception(file_error("Cannot stat", filename));
+    }
+    const uint64_t size = st.st_size;
+    if (offset == 0 || offset >= size) {
+        return std::min(offset, size);
+    }
+
+    // the first record tells FASTA from FASTQ
+    char marker;
+    {
+        FastxScanner head(filename, 0, 0);
+        Span span;
+        if (!head._scan(span)) {
+            return size;
+        }
+        marker = head._marker;
+    }
+
+    // reading from the byte before tells whether offset starts a line
+    FastxScanner scanner(new FileSource(filename, offset - 1, 0), offset - 1,
+                         marker);
+    uint64_t begin = 0, end = 0;
+    scanner._line(begin, end);
+
+    Span span;
+    while (true) {
+        uint64_t start = scanner._pos;
+        scanner._keep = start;
+        bool found = false;
+        try {
+            if (!scanner._scan(span)) {
+                break;
+            }
+            // a FASTQ quality line can start with '@' too; only trust a
+            // record followed by another, or by the end of the file
+            Span following;
+            if (marker == '@') {
+                scanner._scan(following);
+            }
+            found = true;
+        } catch (InvalidRead&) {
+            // not a record start
+        }
+        if (found) {
+            if (force_single || !check_is_right(
+                        scanner._at(span.name_begin),
+                        span.name_end - span.name_begin)) {
+                return span.begin;
+            }
+            // a possible second mate; the next record starts a unit
+            scanner._pos = span.end;
+            continue;
+        }
+        scanner._pos = start;
+        scanner._line(begin, end);
+    }
+    return size;
+}
+
+
+void oxli::read_parsers::fastx_stats(const std::string& filename,
+                                     uint64_t& n_records, uint64_t& n_bases)
+{
+    FastxScanner scanner(filename);
+    FastxRecord record;
+    n_records = n_bases = 0;
+    while (scanner.next(record)) {
+        ++n_records;
+        n_bases += record.length;
+    }
+}
+
+
+FastxFilter::FastxFilter(const std::string& filename, size_t min_length,
+                         bool drop_n, bool to_fasta)
+    : _scanner(filename), _min_length(min_length), _drop_n(drop_n),
+      _to_fasta(to_fasta), _n_written(0)
+{
+}
+
+bool FastxFilter::fill(std::string& out, size_t max_bytes)
+{
+    FastxRecord record;
+    while (out.size() < max_bytes) {
+        if (!_scanner.next(record)) {
+            return false;
+        }
+        if (record.length < _min_length) {
+            continue;
+        }
+        if (_drop_n && memchr(record.sequence, 'N', record.sequence_span)) {
+            continue;
+        }
+        record.write_fastx(out, _to_fasta);
+        ++_n_written;
+    }
+    return true;
+}
+
+
+FastxInterleaver::FastxInterleaver(const std::string& left,
+                                   const std::string& right, bool reformat)
+    : _left(left), _right(right), _reformat(reformat), _n_pairs(0)
+{
+}
+
+bool FastxInterleaver::fill(std::string& out, size_t max_bytes)
+{
+    FastxRecord read1, read2;
+    std::string name1, name2;
+    while (out.size() < max_bytes) {
+        bool has1 = _left.next(read1);
+        bool has2 = _right.next(read2);
+        if (!has1 && !has2) {
+            return false;
+        }
+        if (has1 != has2) {
+            throw oxli_value_exception(
+                "Input files contain different number of records.");
+        }
+
+        const char * suffix1 = "", * suffix2 = "";
+        if (_reformat) {
+            if (!check_is_left(read1.name, read1.name_length)) {
+                suffix1 = "/1";
+            }
+            if (!check_is_right(read2.name, read2.name_length)) {
+                suffix2 = "/2";
+            }
+            name1.assign(read1.name, read1.name_length);
+            name1 += suffix1;
+            name2.assign(read2.name, read2.name_length);
+            name2 += suffix2;
+            if (read1.is_fastq() != read2.is_fastq()
+                    || !check_is_pair(name1, name2)) {
+                throw oxli_value_exception(
+                    "This doesn't look like paired data! " + name1 + " "
+                    + name2);
+            }
+        }
+        read1.write_fastx(out, false, suffix1);
+        read2.write_fastx(out, false, suffix2);
+        ++_n_pairs;
+    }
+    return true;
+}
+
+
+FastxPairSplitter::FastxPairSplitter(const std::string& filename,
+                                     bool allow_orphans)
+    : _scanner(filename), _allow_orphans(allow_orphans), _n_pairs(0),
+      _n_orphans(0)
+{
+}
+
+bool FastxPairSplitter::fill(std::string& left, std::string& right,
+                             std::string& orphans, size_t max_bytes)
+{
+    FastxRecord read1, read2;
+    while (left.size() + right.size() + orphans.size() < max_bytes) {
+        unsigned int n_records = _scanner.next_unit(read1, read2);
+        if (n_records == 0) {
+            return false;
+        }
+        if (n_records == 2) {
+            read1.write_fastx(left);
+            read2.write_fastx(right);
+            ++_n_pairs;
+        } else if (_allow_orphans) {
+            read1.write_fastx(orphans);
+            ++_n_orphans;
+        } else {
+            throw oxli_value_exception("Unpaired reads found starting at "
+                                       + read1.get_name());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,543 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <sstream> // IWYU pragma: keep
+#include <streambuf>
+
+#include "oxli/graph_bundle.hh"
+#include "oxli/hashgraph.hh"
+#include "oxli/labelhash.hh"
+#include "oxli/oxli_exception.hh"
+#include "oxli/subset.hh"
+#include "zlib.h"
+
+// signature, version, type, number of sections, padding
+#define BUNDLE_HEADER_SIZE 16
+#define BUNDLE_ENTRY_SIZE 32
+// bytes read at a time while writing or extracting a section
+#define BUNDLE_CHUNK (1024*1024)
+
+using namespace oxli;
+
+namespace
+{
+
+void pack_entry(const BundleSection& section, char * buf)
+{
+    memset(buf, 0, BUNDLE_ENTRY_SIZE);
+    buf[0] = section.type;
+    buf[1] = section.compressed ? 1 : 0;
+    memcpy(buf + 4, &section.crc, sizeof(uint32_t));
+    memcpy(buf + 8, &section.offset, sizeof(uint64_t));
+    memcpy(buf + 16, &section.stored_length, sizeof(uint64_t));
+    memcpy(buf + 24, &section.length, sizeof(uint64_t));
+}
+
+void unpack_entry(const char * buf, BundleSection& section)
+{
+    section.type = buf[0];
+    section.compressed = buf[1] != 0;
+    memcpy(&section.crc, buf + 4, sizeof(uint32_t));
+    memcpy(&section.offset, buf + 8, sizeof(uint64_t));
+    memcpy(&section.stored_length, buf + 16, sizeof(uint64_t));
+    memcpy(&section.length, buf + 24, sizeof(uint64_t));
+}
+
+// Append infilename to out, deflated if compress is set, filling in the
+// lengths and checksum of section.
+void append_section(std::ofstream& out, const std::string& infilename,
+                    bool compress, BundleSection& section)
+{
+    std::ifstream infile(infilename.c_str(), std::ios::binary);
+    if (!infile.is_open()) {
+        throw oxli_file_exception("Cannot open bundle section file: "
+                                  + infilename);
+    }
+
+    std::vector<char> inbuf(BUNDLE_CHUNK);
+    std::vector<char> outbuf(compress ? BUNDLE_CHUNK : 0);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (compress && deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw oxli_exception("Cannot initialize zlib: " +
+                             std::string(strm.msg ? strm.msg : ""));
+    }
+
+    section.compressed = compress;
+    section.length = 0;
+    section.stored_length = 0;
+
+    bool done = false;
+    while (!done) {
+        infile.read(inbuf.data(), BUNDLE_CHUNK);
+        std::streamsize n_read = infile.gcount();
+        if (infile.bad()) {
+            if (compress) {
+                deflateEnd(&strm);
+            }
+            throw oxli_file_exception("Error reading bundle section file: "
+                                      + infilename);
+        }
+        done = infile.eof();
+        crc = crc32(crc, (const Bytef *) inbuf.data(), n_read);
+        section.length += n_read;
+
+        if (!compress) {
+            out.write(inbuf.data(), n_read);
+            section.stored_length += n_read;
+            continue;
+        }
+
+        strm.next_in = (Bytef *) inbuf.data();
+        strm.avail_in = n_read;
+        int flush = done ? Z_FINISH : Z_NO_FLUSH;
+        do {
+            strm.next_out = (Bytef *) outbuf.data();
+            strm.avail_out = BUNDLE_CHUNK;
+            deflate(&strm, flush);
+            size_t n_out = BUNDLE_CHUNK - strm.avail_out;
+            out.write(outbuf.data(), n_out);
+            section.stored_length += n_out;
+        } while (strm.avail_out == 0);
+    }
+    if (compress) {
+        deflateEnd(&strm);
+    }
+    section.crc = crc;
+
+    if (out.fail()) {
+        throw oxli_file_exception(strerror(errno));
+    }
+}
+
+// The uncompressed bytes of one section, read from the bundle a chunk at a
+// time. Read errors end the stream early and are kept for error(); finish()
+// reads whatever is left and checks the length and checksum.
+class SectionBuf : public std::streambuf
+{
+    std::ifstream _infile;
+    std::string _filename;
+    BundleSection _sec;
+    std::vector<char> _inbuf;
+    std::vector<char> _outbuf;
+    z_stream _strm;
+    int _ret;
+    // stored bytes not yet read
+    uint64_t _remaining;
+    uLong _crc;
+    uint64_t _length;
+    std::string _err;
+
+    // read the next stored chunk into buf; false at the end of the
+    // section or on error
+    bool _read(std::vector<char>& buf, size_t& n_read)
+    {
+        n_read = _remaining < BUNDLE_CHUNK ? _remaining : BUNDLE_CHUNK;
+        if (n_read == 0) {
+            return false;
+        }
+        _infile.read(buf.data(), n_read);
+        if ((size_t) _infile.gcount() != n_read) {
+            _err = "Truncated graph bundle: " + _filename;
+            return false;
+        }
+        _remaining -= n_read;
+        return true;
+    }
+
+    // uncompressed bytes put in outbuf; 0 at the end or on error
+    size_t _fill()
+    {
+        size_t n = 0;
+        if (!_err.empty()) {
+            return 0;
+        }
+        if (!_sec.compressed) {
+            return _read(_outbuf, n) ? n : 0;
+        }
+        while (_ret != Z_STREAM_END) {
+            if (_strm.avail_in == 0) {
+                if (!_read(_inbuf, n)) {
+                    if (_err.empty()) {
+                        _err = "Truncated section in graph bundle: "
+                               + _filename;
+                    }
+                    return 0;
+                }
+                _strm.next_in = (Bytef *) _inbuf.data();
+                _strm.avail_in = n;
+            }
+            _strm.next_out = (Bytef *) _outbuf.data();
+            _strm.avail_out = BUNDLE_CHUNK;
+            _ret = inflate(&_strm, Z_NO_FLUSH);
+            if (_ret != Z_OK && _ret != Z_STREAM_END && _ret != Z_BUF_ERROR) {
+                _err = "Corrupt section in graph bundle: " + _filename;
+                return 0;
+            }
+            n = BUNDLE_CHUNK - _strm.avail_out;
+            if (n > 0) {
+                return n;
+            }
+        }
+        return 0;
+    }
+
+protected:
+    int_type underflow()
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        size_t n = _fill();
+        if (n == 0) {
+            return traits_type::eof();
+        }
+        _crc = crc32(_crc, (const Bytef *) _outbuf.data(), n);
+        _length += n;
+        setg(_outbuf.data(), _outbuf.data(), _outbuf.data() + n);
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    SectionBuf(const std::string& filename, const BundleSection& sec)
+        : _filename(filename), _sec(sec), _inbuf(sec.compressed ?
+                BUNDLE_CHUNK : 0), _outbuf(BUNDLE_CHUNK), _ret(Z_OK),
+          _remaining(sec.stored_length), _crc(crc32(0L, Z_NULL, 0)),
+          _length(0)
+    {
+        _infile.open(filename.c_str(), std::ios::binary);
+        if (!_infile.is_open()) {
+            throw oxli_file_exception("Cannot open graph bundle: "
+                                      + filename);
+        }
+        _infile.seekg(sec.offset);
+        memset(&_strm, 0, sizeof(_strm));
+        if (sec.compressed && inflateInit(&_strm) != Z_OK) {
+            throw oxli_exception("Cannot initialize zlib: " +
+                                 std::string(_strm.msg ? _strm.msg : ""));
+        }
+    }
+
+    ~SectionBuf()
+    {
+        if (_sec.compressed) {
+            inflateEnd(&_strm);
+        }
+    }
+
+    const std::string& error() const
+    {
+        return _err;
+    }
+
+    void finish()
+    {
+        while (underflow() != traits_type::eof()) {
+            setg(eback(), egptr(), egptr());
+        }
+        if (_err.empty() && _sec.compressed && _ret != Z_STREAM_END) {
+            _err = "Truncated section in graph bundle: " + _filename;
+        }
+        if (_err.empty() && (_length != _sec.length || _crc != _sec.crc)) {
+            _err = "Checksum mismatch in graph bundle: " + _filename;
+        }
+        if (!_err.empty()) {
+            throw oxli_file_exception(_err);
+        }
+    }
+};
+
+// Run load on a stream over section sec of the bundle filename, then check
+// the section's checksum.
+void load_section(const std::string& filename, const BundleSection& sec,
+                  std::function<void(std::istream&, const std::string&)> load)
+{
+    SectionBuf buf(filename, sec);
+    std::istream infile(&buf);
+    try {
+        load(infile, filename);
+    } catch (...) {
+        // a damaged section says more than the loader's end of file
+        if (!buf.error().empty()) {
+            throw oxli_file_exception(buf.error());
+        }
+        throw;
+    }
+    buf.finish();
+}
+
+} // anonymous namespace
+
+GraphBundle::GraphBundle(const std::string& filename)
+    : _filename(filename)
+{
+    std::ifstream infile(filename.c_str(), std::ios::binary);
+    if (!infile.is_open()) {
+        throw oxli_file_exception("Cannot open graph bundle: " + filename);
+    }
+
+    char header[BUNDLE_HEADER_SIZE];
+    infile.read(header, BUNDLE_HEADER_SIZE);
+    if (infile.gcount() != BUNDLE_HEADER_SIZE) {
+        throw oxli_file_exception("Graph bundle read error: " + filename);
+    }
+    if (std::string(header, 4) != SAVED_SIGNATURE) {
+        std::ostringstream err;
+        err << "Does not start with signature for a oxli file: 0x";
+        for (size_t i = 0; i < 4; ++i) {
+            err << std::hex << (int) header[i];
+        }
+        err << " Should be: " << SAVED_SIGNATURE;
+        throw oxli_file_exception(err.str());
+    }
+    if (header[4] != SAVED_FORMAT_VERSION) {
+        std::ostringstream err;
+        err << "Incorrect file format version " << (int) header[4]
+            << " while reading graph bundle from " << filename
+            << "; should be " << (int) SAVED_FORMAT_VERSION;
+        throw oxli_file_exception(err.str());
+    }
+    if (header[5] != SAVED_GRAPH_BUNDLE) {
+        std::ostringstream err;
+        err << "Incorrect file format type " << (int) header[5]
+            << " while reading graph bundle from " << filename;
+        throw oxli_file_exception(err.str());
+    }
+
+    unsigned int n_sections = (unsigned char) header[6];
+    char entry[BUNDLE_ENTRY_SIZE];
+    for (unsigned int i = 0; i < n_sections; ++i) {
+        infile.read(entry, BUNDLE_ENTRY_SIZE);
+        if (infile.gcount() != BUNDLE_ENTRY_SIZE) {
+            throw oxli_file_exception("Truncated graph bundle directory: "
+                                      + filename);
+        }
+        BundleSection section;
+        unpack_entry(entry, section);
+        _sections.push_back(section);
+    }
+}
+
+bool GraphBundle::is_bundle(const std::string& filename)
+{
+    std::ifstream infile(filename.c_str(), std::ios::binary);
+    char header[6];
+    infile.read(header, 6);
+    return infile.gcount() == 6 && std::string(header, 4) == SAVED_SIGNATURE
+           && header[5] == SAVED_GRAPH_BUNDLE;
+}
+
+bool GraphBundle::has_section(uint8_t type) const
+{
+    for (auto& section : _sections) {
+        if (section.type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const BundleSection& GraphBundle::section(uint8_t type) const
+{
+    for (auto& section : _sections) {
+        if (section.type == type) {
+            return section;
+        }
+    }
+    std::ostringstream err;
+    err << "Graph bundle " << _filename << " has no section of type "
+        << (int) type;
+    throw oxli_value_exception(err.str());
+}
+
+void GraphBundle::extract_section(uint8_t type,
+                                  const std::string& outfilename) const
+{
+    SectionBuf buf(_filename, section(type));
+    std::ofstream outfile(outfilename.c_str(), std::ios::binary);
+    if (!outfile.is_open()) {
+        throw oxli_file_exception(strerror(errno));
+    }
+
+    std::vector<char> chunk(BUNDLE_CHUNK);
+    std::string err;
+    try {
+        std::streamsize n;
+        while ((n = buf.sgetn(chunk.data(), BUNDLE_CHUNK)) > 0) {
+            outfile.write(chunk.data(), n);
+        }
+        buf.finish();
+    } catch (oxli_file_exception &e) {
+        err = e.what();
+    }
+    outfile.close();
+    if (err.empty() && outfile.fail()) {
+        err = strerror(errno);
+    }
+    if (!err.empty()) {
+        remove(outfilename.c_str());
+        throw oxli_file_exception(err);
+    }
+}
+
+std::string GraphBundle::section_header(uint8_t type, size_t n) const
+{
+    SectionBuf buf(_filename, section(type));
+    std::string header(n, '\0');
+    header.resize(buf.sgetn(&header[0], n));
+    if (!buf.error().empty()) {
+        throw oxli_file_exception(buf.error());
+    }
+    return header;
+}
+
+void GraphBundle::load_table(Hashtable& table) const
+{
+    load_section(_filename, section(BUNDLE_TABLE),
+    [&](std::istream& infile, const std::string& name) {
+        table.load(infile, name);
+    });
+}
+
+void GraphBundle::load_tagset(Hashgraph& graph, bool clear_tags) const
+{
+    load_section(_filename, section(BUNDLE_TAGS),
+    [&](std::istream& infile, const std::string& name) {
+        graph.load_tagset(infile, name, clear_tags);
+    });
+}
+
+void GraphBundle::load_stop_tags(Hashgraph& graph, bool clear_tags) const
+{
+    load_section(_filename, section(BUNDLE_STOP_TAGS),
+    [&](std::istream& infile, const std::string& name) {
+        graph.load_stop_tags(infile, name, clear_tags);
+    });
+}
+
+void GraphBundle::load_partitionmap(SubsetPartition& subset) const
+{
+    load_section(_filename, section(BUNDLE_PARTITION_MAP),
+    [&](std::istream& infile, const std::string& name) {
+        subset.merge_from_disk(infile, name);
+    });
+}
+
+void GraphBundle::load_labels(LabelHash& labels) const
+{
+    load_section(_filename, section(BUNDLE_LABELS),
+    [&](std::istream& infile, const std::string& name) {
+        labels.load_labels_and_tags(infile, name);
+    });
+}
+
+void GraphBundle::write(const std::string& filename,
+                        const std::vector<std::pair<uint8_t, std::string> >&
+                        sections,
+                        bool compress)
+{
+    if (sections.size() > 255) {
+        throw oxli_value_exception("Too many sections for a graph bundle");
+    }
+    std::set<uint8_t> seen;
+    for (auto& section : sections) {
+        if (!seen.insert(section.first).second) {
+            std::ostringstream err;
+            err << "Duplicate graph bundle section of type "
+                << (int) section.first;
+            throw oxli_value_exception(err.str());
+        }
+    }
+
+    // write next to the destination, so a failed write leaves any old
+    // bundle alone
+    std::string tmpfilename = filename + ".tmp";
+    std::ofstream outfile(tmpfilename.c_str(), std::ios::binary);
+    if (!outfile.is_open()) {
+        throw oxli_file_exception(strerror(errno));
+    }
+
+    char header[BUNDLE_HEADER_SIZE];
+    memset(header, 0, BUNDLE_HEADER_SIZE);
+    memcpy(header, SAVED_SIGNATURE, 4);
+    header[4] = SAVED_FORMAT_VERSION;
+    header[5] = SAVED_GRAPH_BUNDLE;
+    header[6] = (unsigned char) sections.size();
+
+    // the directory is only known once the sections are written
+    uint64_t offset = BUNDLE_HEADER_SIZE + BUNDLE_ENTRY_SIZE * sections.size();
+    std::vector<char> directory(offset - BUNDLE_HEADER_SIZE, 0);
+    outfile.write(header, BUNDLE_HEADER_SIZE);
+    outfile.write(directory.data(), directory.size());
+
+    std::vector<BundleSection> entries;
+    try {
+        for (auto& section : sections) {
+            BundleSection entry;
+            entry.type = section.first;
+            entry.offset = offset;
+            append_section(outfile, section.second, compress, entry);
+            offset += entry.stored_length;
+            entries.push_back(entry);
+        }
+    } catch (...) {
+        outfile.close();
+        remove(tmpfilename.c_str());
+        throw;
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pack_entry(entries[i], directory.data() + i * BUNDLE_ENTRY_SIZE);
+    }
+    outfile.seekp(BUNDLE_HEADER_SIZE);
+    outfile.write(directory.data(), directory.size());
+    outfile.close();
+    if (outfile.fail()) {
+        remove(tmpfilename.c_str());
+        throw oxli_file_exception(strerror(errno));
+    }
+    if (rename(tmpfilename.c_str(), filename.c_str()) != 0) {
+        remove(tmpfilename.c_str());
+        throw oxli_file_exception(strerror(errno));
+    }
+}
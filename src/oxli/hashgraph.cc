@@ -47,6 +47,7 @@ Contact: khmer-project@idyll.org
 #include "oxli/hashgraph.hh"
 #include "oxli/oxli.hh"
 #include "oxli/read_parsers.hh"
+#include "oxli/sorted_hashes.hh"
 
 using namespace std;
 using namespace oxli;
@@ -55,36 +56,26 @@ using namespace oxli:: read_parsers;
 void Hashgraph::save_tagset(std::string outfilename)
 {
     ofstream outfile(outfilename.c_str(), ios::binary);
-    const size_t tagset_size = n_tags();
     unsigned int save_ksize = _ksize;
 
-    HashIntoType * buf = new HashIntoType[tagset_size];
-
     outfile.write(SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COMPACT_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
     unsigned char ht_type = SAVED_TAGS;
     outfile.write((const char *) &ht_type, 1);
 
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
-    outfile.write((const char *) &tagset_size, sizeof(tagset_size));
     outfile.write((const char *) &_tag_density, sizeof(_tag_density));
 
-    unsigned int i = 0;
-    for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
-            ++pi, i++) {
-        buf[i] = *pi;
-    }
+    // SeenSet iterates in ascending order, as the encoding requires
+    std::vector<HashIntoType> hashes(all_tags.begin(), all_tags.end());
+    write_sorted_hashes(outfile, hashes, std::vector<uint64_t>());
 
-    outfile.write((const char *) buf, sizeof(HashIntoType) * tagset_size);
     if (outfile.fail()) {
-        delete[] buf;
         throw oxli_file_exception(strerror(errno));
     }
     outfile.close();
-
-    delete[] buf;
 }
 
 void Hashgraph::load_tagset(std::string infilename, bool clear_tags)
@@ -113,6 +104,16 @@ void Hashgraph::load_tagset(std::string infilename, bool clear_tags)
         throw oxli_file_exception(err);
     }
 
+    load_tagset(infile, infilename, clear_tags);
+}
+
+void Hashgraph::load_tagset(std::istream& infile,
+                            const std::string& infilename, bool clear_tags)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
     if (clear_tags) {
         all_tags.clear();
     }
@@ -137,11 +138,13 @@ void Hashgraph::load_tagset(std::string infilename, bool clear_tags)
             err << " while reading tagset from " << infilename
                 << "; should be " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
+        } else if (!(version == SAVED_FORMAT_VERSION ||
+                     version == SAVED_COMPACT_FORMAT_VERSION)) {
             std::ostringstream err;
             err << "Incorrect file format version " << (int) version
                 << " while reading tagset from " << infilename
-                << "; should be " << (int) SAVED_FORMAT_VERSION;
+                << "; should be " << (int) SAVED_FORMAT_VERSION
+                << " or " << (int) SAVED_COMPACT_FORMAT_VERSION;
             throw oxli_file_exception(err.str());
         } else if (!(ht_type == SAVED_TAGS)) {
             std::ostringstream err;
@@ -158,15 +161,28 @@ void Hashgraph::load_tagset(std::string infilename, bool clear_tags)
             throw oxli_file_exception(err.str());
         }
 
-        infile.read((char *) &tagset_size, sizeof(tagset_size));
-        infile.read((char *) &_tag_density, sizeof(_tag_density));
+        if (version == SAVED_COMPACT_FORMAT_VERSION) {
+            infile.read((char *) &_tag_density, sizeof(_tag_density));
+
+            std::vector<HashIntoType> hashes;
+            std::vector<uint64_t> values;
+            read_sorted_hashes(infile, hashes, values);
+
+            // sorted input makes each insert amortized constant time
+            for (auto h : hashes) {
+                all_tags.insert(all_tags.end(), h);
+            }
+        } else {
+            infile.read((char *) &tagset_size, sizeof(tagset_size));
+            infile.read((char *) &_tag_density, sizeof(_tag_density));
 
-        buf = new HashIntoType[tagset_size];
+            buf = new HashIntoType[tagset_size];
 
-        infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
+            infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
-        for (unsigned int i = 0; i < tagset_size; i++) {
-            all_tags.insert(buf[i]);
+            for (unsigned int i = 0; i < tagset_size; i++) {
+                all_tags.insert(buf[i]);
+            }
         }
 
         delete[] buf;
@@ -595,6 +611,17 @@ void Hashgraph::load_stop_tags(std::string infilename, bool clear_tags)
         throw oxli_file_exception(err);
     }
 
+    load_stop_tags(infile, infilename, clear_tags);
+}
+
+void Hashgraph::load_stop_tags(std::istream& infile,
+                               const std::string& infilename,
+                               bool clear_tags)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
     if (clear_tags) {
         stop_tags.clear();
     }
@@ -618,11 +645,13 @@ void Hashgraph::load_stop_tags(std::string infilename, bool clear_tags)
             err << " while reading stoptags from " << infilename
                 << "; should be " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
+        } else if (!(version == SAVED_FORMAT_VERSION ||
+                     version == SAVED_COMPACT_FORMAT_VERSION)) {
             std::ostringstream err;
             err << "Incorrect file format version " << (int) version
                 << " while reading stoptags from " << infilename
-                << "; should be " << (int) SAVED_FORMAT_VERSION;
+                << "; should be " << (int) SAVED_FORMAT_VERSION
+                << " or " << (int) SAVED_COMPACT_FORMAT_VERSION;
             throw oxli_file_exception(err.str());
         } else if (!(ht_type == SAVED_STOPTAGS)) {
             std::ostringstream err;
@@ -638,16 +667,26 @@ void Hashgraph::load_stop_tags(std::string infilename, bool clear_tags)
                 << " while reading stoptags from " << infilename;
             throw oxli_file_exception(err.str());
         }
-        infile.read((char *) &tagset_size, sizeof(tagset_size));
+        if (version == SAVED_COMPACT_FORMAT_VERSION) {
+            std::vector<HashIntoType> hashes;
+            std::vector<uint64_t> values;
+            read_sorted_hashes(infile, hashes, values);
+
+            for (auto h : hashes) {
+                stop_tags.insert(stop_tags.end(), h);
+            }
+        } else {
+            infile.read((char *) &tagset_size, sizeof(tagset_size));
 
-        HashIntoType * buf = new HashIntoType[tagset_size];
+            HashIntoType * buf = new HashIntoType[tagset_size];
 
-        infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
+            infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
-        for (unsigned int i = 0; i < tagset_size; i++) {
-            stop_tags.insert(buf[i]);
+            for (unsigned int i = 0; i < tagset_size; i++) {
+                stop_tags.insert(buf[i]);
+            }
+            delete[] buf;
         }
-        delete[] buf;
     } catch (std::ifstream::failure &e) {
         std::string err = "Error reading stoptags from: " + infilename;
         throw oxli_file_exception(err);
@@ -665,12 +704,9 @@ void Hashgraph::load_stop_tags(std::string infilename, bool clear_tags)
 void Hashgraph::save_stop_tags(std::string outfilename)
 {
     ofstream outfile(outfilename.c_str(), ios::binary);
-    size_t tagset_size = stop_tags.size();
-
-    HashIntoType * buf = new HashIntoType[tagset_size];
 
     outfile.write(SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COMPACT_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
     unsigned char ht_type = SAVED_STOPTAGS;
@@ -678,18 +714,10 @@ void Hashgraph::save_stop_tags(std::string outfilename)
 
     unsigned int save_ksize = _ksize;
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
-    outfile.write((const char *) &tagset_size, sizeof(tagset_size));
-
-    unsigned int i = 0;
-    for (SeenSet::iterator pi = stop_tags.begin(); pi != stop_tags.end();
-            ++pi, i++) {
-        buf[i] = *pi;
-    }
 
-    outfile.write((const char *) buf, sizeof(HashIntoType) * tagset_size);
+    std::vector<HashIntoType> hashes(stop_tags.begin(), stop_tags.end());
+    write_sorted_hashes(outfile, hashes, std::vector<uint64_t>());
     outfile.close();
-
-    delete[] buf;
 }
 
 void Hashgraph::print_stop_tags(std::string infilename)
@@ -889,21 +917,46 @@ const
     return size;
 }
 
-void Nodegraph::update_from(const Nodegraph &otherBASE)
+void Nodegraph::load(std::string filename)
 {
-    if (_ksize != otherBASE._ksize) {
-        throw oxli_exception("both nodegraphs must have same k size");
+    char header[6] = { 0 };
+    std::ifstream infile(filename.c_str(), std::ios::binary);
+    infile.read(header, sizeof(header));
+    infile.close();
+
+    // anything unreadable is left to the storage to report
+    if (std::string(header, 4) == SAVED_SIGNATURE) {
+        bool scalable = dynamic_cast<ScalableBitStorage *>(store) != NULL;
+        TableAllocScope scope(store->alloc_policy());
+        if (header[5] == SAVED_SCALABLE_HASHBITS && !scalable) {
+            std::vector<uint64_t> placeholder(1, 1);
+            Storage * loaded = new ScalableBitStorage(placeholder, 0.01);
+            delete store;
+            store = loaded;
+        } else if (header[5] == SAVED_HASHBITS && scalable) {
+            std::vector<uint64_t> no_tables;
+            Storage * loaded = new BitStorage(no_tables);
+            delete store;
+            store = loaded;
+        }
     }
-    BitStorage * myself = dynamic_cast<BitStorage *>(this->store);
-    const BitStorage * other;
-    other = dynamic_cast<const BitStorage*>(otherBASE.store);
-
-    // if dynamic_cast worked, then the pointers will be not null.
-    if (myself && other) {
-        myself->update_from(*other);
-    } else {
-        throw oxli_exception("update_from failed with incompatible objects");
+    Hashgraph::load(filename);
+}
+
+double Nodegraph::estimated_fp_rate() const
+{
+    if (auto scalable = dynamic_cast<const ScalableBitStorage *>(store)) {
+        return scalable->estimated_fp_rate();
+    }
+    return static_cast<const BitStorage *>(store)->estimated_fp_rate();
+}
+
+unsigned int Nodegraph::n_slices() const
+{
+    if (auto scalable = dynamic_cast<const ScalableBitStorage *>(store)) {
+        return scalable->n_slices();
     }
+    return 1;
 }
 
 template void Hashgraph::consume_seqfile_and_tag<read_parsers::FastxReader>(
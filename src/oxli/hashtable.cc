@@ -45,7 +45,9 @@ Contact: khmer-project@idyll.org
 #include <queue>
 #include <set>
 #include <memory>
+#include <typeinfo>
 
+#include "oxli/batch_pipeline.hh"
 #include "oxli/hashtable.hh"
 #include "oxli/oxli.hh"
 #include "oxli/traversal.hh"
@@ -130,6 +132,10 @@ void Hashtable::consume_seqfile(
 )
 {
     Read read;
+    std::vector<HashIntoType> buffer;
+    if (_write_combining) {
+        buffer.reserve(WRITE_COMBINE_BUFFER);
+    }
 
     // Iterate through the reads and consume their k-mers.
     while (!parser->is_complete( )) {
@@ -140,13 +146,28 @@ void Hashtable::consume_seqfile(
         }
 
         read.set_clean_seq();
-        unsigned int this_n_consumed = consume_string(read.cleaned_seq);
+        unsigned int this_n_consumed;
+        if (_write_combining) {
+            size_t n_buffered = buffer.size();
+            get_kmer_hashes(read.cleaned_seq, buffer);
+            this_n_consumed = buffer.size() - n_buffered;
+            if (buffer.size() >= WRITE_COMBINE_BUFFER) {
+                store->add_batch(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        } else {
+            this_n_consumed = consume_string(read.cleaned_seq);
+        }
 
         __sync_add_and_fetch( &n_consumed, this_n_consumed );
         __sync_add_and_fetch( &total_reads, 1 );
 
     } // while reads left for parser
 
+    if (!buffer.empty()) {
+        store->add_batch(buffer.data(), buffer.size());
+    }
+
 } // consume_seqfile
 
 template<typename SeqIO>
@@ -302,16 +323,27 @@ void Hashtable::get_median_count(const std::string &s,
                                  float &stddev)
 {
     std::vector<BoundedCounterType> counts;
-    this->get_kmer_counts(s, counts);
+    get_median_count(s, median, average, stddev, counts);
+}
 
-    if (!counts.size()) {
-        throw oxli_exception("no k-mer counts for this string; too short?");
-    }
+void Hashtable::get_median_count(const std::string &s,
+                                 BoundedCounterType &median,
+                                 float &average,
+                                 float &stddev,
+                                 std::vector<BoundedCounterType> &counts) const
+{
+    KmerHashIteratorPtr kmers = new_kmer_iterator(s);
 
+    counts.clear();
     average = 0;
-    for (std::vector<BoundedCounterType>::const_iterator i = counts.begin();
-            i != counts.end(); ++i) {
-        average += *i;
+    while(!kmers->done()) {
+        BoundedCounterType c = this->get_count(kmers->next());
+        counts.push_back(c);
+        average += c;
+    }
+
+    if (!counts.size()) {
+        throw oxli_exception("no k-mer counts for this string; too short?");
     }
     average /= float(counts.size());
 
@@ -323,8 +355,77 @@ void Hashtable::get_median_count(const std::string &s,
     stddev /= float(counts.size());
     stddev = sqrt(stddev);
 
-    sort(counts.begin(), counts.end());
-    median = counts[counts.size() / 2]; // rounds down
+    // selecting the middle element is enough; no need to sort everything
+    std::vector<BoundedCounterType>::iterator middle =
+        counts.begin() + counts.size() / 2; // rounds down
+    std::nth_element(counts.begin(), middle, counts.end());
+    median = *middle;
+}
+
+template<typename SeqIO>
+void Hashtable::coverage_profile(
+    ReadParserPtr<SeqIO>& parser,
+    unsigned int n_threads,
+    std::function<void(const ReadCoverage&)> sink,
+    uint64_t max_reads)
+{
+    ReadBatchPipeline<SeqIO> pipeline(parser, n_threads);
+    pipeline.set_max_reads(max_reads);
+    std::vector<std::vector<BoundedCounterType> > counts(pipeline.n_threads());
+
+    // Workers leave median, average and stddev for each read in
+    // batch.values; reads shorter than k get no entry.
+    auto profile = [&](ReadBatch& batch, unsigned int t) -> uint64_t {
+        uint64_t n = 0;
+        for (auto& read : batch.reads)
+        {
+            read.set_clean_seq();
+            if (read.cleaned_seq.length() < _ksize) {
+                continue;
+            }
+
+            BoundedCounterType median;
+            float average, stddev;
+            get_median_count(read.cleaned_seq, median, average, stddev,
+                             counts[t]);
+            batch.values.push_back(median);
+            batch.values.push_back(average);
+            batch.values.push_back(stddev);
+            ++n;
+        }
+        return n;
+    };
+
+    auto write = [&](ReadBatch& batch) {
+        ReadCoverage coverage;
+        size_t i = 0;
+        for (auto& read : batch.reads)
+        {
+            if (read.cleaned_seq.length() < _ksize) {
+                continue;
+            }
+            coverage.name = read.name;
+            coverage.median = batch.values[i++];
+            coverage.average = batch.values[i++];
+            coverage.stddev = batch.values[i++];
+            coverage.length = read.cleaned_seq.length();
+            sink(coverage);
+        }
+    };
+
+    pipeline.run_in_order(profile, write);
+}
+
+template<typename SeqIO>
+void Hashtable::coverage_profile(
+    ReadParserPtr<SeqIO>& parser,
+    unsigned int n_threads,
+    std::vector<ReadCoverage>& profile,
+    uint64_t max_reads)
+{
+    coverage_profile(parser, n_threads, [&profile](const ReadCoverage& c) {
+        profile.push_back(c);
+    }, max_reads);
 }
 
 //
@@ -400,6 +501,48 @@ void Hashtable::get_kmer_hashes_as_hashset(const std::string &s,
 }
 
 
+void Hashtable::hash_sequences(const std::vector<std::string> &seqs,
+                               std::vector<HashIntoType> &hashes,
+                               std::vector<uint64_t> &offsets) const
+{
+    uint64_t n_kmers = 0;
+    for (const std::string &seq : seqs) {
+        if (seq.length() >= _ksize) {
+            n_kmers += seq.length() - _ksize + 1;
+        }
+    }
+    hashes.reserve(hashes.size() + n_kmers);
+    offsets.reserve(offsets.size() + seqs.size() + 1);
+
+    offsets.push_back(hashes.size());
+    for (const std::string &seq : seqs) {
+        if (seq.length() >= _ksize) {
+            get_kmer_hashes(seq, hashes);
+        }
+        offsets.push_back(hashes.size());
+    }
+}
+
+
+uint64_t Hashtable::add_hashes(const HashIntoType * hashes, size_t n)
+{
+    return store->add_batch(hashes, n);
+}
+
+
+size_t Hashtable::get_kmer_counts(const std::string &s,
+                                  BoundedCounterType * counts) const
+{
+    std::vector<HashIntoType> hashes;
+    if (s.length() >= _ksize) {
+        hashes.reserve(s.length() - _ksize + 1);
+        get_kmer_hashes(s, hashes);
+    }
+    store->get_counts(hashes.data(), hashes.size(), counts);
+    return hashes.size();
+}
+
+
 void Hashtable::get_kmer_counts(const std::string &s,
                                 std::vector<BoundedCounterType> &counts) const
 {
@@ -501,6 +644,144 @@ uint64_t * Hashtable::abundance_distribution(
     return abundance_distribution(parser, tracking);
 }
 
+// k-mer hashes are spread over this many partitions for de-duplication
+#define ABUNDANCE_DIST_PARTITIONS 256
+// smallest per-thread run of hashes worth de-duplicating
+#define ABUNDANCE_DIST_MIN_RUN 4096
+
+static inline unsigned int _abundance_dist_partition(HashIntoType kmer)
+{
+    // Fibonacci hashing: spreads 2-bit encoded k-mers, whose high bits are
+    // often zero, as evenly as hashed ones.
+    return (kmer * 0x9E3779B97F4A7C15ULL) >> 56;
+}
+
+static void _sort_unique(std::vector<HashIntoType>& hashes)
+{
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+}
+
+template<typename SeqIO>
+void Hashtable::abundance_distribution(
+    ReadParserPtr<SeqIO>& parser,
+    unsigned int n_threads,
+    std::vector<uint64_t>& dist)
+{
+    typedef std::vector<HashIntoType> HashRun;
+
+    ReadBatchPipeline<SeqIO> pipeline(parser, n_threads);
+    n_threads = pipeline.n_threads();
+
+    // runs[t][p] holds the hashes in partition p seen by worker t. A run is
+    // de-duplicated whenever it doubles in size, which keeps memory in
+    // proportion to the number of distinct k-mers.
+    std::vector<std::vector<HashRun> > runs(
+        n_threads, std::vector<HashRun>(ABUNDANCE_DIST_PARTITIONS));
+    std::vector<std::vector<size_t> > run_unique(
+        n_threads, std::vector<size_t>(ABUNDANCE_DIST_PARTITIONS, 0));
+
+    pipeline.run([&](ReadBatch& batch, unsigned int t) -> uint64_t {
+        uint64_t n = 0;
+        for (auto& read : batch.reads)
+        {
+            read.set_clean_seq();
+            KmerHashIteratorPtr kmers = new_kmer_iterator(read.cleaned_seq);
+
+            while (!kmers->done()) {
+                HashIntoType kmer = kmers->next();
+                unsigned int p = _abundance_dist_partition(kmer);
+                HashRun& run = runs[t][p];
+
+                run.push_back(kmer);
+                if (run.size() >= 2 * run_unique[t][p]
+                        && run.size() >= ABUNDANCE_DIST_MIN_RUN) {
+                    _sort_unique(run);
+                    run_unique[t][p] = run.size();
+                }
+                ++n;
+            }
+        }
+        return n;
+    });
+
+    dist.assign(MAX_BIGCOUNT + 1, 0);
+    size_t expected = n_unique_kmers() / ABUNDANCE_DIST_PARTITIONS;
+
+    // Partitions are disjoint, so each one is merged, de-duplicated and
+    // looked up on its own; per-thread histograms are summed at the end.
+    #pragma omp parallel num_threads(n_threads)
+    {
+        std::vector<uint64_t> local(MAX_BIGCOUNT + 1, 0);
+        HashRun merged;
+        merged.reserve(expected);
+
+        #pragma omp for schedule(dynamic)
+        for (int p = 0; p < ABUNDANCE_DIST_PARTITIONS; ++p) {
+            merged.clear();
+            for (unsigned int t = 0; t < n_threads; ++t) {
+                merged.insert(merged.end(),
+                              runs[t][p].begin(), runs[t][p].end());
+                HashRun().swap(runs[t][p]);
+            }
+            _sort_unique(merged);
+
+            for (auto kmer : merged) {
+                local[get_count(kmer)]++;
+            }
+        }
+
+        #pragma omp critical(abundance_distribution_merge)
+        for (size_t i = 0; i <= MAX_BIGCOUNT; ++i) {
+            dist[i] += local[i];
+        }
+    }
+}
+
+void Hashtable::update_from(const Hashtable& other, unsigned int n_threads)
+{
+    if (_ksize != other._ksize) {
+        throw oxli_exception("both tables must have same k size");
+    }
+    // different table types may hash k-mers differently
+    if (typeid(*this) != typeid(other)) {
+        throw oxli_exception("update_from failed with incompatible objects");
+    }
+
+    if (auto mine = dynamic_cast<ByteStorage *>(store)) {
+        if (auto theirs = dynamic_cast<const ByteStorage *>(other.store)) {
+            mine->update_from(*theirs, n_threads);
+            return;
+        }
+    } else if (auto mine = dynamic_cast<NibbleStorage *>(store)) {
+        if (auto theirs = dynamic_cast<const NibbleStorage *>(other.store)) {
+            mine->update_from(*theirs, n_threads);
+            return;
+        }
+    } else if (auto mine = dynamic_cast<BitStorage *>(store)) {
+        if (auto theirs = dynamic_cast<const BitStorage *>(other.store)) {
+            mine->update_from(*theirs, n_threads);
+            return;
+        }
+    } else if (auto mine = dynamic_cast<QFStorage *>(store)) {
+        if (auto theirs = dynamic_cast<const QFStorage *>(other.store)) {
+            mine->update_from(*theirs);
+            return;
+        }
+    }
+    throw oxli_exception("update_from failed with incompatible objects");
+}
+
+void Hashtable::update_from_file(std::string filename, unsigned int n_threads)
+{
+    ByteStorage * mine = dynamic_cast<ByteStorage *>(store);
+    if (!mine) {
+        throw oxli_exception("update_from_file is only supported for "
+                             "byte storage");
+    }
+    ByteStorageFile::merge(filename, _ksize, *mine, n_threads);
+}
+
 unsigned long Hashtable::trim_on_abundance(
     std::string     seq,
     BoundedCounterType  min_abund)
@@ -532,6 +813,82 @@ const
     return seq.length();
 }
 
+template<typename SeqIO>
+void Hashtable::trim_seqfile_on_abundance(
+    ReadParserPtr<SeqIO>& parser,
+    FastxWriter& output,
+    BoundedCounterType min_abund,
+    bool variable_coverage,
+    unsigned int normalize_to,
+    bool paired,
+    unsigned int n_threads,
+    unsigned int &total_reads,
+    unsigned int &n_kept)
+{
+    ReadBatchPipeline<SeqIO> pipeline(parser, n_threads);
+    pipeline.set_paired(paired);
+
+    // Same rules as khmer.trimming.trim_record; returns false if the read
+    // is to be dropped.
+    auto trim = [&](Read& read) -> bool {
+        if (read.sequence.length() < _ksize)
+        {
+            return false;
+        }
+        read.set_clean_seq();
+        if (variable_coverage &&
+                !median_at_least(read.cleaned_seq, normalize_to))
+        {
+            return true;
+        }
+
+        unsigned long trim_at = trim_on_abundance(read.cleaned_seq,
+                                min_abund);
+        if (trim_at < _ksize)
+        {
+            return false;
+        }
+        if (trim_at < read.sequence.length())
+        {
+            read.sequence.resize(trim_at);
+            if (!read.quality.empty()) {
+                read.quality.resize(trim_at);
+            }
+        }
+        return true;
+    };
+
+    auto filter = [&](ReadBatch& batch, unsigned int) -> uint64_t {
+        uint64_t kept = 0;
+        size_t step = paired ? 2 : 1;
+        for (size_t i = 0; i < batch.reads.size(); i += step)
+        {
+            bool keep = trim(batch.reads[i]);
+            if (paired) {
+                // trim both mates, even if the first is already lost
+                keep = trim(batch.reads[i + 1]) && keep;
+            }
+            if (!keep) {
+                continue;
+            }
+            for (size_t j = i; j < i + step; ++j) {
+                batch.reads[j].write_fastx(batch.output);
+            }
+            kept += step;
+        }
+        return kept;
+    };
+
+    auto write = [&output](ReadBatch& batch) {
+        output.write(batch.output);
+    };
+
+    pipeline.run_in_order(filter, write);
+
+    total_reads = pipeline.n_reads();
+    n_kept = pipeline.n_consumed();
+}
+
 unsigned long Hashtable::trim_below_abundance(
     std::string     seq,
     BoundedCounterType  max_abund)
@@ -695,3 +1052,39 @@ template uint64_t * Hashtable::abundance_distribution<FastxReader>(
     std::string filename,
     Hashtable * tracking
 );
+
+
+template void Hashtable::abundance_distribution<FastxReader>(
+    ReadParserPtr<FastxReader>& parser,
+    unsigned int n_threads,
+    std::vector<uint64_t>& dist
+);
+
+
+template void Hashtable::coverage_profile<FastxReader>(
+    ReadParserPtr<FastxReader>& parser,
+    unsigned int n_threads,
+    std::function<void(const ReadCoverage&)> sink,
+    uint64_t max_reads
+);
+
+
+template void Hashtable::coverage_profile<FastxReader>(
+    ReadParserPtr<FastxReader>& parser,
+    unsigned int n_threads,
+    std::vector<ReadCoverage>& profile,
+    uint64_t max_reads
+);
+
+
+template void Hashtable::trim_seqfile_on_abundance<FastxReader>(
+    ReadParserPtr<FastxReader>& parser,
+    FastxWriter& output,
+    BoundedCounterType min_abund,
+    bool variable_coverage,
+    unsigned int normalize_to,
+    bool paired,
+    unsigned int n_threads,
+    unsigned int &total_reads,
+    unsigned int &n_kept
+);
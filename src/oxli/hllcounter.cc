@@ -47,12 +47,10 @@ Contact: khmer-project@idyll.org
 #include "oxli/oxli_exception.hh"
 #include "oxli/kmer_hash.hh"
 #include "oxli/read_parsers.hh"
+#include "oxli/batch_pipeline.hh"
 
-#ifdef _OPENMP
-#include <omp.h>
-#else
-#define omp_get_thread_num() 0
-#define omp_get_num_threads() 1
+#ifdef __AVX2__
+#include <immintrin.h>
 #endif
 
 using namespace oxli;
@@ -175,6 +173,75 @@ double estimate_bias(double E, int p)
 }
 
 
+/*
+   Register kernels for merge and estimate_cardinality. When built with AVX2
+   enabled (e.g. WANT_AVX2=true in src/oxli/Makefile, or -mavx2 in CXXFLAGS)
+   32 registers are processed per step; otherwise the plain loops are used.
+*/
+
+// counters[i] = max(counters[i], other[i])
+static void _merge_registers(uint8_t * counters, const uint8_t * other,
+                             size_t n)
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(counters + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(other + i));
+        _mm256_storeu_si256((__m256i *)(counters + i), _mm256_max_epu8(a, b));
+    }
+#endif
+    for (; i < n; ++i) {
+        counters[i] = std::max(counters[i], other[i]);
+    }
+}
+
+// Return the sum of 2^-v over all registers (the denominator of the
+// harmonic mean) and count the registers which are still zero.
+static double _harmonic_sum(const uint8_t * counters, size_t n, long &zeros)
+{
+    double sum = 0.0;
+    size_t i = 0;
+    zeros = 0;
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi32(127);
+    const __m256i max_exp = _mm256_set1_epi32(126);
+    __m256d acc_lo = _mm256_setzero_pd();
+    __m256d acc_hi = _mm256_setzero_pd();
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(counters + i));
+        zeros += __builtin_popcount(
+                     _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+
+        for (size_t j = 0; j < 32; j += 8) {
+            // 2^-v is the float with biased exponent 127 - v; registers
+            // never get near 126, the clamp only guards set_counters.
+            __m256i w = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i *)(counters + i + j)));
+            w = _mm256_min_epi32(w, max_exp);
+            __m256 p = _mm256_castsi256_ps(
+                           _mm256_slli_epi32(_mm256_sub_epi32(bias, w), 23));
+            acc_lo = _mm256_add_pd(acc_lo,
+                                   _mm256_cvtps_pd(_mm256_castps256_ps128(p)));
+            acc_hi = _mm256_add_pd(acc_hi,
+                                   _mm256_cvtps_pd(_mm256_extractf128_ps(p, 1)));
+        }
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc_lo, acc_hi));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; ++i) {
+        zeros += (counters[i] == 0);
+        sum += ldexp(1.0, -(int)counters[i]);
+    }
+    return sum;
+}
+
+
 HLLCounter::HLLCounter(double error_rate, WordLength ksize)
 {
     if (error_rate < 0) {
@@ -236,7 +303,8 @@ void HLLCounter::set_ksize(WordLength new_ksize)
 
 uint64_t HLLCounter::estimate_cardinality()
 {
-    long V = std::count(begin(counters), end(counters), 0);
+    long V = 0;
+    double sum = _harmonic_sum(counters.data(), counters.size(), V);
 
     if (V > 0) {
         double H = ncounters * log((double)ncounters / V);
@@ -245,11 +313,6 @@ uint64_t HLLCounter::estimate_cardinality()
         }
     }
 
-    double sum = 0.0;
-    for (auto v: counters) {
-        sum += pow(2.0, float(-v));
-    }
-
     double E = alpha * pow(ncounters, 2.0) / sum;
 
     if (E <= (5 * (double)ncounters)) {
@@ -261,7 +324,11 @@ uint64_t HLLCounter::estimate_cardinality()
 
 void HLLCounter::add(const std::string &value)
 {
-    HashIntoType hashed = oxli::_hash_murmur(value, value.length());
+    add_hash(oxli::_hash_murmur(value, value.length()));
+}
+
+void HLLCounter::add_hash(HashIntoType hashed)
+{
     // Use lowest bits for indexing
     uint64_t index = hashed & (ncounters - 1);
 
@@ -299,18 +366,23 @@ void HLLCounter::add(const std::string &value)
 
 unsigned int HLLCounter::consume_string(const std::string &inp)
 {
-    unsigned int n_consumed = 0;
-    std::string kmer = "";
-
-    for(auto ch: inp) {
-        kmer.push_back(ch);
-        if (kmer.size() < _ksize) {
-            continue;
-        }
-        add(kmer);
+    if (inp.length() < _ksize) {
+        return 0;
+    }
 
-        kmer.erase(0, 1);
-        n_consumed++;
+    // The reverse complement of the k-mer starting at i is the window of the
+    // reverse-complemented sequence ending at length - i, so one pass over
+    // the sequence gives every k-mer its canonical hash without copies.
+    // The buffer is per thread, so it is reused across reads without
+    // threads sharing a counter racing on it.
+    thread_local std::string rc;
+    _revcomp(inp, rc);
+    const char * fwd = inp.c_str();
+    const char * rev = rc.c_str() + inp.length() - _ksize;
+    unsigned int n_consumed = inp.length() - _ksize + 1;
+
+    for (unsigned int i = 0; i < n_consumed; ++i) {
+        add_hash(oxli::_hash_murmur(fwd + i, rev - i, _ksize));
     }
     return n_consumed;
 }
@@ -333,74 +405,47 @@ void HLLCounter::consume_seqfile(
     unsigned int &      total_reads,
     unsigned long long &    n_consumed)
 {
+    ReadBatchPipeline<SeqIO> pipeline(parser, 0);
+    consume_seqfile<SeqIO>(pipeline, stream_records, total_reads, n_consumed);
+}
 
-    read_parsers::Read read;
-    HLLCounter** hlls;
-    unsigned int *n_consumed_partial;
-    unsigned int *total_reads_partial;
-
-    n_consumed = 0;
-
-    #pragma omp parallel
-    {
-        #pragma omp master
+template<typename SeqIO>
+void HLLCounter::consume_seqfile(
+    ReadBatchPipeline<SeqIO>& pipeline,
+    bool stream_records,
+    unsigned int &      total_reads,
+    unsigned long long &    n_consumed)
+{
+    // Each worker keeps its own counter and consumes whole batches into it;
+    // the counters are merged once all reads are in.
+    std::vector<HLLCounter> hlls(pipeline.n_threads(),
+                                 HLLCounter(ncounters, _ksize));
+
+    auto consume = [&hlls](ReadBatch& batch, unsigned int t) -> uint64_t {
+        uint64_t n = 0;
+        for (auto& read : batch.reads)
         {
-            hlls = (HLLCounter**)calloc(omp_get_num_threads(),
-            sizeof(HLLCounter*));
-            n_consumed_partial = (unsigned int*)calloc(omp_get_num_threads(),
-            sizeof(unsigned int));
-            total_reads_partial = (unsigned int*)calloc(omp_get_num_threads(),
-            sizeof(unsigned int));
-
-            for (int i=0; i < omp_get_num_threads(); i++)
-            {
-                HLLCounter *newc = new HLLCounter(ncounters, _ksize);
-                hlls[i] = newc;
-            }
-
-            while (!parser->is_complete())
-            {
-                // Iterate through the reads and consume their k-mers.
-                try {
-                    read = parser->get_next_read();
-                } catch (read_parsers::NoMoreReadsAvailable) {
-                    break;
-                }
-
-                if (stream_records) {
-                    read.write_fastx(std::cout);
-                }
-
-                #pragma omp task default(none) firstprivate(read) \
-                shared(hlls, n_consumed_partial, total_reads_partial)
-                {
-                    int n, t = omp_get_thread_num();
-
-                    read.set_clean_seq();
-                    n = hlls[t]->consume_string(read.cleaned_seq);
-
-                    n_consumed_partial[t] += n;
-                    total_reads_partial[t] += 1;
-                }
-
-            } // while reads left for parser
+            read.set_clean_seq();
+            n += hlls[t].consume_string(read.cleaned_seq);
         }
-        #pragma omp taskwait
+        return n;
+    };
 
-        #pragma omp master
-        {
-            for (int i=0; i < omp_get_num_threads(); ++i)
-            {
-                merge(*hlls[i]);
-                delete hlls[i];
-                n_consumed += n_consumed_partial[i];
-                total_reads += total_reads_partial[i];;
+    if (stream_records) {
+        pipeline.run_in_order(consume, [](ReadBatch& batch) {
+            for (auto& read : batch.reads) {
+                read.write_fastx(std::cout);
             }
-            free(hlls);
-            free(n_consumed_partial);
-            free(total_reads_partial);
-        }
+        });
+    } else {
+        pipeline.run(consume);
+    }
+
+    for (auto& hll : hlls) {
+        merge(hll);
     }
+    n_consumed = pipeline.n_consumed();
+    total_reads += pipeline.n_reads();
 }
 
 void HLLCounter::merge(HLLCounter &other)
@@ -408,9 +453,7 @@ void HLLCounter::merge(HLLCounter &other)
     if ((ncounters != other.ncounters) or (_ksize != other._ksize)) {
         throw InvalidValue("HLLCounters to be merged must be created with same parameters");
     }
-    for (size_t i=0; i < counters.size(); ++i) {
-        counters[i] = std::max(other.counters[i], counters[i]);
-    }
+    _merge_registers(counters.data(), other.counters.data(), counters.size());
 }
 
 void HLLCounter::set_counters(std::vector<uint8_t> new_counters)
@@ -433,3 +476,9 @@ template void HLLCounter::consume_seqfile<FastxReader>(
     unsigned int &,
     unsigned long long &
 );
+template void HLLCounter::consume_seqfile<FastxReader>(
+    ReadBatchPipeline<FastxReader>&,
+    bool,
+    unsigned int &,
+    unsigned long long &
+);
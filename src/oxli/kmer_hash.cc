@@ -165,6 +165,17 @@ std::string _revcomp(const std::string& kmer)
     return out;
 }
 
+void _revcomp(const std::string& seq, std::string& out)
+{
+    out.resize(seq.length());
+
+    auto from = seq.begin();
+    auto to = out.rbegin();
+    for (; from != seq.end(); from++, to++) {
+        *to = tbl[(int)*from];
+    }
+}
+
 HashIntoType _hash_murmur(const std::string& kmer, const WordLength k)
 {
     HashIntoType h = 0;
@@ -197,6 +208,25 @@ HashIntoType _hash_murmur(const std::string& kmer, const WordLength k,
     return h ^ r;
 }
 
+HashIntoType _hash_murmur(const char * kmer, const char * rc,
+                          const WordLength k)
+{
+    uint64_t out[2];
+    uint32_t seed = 0;
+    MurmurHash3_x64_128((void *)kmer, k, seed, &out);
+    HashIntoType h = out[0];
+
+    MurmurHash3_x64_128((void *)rc, k, seed, &out);
+    HashIntoType r = out[0];
+
+    // a self complement kmer hashes the same both ways; only then is it
+    // worth comparing the strings.
+    if (h == r && memcmp(kmer, rc, k) == 0) {
+        return h;
+    }
+    return h ^ r;
+}
+
 HashIntoType _hash_murmur_forward(const std::string& kmer, const WordLength k)
 {
     HashIntoType h = 0;
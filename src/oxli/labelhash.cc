@@ -37,6 +37,7 @@ Contact: khmer-project@idyll.org
 */
 #include <errno.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream> // IWYU pragma: keep
 #include <set>
@@ -45,6 +46,7 @@ Contact: khmer-project@idyll.org
 #include "oxli/oxli_exception.hh"
 #include "oxli/labelhash.hh"
 #include "oxli/read_parsers.hh"
+#include "oxli/sorted_hashes.hh"
 #include "oxli/subset.hh"
 
 #define IO_BUF_SIZE 250*1000*1000
@@ -402,7 +404,7 @@ void LabelHash::save_labels_and_tags(std::string filename)
     ofstream outfile(filename.c_str(), ios::binary);
 
     outfile.write(SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COMPACT_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
     unsigned char ht_type = SAVED_LABELSET;
@@ -411,46 +413,25 @@ void LabelHash::save_labels_and_tags(std::string filename)
     unsigned int save_ksize = graph->ksize();
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
 
-    unsigned long n_labeltags = tag_labels.size();
-    outfile.write((const char *) &n_labeltags, sizeof(n_labeltags));
+    // For each tag/label link, save the tag and the label, in tag order.
 
-    ///
+    std::vector<TagLabelPair> links(tag_labels.begin(), tag_labels.end());
+    std::sort(links.begin(), links.end());
 
-    char * buf = NULL;
-    buf = new char[IO_BUF_SIZE];
-    unsigned int n_bytes = 0;
-
-    // For each tag in the partition map, save the tag and the associated
-    // partition ID.
-
-    TagLabelMap::const_iterator pi = tag_labels.begin();
-    for (; pi != tag_labels.end(); ++pi) {
-        HashIntoType *k_p = (HashIntoType *) (buf + n_bytes);
-        *k_p = pi->first;
-        n_bytes += sizeof(HashIntoType);
-
-        Label * l_p = (Label *) (buf + n_bytes);
-        *l_p = pi->second;
-        n_bytes += sizeof(Label);
-
-        // flush to disk
-        if (n_bytes >= IO_BUF_SIZE - sizeof(HashIntoType) - sizeof(Label)) {
-            outfile.write(buf, n_bytes);
-            n_bytes = 0;
-        }
-    }
-    // save remainder.
-    if (n_bytes) {
-        outfile.write(buf, n_bytes);
+    std::vector<HashIntoType> tags(links.size());
+    std::vector<uint64_t> labels(links.size());
+    for (size_t i = 0; i < links.size(); ++i) {
+        tags[i] = links[i].first;
+        labels[i] = links[i].second;
     }
+    links.clear();
+
+    write_sorted_hashes(outfile, tags, labels);
 
     if (outfile.fail()) {
-        delete[] buf;
         throw oxli_file_exception(strerror(errno));
     }
     outfile.close();
-
-    delete[] buf;
 }
 
 void LabelHash::load_labels_and_tags(std::string filename)
@@ -478,6 +459,15 @@ void LabelHash::load_labels_and_tags(std::string filename)
         throw oxli_file_exception(err);
     }
 
+    load_labels_and_tags(infile, filename);
+}
+
+void LabelHash::load_labels_and_tags(std::istream& infile,
+                                     const std::string& filename)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
     unsigned long n_labeltags = 1;
     try {
         unsigned int save_ksize = 0;
@@ -496,10 +486,13 @@ void LabelHash::load_labels_and_tags(std::string filename)
             err << " while reading labels/tags from " << filename
                 << " Should be: " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
+        } else if (!(version == SAVED_FORMAT_VERSION ||
+                     version == SAVED_COMPACT_FORMAT_VERSION)) {
             std::ostringstream err;
             err << "Incorrect file format version " << (int) version
-                << " while reading labels/tags from " << filename;
+                << " while reading labels/tags from " << filename
+                << "; should be " << (int) SAVED_FORMAT_VERSION
+                << " or " << (int) SAVED_COMPACT_FORMAT_VERSION;
             throw oxli_file_exception(err.str());
         } else if (!(ht_type == SAVED_LABELSET)) {
             std::ostringstream err;
@@ -516,6 +509,24 @@ void LabelHash::load_labels_and_tags(std::string filename)
             throw oxli_file_exception(err.str());
         }
 
+        if (version == SAVED_COMPACT_FORMAT_VERSION) {
+            std::vector<HashIntoType> tags;
+            std::vector<uint64_t> labels;
+            read_sorted_hashes(infile, tags, labels);
+            if (labels.size() != tags.size()) {
+                throw oxli_file_exception("error loading labels: "
+                                          "missing labels");
+            }
+
+            tag_labels.reserve(tag_labels.size() + tags.size());
+            label_tag.reserve(label_tag.size() + tags.size());
+            for (size_t i = 0; i < tags.size(); ++i) {
+                graph->all_tags.insert(graph->all_tags.end(), tags[i]);
+                link_tag_and_label(tags[i], labels[i]);
+            }
+            return;
+        }
+
         infile.read((char *) &n_labeltags, sizeof(n_labeltags));
     } catch (std::ifstream::failure &e) {
         std::string err;
@@ -0,0 +1,531 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the Michigan State University nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+
+// oxli-bench: microbenchmarks for the core of liboxli.
+//
+// Usage: oxli-bench [-t THREADS] [-n READS] [-r REPS] [-f FILTER] [FILE ...]
+//
+//   -t  comma-separated thread counts to run each benchmark at (default 1)
+//   -n  number of synthetic reads, and of reads loaded from each FILE
+//       (default 20000)
+//   -r  repetitions per benchmark; the fastest is reported (default 3)
+//   -f  only run benchmarks whose name contains FILTER
+//
+// Every read-based benchmark runs over synthetic reads sampled with errors
+// from a random genome, and then over the reads of each FILE. The parser
+// benchmark also reads the synthetic reads back from plain and gzipped
+// FASTA.
+//
+// Results go to stdout as tab-separated lines, after a header line:
+//   benchmark  input  threads  items  seconds  items_per_sec
+// Progress and errors go to stderr.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+
+#include "oxli/oxli.hh"
+#include "oxli/assembler.hh"
+#include "oxli/hashgraph.hh"
+#include "oxli/hashtable.hh"
+#include "oxli/kmer_hash.hh"
+#include "oxli/read_aligner.hh"
+#include "oxli/read_parsers.hh"
+#include "oxli/storage.hh"
+#include "oxli/subset.hh"
+
+using namespace oxli;
+using namespace oxli::read_parsers;
+
+namespace
+{
+
+const WordLength K = 25;
+const unsigned int READ_LENGTH = 100;
+const unsigned int GENOME_SIZE = 200000;
+const double ERROR_RATE = 0.01;
+
+// storage benchmarks add and look up this many random hashes
+const uint64_t STORAGE_ITEMS = 1 << 20;
+// slots in the quotient filter, as a power of two
+const int QF_SIZE = 22;
+
+// graph traversal benchmarks start from at most this many reads
+const unsigned int MAX_SEEDS = 1000;
+
+std::vector<uint64_t> table_sizes()
+{
+    std::vector<uint64_t> sizes = {2000003, 2000029, 2000039, 2000081};
+    return sizes;
+}
+
+struct Input {
+    std::string name;
+    std::vector<std::string> reads;
+};
+
+struct Config {
+    std::vector<unsigned int> threads;
+    unsigned int n_reads;
+    unsigned int reps;
+    std::string filter;
+};
+
+Config config;
+
+// keeps the compiler from discarding results nobody looks at
+volatile uint64_t sink;
+
+// Run fn config.reps times and report the fastest run. fn does the work on
+// n_threads threads and returns the number of items it processed.
+template<typename Fn>
+void bench(const std::string& name, const std::string& input,
+           unsigned int n_threads, Fn fn)
+{
+    if (name.find(config.filter) == std::string::npos) {
+        return;
+    }
+
+    double best = -1;
+    uint64_t items = 0;
+    for (unsigned int rep = 0; rep < config.reps; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        items = fn();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (best < 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+
+    printf("%s\t%s\t%u\t%llu\t%.6f\t%.1f\n", name.c_str(), input.c_str(),
+           n_threads, (unsigned long long) items, best,
+           best > 0 ? items / best : 0.0);
+    fflush(stdout);
+}
+
+//
+// synthetic input
+//
+
+std::string random_genome(std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> base(0, 3);
+    std::string genome(GENOME_SIZE, 'A');
+    for (auto& c : genome) {
+        c = "ACGT"[base(rng)];
+    }
+    return genome;
+}
+
+Input synthetic_reads(unsigned int n_reads)
+{
+    std::mt19937_64 rng(1);
+    std::string genome = random_genome(rng);
+    std::uniform_int_distribution<size_t> pos(0, GENOME_SIZE - READ_LENGTH);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::bernoulli_distribution error(ERROR_RATE);
+    std::bernoulli_distribution reverse(0.5);
+
+    Input input;
+    input.name = "synthetic";
+    for (unsigned int i = 0; i < n_reads; ++i) {
+        std::string read = genome.substr(pos(rng), READ_LENGTH);
+        for (auto& c : read) {
+            if (error(rng)) {
+                c = "ACGT"[base(rng)];
+            }
+        }
+        if (reverse(rng)) {
+            read = _revcomp(read);
+        }
+        input.reads.push_back(read);
+    }
+    return input;
+}
+
+void write_fasta(const Input& input, const std::string& filename)
+{
+    std::ofstream out(filename.c_str());
+    for (size_t i = 0; i < input.reads.size(); ++i) {
+        out << ">read" << i << "\n" << input.reads[i] << "\n";
+    }
+    if (!out) {
+        throw oxli_file_exception("cannot write " + filename);
+    }
+}
+
+void write_fasta_gz(const Input& input, const std::string& filename)
+{
+    gzFile out = gzopen(filename.c_str(), "wb");
+    if (out == NULL) {
+        throw oxli_file_exception("cannot write " + filename);
+    }
+    for (size_t i = 0; i < input.reads.size(); ++i) {
+        std::ostringstream record;
+        record << ">read" << i << "\n" << input.reads[i] << "\n";
+        gzputs(out, record.str().c_str());
+    }
+    gzclose(out);
+}
+
+Input load_reads(const std::string& filename, unsigned int n_reads)
+{
+    Input input;
+    size_t slash = filename.rfind('/');
+    input.name = slash == std::string::npos ?
+                 filename : filename.substr(slash + 1);
+
+    ReadParserPtr<FastxReader> parser = get_parser<FastxReader>(filename);
+    while (input.reads.size() < n_reads && !parser->is_complete()) {
+        Read read;
+        try {
+            read = parser->get_next_read();
+        } catch (NoMoreReadsAvailable&) {
+            break;
+        }
+        read.set_clean_seq();
+        if (read.cleaned_seq.length() >= K) {
+            input.reads.push_back(read.cleaned_seq);
+        }
+    }
+    return input;
+}
+
+//
+// benchmarks
+//
+
+void bench_storage(const std::string& backend, Storage& store,
+                   const std::vector<HashIntoType>& hashes,
+                   unsigned int n_threads)
+{
+    int64_t n = hashes.size();
+
+    bench("storage_add/" + backend, "synthetic", n_threads,
+    [&]() -> uint64_t {
+        #pragma omp parallel for num_threads(n_threads) schedule(static)
+        for (int64_t i = 0; i < n; ++i) {
+            store.add(hashes[i]);
+        }
+        return n;
+    });
+
+    bench("storage_get/" + backend, "synthetic", n_threads,
+    [&]() -> uint64_t {
+        uint64_t total = 0;
+        #pragma omp parallel for num_threads(n_threads) schedule(static) \
+        reduction(+:total)
+        for (int64_t i = 0; i < n; ++i) {
+            total += store.get_count(hashes[i]);
+        }
+        sink = total;
+        return n;
+    });
+}
+
+void bench_storages(unsigned int n_threads)
+{
+    std::mt19937_64 rng(2);
+    std::vector<HashIntoType> hashes(STORAGE_ITEMS);
+    for (auto& h : hashes) {
+        h = rng();
+    }
+
+    std::vector<uint64_t> sizes = table_sizes();
+    BitStorage bits(sizes);
+    bench_storage("BitStorage", bits, hashes, n_threads);
+    NibbleStorage nibbles(sizes);
+    bench_storage("NibbleStorage", nibbles, hashes, n_threads);
+    ByteStorage bytes(sizes);
+    bench_storage("ByteStorage", bytes, hashes, n_threads);
+
+    NibbleStorage cons_nibbles(sizes);
+    cons_nibbles.set_conservative_update(true);
+    bench_storage("NibbleStorage/conservative", cons_nibbles, hashes,
+                  n_threads);
+    ByteStorage cons_bytes(sizes);
+    cons_bytes.set_conservative_update(true);
+    bench_storage("ByteStorage/conservative", cons_bytes, hashes, n_threads);
+
+    // the quotient filter serializes inserts on a lock; lookups share it
+    QFStorage qf(QF_SIZE);
+    bench_storage("QFStorage", qf, hashes, n_threads);
+}
+
+template<typename Iterator>
+void bench_hash_iterator(const std::string& name, const Input& input,
+                         unsigned int n_threads)
+{
+    int64_t n = input.reads.size();
+
+    bench("kmer_hash_iterator/" + name, input.name, n_threads,
+    [&]() -> uint64_t {
+        uint64_t n_kmers = 0;
+        HashIntoType total = 0;
+        #pragma omp parallel for num_threads(n_threads) \
+        schedule(dynamic, 256) reduction(+:n_kmers, total)
+        for (int64_t i = 0; i < n; ++i) {
+            Iterator kmers(input.reads[i].c_str(), K);
+            while (!kmers.done()) {
+                total += kmers.next();
+                ++n_kmers;
+            }
+        }
+        sink = total;
+        return n_kmers;
+    });
+}
+
+void bench_parser(const std::string& filename, const std::string& label,
+                  unsigned int n_threads)
+{
+    bench("read_parser", label, n_threads, [&]() -> uint64_t {
+        ReadParserPtr<FastxReader> parser = get_parser<FastxReader>(filename);
+        uint64_t n = 0;
+        #pragma omp parallel num_threads(n_threads) reduction(+:n)
+        {
+            Read read;
+            while (!parser->is_complete()) {
+                try {
+                    read = parser->get_next_read();
+                } catch (NoMoreReadsAvailable&) {
+                    break;
+                }
+                ++n;
+            }
+        }
+        return n;
+    });
+}
+
+void bench_graphs(const Input& input, unsigned int n_threads)
+{
+    int64_t n = input.reads.size();
+    int64_t n_seeds = std::min<int64_t>(n, MAX_SEEDS);
+
+    bench("consume_sequence_and_tag", input.name, n_threads,
+    [&]() -> uint64_t {
+        Nodegraph graph(K, table_sizes());
+        #pragma omp parallel for num_threads(n_threads) schedule(dynamic, 256)
+        for (int64_t i = 0; i < n; ++i) {
+            unsigned long long n_consumed = 0;
+            graph.consume_sequence_and_tag(input.reads[i], n_consumed);
+        }
+        return n;
+    });
+
+    // The remaining benchmarks only read the graphs.
+    Nodegraph nodegraph(K, table_sizes());
+    Countgraph countgraph(K, table_sizes());
+    for (auto& read : input.reads) {
+        unsigned long long n_consumed = 0;
+        nodegraph.consume_sequence_and_tag(read, n_consumed);
+        countgraph.consume_string(read);
+    }
+
+    bench("find_all_tags", input.name, n_threads, [&]() -> uint64_t {
+        uint64_t n_tags = 0;
+        #pragma omp parallel for num_threads(n_threads) schedule(dynamic) \
+        reduction(+:n_tags)
+        for (int64_t i = 0; i < n_seeds; ++i) {
+            SeenSet tagged;
+            Kmer start = nodegraph.build_kmer(input.reads[i].substr(0, K));
+            nodegraph.partition->find_all_tags(start, tagged,
+                                               nodegraph.all_tags,
+                                               false, true);
+            n_tags += tagged.size();
+        }
+        sink = n_tags;
+        return n_seeds;
+    });
+
+    bench("linear_assembler", input.name, n_threads, [&]() -> uint64_t {
+        LinearAssembler assembler(&nodegraph);
+        uint64_t n_bases = 0;
+        #pragma omp parallel for num_threads(n_threads) schedule(dynamic) \
+        reduction(+:n_bases)
+        for (int64_t i = 0; i < n_seeds; ++i) {
+            Kmer seed = nodegraph.build_kmer(input.reads[i].substr(0, K));
+            n_bases += assembler.assemble(seed).length();
+        }
+        sink = n_bases;
+        return n_seeds;
+    });
+
+    bench("read_aligner", input.name, n_threads, [&]() -> uint64_t {
+        ReadAligner master(&countgraph, 2, 1.0);
+        uint64_t total = 0;
+        #pragma omp parallel num_threads(n_threads) reduction(+:total)
+        {
+            ReadAligner aligner(master);
+            #pragma omp for schedule(dynamic)
+            for (int64_t i = 0; i < n_seeds; ++i) {
+                Alignment * aln = aligner.Align(input.reads[i]);
+                total += aln->graph_alignment.length();
+                delete aln;
+            }
+        }
+        sink = total;
+        return n_seeds;
+    });
+}
+
+std::vector<unsigned int> parse_threads(const std::string& arg)
+{
+    std::vector<unsigned int> threads;
+    std::istringstream in(arg);
+    std::string field;
+    while (std::getline(in, field, ',')) {
+        int t = atoi(field.c_str());
+        if (t <= 0) {
+            throw InvalidValue("thread counts must be positive: " + arg);
+        }
+#ifndef _OPENMP
+        if (t != 1) {
+            std::cerr << "built without OpenMP; running on 1 thread only\n";
+            t = 1;
+        }
+#endif
+        if (std::find(threads.begin(), threads.end(), t) == threads.end()) {
+            threads.push_back(t);
+        }
+    }
+    return threads;
+}
+
+void usage()
+{
+    std::cerr << "usage: oxli-bench [-t THREADS] [-n READS] [-r REPS] "
+              "[-f FILTER] [FILE ...]\n";
+    exit(1);
+}
+
+} // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    config.threads.push_back(1);
+    config.n_reads = 20000;
+    config.reps = 3;
+
+    int opt;
+    try {
+        while ((opt = getopt(argc, argv, "t:n:r:f:h")) != -1) {
+            switch (opt) {
+            case 't':
+                config.threads = parse_threads(optarg);
+                break;
+            case 'n':
+                config.n_reads = atoi(optarg);
+                break;
+            case 'r':
+                config.reps = atoi(optarg);
+                break;
+            case 'f':
+                config.filter = optarg;
+                break;
+            default:
+                usage();
+            }
+        }
+    } catch (oxli_exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        return 1;
+    }
+    if (config.threads.empty() || config.n_reads == 0 || config.reps == 0) {
+        usage();
+    }
+
+    const char * tmpdir = getenv("TMPDIR");
+    std::ostringstream prefix;
+    prefix << (tmpdir ? tmpdir : "/tmp") << "/oxli-bench-" << getpid();
+    std::string plain = prefix.str() + ".fa";
+    std::string gzipped = prefix.str() + ".fa.gz";
+
+    int status = 0;
+    try {
+        std::vector<Input> inputs;
+        inputs.push_back(synthetic_reads(config.n_reads));
+        write_fasta(inputs[0], plain);
+        write_fasta_gz(inputs[0], gzipped);
+        for (int i = optind; i < argc; ++i) {
+            std::cerr << "loading " << argv[i] << "\n";
+            inputs.push_back(load_reads(argv[i], config.n_reads));
+        }
+
+        printf("benchmark\tinput\tthreads\titems\tseconds\titems_per_sec\n");
+        for (unsigned int n_threads : config.threads) {
+            std::cerr << "running on " << n_threads << " thread(s)\n";
+            bench_storages(n_threads);
+
+            bench_parser(plain, "synthetic.fa", n_threads);
+            bench_parser(gzipped, "synthetic.fa.gz", n_threads);
+            for (int i = optind; i < argc; ++i) {
+                bench_parser(argv[i], inputs[i - optind + 1].name, n_threads);
+            }
+
+            for (auto& input : inputs) {
+                bench_hash_iterator<TwoBitKmerHashIterator>("TwoBit", input,
+                        n_threads);
+                bench_hash_iterator<RollingHashKmerIterator>("RollingHash",
+                        input, n_threads);
+                bench_hash_iterator<MurmurKmerHashIterator>("Murmur", input,
+                        n_threads);
+                bench_graphs(input, n_threads);
+            }
+        }
+    } catch (oxli_exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        status = 1;
+    }
+
+    remove(plain.c_str());
+    remove(gzipped.c_str());
+    return status;
+}
@@ -0,0 +1,612 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <memory>
+#include <queue>
+#include <utility>
+
+#include "oxli/oxli_exception.hh"
+#include "oxli/partition_extractor.hh"
+#include "oxli/read_parsers.hh"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace oxli;
+using namespace oxli:: read_parsers;
+
+namespace
+{
+
+// Spill files hold framed records: the input position, the partition ID
+// (bucket files only), then the length and text of the FASTA/FASTQ record.
+
+struct SpillRecord {
+    uint64_t seqno;
+    unsigned int group;
+    std::string text;
+};
+
+FILE * open_spill_file(const std::string& filename, const char * mode)
+{
+    FILE * fp = fopen(filename.c_str(), mode);
+    if (fp == NULL) {
+        std::string err = "Cannot open spill file " + filename + ": ";
+        err += strerror(errno);
+        throw oxli_file_exception(err);
+    }
+    return fp;
+}
+
+void write_spill(FILE * fp, const void * data, size_t size)
+{
+    if (fwrite(data, 1, size, fp) != size) {
+        throw oxli_file_exception("Error writing spill file");
+    }
+}
+
+// false at a clean end of file
+bool read_spill(FILE * fp, void * data, size_t size)
+{
+    size_t n = fread(data, 1, size, fp);
+    if (n == size) {
+        return true;
+    }
+    if (n == 0 && feof(fp)) {
+        return false;
+    }
+    throw oxli_file_exception("Truncated spill file");
+}
+
+bool read_spill_text(FILE * fp, std::string& text)
+{
+    uint32_t len;
+    if (!read_spill(fp, &len, sizeof(len))) {
+        return false;
+    }
+    text.resize(len);
+    if (len && !read_spill(fp, &text[0], len)) {
+        throw oxli_file_exception("Truncated spill file");
+    }
+    return true;
+}
+
+void write_spill_text(FILE * fp, const std::string& text)
+{
+    uint32_t len = text.size();
+    write_spill(fp, &len, sizeof(len));
+    write_spill(fp, text.data(), text.size());
+}
+
+// Sorted runs of an oversized bucket also keep each record's group.
+void write_run_record(FILE * fp, const SpillRecord& record)
+{
+    uint32_t group = record.group;
+    write_spill(fp, &record.seqno, sizeof(record.seqno));
+    write_spill(fp, &group, sizeof(group));
+    write_spill_text(fp, record.text);
+}
+
+bool read_run_record(FILE * fp, SpillRecord& record)
+{
+    uint32_t group;
+    if (!read_spill(fp, &record.seqno, sizeof(record.seqno))) {
+        return false;
+    }
+    if (!read_spill(fp, &group, sizeof(group)) ||
+            !read_spill_text(fp, record.text)) {
+        throw oxli_file_exception("Truncated spill file");
+    }
+    record.group = group;
+    return true;
+}
+
+struct RunSource {
+    FILE * fp;
+    SpillRecord record;
+};
+
+// Run every iteration of fn over [0, n) on n_threads threads, rethrowing
+// the first exception once all threads are done.
+template<typename Fn>
+void parallel_for_each(size_t n, unsigned int n_threads, Fn fn)
+{
+    std::exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+    for (size_t i = 0; i < n; ++i) {
+        try {
+            fn(i);
+        } catch (...) {
+            #pragma omp critical(partition_extractor_error)
+            {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // anonymous namespace
+
+
+PartitionExtractor::PartitionExtractor(
+    const std::string& prefix,
+    const std::string& suffix,
+    uint64_t min_size,
+    uint64_t max_size,
+    uint8_t compression,
+    unsigned int n_buckets,
+    uint64_t sort_budget)
+    : _prefix(prefix), _suffix(suffix), _min_size(min_size),
+      _max_size(max_size), _compression(compression), _n_buckets(n_buckets),
+      _sort_budget(sort_budget),
+      _n_groups(0), _spilled(false), _total_seqs(0), _part_seqs(0),
+      _toosmall_parts(0), _n_unassigned(0)
+{
+    if (_n_buckets == 0) {
+        throw InvalidValue("PartitionExtractor needs at least one bucket");
+    }
+}
+
+PartitionExtractor::~PartitionExtractor()
+{
+    _remove_spill_files();
+}
+
+std::string PartitionExtractor::_bucket_filename(unsigned int bucket,
+        bool sorted) const
+{
+    return _prefix + ".spill" + std::to_string(bucket)
+           + (sorted ? ".sorted" : "");
+}
+
+std::string PartitionExtractor::_group_filename(unsigned int group) const
+{
+    char n[16];
+    snprintf(n, sizeof(n), "%04u", group);
+    return _prefix + ".group" + n + "." + _suffix;
+}
+
+void PartitionExtractor::_remove_spill_files()
+{
+    if (!_spilled) {
+        return;
+    }
+    for (unsigned int b = 0; b < _n_buckets; ++b) {
+        remove(_bucket_filename(b, false).c_str());
+        remove(_bucket_filename(b, true).c_str());
+    }
+    _spilled = false;
+}
+
+void PartitionExtractor::consume(
+    const std::vector<std::string>& filenames,
+    bool output_unassigned,
+    bool spill_reads)
+{
+    std::unique_ptr<FastxWriter> unassigned;
+    if (output_unassigned) {
+        unassigned.reset(new FastxWriter(_prefix + ".unassigned." + _suffix,
+                                         _compression));
+    }
+
+    std::vector<FILE *> buckets;
+    if (spill_reads) {
+        _spilled = true;
+        for (unsigned int b = 0; b < _n_buckets; ++b) {
+            buckets.push_back(open_spill_file(_bucket_filename(b, false),
+                                              "wb"));
+        }
+    }
+
+    uint64_t seqno = _total_seqs;
+    std::string text;
+    try {
+        for (auto& filename : filenames) {
+            auto parser = get_parser<FastxReader>(filename);
+            while (!parser->is_complete()) {
+                Read read;
+                try {
+                    read = parser->get_next_read();
+                } catch (NoMoreReadsAvailable &exc) {
+                    break;
+                }
+
+                PartitionID pid = _parse_partition_id(read.name);
+                auto info = _partitions.insert(
+                                std::make_pair(pid, PartitionInfo{0, seqno}));
+                info.first->second.n_reads++;
+
+                text.clear();
+                if (pid == 0) {
+                    if (unassigned) {
+                        read.write_fastx(text);
+                        unassigned->write(text);
+                    }
+                } else if (spill_reads) {
+                    FILE * fp = buckets[pid % _n_buckets];
+                    read.write_fastx(text);
+                    write_spill(fp, &seqno, sizeof(seqno));
+                    write_spill(fp, &pid, sizeof(pid));
+                    write_spill_text(fp, text);
+                }
+                seqno++;
+            }
+        }
+    } catch (...) {
+        for (auto fp : buckets) {
+            fclose(fp);
+        }
+        throw;
+    }
+
+    bool ok = true;
+    for (auto fp : buckets) {
+        ok = fclose(fp) == 0 && ok;
+    }
+    if (!ok) {
+        throw oxli_file_exception("Error closing spill files");
+    }
+    if (unassigned) {
+        unassigned->close();
+    }
+    _total_seqs = seqno;
+}
+
+void PartitionExtractor::write_distribution(const std::string& filename)
+const
+{
+    std::map<uint64_t, uint64_t> dist;
+    for (auto& p : _partitions) {
+        dist[p.second.n_reads]++;
+    }
+
+    FILE * fp = fopen(filename.c_str(), "w");
+    if (fp == NULL) {
+        std::string err = "Cannot open " + filename + ": " + strerror(errno);
+        throw oxli_file_exception(err);
+    }
+    uint64_t total = 0, wtotal = 0;
+    for (auto& d : dist) {
+        total += d.second;
+        wtotal += d.first * d.second;
+        fprintf(fp, "%llu %llu %llu %llu\n", (unsigned long long) d.first,
+                (unsigned long long) d.second, (unsigned long long) total,
+                (unsigned long long) wtotal);
+    }
+    if (fclose(fp) != 0) {
+        throw oxli_file_exception("Error writing " + filename);
+    }
+}
+
+unsigned int PartitionExtractor::develop_groups()
+{
+    // partitions worth keeping, smallest first; ties keep input order.
+    std::vector<std::pair<PartitionID, PartitionInfo> > divvy;
+    _n_unassigned = 0;
+    for (auto& p : _partitions) {
+        if (p.first == 0) {
+            _n_unassigned = p.second.n_reads;
+        } else if (p.second.n_reads > _min_size) {
+            divvy.push_back(p);
+        }
+    }
+    std::sort(divvy.begin(), divvy.end(),
+    [](const std::pair<PartitionID, PartitionInfo>& a,
+    const std::pair<PartitionID, PartitionInfo>& b) {
+        if (a.second.n_reads != b.second.n_reads) {
+            return a.second.n_reads < b.second.n_reads;
+        }
+        return a.second.first_read < b.second.first_read;
+    });
+
+    // divvy up into different groups, based on having max_size sequences
+    // in each group.
+    _group_of.clear();
+    _n_groups = 0;
+    _part_seqs = 0;
+    uint64_t total = 0;
+    for (auto& p : divvy) {
+        _group_of[p.first] = _n_groups;
+        total += p.second.n_reads;
+        _part_seqs += p.second.n_reads;
+
+        if (total > _max_size) {
+            _n_groups++;
+            total = 0;
+        }
+    }
+    if (total > 0) {
+        _n_groups++;
+    }
+    _toosmall_parts = _total_seqs - _part_seqs - _n_unassigned;
+
+    return _n_groups;
+}
+
+void PartitionExtractor::_sort_bucket(unsigned int bucket,
+                                      std::vector<GroupRun>& runs)
+{
+    std::string filename = _bucket_filename(bucket, false);
+    std::vector<SpillRecord> records;
+    uint64_t records_size = 0;
+    std::vector<std::string> run_names;
+
+    // records are in input order already, so a stable sort by group
+    // leaves each group's reads in input order too.
+    auto sort_records = [&records]() {
+        std::stable_sort(records.begin(), records.end(),
+        [](const SpillRecord& a, const SpillRecord& b) {
+            return a.group < b.group;
+        });
+    };
+
+    // Past the sort budget, the records read so far are sorted and spilled
+    // as a run, to be merged with the bucket's other runs below.
+    auto spill_run = [&]() {
+        sort_records();
+        run_names.push_back(filename + ".run" +
+                            std::to_string(run_names.size()));
+        FILE * fp = open_spill_file(run_names.back(), "wb");
+        try {
+            for (auto& record : records) {
+                write_run_record(fp, record);
+            }
+        } catch (...) {
+            fclose(fp);
+            throw;
+        }
+        if (fclose(fp) != 0) {
+            throw oxli_file_exception("Error closing spill file");
+        }
+        records.clear();
+        records_size = 0;
+    };
+
+    std::vector<RunSource> sources;
+    FILE * fp = NULL;
+    try {
+        fp = open_spill_file(filename, "rb");
+        SpillRecord record;
+        PartitionID pid;
+        while (read_spill(fp, &record.seqno, sizeof(record.seqno))) {
+            if (!read_spill(fp, &pid, sizeof(pid)) ||
+                    !read_spill_text(fp, record.text)) {
+                throw oxli_file_exception("Truncated spill file");
+            }
+            auto group = _group_of.find(pid);
+            if (group == _group_of.end()) {  // partition too small
+                continue;
+            }
+            record.group = group->second;
+            records_size += sizeof(SpillRecord) + record.text.size();
+            records.push_back(std::move(record));
+            if (records_size >= _sort_budget) {
+                spill_run();
+            }
+        }
+        fclose(fp);
+        fp = NULL;
+        remove(filename.c_str());
+
+        fp = open_spill_file(_bucket_filename(bucket, true), "wb");
+        auto append = [&runs, fp](const SpillRecord& record) {
+            if (runs.empty() || runs.back().group != record.group) {
+                if (!runs.empty()) {
+                    runs.back().end = ftell(fp);
+                }
+                runs.push_back(GroupRun{record.group, ftell(fp), 0});
+            }
+            write_spill(fp, &record.seqno, sizeof(record.seqno));
+            write_spill_text(fp, record.text);
+        };
+
+        if (run_names.empty()) {
+            sort_records();
+            for (auto& record : records) {
+                append(record);
+            }
+        } else {
+            if (!records.empty()) {
+                spill_run();
+            }
+
+            // k-way merge of the runs by (group, input position)
+            for (auto& run_name : run_names) {
+                sources.push_back(RunSource{open_spill_file(run_name, "rb"),
+                                            SpillRecord()});
+            }
+            auto later = [&sources](size_t a, size_t b) {
+                const SpillRecord& x = sources[a].record;
+                const SpillRecord& y = sources[b].record;
+                if (x.group != y.group) {
+                    return x.group > y.group;
+                }
+                return x.seqno > y.seqno;
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(later)>
+            heads(later);
+            for (size_t i = 0; i < sources.size(); ++i) {
+                if (read_run_record(sources[i].fp, sources[i].record)) {
+                    heads.push(i);
+                }
+            }
+            while (!heads.empty()) {
+                size_t i = heads.top();
+                heads.pop();
+                append(sources[i].record);
+                if (read_run_record(sources[i].fp, sources[i].record)) {
+                    heads.push(i);
+                }
+            }
+        }
+        if (!runs.empty()) {
+            runs.back().end = ftell(fp);
+        }
+    } catch (...) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        for (auto& source : sources) {
+            fclose(source.fp);
+        }
+        for (auto& run_name : run_names) {
+            remove(run_name.c_str());
+        }
+        throw;
+    }
+
+    for (auto& source : sources) {
+        fclose(source.fp);
+    }
+    for (auto& run_name : run_names) {
+        remove(run_name.c_str());
+    }
+    if (fclose(fp) != 0) {
+        throw oxli_file_exception("Error closing spill file");
+    }
+}
+
+void PartitionExtractor::_merge_group(
+    unsigned int group,
+    const std::vector<std::vector<GroupRun> >& runs)
+{
+    struct Source {
+        FILE * fp;
+        long end;
+        uint64_t seqno;
+        std::string text;
+
+        bool next()
+        {
+            if (ftell(fp) >= end) {
+                return false;
+            }
+            if (!read_spill(fp, &seqno, sizeof(seqno)) ||
+                    !read_spill_text(fp, text)) {
+                throw oxli_file_exception("Truncated spill file");
+            }
+            return true;
+        }
+    };
+
+    std::vector<Source> sources;
+    auto later = [&sources](size_t a, size_t b) {
+        return sources[a].seqno > sources[b].seqno;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)>
+    heads(later);
+
+    try {
+        for (unsigned int b = 0; b < runs.size(); ++b) {
+            auto run = std::lower_bound(runs[b].begin(), runs[b].end(), group,
+            [](const GroupRun& r, unsigned int g) {
+                return r.group < g;
+            });
+            if (run == runs[b].end() || run->group != group) {
+                continue;
+            }
+            FILE * fp = open_spill_file(_bucket_filename(b, true), "rb");
+            sources.push_back(Source{fp, run->end, 0, ""});
+            if (fseek(fp, run->begin, SEEK_SET) != 0) {
+                throw oxli_file_exception("Cannot seek in spill file");
+            }
+        }
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (sources[i].next()) {
+                heads.push(i);
+            }
+        }
+
+        FastxWriter output(_group_filename(group), _compression);
+        while (!heads.empty()) {
+            size_t i = heads.top();
+            heads.pop();
+            output.write(sources[i].text);
+            if (sources[i].next()) {
+                heads.push(i);
+            }
+        }
+        output.close();
+    } catch (...) {
+        for (auto& source : sources) {
+            fclose(source.fp);
+        }
+        throw;
+    }
+    for (auto& source : sources) {
+        fclose(source.fp);
+    }
+}
+
+void PartitionExtractor::output_groups(unsigned int n_threads)
+{
+    if (!_spilled) {
+        throw oxli_exception("PartitionExtractor: no reads were spilled");
+    }
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#endif
+    if (n_threads == 0) {
+        n_threads = 1;
+    }
+
+    std::vector<std::vector<GroupRun> > runs(_n_buckets);
+    parallel_for_each(_n_buckets, n_threads, [&](size_t b) {
+        _sort_bucket(b, runs[b]);
+    });
+    parallel_for_each(_n_groups, n_threads, [&](size_t g) {
+        _merge_group(g, runs);
+    });
+
+    _remove_spill_files();
+}
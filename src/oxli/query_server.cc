@@ -0,0 +1,416 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream> // IWYU pragma: keep
+#include <thread>
+#include <vector>
+
+#include "oxli/hashtable.hh"
+#include "oxli/oxli_exception.hh"
+#include "oxli/query_server.hh"
+
+using namespace oxli;
+
+namespace
+{
+
+struct QueryHeader {
+    uint8_t code;
+    uint8_t _pad[3];
+    uint32_t param;
+    uint32_t n;
+};
+
+std::string socket_error(const std::string& what, const std::string& path)
+{
+    return what + " " + path + ": " + strerror(errno);
+}
+
+bool make_address(const std::string& path, struct sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// A socket file nobody is listening on is left behind by a server that
+// died; anything else at path is not ours to remove.
+void remove_stale_socket(const std::string& path,
+                         const struct sockaddr_un& addr)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode)) {
+        return;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return;
+    }
+    if (connect(fd, (const struct sockaddr *) &addr, sizeof(addr)) != 0
+            && errno == ECONNREFUSED) {
+        unlink(path.c_str());
+    }
+    close(fd);
+}
+
+// Buffered reads from a connection; false once the peer has gone.
+class SocketReader
+{
+    int _fd;
+    std::vector<char> _buf;
+    size_t _pos, _end;
+public:
+    explicit SocketReader(int fd) : _fd(fd), _buf(64 * 1024), _pos(0),
+        _end(0) { }
+
+    bool read(void * dest, size_t n)
+    {
+        char * out = (char *) dest;
+        while (n) {
+            if (_pos == _end) {
+                ssize_t got = recv(_fd, _buf.data(), _buf.size(), 0);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    return false;
+                }
+                _pos = 0;
+                _end = got;
+            }
+            size_t take = std::min(n, _end - _pos);
+            memcpy(out, _buf.data() + _pos, take);
+            _pos += take;
+            out += take;
+            n -= take;
+        }
+        return true;
+    }
+};
+
+bool write_all(int fd, const char * data, size_t n)
+{
+    while (n) {
+        ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+template<typename T>
+void append(std::string& out, T value)
+{
+    out.append((const char *) &value, sizeof(value));
+}
+
+} // anonymous namespace
+
+QueryServer::QueryServer(const Hashtable& table,
+                         const std::string& socket_path,
+                         unsigned int n_threads)
+    : _table(table), _socket_path(socket_path), _n_threads(n_threads),
+      _listen_fd(-1), _stopping(false)
+{
+    if (_n_threads == 0) {
+        _n_threads = std::thread::hardware_concurrency();
+    }
+    if (_n_threads == 0) {
+        _n_threads = 1;
+    }
+
+    struct sockaddr_un addr;
+    if (!make_address(socket_path, addr)) {
+        throw oxli_file_exception("Socket path is too long: " + socket_path);
+    }
+    remove_stale_socket(socket_path, addr);
+
+    if (pipe(_wake_fds) != 0) {
+        throw oxli_file_exception(socket_error("Cannot listen on",
+                                               socket_path));
+    }
+    for (int fd : _wake_fds) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+
+    _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_listen_fd < 0
+            || fcntl(_listen_fd, F_SETFD, FD_CLOEXEC) != 0
+            || bind(_listen_fd, (const struct sockaddr *) &addr,
+                    sizeof(addr)) != 0
+            || listen(_listen_fd, 64) != 0) {
+        std::string err = socket_error("Cannot listen on", socket_path);
+        if (_listen_fd >= 0) {
+            close(_listen_fd);
+        }
+        close(_wake_fds[0]);
+        close(_wake_fds[1]);
+        throw oxli_file_exception(err);
+    }
+}
+
+QueryServer::~QueryServer()
+{
+    if (_listen_fd >= 0) {
+        close(_listen_fd);
+        unlink(_socket_path.c_str());
+    }
+    close(_wake_fds[0]);
+    close(_wake_fds[1]);
+}
+
+void QueryServer::stop()
+{
+    // a full pipe already holds a wakeup, so a failed write is harmless
+    char c = 0;
+    ssize_t ignored = write(_wake_fds[1], &c, 1);
+    (void) ignored;
+}
+
+void QueryServer::serve()
+{
+    if (_listen_fd < 0) {
+        throw oxli_exception("QueryServer has already been stopped");
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < _n_threads; i++) {
+        workers.push_back(std::thread(&QueryServer::_worker, this));
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = _listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = _wake_fds[0];
+    fds[1].events = POLLIN;
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(_listen_fd, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            std::lock_guard<std::mutex> lock(_lock);
+            _waiting.push_back(fd);
+            _have_client.notify_one();
+        }
+    }
+
+    {
+        // wake workers blocked on their clients, and drop waiting ones
+        std::lock_guard<std::mutex> lock(_lock);
+        _stopping = true;
+        for (int fd : _active) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (int fd : _waiting) {
+            close(fd);
+        }
+        _waiting.clear();
+        _have_client.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    close(_listen_fd);
+    _listen_fd = -1;
+    unlink(_socket_path.c_str());
+}
+
+void QueryServer::_worker()
+{
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            while (!_stopping && _waiting.empty()) {
+                _have_client.wait(lock);
+            }
+            if (_stopping) {
+                return;
+            }
+            fd = _waiting.front();
+            _waiting.pop_front();
+            _active.insert(fd);
+        }
+
+        bool shutdown_requested = _serve_client(fd);
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _active.erase(fd);
+        }
+        close(fd);
+
+        if (shutdown_requested) {
+            stop();
+        }
+    }
+}
+
+// Answer requests on fd until the client goes away; true if it asked for
+// the server to shut down.
+bool QueryServer::_serve_client(int fd)
+{
+    SocketReader reader(fd);
+    std::vector<std::string> items;
+    std::vector<BoundedCounterType> counts;
+    std::string body;
+    const unsigned int ksize = _table.ksize();
+
+    QueryHeader request;
+    while (reader.read(&request, sizeof(request))) {
+        if (request.n > QUERY_MAX_ITEMS) {
+            return false;
+        }
+
+        uint64_t total = 0;
+        items.resize(request.n);
+        for (auto& item : items) {
+            uint32_t length;
+            if (!reader.read(&length, sizeof(length))) {
+                return false;
+            }
+            total += length;
+            if (total > QUERY_MAX_BYTES) {
+                return false;
+            }
+            item.resize(length);
+            if (!reader.read(&item[0], length)) {
+                return false;
+            }
+        }
+
+        QueryHeader response;
+        memset(&response, 0, sizeof(response));
+        response.code = QUERY_OK;
+        response.n = request.n;
+        body.clear();
+
+        try {
+            switch (request.code) {
+            case QUERY_COUNT:
+                for (auto& kmer : items) {
+                    if (kmer.size() != ksize) {
+                        std::ostringstream err;
+                        err << "Expected k-mer length " << ksize
+                            << " but got " << kmer.size() << ".";
+                        throw oxli_exception(err.str());
+                    }
+                    append<uint32_t>(body, _table.get_count(kmer.c_str()));
+                }
+                break;
+            case QUERY_MEDIAN:
+            case QUERY_TRIM:
+                for (auto& seq : items) {
+                    if (seq.size() < ksize) {
+                        std::ostringstream err;
+                        err << "sequence length (" << seq.size()
+                            << ") must >= the hashtable k-mer size ("
+                            << ksize << ")";
+                        throw oxli_exception(err.str());
+                    }
+                    if (request.code == QUERY_TRIM) {
+                        append<uint32_t>(body, _table.trim_on_abundance(
+                                             seq, request.param));
+                        continue;
+                    }
+                    BoundedCounterType median;
+                    float average, stddev;
+                    _table.get_median_count(seq, median, average, stddev,
+                                            counts);
+                    append<uint32_t>(body, median);
+                    append<float>(body, average);
+                    append<float>(body, stddev);
+                }
+                break;
+            case QUERY_INFO:
+                response.n = 1;
+                append<uint32_t>(body, ksize);
+                break;
+            case QUERY_SHUTDOWN:
+                response.n = 0;
+                break;
+            default:
+                throw oxli_exception("unknown query type");
+            }
+        } catch (std::exception& e) {
+            response.code = QUERY_ERROR;
+            body = e.what();
+            response.n = body.size();
+        }
+
+        if (!write_all(fd, (const char *) &response, sizeof(response))
+                || !write_all(fd, body.data(), body.size())) {
+            return false;
+        }
+        if (request.code == QUERY_SHUTDOWN) {
+            return true;
+        }
+    }
+    return false;
+}
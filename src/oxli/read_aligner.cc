@@ -42,10 +42,15 @@ Contact: khmer-project@idyll.org
 #include <memory>
 #include <set>
 #include <utility>
+#include <vector>
 
+#include "oxli/batch_pipeline.hh"
 #include "oxli/hashtable.hh"
 #include "oxli/oxli_exception.hh"
 #include "oxli/read_aligner.hh"
+#include "oxli/read_parsers.hh"
+
+using namespace oxli::read_parsers;
 
 namespace oxli
 {
@@ -671,4 +676,78 @@ ScoringMatrix ReadAligner::getScoringMatrix()
     return m_sm;
 }
 
+bool ReadAligner::CorrectRead(Read& read)
+{
+    read.set_clean_seq();
+    if (read.cleaned_seq.length() < m_ch->ksize()) {
+        return false;
+    }
+
+    Alignment* aln = Align(read.cleaned_seq);
+    bool corrected = false;
+
+    if (!aln->truncated) {
+        std::string graph_seq;
+        graph_seq.reserve(aln->graph_alignment.length());
+        for (auto base : aln->graph_alignment) {
+            if (base != '-') {
+                graph_seq.push_back(toupper(base));
+            }
+        }
+
+        corrected = (graph_seq != read.sequence);
+        read.sequence = graph_seq;
+        // keep qualities in step with the corrected sequence
+        if (read.quality.length() != 0) {
+            read.quality.resize(read.sequence.length(), 'I');
+        }
+        read.set_clean_seq();
+    }
+
+    delete aln;
+    return corrected;
+}
+
+template<typename SeqIO>
+void ReadAligner::align_reads_parallel(
+    ReadParserPtr<SeqIO>& parser,
+    unsigned int n_threads,
+    std::ostream& output,
+    unsigned int &total_reads,
+    unsigned int &n_corrected
+)
+{
+    ReadBatchPipeline<SeqIO> pipeline(parser, n_threads ? n_threads : 1);
+    std::vector<ReadAligner> aligners(pipeline.n_threads(), *this);
+
+    // The pipeline hands batches to the writer in input order, so output
+    // order (and thus pairing) matches the input.
+    pipeline.run_in_order(
+    [&aligners](ReadBatch& batch, unsigned int t) -> uint64_t {
+        uint64_t batch_corrected = 0;
+        for (auto& read : batch.reads) {
+            if (aligners[t].CorrectRead(read)) {
+                ++batch_corrected;
+            }
+        }
+        return batch_corrected;
+    },
+    [&output](ReadBatch& batch) {
+        for (auto& read : batch.reads) {
+            read.write_fastx(output);
+        }
+    });
+
+    total_reads += pipeline.n_reads();
+    n_corrected += pipeline.n_consumed();
+}
+
+template void ReadAligner::align_reads_parallel<FastxReader>(
+    ReadParserPtr<FastxReader>& parser,
+    unsigned int n_threads,
+    std::ostream& output,
+    unsigned int &total_reads,
+    unsigned int &n_corrected
+);
+
 }
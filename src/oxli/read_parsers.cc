@@ -35,8 +35,13 @@ LICENSE (END)
 
 Contact: khmer-project@idyll.org
   */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <fstream>
 #include <utility>  
+#include "bzlib.h"
+#include "zlib.h"
 #include "seqan/seq_io.h" // IWYU pragma: keep
 #include "seqan/sequence.h" // IWYU pragma: keep
 #include "seqan/stream.h" // IWYU pragma: keep
@@ -68,70 +73,115 @@ unsigned char _to_valid_dna(const unsigned char c)
     }
 }
 
-template<typename SeqIO>
-void ReadParser<SeqIO>::_init()
-{
-    int regex_rc =
-        regcomp(
-            &_re_read_2_nosub,
-            // ".+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+)$",
-            "^.+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}",
-            REG_EXTENDED | REG_NOSUB
-        );
-    if (regex_rc) {
-        throw oxli_exception("Could not compile R2 nosub regex");
+namespace
+{
+
+// Split a read name at its first space or tab into an ID and a comment.
+void split_name(const char * name, size_t length, size_t& id_length,
+                const char *& comment, size_t& comment_length)
+{
+    id_length = 0;
+    while (id_length < length && name[id_length] != ' '
+            && name[id_length] != '\t') {
+        ++id_length;
     }
-    regex_rc =
-        regcomp(
-            &_re_read_1,
-            "^.+(/1| 1:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}", REG_EXTENDED
-        );
-    if (regex_rc) {
-        throw oxli_exception("Could not compile R1 regex");
+    comment = name + std::min(id_length + 1, length);
+    comment_length = length - (comment - name);
+}
+
+bool ends_with_mate(const char * s, size_t length, char mate)
+{
+    return length >= 2 && s[length - 2] == '/' && s[length - 1] == mate;
+}
+
+// Whether s and t, which end in "/1" and "/2", match up to their first
+// '/'.
+bool same_before_slash(const char * s, size_t s_length,
+                       const char * t, size_t t_length)
+{
+    const char * slash = (const char *) memchr(s, '/', s_length);
+    size_t prefix = slash - s;
+    return prefix > 0 && prefix < t_length && t[prefix] == '/'
+           && memcmp(s, t, prefix) == 0;
+}
+
+bool check_is_mate(const char * name, size_t length, char mate)
+{
+    size_t id_length, comment_length;
+    const char * comment;
+    split_name(name, length, id_length, comment, comment_length);
+    return ends_with_mate(name, id_length, mate)
+           || (comment_length >= 2 && comment[0] == mate
+               && comment[1] == ':')
+           || ends_with_mate(comment, comment_length, mate);
+}
+
+} // anonymous namespace
+
+bool check_is_pair(const char * name1, size_t length1,
+                   const char * name2, size_t length2)
+{
+    size_t id1, id2, comment1_length, comment2_length;
+    const char * comment1, * comment2;
+    split_name(name1, length1, id1, comment1, comment1_length);
+    split_name(name2, length2, id2, comment2, comment2_length);
+
+    // 'frag/1' and 'frag/2'
+    if (ends_with_mate(name1, id1, '1') && ends_with_mate(name2, id2, '2')) {
+        return same_before_slash(name1, id1, name2, id2);
+    }
+    if (id1 != id2 || memcmp(name1, name2, id1) != 0) {
+        return false;
     }
-    regex_rc =
-        regcomp(
-            &_re_read_2,
-            "^.+(/2| 2:[YN]:[[:digit:]]+:[[:alpha:]]+).{0}", REG_EXTENDED
-        );
-    if (regex_rc) {
-        throw oxli_exception("Could not compile R2 regex");
+    // 'frag 1:N:...' and 'frag 2:N:...'
+    if (comment1_length >= 2 && comment2_length >= 2
+            && memcmp(comment1, "1:", 2) == 0
+            && memcmp(comment2, "2:", 2) == 0) {
+        return true;
     }
+    // 'acc frag/1' and 'acc frag/2'
+    if (ends_with_mate(comment1, comment1_length, '1')
+            && ends_with_mate(comment2, comment2_length, '2')) {
+        return same_before_slash(comment1, comment1_length,
+                                 comment2, comment2_length);
+    }
+    return false;
+}
+
+bool check_is_left(const char * name, size_t length)
+{
+    return check_is_mate(name, length, '1');
+}
+
+bool check_is_right(const char * name, size_t length)
+{
+    return check_is_mate(name, length, '2');
 }
 
 template<typename SeqIO>
 ReadPair ReadParser<SeqIO>::_get_next_read_pair_in_ignore_mode()
 {
     ReadPair pair;
-    regmatch_t match_1, match_2;
+
+    // Note: We let any exception, which flies out of the following,
+    //	     pass through unhandled.
+    pair.first = get_next_read();
 
     // Hunt for a read pair until one is found or end of reads is reached.
     while (true) {
 
         // Toss out all reads which are not marked as first of a pair.
-        // Note: We let any exception, which flies out of the following,
-        //	 pass through unhandled.
-        while (true) {
+        while (!check_is_left(pair.first.name)) {
             pair.first = get_next_read();
-            if (!regexec(
-                        &_re_read_1, pair.first.name.c_str( ), 1, &match_1, 0
-                    )) {
-                break;
-            }
         }
 
-        // If first read of a pair was found, then insist upon second read.
-        // If not found, then restart search for pair.
-        // If found, then validate match.
-        // If invalid pair, then restart search for pair.
+        // If first read of a pair was found, then insist upon its mate.
+        // If not found, then restart the search from the read found instead.
         pair.second = get_next_read();
-        if (!regexec(
-                    &_re_read_2, pair.second.name.c_str( ), 1, &match_2, 0
-                )) {
-            if (_is_valid_read_pair(pair, match_1, match_2)) {
-                break;
-            }
+        if (check_is_pair(pair.first.name, pair.second.name)) {
+            break;
         }
+        pair.first = std::move(pair.second);
 
     } // while pair not found
 
@@ -142,51 +192,24 @@ template<typename SeqIO>
 ReadPair ReadParser<SeqIO>::_get_next_read_pair_in_error_mode()
 {
     ReadPair pair;
-    regmatch_t match_1, match_2;
 
     // Note: We let any exception, which flies out of the following,
     //	     pass through unhandled.
     pair.first = get_next_read();
     pair.second = get_next_read();
 
-    // Is the first read really the first member of a pair?
-    if (REG_NOMATCH == regexec(
-                &_re_read_1, pair.first.name.c_str( ), 1, &match_1, 0
-            )) {
-        throw InvalidReadPair( );
-    }
-    // Is the second read really the second member of a pair?
-    if (REG_NOMATCH == regexec(
-                &_re_read_2, pair.second.name.c_str( ), 1, &match_2, 0
-            )) {
-        throw InvalidReadPair( );
-    }
-
-    // Is the pair valid?
-    if (!_is_valid_read_pair(pair, match_1, match_2)) {
+    if (!check_is_pair(pair.first.name, pair.second.name)) {
         throw InvalidReadPair( );
     }
 
     return pair;
 } // _get_next_read_pair_in_error_mode
 
-template<typename SeqIO>
-bool ReadParser<SeqIO>::_is_valid_read_pair(
-    ReadPair &the_read_pair, regmatch_t &match_1, regmatch_t &match_2
-)
-{
-    return	(match_1.rm_so == match_2.rm_so)
-            &&	(match_1.rm_eo == match_2.rm_eo)
-            &&	(	the_read_pair.first.name.substr( 0, match_1.rm_so )
-                    ==	the_read_pair.second.name.substr( 0, match_1.rm_so ));
-}
-
 
 template<typename SeqIO>
 ReadParser<SeqIO>::ReadParser(std::unique_ptr<SeqIO> pf)
 {
     _parser = std::move(pf);
-    _init();
 }
 
 
@@ -194,13 +217,14 @@ template<typename SeqIO>
 ReadParser<SeqIO>::ReadParser(ReadParser<SeqIO>& other)
 {
     _parser = std::move(other._parser);
-    _init();
+    _pending_error = std::move(other._pending_error);
 }
 
 template<typename SeqIO>
 ReadParser<SeqIO>&
 ReadParser<SeqIO>::operator=(ReadParser<SeqIO>& other) {
     _parser = std::move(other._parser);
+    _pending_error = std::move(other._pending_error);
     return *this;
 }
 
@@ -211,9 +235,6 @@ ReadParser<SeqIO>::ReadParser(ReadParser<SeqIO>&&) noexcept {}
 template<typename SeqIO>
 ReadParser<SeqIO>::~ReadParser()
 {
-    regfree(&_re_read_2_nosub);
-    regfree(&_re_read_1);
-    regfree(&_re_read_2);
 }
 
 template<typename SeqIO>
@@ -236,6 +257,34 @@ ReadPair ReadParser<SeqIO>::get_next_read_pair(uint8_t mode)
     }
 }
 
+template<typename SeqIO>
+size_t ReadParser<SeqIO>::get_next_read_pairs(std::vector<ReadPair>& pairs,
+        size_t n, uint8_t mode)
+{
+    if (_pending_error) {
+        std::exception_ptr error = _pending_error;
+        _pending_error = nullptr;
+        std::rethrow_exception(error);
+    }
+
+    size_t n_found = 0;
+    try {
+        while (n_found < n) {
+            pairs.push_back(get_next_read_pair(mode));
+            ++n_found;
+        }
+    } catch (NoMoreReadsAvailable&) {
+        // the end of the input; a last read without its mate is dropped
+    } catch (InvalidReadPair&) {
+        // hand out the good pairs first, as reading them one at a time would
+        if (n_found == 0) {
+            throw;
+        }
+        _pending_error = std::current_exception();
+    }
+    return n_found;
+}
+
 template<typename SeqIO>
 size_t ReadParser<SeqIO>::get_num_reads()
 {
@@ -371,6 +420,120 @@ Read FastxReader::get_next_read()
     return read;
 }
 
+FastxWriter::FastxWriter(const std::string& filename, uint8_t compression,
+                         bool append)
+    : _filename(filename), _compression(compression), _file(NULL),
+      _stream(NULL)
+{
+    if (compression > COMPRESSION_BZIP2) {
+        throw InvalidValue("unknown FastxWriter compression");
+    }
+    if (filename == "-") {
+        _file = stdout;
+    } else {
+        _file = fopen(filename.c_str(), append ? "ab" : "wb");
+    }
+    if (_file == NULL) {
+        std::string err = "Cannot open " + filename + " for writing: ";
+        err += strerror(errno);
+        throw oxli_file_exception(err);
+    }
+
+    if (_compression == COMPRESSION_GZIP) {
+        int fd = dup(fileno(_file));
+        if (fd != -1) {
+            _stream = gzdopen(fd, "wb");
+            if (_stream == NULL) {
+                ::close(fd);
+            }
+        }
+    } else if (_compression == COMPRESSION_BZIP2) {
+        int bzerror;
+        _stream = BZ2_bzWriteOpen(&bzerror, _file, 9, 0, 0);
+        if (bzerror != BZ_OK) {
+            _stream = NULL;
+        }
+    }
+    if (_compression != COMPRESSION_NONE && _stream == NULL) {
+        if (_file != stdout) {
+            fclose(_file);
+        }
+        _file = NULL;
+        throw oxli_file_exception("Cannot start compressed output to "
+                                  + filename);
+    }
+}
+
+FastxWriter::~FastxWriter()
+{
+    try {
+        close();
+    } catch (oxli_file_exception&) {
+        // nothing sensible left to do with a write error here
+    }
+}
+
+void FastxWriter::write(const std::string& data)
+{
+    if (_file == NULL) {
+        throw oxli_file_exception("write to closed FastxWriter");
+    }
+    if (data.empty()) {
+        return;
+    }
+
+    bool ok;
+    if (_compression == COMPRESSION_GZIP) {
+        ok = gzwrite((gzFile) _stream, data.data(), data.size())
+             == (int) data.size();
+    } else if (_compression == COMPRESSION_BZIP2) {
+        int bzerror;
+        BZ2_bzWrite(&bzerror, (BZFILE *) _stream,
+                    const_cast<char *>(data.data()), data.size());
+        ok = bzerror == BZ_OK;
+    } else {
+        ok = fwrite(data.data(), 1, data.size(), _file) == data.size();
+    }
+    if (!ok) {
+        throw oxli_file_exception("Error writing to " + _filename);
+    }
+}
+
+void FastxWriter::write(const Read& read)
+{
+    std::string record;
+    read.write_fastx(record);
+    write(record);
+}
+
+void FastxWriter::close()
+{
+    if (_file == NULL) {
+        return;
+    }
+
+    bool ok = true;
+    if (_compression == COMPRESSION_GZIP) {
+        ok = gzclose((gzFile) _stream) == Z_OK;
+    } else if (_compression == COMPRESSION_BZIP2) {
+        int bzerror;
+        BZ2_bzWriteClose(&bzerror, (BZFILE *) _stream, 0, NULL, NULL);
+        ok = bzerror == BZ_OK;
+    }
+    _stream = NULL;
+
+    if (_file == stdout) {
+        ok = fflush(_file) == 0 && ok;
+    } else {
+        ok = fclose(_file) == 0 && ok;
+    }
+    _file = NULL;
+
+    if (!ok) {
+        throw oxli_file_exception("Error closing " + _filename);
+    }
+}
+
 template<typename SeqIO>
 ReadParserPtr<SeqIO> get_parser(const std::string& filename)
 {
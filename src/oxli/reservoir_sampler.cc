@@ -0,0 +1,442 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <math.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <exception>
+#include <random>
+#include <unordered_map>
+#include "oxli/oxli_exception.hh"
+#include "oxli/fastx_scanner.hh"
+#include "oxli/reservoir_sampler.hh"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// arena garbage always tolerated before compacting
+#define SAMPLE_MIN_GARBAGE (1024*1024)
+// Slot::key is range index << SAMPLE_KEY_BITS | unit within the range
+#define SAMPLE_KEY_BITS 40
+
+using namespace oxli;
+using namespace oxli::read_parsers;
+
+namespace
+{
+
+// Units skipped by an Algorithm L reservoir with weight w, before the next
+// one it takes.
+uint64_t skip_length(double w, double u)
+{
+    double skip = floor(log(u) / log1p(-w));
+    if (!(skip < 1e18)) {  // also catches NaN, from w == 1
+        return (uint64_t) 1e18;
+    }
+    return (uint64_t) skip;
+}
+
+// A uniform number in (0, 1].
+double open_uniform(std::mt19937_64& rng)
+{
+    return 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+std::mt19937_64 make_rng(uint64_t seed, uint64_t stream)
+{
+    std::seed_seq seq { (uint32_t) seed, (uint32_t) (seed >> 32),
+                        (uint32_t) stream, (uint32_t) (stream >> 32) };
+    return std::mt19937_64(seq);
+}
+
+// Drop arena text no slot points at any more; the first n slots of each
+// sample's reservoir are in use.
+void compact(SampleRange& range, uint64_t sample_size, unsigned int n_samples,
+             uint64_t n)
+{
+    std::vector<SampleRange::Slot *> live;
+    live.reserve(n * n_samples);
+    for (unsigned int s = 0; s < n_samples; ++s) {
+        for (uint64_t i = 0; i < n; ++i) {
+            live.push_back(&range.slots[s * sample_size + i]);
+        }
+    }
+    std::sort(live.begin(), live.end(),
+    [](const SampleRange::Slot * a, const SampleRange::Slot * b) {
+        return a->offset < b->offset;
+    });
+
+    std::string arena;
+    uint64_t last = UINT64_MAX, moved = 0;
+    for (SampleRange::Slot * slot : live) {
+        if (slot->offset != last) {
+            last = slot->offset;
+            moved = arena.size();
+            arena.append(range.arena, slot->offset, slot->length);
+        }
+        slot->offset = moved;
+    }
+    range.arena.swap(arena);
+    range.live_bytes = range.arena.size();
+}
+
+} // anonymous namespace
+
+
+ReservoirSampler::ReservoirSampler(uint64_t sample_size,
+                                   unsigned int n_samples, bool force_single,
+                                   uint64_t max_units, uint64_t seed,
+                                   uint64_t range_size)
+    : _sample_size(sample_size), _n_samples(n_samples),
+      _force_single(force_single), _max_units(max_units), _seed(seed),
+      _range_size(range_size), _merged("", 0, 0)
+{
+    if (sample_size == 0) {
+        throw InvalidValue("sample size must be > 0");
+    }
+    if (n_samples == 0) {
+        throw InvalidValue("number of samples must be > 0");
+    }
+    if (range_size == 0) {
+        throw InvalidValue("range size must be > 0");
+    }
+}
+
+void ReservoirSampler::_split(const std::string& filename)
+{
+    struct stat st;
+    if (!FastxScanner::is_seekable(filename)
+            || stat(filename.c_str(), &st) != 0
+            || (uint64_t) st.st_size <= _range_size) {
+        _ranges.emplace_back(new SampleRange(filename, 0, 0));
+        return;
+    }
+    const uint64_t size = st.st_size;
+
+    // Start a range at the first unit after each multiple of range_size.
+    std::vector<uint64_t> bounds(1, 0);
+    for (uint64_t split = _range_size; split < size; split += _range_size) {
+        if (split <= bounds.back()) {
+            continue;
+        }
+        uint64_t bound = FastxScanner::find_unit_start(filename, split,
+                         _force_single);
+        if (bound >= size) {
+            break;
+        }
+        if (bound > bounds.back()) {
+            bounds.push_back(bound);
+        }
+    }
+
+    bounds.push_back(size);
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+        _ranges.emplace_back(new SampleRange(filename, bounds[i],
+                                             bounds[i + 1]));
+    }
+}
+
+void ReservoirSampler::_sample_range(SampleRange& range, size_t index,
+                                     uint64_t max_units) const
+{
+    const uint64_t n = _sample_size;
+    range.clear();
+    range.slots.resize(n * _n_samples);
+
+    std::mt19937_64 rng = make_rng(_seed, index);
+    std::vector<double> weights(_n_samples);
+    std::vector<uint64_t> next_take(_n_samples, UINT64_MAX);
+    uint64_t next_any = UINT64_MAX;
+    const uint64_t key_base = (uint64_t) index << SAMPLE_KEY_BITS;
+
+    std::unique_ptr<FastxScanner> scanner;
+    if (range.begin == 0 && range.end == 0) {
+        scanner.reset(new FastxScanner(range.filename));
+    } else {
+        scanner.reset(new FastxScanner(range.filename, range.begin,
+                                       range.end));
+    }
+    FastxRecord first, second;
+    uint64_t unit = 0;
+
+    while (!max_units || unit < max_units) {
+        unsigned int n_reads = scanner->next_unit(first, second,
+                               _force_single);
+        if (n_reads == 0) {
+            break;
+        }
+
+        if (unit < n || unit == next_any) {
+            const FastxRecord& last = n_reads == 2 ? second : first;
+            SampleRange::Slot slot;
+            slot.key = key_base | unit;
+            slot.offset = range.arena.size();
+            slot.length = last.offset + last.text_length - first.offset;
+            slot.n_reads = n_reads;
+            range.arena.append(first.text, slot.length);
+            if (unit < n) {
+                for (unsigned int s = 0; s < _n_samples; ++s) {
+                    range.slots[s * n + unit] = slot;
+                }
+                if (unit == n - 1) {
+                    for (unsigned int s = 0; s < _n_samples; ++s) {
+                        weights[s] = exp(log(open_uniform(rng)) / n);
+                        next_take[s] = unit + 1 + skip_length(
+                                           weights[s], open_uniform(rng));
+                    }
+                }
+                range.live_bytes = range.arena.size();
+            } else {
+                std::uniform_int_distribution<uint64_t> pick(0, n - 1);
+                for (unsigned int s = 0; s < _n_samples; ++s) {
+                    if (next_take[s] == unit) {
+                        range.slots[s * n + pick(rng)] = slot;
+                        weights[s] *= exp(log(open_uniform(rng)) / n);
+                        next_take[s] = unit + 1 + skip_length(
+                                           weights[s], open_uniform(rng));
+                    }
+                }
+                if (range.arena.size() > 2 * range.live_bytes
+                        + SAMPLE_MIN_GARBAGE) {
+                    compact(range, n, _n_samples, n);
+                }
+            }
+            if (unit >= n - 1) {
+                next_any = *std::min_element(next_take.begin(),
+                                             next_take.end());
+            }
+        }
+
+        range.n_reads += n_reads;
+        ++unit;
+    }
+    range.n_units = unit;
+}
+
+void ReservoirSampler::_merge_range(SampleRange& range, size_t index)
+{
+    if (range.n_units == 0) {
+        return;
+    }
+    if (_merged.n_units == 0) {
+        std::swap(_merged, range);
+        return;
+    }
+
+    const uint64_t n = _sample_size;
+    std::mt19937_64 rng = make_rng(_seed, _ranges.size() + index);
+    SampleRange merged("", 0, 0);
+    merged.slots.resize(n * _n_samples);
+    merged.n_units = _merged.n_units + range.n_units;
+    merged.n_reads = _merged.n_reads + range.n_reads;
+
+    // a unit shared by several samples is copied once
+    SampleRange * sides[2] = { &_merged, &range };
+    std::unordered_map<uint64_t, uint64_t> copied[2];
+
+    for (unsigned int s = 0; s < _n_samples; ++s) {
+        // Draw from all units seen without replacement: pick a side by how
+        // many of its units are left, then one of its unpicked slots, which
+        // stand for those units uniformly.
+        std::vector<uint64_t> pool[2];
+        uint64_t left[2];
+        for (int side = 0; side < 2; ++side) {
+            left[side] = sides[side]->n_units;
+            uint64_t held = std::min(n, left[side]);
+            for (uint64_t i = 0; i < held; ++i) {
+                pool[side].push_back(s * n + i);
+            }
+        }
+
+        uint64_t total = merged.n_units;
+        uint64_t length = std::min(n, total);
+        for (uint64_t i = 0; i < length; ++i) {
+            uint64_t r = std::uniform_int_distribution<uint64_t>(
+                             0, total - 1)(rng);
+            int side = r < left[0] ? 0 : 1;
+            std::vector<uint64_t>& from = pool[side];
+            size_t k = std::uniform_int_distribution<size_t>(
+                           0, from.size() - 1)(rng);
+            SampleRange::Slot slot = sides[side]->slots[from[k]];
+            from[k] = from.back();
+            from.pop_back();
+            --left[side];
+            --total;
+
+            auto it = copied[side].find(slot.offset);
+            if (it == copied[side].end()) {
+                uint64_t offset = merged.arena.size();
+                merged.arena.append(sides[side]->arena, slot.offset,
+                                    slot.length);
+                it = copied[side].emplace(slot.offset, offset).first;
+            }
+            slot.offset = it->second;
+            merged.slots[s * n + i] = slot;
+        }
+    }
+
+    merged.live_bytes = merged.arena.size();
+    std::swap(_merged, merged);
+}
+
+void ReservoirSampler::sample(const std::vector<std::string>& filenames,
+                              unsigned int n_threads)
+{
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#else
+    n_threads = 1;
+#endif
+    if (n_threads == 0) {
+        n_threads = 1;
+    }
+
+    _ranges.clear();
+    _merged.clear();
+    for (const std::string& filename : filenames) {
+        _split(filename);
+    }
+
+    // Ranges are merged in order as soon as all those before them are, so
+    // only the ones waiting on a slower range before them hold memory.
+    const size_t n_ranges = _ranges.size();
+    std::vector<bool> done(n_ranges, false);
+    size_t n_merged = 0;
+    uint64_t merged_units = 0;
+    bool failed = false;
+    std::exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+    for (size_t i = 0; i < n_ranges; ++i) {
+        bool skip;
+        #pragma omp critical(reservoir_sampler_merge)
+        skip = failed || (_max_units && merged_units >= _max_units);
+
+        std::exception_ptr range_error;
+        if (!skip) {
+            try {
+                _sample_range(*_ranges[i], i, _max_units);
+            } catch (...) {
+                range_error = std::current_exception();
+            }
+        }
+
+        #pragma omp critical(reservoir_sampler_merge)
+        {
+            done[i] = true;
+            if (range_error && !error) {
+                error = range_error;
+            }
+            failed = failed || range_error;
+            while (!failed && n_merged < n_ranges && done[n_merged]) {
+                SampleRange& range = *_ranges[n_merged];
+                try {
+                    uint64_t before = _merged.n_units;
+                    if (_max_units && before + range.n_units > _max_units) {
+                        // only part of this range is wanted; sample that
+                        if (before < _max_units) {
+                            _sample_range(range, n_merged,
+                                          _max_units - before);
+                            _merge_range(range, n_merged);
+                        }
+                    } else {
+                        _merge_range(range, n_merged);
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                    failed = true;
+                }
+                range.clear();
+                merged_units = _merged.n_units;
+                ++n_merged;
+            }
+        }
+    }
+
+    if (error) {
+        _merged.clear();
+        std::rethrow_exception(error);
+    }
+
+    // write each sample in input order
+    const uint64_t length = sample_length();
+    for (unsigned int s = 0; s < _n_samples; ++s) {
+        std::sort(_merged.slots.begin() + s * _sample_size,
+                  _merged.slots.begin() + s * _sample_size + length,
+        [](const SampleRange::Slot& a, const SampleRange::Slot& b) {
+            return a.key < b.key;
+        });
+    }
+}
+
+std::string ReservoirSampler::get_unit(unsigned int sample, size_t i) const
+{
+    if (sample >= _n_samples || i >= sample_length()) {
+        throw InvalidValue("no such unit in the sample");
+    }
+    const SampleRange::Slot& slot = _merged.slots[sample * _sample_size + i];
+    return _merged.arena.substr(slot.offset, slot.length);
+}
+
+uint64_t ReservoirSampler::write_sample(unsigned int sample,
+                                        FastxWriter& writer) const
+{
+    if (sample >= _n_samples) {
+        throw InvalidValue("no such sample");
+    }
+
+    std::string buf;
+    uint64_t n_reads = 0;
+    const uint64_t length = sample_length();
+    for (uint64_t i = 0; i < length; ++i) {
+        const SampleRange::Slot& slot =
+            _merged.slots[sample * _sample_size + i];
+        buf.append(_merged.arena, slot.offset, slot.length);
+        if (slot.length && buf.back() != '\n') {
+            buf += '\n';
+        }
+        n_reads += slot.n_reads;
+        if (buf.size() >= FASTX_OUTPUT_CHUNK) {
+            writer.write(buf);
+            buf.clear();
+        }
+    }
+    writer.write(buf);
+    return n_reads;
+}
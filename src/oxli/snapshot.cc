@@ -0,0 +1,175 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <exception>
+
+#include "oxli/oxli_exception.hh"
+#include "oxli/snapshot.hh"
+#include "oxli/storage.hh"
+
+using namespace oxli;
+
+namespace
+{
+
+// ".snapshot-<name>" in the same directory, so rename() stays atomic.
+std::string snapshot_tempname(const std::string& filename)
+{
+    size_t slash = filename.find_last_of('/');
+    size_t base = slash == std::string::npos ? 0 : slash + 1;
+    return filename.substr(0, base) + ".snapshot-" + filename.substr(base);
+}
+
+} // anonymous namespace
+
+StorageSnapshot::StorageSnapshot(Storage& store,
+                                 const std::string& outfilename,
+                                 WordLength ksize)
+    : _pid(-1), _error_fd(-1), _finished(false), _succeeded(false),
+      _filename(outfilename)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw oxli_file_exception(std::string("Cannot start snapshot: ") +
+                                  strerror(errno));
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    const std::string tempname = snapshot_tempname(outfilename);
+
+    // keep the storage's own bookkeeping (e.g. bigcounts) out of a
+    // half-updated state while the address space is copied
+    store.lock_for_snapshot();
+    _pid = fork();
+    int fork_errno = errno;
+    store.unlock_for_snapshot();
+
+    if (_pid == 0) {
+        // child: write the image, report any error, and leave without
+        // running the parent's exit handlers.
+        close(fds[0]);
+        int status = 0;
+        try {
+            store.save(tempname, ksize);
+            if (rename(tempname.c_str(), outfilename.c_str()) != 0) {
+                throw oxli_file_exception(strerror(errno));
+            }
+        } catch (std::exception& e) {
+            const char * msg = e.what();
+            ssize_t n = write(fds[1], msg, strlen(msg));
+            (void) n;
+            status = 1;
+        } catch (...) {
+            status = 1;
+        }
+        if (status) {
+            unlink(tempname.c_str());
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    if (_pid < 0) {
+        close(fds[0]);
+        throw oxli_file_exception(std::string("Cannot start snapshot: ") +
+                                  strerror(fork_errno));
+    }
+    _error_fd = fds[0];
+}
+
+StorageSnapshot::~StorageSnapshot()
+{
+    _reap(true);
+}
+
+void StorageSnapshot::_reap(bool block)
+{
+    if (_finished) {
+        return;
+    }
+
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(_pid, &status, block ? 0 : WNOHANG);
+    } while (result < 0 && errno == EINTR);
+    int wait_errno = errno;
+
+    if (result == 0) {
+        return;                 // still running
+    }
+
+    char buf[256];
+    ssize_t n;
+    while ((n = read(_error_fd, buf, sizeof(buf))) > 0) {
+        _error.append(buf, n);
+    }
+    close(_error_fd);
+    _error_fd = -1;
+
+    _finished = true;
+    if (result < 0) {
+        _error = std::string("cannot wait for snapshot process: ") +
+                 strerror(wait_errno);
+    } else {
+        _succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!_succeeded && _error.empty()) {
+            _error = "snapshot process exited abnormally";
+        }
+    }
+}
+
+bool StorageSnapshot::is_done()
+{
+    _reap(false);
+    return _finished;
+}
+
+void StorageSnapshot::wait()
+{
+    _reap(true);
+    if (!_succeeded) {
+        throw oxli_file_exception("Error saving snapshot to " + _filename +
+                                  ": " + _error);
+    }
+}
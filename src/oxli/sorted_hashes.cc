@@ -0,0 +1,316 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "oxli/oxli_exception.hh"
+#include "oxli/sorted_hashes.hh"
+
+using namespace std;
+using namespace oxli;
+
+namespace
+{
+
+struct BlockIndexEntry {
+    uint64_t first_hash;
+    uint64_t offset;
+    uint8_t delta_bits;
+    uint8_t value_bits;
+};
+
+inline unsigned int bit_width(uint64_t x)
+{
+    unsigned int n = 0;
+    for (; x; x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+inline uint64_t packed_size(uint64_t n_items, const BlockIndexEntry& entry)
+{
+    uint64_t n_bits = (n_items - 1) * entry.delta_bits +
+                      n_items * entry.value_bits;
+    return (n_bits + 7) / 8;
+}
+
+// Appends values of up to 64 bits to a little-endian bit stream.
+class BitWriter
+{
+    std::string& _out;
+    uint64_t _acc;
+    unsigned int _n_bits;
+
+    void _flush_word()
+    {
+        for (unsigned int i = 0; i < 64; i += 8) {
+            _out += (char) (_acc >> i);
+        }
+    }
+public:
+    explicit BitWriter(std::string& out) : _out(out), _acc(0), _n_bits(0) {}
+
+    void put(uint64_t x, unsigned int width)
+    {
+        if (width == 0) {
+            return;
+        }
+        if (width < 64) {
+            x &= (uint64_t(1) << width) - 1;
+        }
+        _acc |= x << _n_bits;
+        if (_n_bits + width >= 64) {
+            _flush_word();
+            _acc = _n_bits ? x >> (64 - _n_bits) : 0;
+            _n_bits = _n_bits + width - 64;
+        } else {
+            _n_bits += width;
+        }
+    }
+
+    void finish()
+    {
+        for (unsigned int i = 0; i < _n_bits; i += 8) {
+            _out += (char) (_acc >> i);
+        }
+        _acc = 0;
+        _n_bits = 0;
+    }
+};
+
+// Reads a bit stream written by BitWriter; the buffer must extend at least
+// 8 bytes past the last bit read.
+class BitReader
+{
+    const unsigned char * _data;
+    uint64_t _pos;
+
+    uint64_t _get_short(unsigned int width)
+    {
+        uint64_t word;
+        memcpy(&word, _data + (_pos >> 3), sizeof(word));
+        word >>= _pos & 7;
+        _pos += width;
+        return word & ((uint64_t(1) << width) - 1);
+    }
+public:
+    explicit BitReader(const unsigned char * data) : _data(data), _pos(0) {}
+
+    uint64_t get(unsigned int width)
+    {
+        if (width <= 56) {
+            return width ? _get_short(width) : 0;
+        }
+        uint64_t low = _get_short(32);
+        return low | (_get_short(width - 32) << 32);
+    }
+};
+
+// Run fn(b) for every block on all threads, rethrowing the first exception.
+template<typename Fn>
+void for_each_block(uint64_t n_blocks, Fn fn)
+{
+    std::exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (uint64_t b = 0; b < n_blocks; ++b) {
+        try {
+            fn(b);
+        } catch (...) {
+            #pragma omp critical(sorted_hashes_error)
+            {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // anonymous namespace
+
+void oxli::write_sorted_hashes(std::ostream& out,
+                               const std::vector<HashIntoType>& hashes,
+                               const std::vector<uint64_t>& values)
+{
+    const uint64_t n_items = hashes.size();
+    const uint8_t has_values = !values.empty();
+    const uint32_t block_size = SORTED_HASHES_BLOCK_SIZE;
+    const uint64_t n_blocks = (n_items + block_size - 1) / block_size;
+
+    if (has_values && values.size() != hashes.size()) {
+        throw oxli_value_exception("need one value per hash");
+    }
+
+    std::vector<std::string> blocks(n_blocks);
+    std::vector<BlockIndexEntry> index(n_blocks);
+    for_each_block(n_blocks, [&](uint64_t b) {
+        uint64_t start = b * block_size;
+        uint64_t end = std::min(n_items, start + block_size);
+        BlockIndexEntry& entry = index[b];
+
+        uint64_t max_delta = 0, max_value = 0;
+        for (uint64_t i = start + 1; i < end; ++i) {
+            if (hashes[i] < hashes[i - 1]) {
+                throw oxli_value_exception("hashes must be sorted");
+            }
+            max_delta = std::max<uint64_t>(max_delta, hashes[i] - hashes[i - 1]);
+        }
+        for (uint64_t i = start; has_values && i < end; ++i) {
+            max_value = std::max(max_value, values[i]);
+        }
+        entry.first_hash = hashes[start];
+        entry.delta_bits = bit_width(max_delta);
+        entry.value_bits = bit_width(max_value);
+
+        std::string& data = blocks[b];
+        data.reserve(packed_size(end - start, entry) + 8);
+        BitWriter bits(data);
+        for (uint64_t i = start + 1; i < end; ++i) {
+            bits.put(hashes[i] - hashes[i - 1], entry.delta_bits);
+        }
+        for (uint64_t i = start; has_values && i < end; ++i) {
+            bits.put(values[i], entry.value_bits);
+        }
+        bits.finish();
+    });
+
+    uint64_t data_size = 0;
+    for (uint64_t b = 0; b < n_blocks; ++b) {
+        index[b].offset = data_size;
+        data_size += blocks[b].size();
+    }
+
+    out.write((const char *) &n_items, sizeof(n_items));
+    out.write((const char *) &has_values, sizeof(has_values));
+    out.write((const char *) &block_size, sizeof(block_size));
+    out.write((const char *) &n_blocks, sizeof(n_blocks));
+    for (auto& entry : index) {
+        out.write((const char *) &entry.first_hash, sizeof(entry.first_hash));
+        out.write((const char *) &entry.offset, sizeof(entry.offset));
+        out.write((const char *) &entry.delta_bits, sizeof(entry.delta_bits));
+        out.write((const char *) &entry.value_bits, sizeof(entry.value_bits));
+    }
+    out.write((const char *) &data_size, sizeof(data_size));
+    for (auto& data : blocks) {
+        out.write(data.data(), data.size());
+    }
+}
+
+void oxli::read_sorted_hashes(std::istream& in,
+                              std::vector<HashIntoType>& hashes,
+                              std::vector<uint64_t>& values)
+{
+    uint64_t n_items, n_blocks, data_size;
+    uint8_t has_values;
+    uint32_t block_size;
+
+    in.read((char *) &n_items, sizeof(n_items));
+    in.read((char *) &has_values, sizeof(has_values));
+    in.read((char *) &block_size, sizeof(block_size));
+    in.read((char *) &n_blocks, sizeof(n_blocks));
+    if (block_size == 0 || has_values > 1 ||
+            n_blocks != (n_items + block_size - 1) / block_size) {
+        throw oxli_file_exception("Corrupt sorted hash block index");
+    }
+
+    // check every block's extent up front, so that decoding can't overrun
+    std::vector<BlockIndexEntry> index(n_blocks);
+    uint64_t expected_offset = 0;
+    for (uint64_t b = 0; b < n_blocks; ++b) {
+        BlockIndexEntry& entry = index[b];
+        in.read((char *) &entry.first_hash, sizeof(entry.first_hash));
+        in.read((char *) &entry.offset, sizeof(entry.offset));
+        in.read((char *) &entry.delta_bits, sizeof(entry.delta_bits));
+        in.read((char *) &entry.value_bits, sizeof(entry.value_bits));
+
+        uint64_t n = std::min<uint64_t>(block_size, n_items - b * block_size);
+        if (entry.offset != expected_offset || entry.delta_bits > 64 ||
+                entry.value_bits > (has_values ? 64 : 0)) {
+            throw oxli_file_exception("Corrupt sorted hash block index");
+        }
+        expected_offset += packed_size(n, entry);
+    }
+    in.read((char *) &data_size, sizeof(data_size));
+    if (data_size != expected_offset) {
+        throw oxli_file_exception("Corrupt sorted hash block index");
+    }
+
+    // padded for BitReader's word-at-a-time loads
+    std::string data(data_size + 8, '\0');
+    if (data_size) {
+        in.read(&data[0], data_size);
+    }
+
+    hashes.resize(n_items);
+    if (has_values) {
+        values.resize(n_items);
+    } else {
+        values.clear();
+    }
+
+    const unsigned char * data_begin = (const unsigned char *) data.data();
+    for_each_block(n_blocks, [&](uint64_t b) {
+        const BlockIndexEntry& entry = index[b];
+        uint64_t start = b * block_size;
+        uint64_t end = std::min(n_items, start + block_size);
+
+        BitReader bits(data_begin + entry.offset);
+        HashIntoType h = entry.first_hash;
+        hashes[start] = h;
+        for (uint64_t i = start + 1; i < end; ++i) {
+            uint64_t delta = bits.get(entry.delta_bits);
+            if (h + delta < h) {
+                throw oxli_file_exception("Corrupt sorted hash block");
+            }
+            h += delta;
+            hashes[i] = h;
+        }
+        for (uint64_t i = start; has_values && i < end; ++i) {
+            values[i] = bits.get(entry.value_bits);
+        }
+    });
+}
@@ -36,17 +36,100 @@ Contact: khmer-project@idyll.org
 */
 
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
 #include <sstream> // IWYU pragma: keep
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 
 #include "oxli/oxli_exception.hh"
 #include "oxli/hashtable.hh"
 #include "zlib.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// bytes of a saved table read at a time by ByteStorageFile::merge
+#define MERGE_CHUNK_SIZE (64*1024*1024)
+// tables smaller than this are merged on one thread
+#define MERGE_PARALLEL_MIN (1024*1024)
+// how far ahead of the current hash batch lookups prefetch
+#define LOOKUP_PREFETCH_AHEAD 16
+// hashes ordered and added together by add_batch
+#define WRITE_COMBINE_BATCH ((size_t)64*1024)
+// table regions the bins of a batch are bucketed into
+#define WRITE_COMBINE_BUCKETS 4096
+
 using namespace oxli;
 using namespace std;
 
+namespace
+{
+
+unsigned int merge_threads(unsigned int n_threads)
+{
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#else
+    n_threads = 1;
+#endif
+    return n_threads ? n_threads : 1;
+}
+
+// Fill order with the indices of bins, bucketed by the region of the table
+// (of tablesize bins) they fall in, low addresses first. A counting sort,
+// so the indices within a region stay in input order.
+void order_by_region(const std::vector<uint64_t>& bins, uint64_t tablesize,
+                     std::vector<uint32_t>& order,
+                     std::vector<uint32_t>& starts)
+{
+    unsigned int shift = 0;
+    while (((tablesize - 1) >> shift) >= WRITE_COMBINE_BUCKETS) {
+        shift++;
+    }
+
+    starts.assign(WRITE_COMBINE_BUCKETS + 1, 0);
+    for (uint64_t bin : bins) {
+        starts[(bin >> shift) + 1]++;
+    }
+    for (size_t i = 1; i <= WRITE_COMBINE_BUCKETS; i++) {
+        starts[i] += starts[i - 1];
+    }
+    order.resize(bins.size());
+    for (uint32_t j = 0; j < bins.size(); j++) {
+        order[starts[bins[j] >> shift]++] = j;
+    }
+}
+
+// Counting tables saved before SAVED_COUNTING_FORMAT_VERSION still load;
+// the flags byte of their byte tables only ever holds SAVED_FLAG_BIGCOUNT,
+// and small count tables have none.
+bool counting_version_ok(unsigned char version)
+{
+    return version == SAVED_COUNTING_FORMAT_VERSION ||
+           version == SAVED_FORMAT_VERSION;
+}
+
+std::string counting_version_error(unsigned char version,
+                                   const std::string &infilename)
+{
+    std::ostringstream err;
+    err << "Incorrect file format version " << (int) version
+        << " while reading k-mer count file from " << infilename
+        << "; should be " << (int) SAVED_COUNTING_FORMAT_VERSION
+        << " or " << (int) SAVED_FORMAT_VERSION;
+    return err.str();
+}
+
+} // anonymous namespace
+
 void Storage::set_use_bigcount(bool b)
 {
     if (!_supports_bigcount) {
@@ -60,23 +143,252 @@ bool Storage::get_use_bigcount()
     return _use_bigcount;
 }
 
-void BitStorage::update_from(const BitStorage& other)
+void Storage::set_conservative_update(bool b)
+{
+    if (!_supports_conservative) {
+        throw oxli_exception("conservative update is not supported for this "
+                             "storage.");
+    }
+    _conservative = b;
+}
+
+bool Storage::get_conservative_update() const
+{
+    return _conservative;
+}
+
+void Storage::load(std::istream&, const std::string& infilename, WordLength&)
+{
+    throw oxli_file_exception("This table type cannot be loaded from a "
+                              "stream: " + infilename);
+}
+
+void Storage::get_counts(const HashIntoType * hashes, size_t n,
+                         BoundedCounterType * counts) const
+{
+    for (size_t i = 0; i < n; i++) {
+        counts[i] = get_count(hashes[i]);
+    }
+}
+
+// Batch lookups go through the hashes a table at a time, prefetching bins a
+// few hashes ahead, so that the cache misses of several lookups overlap.
+
+void BitStorage::get_counts(const HashIntoType * hashes, size_t n,
+                            BoundedCounterType * counts) const
+{
+    std::fill(counts, counts + n, 1);
+    for (size_t t = 0; t < _n_tables; t++) {
+        const Byte * table = _counts[t];
+        const uint64_t tablesize = _tablesizes[t];
+        for (size_t i = 0; i < n; i++) {
+            if (i + LOOKUP_PREFETCH_AHEAD < n) {
+                uint64_t ahead = hashes[i + LOOKUP_PREFETCH_AHEAD] % tablesize;
+                __builtin_prefetch(table + ahead / 8);
+            }
+            uint64_t bin = hashes[i] % tablesize;
+            if (!(table[bin / 8] & (1 << (bin % 8)))) {
+                counts[i] = 0;
+            }
+        }
+    }
+}
+
+void ByteStorage::get_counts(const HashIntoType * hashes, size_t n,
+                             BoundedCounterType * counts) const
+{
+    std::fill(counts, counts + n, _max_count);
+    for (size_t t = 0; t < _n_tables; t++) {
+        const Byte * table = _counts[t];
+        const uint64_t tablesize = _tablesizes[t];
+        for (size_t i = 0; i < n; i++) {
+            if (i + LOOKUP_PREFETCH_AHEAD < n) {
+                __builtin_prefetch(table + hashes[i + LOOKUP_PREFETCH_AHEAD] %
+                                   tablesize);
+            }
+            BoundedCounterType count = table[hashes[i] % tablesize];
+            if (count < counts[i]) {
+                counts[i] = count;
+            }
+        }
+    }
+
+    if (_use_bigcount) {
+        for (size_t i = 0; i < n; i++) {
+            if (counts[i] == _max_count) {
+                auto it = _bigcounts.find(hashes[i]);
+                if (it != _bigcounts.end()) {
+                    counts[i] = it->second;
+                }
+            }
+        }
+    }
+}
+
+uint64_t Storage::add_batch(const HashIntoType * hashes, size_t n)
+{
+    uint64_t n_new = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (add(hashes[i])) {
+            n_new++;
+        }
+    }
+    return n_new;
+}
+
+// Batch adds also go a table at a time, with the bins of each table bucketed
+// by region first, so that a table is written in one sweep from low to high
+// addresses instead of at random: bins close together share cache lines and
+// DRAM pages, and the hardware prefetcher can follow the sweep. Repeats of a
+// hash keep their order, so they see the counts they would see with add().
+// Updates stay atomic, as other threads may be adding to the same table.
+
+uint64_t BitStorage::add_batch(const HashIntoType * hashes, size_t n)
+{
+    std::vector<uint64_t> bins;
+    std::vector<uint32_t> order, starts;
+    std::vector<uint8_t> is_new;
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += WRITE_COMBINE_BATCH) {
+        const HashIntoType * batch = hashes + start;
+        const size_t m = std::min(n - start, WRITE_COMBINE_BATCH);
+        bins.resize(m);
+        is_new.assign(m, 0);
+        uint64_t newly_occupied = 0;
+
+        for (size_t t = 0; t < _n_tables; t++) {
+            Byte * table = _counts[t];
+            const uint64_t tablesize = _tablesizes[t];
+            for (size_t j = 0; j < m; j++) {
+                bins[j] = batch[j] % tablesize;
+            }
+            order_by_region(bins, tablesize, order, starts);
+
+            for (size_t k = 0; k < m; k++) {
+                const uint32_t j = order[k];
+                Byte * byte = table + bins[j] / 8;
+                const unsigned char bit = (unsigned char)(1 << (bins[j] % 8));
+                if (*byte & bit) {
+                    continue;
+                }
+                if (!(__sync_fetch_and_or(byte, bit) & bit)) {
+                    if (t == 0) {
+                        newly_occupied++;
+                    }
+                    is_new[j] = 1;
+                }
+            }
+        }
+
+        uint64_t batch_new = std::count(is_new.begin(), is_new.end(), 1);
+        __sync_add_and_fetch(&_occupied_bins, newly_occupied);
+        __sync_add_and_fetch(&_n_unique_kmers, batch_new);
+        n_new += batch_new;
+    }
+    return n_new;
+}
+
+uint64_t ByteStorage::add_batch(const HashIntoType * hashes, size_t n)
+{
+    // conservative updates need each k-mer's counters together
+    if (_conservative) {
+        return Storage::add_batch(hashes, n);
+    }
+
+    std::vector<uint64_t> bins;
+    std::vector<uint32_t> order, starts;
+    std::vector<uint8_t> is_new;
+    std::vector<unsigned int> n_full;
+    uint64_t n_new = 0;
+
+    for (size_t start = 0; start < n; start += WRITE_COMBINE_BATCH) {
+        const HashIntoType * batch = hashes + start;
+        const size_t m = std::min(n - start, WRITE_COMBINE_BATCH);
+        bins.resize(m);
+        is_new.assign(m, 0);
+        n_full.assign(m, 0);
+        uint64_t newly_occupied = 0;
+
+        for (size_t t = 0; t < _n_tables; t++) {
+            Byte * table = _counts[t];
+            const uint64_t tablesize = _tablesizes[t];
+            for (size_t j = 0; j < m; j++) {
+                bins[j] = batch[j] % tablesize;
+            }
+            order_by_region(bins, tablesize, order, starts);
+
+            for (size_t k = 0; k < m; k++) {
+                const uint32_t j = order[k];
+                Byte * count = table + bins[j];
+                const Byte current_count = *count;
+                if (current_count == 0 && !is_new[j]) {
+                    is_new[j] = 1;
+                    if (t == 0) {
+                        newly_occupied++;
+                    }
+                }
+                if (_max_count > current_count) {
+                    __sync_add_and_fetch(count, 1);
+                } else {
+                    n_full[j]++;
+                }
+            }
+        }
+
+        // saturated in every table: count on in the bigcount map
+        if (_use_bigcount) {
+            bool locked = false;
+            for (size_t j = 0; j < m; j++) {
+                if (n_full[j] != _n_tables) {
+                    continue;
+                }
+                if (!locked) {
+                    while (!__sync_bool_compare_and_swap(&_bigcount_spin_lock,
+                                                         0, 1));
+                    locked = true;
+                }
+                BoundedCounterType& bigcount = _bigcounts[batch[j]];
+                if (bigcount == 0) {
+                    bigcount = _max_count + 1;
+                } else if (bigcount < _max_bigcount) {
+                    bigcount += 1;
+                }
+            }
+            if (locked) {
+                __sync_bool_compare_and_swap(&_bigcount_spin_lock, 1, 0);
+            }
+        }
+
+        uint64_t batch_new = std::count(is_new.begin(), is_new.end(), 1);
+        __sync_add_and_fetch(&_occupied_bins, newly_occupied);
+        __sync_add_and_fetch(&_n_unique_kmers, batch_new);
+        n_new += batch_new;
+    }
+    return n_new;
+}
+
+void BitStorage::update_from(const BitStorage& other,
+                             unsigned int n_threads)
 {
     if (_tablesizes != other._tablesizes) {
         throw oxli_exception("both nodegraphs must have same table sizes");
     }
+    n_threads = merge_threads(n_threads);
 
-    Byte tmp = 0;
+    uint64_t newly_occupied = 0;
     for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
         Byte * me = _counts[table_num];
         Byte * ot = other._counts[table_num];
         uint64_t tablesize = _tablesizes[table_num];
         uint64_t tablebytes = tablesize / 8 + 1;
 
+        #pragma omp parallel for num_threads(n_threads) schedule(static) \
+            reduction(+:newly_occupied) if(tablebytes >= MERGE_PARALLEL_MIN)
         for (uint64_t index = 0; index < tablebytes; index++) {
             // Bloom filters can be unioned with bitwise OR.
             // First, get the new value
-            tmp = me[index] | ot[index];
+            Byte tmp = me[index] | ot[index];
             if (table_num == 0) {
                 // We'd like for the merged filter to have an accurate
                 // count of occupied bins.  First, observe that
@@ -88,11 +400,12 @@ void BitStorage::update_from(const BitStorage& other)
                 // function, which calls a hardware instruction for
                 // hamming weight, with the original and merged bin,
                 // to find the number of additional occupied bins.
-                _occupied_bins += __builtin_popcountll(me[index] ^ tmp);
+                newly_occupied += __builtin_popcountll(me[index] ^ tmp);
             }
             me[index] = tmp;
         }
     }
+    _occupied_bins += newly_occupied;
 }
 
 
@@ -103,9 +416,6 @@ void BitStorage::save(std::string outfilename, WordLength ksize)
     }
 
     unsigned int save_ksize = ksize;
-    unsigned char save_n_tables = _n_tables;
-    unsigned long long save_tablesize;
-    unsigned long long save_occupied_bins = _occupied_bins;
 
     ofstream outfile(outfilename.c_str(), ios::binary);
 
@@ -117,6 +427,20 @@ void BitStorage::save(std::string outfilename, WordLength ksize)
     outfile.write((const char *) &ht_type, 1);
 
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+    _save_tables(outfile);
+
+    if (outfile.fail()) {
+        throw oxli_file_exception(strerror(errno));
+    }
+    outfile.close();
+}
+
+void BitStorage::_save_tables(std::ostream& outfile) const
+{
+    unsigned char save_n_tables = _n_tables;
+    unsigned long long save_tablesize;
+    unsigned long long save_occupied_bins = _occupied_bins;
+
     outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
     outfile.write((const char *) &save_occupied_bins,
                   sizeof(save_occupied_bins));
@@ -129,10 +453,62 @@ void BitStorage::save(std::string outfilename, WordLength ksize)
 
         outfile.write((const char *) _counts[i], tablebytes);
     }
-    if (outfile.fail()) {
-        throw oxli_file_exception(strerror(errno));
+}
+
+// Reads the tables written by _save_tables, replacing the current ones;
+// failures surface as exceptions from infile.
+void BitStorage::_load_tables(std::istream& infile)
+{
+    if (_counts) {
+        for (unsigned int i = 0; i < _n_tables; i++) {
+            TableAllocator::release(_counts[i]);
+            _counts[i] = NULL;
+        }
+        delete[] _counts;
+        _counts = NULL;
+    }
+    _tablesizes.clear();
+    _n_tables = 0;
+
+    unsigned char save_n_tables = 0;
+    unsigned long long save_tablesize = 0;
+    unsigned long long save_occupied_bins = 0;
+
+    infile.read((char *) &save_n_tables, sizeof(save_n_tables));
+    infile.read((char *) &save_occupied_bins, sizeof(save_occupied_bins));
+
+    _occupied_bins = save_occupied_bins;
+
+    _counts = new Byte*[save_n_tables];
+    for (unsigned int i = 0; i < save_n_tables; i++) {
+        uint64_t tablesize;
+        unsigned long long tablebytes;
+
+        infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+
+        tablesize = save_tablesize;
+        _tablesizes.push_back(tablesize);
+
+        tablebytes = tablesize / 8 + 1;
+        _counts[i] = TableAllocator::allocate(tablebytes, _alloc_policy);
+        _n_tables = i + 1;
+
+        unsigned long long loaded = 0;
+        while (loaded != tablebytes) {
+            infile.read((char *) _counts[i], tablebytes - loaded);
+            loaded += infile.gcount();
+        }
     }
-    outfile.close();
+}
+
+double BitStorage::estimated_fp_rate() const
+{
+    if (!_n_tables) {
+        return 0;
+    }
+    uint64_t min_size = *std::min_element(_tablesizes.begin(),
+                                          _tablesizes.end());
+    return pow(double(_occupied_bins) / min_size, double(_n_tables));
 }
 
 /**
@@ -165,21 +541,18 @@ void BitStorage::load(std::string infilename, WordLength &ksize)
         throw oxli_file_exception(err);
     }
 
-    if (_counts) {
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            delete[] _counts[i];
-            _counts[i] = NULL;
-        }
-        delete[] _counts;
-        _counts = NULL;
-    }
-    _tablesizes.clear();
+    load(infile, infilename, ksize);
+}
+
+void BitStorage::load(std::istream &infile, const std::string &infilename,
+                      WordLength &ksize)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
 
     try {
         unsigned int save_ksize = 0;
-        unsigned char save_n_tables = 0;
-        unsigned long long save_tablesize = 0;
-        unsigned long long save_occupied_bins = 0;
         char signature[4];
         unsigned char version, ht_type;
 
@@ -208,33 +581,281 @@ void BitStorage::load(std::string infilename, WordLength &ksize)
         }
 
         infile.read((char *) &save_ksize, sizeof(save_ksize));
-        infile.read((char *) &save_n_tables, sizeof(save_n_tables));
-        infile.read((char *) &save_occupied_bins, sizeof(save_occupied_bins));
-
         ksize = (WordLength) save_ksize;
-        _n_tables = (unsigned int) save_n_tables;
-        _occupied_bins = save_occupied_bins;
 
-        _counts = new Byte*[_n_tables];
-        for (unsigned int i = 0; i < _n_tables; i++) {
-            uint64_t tablesize;
-            unsigned long long tablebytes;
+        _load_tables(infile);
+    } catch (std::ifstream::failure &e) {
+        std::string err;
+        if (infile.eof()) {
+            err = "Unexpected end of k-mer graph file: " + infilename;
+        } else {
+            err = "Error reading from k-mer graph file: " + infilename;
+        }
+        throw oxli_file_exception(err);
+    } catch (const std::exception &e) {
+        // Catching std::exception is a stopgap for
+        // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66145
+        std::string err = "Unknown error opening file: " + infilename + " "
+                          + strerror(errno);
+        throw oxli_file_exception(err);
+    }
+}
 
-            infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+ScalableBitStorage::ScalableBitStorage(std::vector<uint64_t>& tablesizes,
+                                       double fp_rate)
+    : _fp_rate(fp_rate), _max_fill(0), _n_slices(0)
+{
+    if (tablesizes.empty()) {
+        throw oxli_exception("scalable nodegraph needs at least one table");
+    }
+    if (!(fp_rate > 0 && fp_rate < 1)) {
+        throw oxli_exception("false positive rate must be between 0 and 1");
+    }
 
-            tablesize = save_tablesize;
-            _tablesizes.push_back(tablesize);
+    // Slice i has n + i tables filled to at most f, so the slices' rates
+    // sum to at most f^n / (1 - f); with f <= 1/2 and f^n = fp_rate / 2
+    // that is at most fp_rate.
+    _max_fill = std::min(0.5, pow(fp_rate / 2, 1.0 / tablesizes.size()));
+    _add_slice(new BitStorage(tablesizes));
+}
 
-            tablebytes = tablesize / 8 + 1;
-            _counts[i] = new Byte[tablebytes];
+ScalableBitStorage::~ScalableBitStorage()
+{
+    _clear();
+}
 
-            unsigned long long loaded = 0;
-            while (loaded != tablebytes) {
-                infile.read((char *) _counts[i], tablebytes - loaded);
-                loaded += infile.gcount();
+void ScalableBitStorage::_clear()
+{
+    unsigned int n = _n_slices.load();
+    for (unsigned int i = 0; i < n; i++) {
+        delete _slices[i];
+        _slices[i] = NULL;
+    }
+    _n_slices.store(0);
+    _raw_tables.clear();
+}
+
+void ScalableBitStorage::_add_slice(BitStorage * slice)
+{
+    unsigned int n = _n_slices.load();
+    _slices[n] = slice;
+    _grow_at[n] = (uint64_t) (_max_fill * slice->_tablesizes[0]);
+    if (_grow_at[n] == 0) {
+        _grow_at[n] = 1;
+    }
+    _raw_tables.insert(_raw_tables.end(), slice->_counts,
+                       slice->_counts + slice->_n_tables);
+    _n_slices.store(n + 1, std::memory_order_release);
+}
+
+// Start a new slice, unless another thread already has since n_slices
+// were seen.
+void ScalableBitStorage::_grow(unsigned int n_slices)
+{
+    std::lock_guard<std::mutex> lock(_grow_lock);
+    if (_n_slices.load() != n_slices || n_slices == SCALABLE_MAX_SLICES) {
+        return;
+    }
+
+    const BitStorage * last = _slices[n_slices - 1];
+    std::vector<uint64_t> sizes = get_n_primes_near_x(
+                                      last->_n_tables + 1,
+                                      2 * last->_tablesizes[0]);
+    // growth may happen on any thread; keep to the policy of the graph
+    TableAllocScope scope(_alloc_policy);
+    _add_slice(new BitStorage(sizes));
+}
+
+std::vector<uint64_t> ScalableBitStorage::get_tablesizes() const
+{
+    std::vector<uint64_t> sizes;
+    unsigned int n = _n_slices.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < n; i++) {
+        sizes.insert(sizes.end(), _slices[i]->_tablesizes.begin(),
+                     _slices[i]->_tablesizes.end());
+    }
+    return sizes;
+}
+
+const size_t ScalableBitStorage::n_tables() const
+{
+    size_t n_tables = 0;
+    unsigned int n = _n_slices.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < n; i++) {
+        n_tables += _slices[i]->_n_tables;
+    }
+    return n_tables;
+}
+
+const uint64_t ScalableBitStorage::n_occupied() const
+{
+    uint64_t occupied = 0;
+    unsigned int n = _n_slices.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < n; i++) {
+        occupied += _slices[i]->n_occupied();
+    }
+    return occupied;
+}
+
+const uint64_t ScalableBitStorage::n_unique_kmers() const
+{
+    uint64_t n_kmers = 0;
+    unsigned int n = _n_slices.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < n; i++) {
+        n_kmers += _slices[i]->n_unique_kmers();
+    }
+    return n_kmers;
+}
+
+double ScalableBitStorage::estimated_fp_rate() const
+{
+    // a false positive is a hit in any slice
+    double all_negative = 1;
+    unsigned int n = _n_slices.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < n; i++) {
+        all_negative *= 1 - _slices[i]->estimated_fp_rate();
+    }
+    return 1 - all_negative;
+}
+
+void ScalableBitStorage::save(std::string outfilename, WordLength ksize)
+{
+    unsigned int save_ksize = ksize;
+    unsigned char save_n_slices = _n_slices.load();
+
+    ofstream outfile(outfilename.c_str(), ios::binary);
+
+    outfile.write(SAVED_SIGNATURE, 4);
+    unsigned char version = SAVED_FORMAT_VERSION;
+    outfile.write((const char *) &version, 1);
+
+    unsigned char ht_type = SAVED_SCALABLE_HASHBITS;
+    outfile.write((const char *) &ht_type, 1);
+
+    outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+    outfile.write((const char *) &_fp_rate, sizeof(_fp_rate));
+    outfile.write((const char *) &save_n_slices, sizeof(save_n_slices));
+
+    for (unsigned int i = 0; i < save_n_slices; i++) {
+        unsigned long long save_n_unique_kmers = _slices[i]->_n_unique_kmers;
+        outfile.write((const char *) &save_n_unique_kmers,
+                      sizeof(save_n_unique_kmers));
+        _slices[i]->_save_tables(outfile);
+    }
+
+    if (outfile.fail()) {
+        throw oxli_file_exception(strerror(errno));
+    }
+    outfile.close();
+}
+
+void ScalableBitStorage::load(std::string infilename, WordLength &ksize)
+{
+    ifstream infile;
+
+    // configure ifstream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
+    try {
+        infile.open(infilename.c_str(), ios::binary);
+    } catch (std::ifstream::failure &e) {
+        std::string err;
+        if (!infile.is_open()) {
+            err = "Cannot open k-mer graph file: " + infilename;
+        } else {
+            err = "Unknown error in opening file: " + infilename;
+        }
+        throw oxli_file_exception(err);
+    } catch (const std::exception &e) {
+        std::string err = "Unknown error opening file: " + infilename + " "
+                          + strerror(errno);
+        throw oxli_file_exception(err);
+    }
+
+    load(infile, infilename, ksize);
+}
+
+void ScalableBitStorage::load(std::istream &infile,
+                              const std::string &infilename,
+                              WordLength &ksize)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
+    try {
+        unsigned int save_ksize = 0;
+        unsigned char save_n_slices = 0;
+        double save_fp_rate = 0;
+        char signature[4];
+        unsigned char version, ht_type;
+
+        infile.read(signature, 4);
+        infile.read((char *) &version, 1);
+        infile.read((char *) &ht_type, 1);
+        if (!(std::string(signature, 4) == SAVED_SIGNATURE)) {
+            std::ostringstream err;
+            err << "Does not start with signature for a oxli file: 0x";
+            for(size_t i=0; i < 4; ++i) {
+                err << std::hex << (int) signature[i];
             }
+            err << " Should be: " << SAVED_SIGNATURE;
+            throw oxli_file_exception(err.str());
+        } else if (!(version == SAVED_FORMAT_VERSION)) {
+            std::ostringstream err;
+            err << "Incorrect file format version " << (int) version
+                << " while reading k-mer graph from " << infilename
+                << "; should be " << (int) SAVED_FORMAT_VERSION;
+            throw oxli_file_exception(err.str());
+        } else if (!(ht_type == SAVED_SCALABLE_HASHBITS)) {
+            std::ostringstream err;
+            err << "Incorrect file format type " << (int) ht_type
+                << " while reading k-mer graph from " << infilename;
+            throw oxli_file_exception(err.str());
+        }
+
+        infile.read((char *) &save_ksize, sizeof(save_ksize));
+        infile.read((char *) &save_fp_rate, sizeof(save_fp_rate));
+        infile.read((char *) &save_n_slices, sizeof(save_n_slices));
+        if (save_n_slices == 0 || save_n_slices > SCALABLE_MAX_SLICES
+                || !(save_fp_rate > 0 && save_fp_rate < 1)) {
+            throw oxli_file_exception("Corrupt scalable k-mer graph file: "
+                                      + infilename);
+        }
+
+        std::vector<BitStorage *> slices;
+        TableAllocScope scope(_alloc_policy);
+        try {
+            for (unsigned int i = 0; i < save_n_slices; i++) {
+                std::vector<uint64_t> no_tables;
+                slices.push_back(new BitStorage(no_tables));
+
+                unsigned long long save_n_unique_kmers = 0;
+                infile.read((char *) &save_n_unique_kmers,
+                            sizeof(save_n_unique_kmers));
+                slices.back()->_n_unique_kmers = save_n_unique_kmers;
+                slices.back()->_load_tables(infile);
+                if (!slices.back()->_n_tables) {
+                    throw oxli_file_exception("Corrupt scalable k-mer graph "
+                                              "file: " + infilename);
+                }
+            }
+        } catch (...) {
+            for (auto slice : slices) {
+                delete slice;
+            }
+            throw;
+        }
+
+        ksize = (WordLength) save_ksize;
+        _clear();
+        _fp_rate = save_fp_rate;
+        _max_fill = std::min(0.5, pow(_fp_rate / 2,
+                                      1.0 / slices[0]->_n_tables));
+        for (auto slice : slices) {
+            _add_slice(slice);
         }
-        infile.close();
     } catch (std::ifstream::failure &e) {
         std::string err;
         if (infile.eof()) {
@@ -243,9 +864,9 @@ void BitStorage::load(std::string infilename, WordLength &ksize)
             err = "Error reading from k-mer graph file: " + infilename;
         }
         throw oxli_file_exception(err);
+    } catch (oxli_file_exception &e) {
+        throw;
     } catch (const std::exception &e) {
-        // Catching std::exception is a stopgap for
-        // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=66145
         std::string err = "Unknown error opening file: " + infilename + " "
                           + strerror(errno);
         throw oxli_file_exception(err);
@@ -295,9 +916,22 @@ ByteStorageFileReader::ByteStorageFileReader(
         throw oxli_file_exception(err);
     }
 
+    ByteStorageFileReader(infile, infilename, ksize, store);
+}
+
+ByteStorageFileReader::ByteStorageFileReader(
+    std::istream &infile,
+    const std::string &infilename,
+    WordLength& ksize,
+    ByteStorage &store)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
     if (store._counts) {
         for (unsigned int i = 0; i < store._n_tables; i++) {
-            delete[] store._counts[i];
+            TableAllocator::release(store._counts[i]);
             store._counts[i] = NULL;
         }
         delete[] store._counts;
@@ -311,7 +945,7 @@ ByteStorageFileReader::ByteStorageFileReader(
         unsigned long long save_tablesize = 0;
         unsigned long long save_occupied_bins = 0;
         char signature [4];
-        unsigned char version = 0, ht_type = 0, use_bigcount = 0;
+        unsigned char version = 0, ht_type = 0, flags = 0;
 
         infile.read(signature, 4);
         infile.read((char *) &version, 1);
@@ -324,12 +958,9 @@ ByteStorageFileReader::ByteStorageFileReader(
             }
             err << " Should be: " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
-            std::ostringstream err;
-            err << "Incorrect file format version " << (int) version
-                << " while reading k-mer count file from " << infilename
-                << "; should be " << (int) SAVED_FORMAT_VERSION;
-            throw oxli_file_exception(err.str());
+        } else if (!counting_version_ok(version)) {
+            throw oxli_file_exception(counting_version_error(version,
+                                      infilename));
         } else if (!(ht_type == SAVED_COUNTING_HT)) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
@@ -337,7 +968,10 @@ ByteStorageFileReader::ByteStorageFileReader(
             throw oxli_file_exception(err.str());
         }
 
-        infile.read((char *) &use_bigcount, 1);
+        infile.read((char *) &flags, 1);
+        if (version == SAVED_FORMAT_VERSION) {
+            flags &= SAVED_FLAG_BIGCOUNT;
+        }
         infile.read((char *) &save_ksize, sizeof(save_ksize));
         infile.read((char *) &save_n_tables, sizeof(save_n_tables));
         infile.read((char *) &save_occupied_bins, sizeof(save_occupied_bins));
@@ -346,7 +980,8 @@ ByteStorageFileReader::ByteStorageFileReader(
         store._n_tables = (unsigned int) save_n_tables;
         store._occupied_bins = save_occupied_bins;
 
-        store._use_bigcount = use_bigcount;
+        store._use_bigcount = flags & SAVED_FLAG_BIGCOUNT;
+        store._conservative = flags & SAVED_FLAG_CONSERVATIVE;
 
         store._counts = new Byte*[store._n_tables];
         for (unsigned int i = 0; i < store._n_tables; i++) {
@@ -361,7 +996,8 @@ ByteStorageFileReader::ByteStorageFileReader(
             tablesize = save_tablesize;
             store._tablesizes.push_back(tablesize);
 
-            store._counts[i] = new Byte[tablesize];
+            store._counts[i] = TableAllocator::allocate(tablesize,
+                                                        store._alloc_policy);
 
             unsigned long long loaded = 0;
             while (loaded != tablesize) {
@@ -385,8 +1021,6 @@ ByteStorageFileReader::ByteStorageFileReader(
                 store._bigcounts[kmer] = count;
             }
         }
-
-        infile.close();
     } catch (std::ifstream::failure &e) {
         std::string err;
         if (infile.eof()) {
@@ -416,7 +1050,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
 
     if (store._counts) {
         for (unsigned int i = 0; i < store._n_tables; i++) {
-            delete[] store._counts[i];
+            TableAllocator::release(store._counts[i]);
             store._counts[i] = NULL;
         }
         delete[] store._counts;
@@ -429,7 +1063,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
     unsigned long long save_tablesize = 0;
     unsigned long long save_occupied_bins = 0;
     char signature [4];
-    unsigned char version, ht_type, use_bigcount;
+    unsigned char version, ht_type, flags;
 
     int read_s = gzread(infile, signature, 4);
     int read_v = gzread(infile, (char *) &version, 1);
@@ -445,15 +1079,12 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
             "file: " << signature << " Should be: " <<
             SAVED_SIGNATURE;
         throw oxli_file_exception(err.str());
-    } else if (!(version == SAVED_FORMAT_VERSION)
+    } else if (!counting_version_ok(version)
                || !(ht_type == SAVED_COUNTING_HT)) {
-        if (!(version == SAVED_FORMAT_VERSION)) {
-            std::ostringstream err;
-            err << "Incorrect file format version " << (int) version
-                << " while reading k-mer count file from " << infilename
-                << "; should be " << (int) SAVED_FORMAT_VERSION;
+        if (!counting_version_ok(version)) {
             gzclose(infile);
-            throw oxli_file_exception(err.str());
+            throw oxli_file_exception(counting_version_error(version,
+                                      infilename));
         } else if (!(ht_type == SAVED_COUNTING_HT)) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
@@ -463,7 +1094,7 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
         }
     }
 
-    int read_b = gzread(infile, (char *) &use_bigcount, 1);
+    int read_b = gzread(infile, (char *) &flags, 1);
     int read_k = gzread(infile, (char *) &save_ksize, sizeof(save_ksize));
     int read_nt = gzread(infile, (char *) &save_n_tables,
                          sizeof(save_n_tables));
@@ -481,7 +1112,11 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
     store._occupied_bins = save_occupied_bins;
     store._n_tables = (unsigned int) save_n_tables;
 
-    store._use_bigcount = use_bigcount;
+    if (version == SAVED_FORMAT_VERSION) {
+        flags &= SAVED_FLAG_BIGCOUNT;
+    }
+    store._use_bigcount = flags & SAVED_FLAG_BIGCOUNT;
+    store._conservative = flags & SAVED_FLAG_CONSERVATIVE;
 
     store._counts = new Byte*[store._n_tables];
     for (unsigned int i = 0; i < store._n_tables; i++) {
@@ -506,7 +1141,8 @@ ByteStorageGzFileReader::ByteStorageGzFileReader(
         tablesize = save_tablesize;
         store._tablesizes.push_back(tablesize);
 
-        store._counts[i] = new Byte[tablesize];
+        store._counts[i] = TableAllocator::allocate(tablesize,
+                                                    store._alloc_policy);
 
         uint64_t loaded = 0;
         while (loaded != tablesize) {
@@ -596,17 +1232,20 @@ ByteStorageFileWriter::ByteStorageFileWriter(
     ofstream outfile(outfilename.c_str(), ios::binary);
 
     outfile.write(SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COUNTING_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
     unsigned char ht_type = SAVED_COUNTING_HT;
     outfile.write((const char *) &ht_type, 1);
 
-    unsigned char use_bigcount = 0;
+    unsigned char flags = 0;
     if (store._use_bigcount) {
-        use_bigcount = 1;
+        flags |= SAVED_FLAG_BIGCOUNT;
     }
-    outfile.write((const char *) &use_bigcount, 1);
+    if (store._conservative) {
+        flags |= SAVED_FLAG_CONSERVATIVE;
+    }
+    outfile.write((const char *) &flags, 1);
 
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
     outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
@@ -663,17 +1302,20 @@ ByteStorageGzFileWriter::ByteStorageGzFileWriter(
     }
 
     gzwrite(outfile, SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COUNTING_FORMAT_VERSION;
     gzwrite(outfile, (const char *) &version, 1);
 
     unsigned char ht_type = SAVED_COUNTING_HT;
     gzwrite(outfile, (const char *) &ht_type, 1);
 
-    unsigned char use_bigcount = 0;
+    unsigned char flags = 0;
     if (store._use_bigcount) {
-        use_bigcount = 1;
+        flags |= SAVED_FLAG_BIGCOUNT;
     }
-    gzwrite(outfile, (const char *) &use_bigcount, 1);
+    if (store._conservative) {
+        flags |= SAVED_FLAG_CONSERVATIVE;
+    }
+    gzwrite(outfile, (const char *) &flags, 1);
 
     gzwrite(outfile, (const char *) &save_ksize, sizeof(save_ksize));
     gzwrite(outfile, (const char *) &save_n_tables, sizeof(save_n_tables));
@@ -758,6 +1400,15 @@ void ByteStorageFile::load(
     }
 }
 
+void ByteStorageFile::load(
+    std::istream &infile,
+    const std::string &infilename,
+    WordLength &ksize,
+    ByteStorage &store)
+{
+    ByteStorageFileReader(infile, infilename, ksize, store);
+}
+
 void ByteStorage::save(std::string outfilename, WordLength ksize)
 {
     ByteStorageFile::save(outfilename, ksize, *this);
@@ -768,6 +1419,280 @@ void ByteStorage::load(std::string infilename, WordLength& ksize)
     ByteStorageFile::load(infilename, ksize, *this);
 }
 
+void ByteStorage::load(std::istream& infile, const std::string& infilename,
+                       WordLength& ksize)
+{
+    ByteStorageFile::load(infile, infilename, ksize, *this);
+}
+
+namespace oxli
+{
+
+/**
+ * Saturating addition of another ByteStorage's tables into a store, fed a
+ * range of bins at a time so that the other tables can be streamed from
+ * disk (ByteStorageFile::merge) as well as taken from memory
+ * (ByteStorage::update_from).
+ *
+ * The bigcount maps come last in a saved file, so everything needed to
+ * sum the counts of k-mers in either map is gathered while the tables go
+ * by: the other side's count of each k-mer in the store's map, and the
+ * store's count in bins where the other side is saturated, since only
+ * those can belong to k-mers in the other map.
+ */
+class ByteStorageMerge
+{
+protected:
+    ByteStorage& _store;
+    unsigned int _n_threads;
+    bool _track_saturated;
+
+    std::vector<HashIntoType> _keys;
+    std::vector<BoundedCounterType> _other_counts;
+    std::vector<std::unordered_map<uint64_t, Byte> > _saturated;
+
+public:
+    ByteStorageMerge(ByteStorage& store, bool other_has_bigcounts,
+                     unsigned int n_threads)
+        : _store(store), _n_threads(merge_threads(n_threads)),
+          _track_saturated(other_has_bigcounts && store._use_bigcount),
+          _saturated(store._n_tables)
+    {
+        if (store._use_bigcount) {
+            for (auto& kv : store._bigcounts) {
+                _keys.push_back(kv.first);
+            }
+            _other_counts.assign(_keys.size(), store._max_count);
+        }
+    }
+
+    // Add the other side's bins [start, start + n) of table.
+    void add(unsigned int table, uint64_t start, const Byte * counts,
+             uint64_t n)
+    {
+        const uint64_t tablesize = _store._tablesizes[table];
+        for (size_t i = 0; i < _keys.size(); ++i) {
+            uint64_t bin = _keys[i] % tablesize;
+            if (bin >= start && bin - start < n) {
+                _other_counts[i] = std::min<BoundedCounterType>(
+                                       _other_counts[i], counts[bin - start]);
+            }
+        }
+
+        Byte * mine = _store._counts[table] + start;
+        const unsigned int max_count = _store._max_count;
+        const bool track = _track_saturated;
+        std::vector<std::vector<std::pair<uint64_t, Byte> > >
+        saturated(_n_threads);
+        uint64_t newly_occupied = 0;
+
+        #pragma omp parallel num_threads(_n_threads) \
+            reduction(+:newly_occupied) if(n >= MERGE_PARALLEL_MIN)
+        {
+#ifdef _OPENMP
+            unsigned int thread_id = omp_get_thread_num();
+#else
+            unsigned int thread_id = 0;
+#endif
+            #pragma omp for schedule(static)
+            for (uint64_t i = 0; i < n; i++) {
+                const Byte other = counts[i];
+                if (!other) {
+                    continue;
+                }
+                const Byte current = mine[i];
+                if (!current) {
+                    newly_occupied++;
+                }
+                if (track && other >= max_count) {
+                    saturated[thread_id].push_back(
+                        std::make_pair(start + i, current));
+                }
+                const unsigned int sum = current + other;
+                mine[i] = sum > max_count ? max_count : sum;
+            }
+        }
+
+        if (table == 0) {
+            _store._occupied_bins += newly_occupied;
+        }
+        for (auto& bins : saturated) {
+            _saturated[table].insert(bins.begin(), bins.end());
+        }
+    }
+
+    // Combine the bigcount maps once all tables have been added.
+    void finish(const KmerCountMap& other_bigcounts)
+    {
+        if (!_store._use_bigcount) {
+            return;
+        }
+        const unsigned int max_count = _store._max_count;
+        const unsigned int max_bigcount = _store._max_bigcount;
+
+        KmerCountMap merged;
+        for (size_t i = 0; i < _keys.size(); ++i) {
+            unsigned int other = _other_counts[i];
+            if (other == max_count) {
+                auto it = other_bigcounts.find(_keys[i]);
+                if (it != other_bigcounts.end()) {
+                    other = it->second;
+                }
+            }
+            unsigned int sum = _store._bigcounts[_keys[i]] + other;
+            merged[_keys[i]] = std::min(sum, max_bigcount);
+        }
+
+        for (auto& kv : other_bigcounts) {
+            if (_store._bigcounts.count(kv.first)) {
+                continue;
+            }
+            unsigned int mine = max_count;
+            for (unsigned int t = 0; t < _store._n_tables; t++) {
+                uint64_t bin = kv.first % _store._tablesizes[t];
+                auto it = _saturated[t].find(bin);
+                unsigned int count = it == _saturated[t].end() ? 0
+                                     : it->second;
+                mine = std::min(mine, count);
+            }
+            unsigned int sum = mine + kv.second;
+            merged[kv.first] = std::min(sum, max_bigcount);
+        }
+
+        for (auto& kv : merged) {
+            _store._bigcounts[kv.first] = kv.second;
+        }
+    }
+};
+
+} // namespace oxli
+
+void ByteStorage::update_from(const ByteStorage& other,
+                              unsigned int n_threads)
+{
+    if (_tablesizes != other._tablesizes) {
+        throw oxli_exception("both tables must have same table sizes");
+    }
+
+    ByteStorageMerge merge(*this, !other._bigcounts.empty(), n_threads);
+    for (unsigned int i = 0; i < _n_tables; i++) {
+        merge.add(i, 0, other._counts[i], _tablesizes[i]);
+    }
+    merge.finish(other._bigcounts);
+}
+
+void ByteStorageFile::merge(
+    const std::string   &infilename,
+    const WordLength ksize,
+    ByteStorage &store,
+    unsigned int n_threads)
+{
+    // zlib reads uncompressed files transparently
+    gzFile infile = gzopen(infilename.c_str(), "rb");
+    if (infile == Z_NULL) {
+        std::string err = "Cannot open k-mer count file: " + infilename;
+        throw oxli_file_exception(err);
+    }
+    std::unique_ptr<gzFile_s, int (*)(gzFile)> closer(infile, gzclose);
+
+    auto read_exactly = [&](void * buf, uint64_t n) {
+        char * p = (char *) buf;
+        while (n) {
+            unsigned int to_read = n > INT_MAX ? INT_MAX : (unsigned int) n;
+            int read_b = gzread(infile, p, to_read);
+            if (read_b <= 0) {
+                std::string err;
+                if (read_b == 0) {
+                    err = "Unexpected end of k-mer count file: " + infilename;
+                } else {
+                    err = "K-mer count file read error: " + infilename + " "
+                          + gzerror(infile, &read_b);
+                }
+                throw oxli_file_exception(err);
+            }
+            p += read_b;
+            n -= read_b;
+        }
+    };
+
+    char signature[4];
+    unsigned char version = 0, ht_type = 0, flags = 0;
+    unsigned int save_ksize = 0;
+    unsigned char save_n_tables = 0;
+    unsigned long long save_occupied_bins = 0;
+
+    read_exactly(signature, 4);
+    read_exactly(&version, 1);
+    read_exactly(&ht_type, 1);
+    if (!(std::string(signature, 4) == SAVED_SIGNATURE)) {
+        std::ostringstream err;
+        err << "Does not start with signature for a oxli file: 0x";
+        for(size_t i=0; i < 4; ++i) {
+            err << std::hex << (int) signature[i];
+        }
+        err << " Should be: " << SAVED_SIGNATURE;
+        throw oxli_file_exception(err.str());
+    } else if (!counting_version_ok(version)) {
+        throw oxli_file_exception(counting_version_error(version, infilename));
+    } else if (!(ht_type == SAVED_COUNTING_HT)) {
+        std::ostringstream err;
+        err << "Incorrect file format type " << (int) ht_type
+            << " while reading k-mer count file from " << infilename;
+        throw oxli_file_exception(err.str());
+    }
+
+    read_exactly(&flags, 1);
+    read_exactly(&save_ksize, sizeof(save_ksize));
+    read_exactly(&save_n_tables, sizeof(save_n_tables));
+    read_exactly(&save_occupied_bins, sizeof(save_occupied_bins));
+
+    if (save_ksize != ksize) {
+        std::ostringstream err;
+        err << "Incorrect k-mer size " << save_ksize
+            << " while merging k-mer count file " << infilename;
+        throw oxli_file_exception(err.str());
+    }
+    if (save_n_tables != store._n_tables) {
+        throw oxli_file_exception("both tables must have same number of "
+                                  "tables: " + infilename);
+    }
+
+    ByteStorageMerge merge(store, flags & SAVED_FLAG_BIGCOUNT,
+                           n_threads);
+    std::vector<Byte> buf;
+    for (unsigned int i = 0; i < store._n_tables; i++) {
+        unsigned long long save_tablesize = 0;
+        read_exactly(&save_tablesize, sizeof(save_tablesize));
+        if (save_tablesize != store._tablesizes[i]) {
+            throw oxli_file_exception("both tables must have same table "
+                                      "sizes: " + infilename);
+        }
+
+        for (uint64_t start = 0; start < save_tablesize;
+                start += MERGE_CHUNK_SIZE) {
+            uint64_t n = std::min<uint64_t>(MERGE_CHUNK_SIZE,
+                                            save_tablesize - start);
+            buf.resize(n);
+            read_exactly(buf.data(), n);
+            merge.add(i, start, buf.data(), n);
+        }
+    }
+
+    uint64_t n_counts = 0;
+    read_exactly(&n_counts, sizeof(n_counts));
+
+    KmerCountMap other_bigcounts;
+    for (uint64_t n = 0; n < n_counts; n++) {
+        HashIntoType kmer;
+        BoundedCounterType count;
+        read_exactly(&kmer, sizeof(kmer));
+        read_exactly(&count, sizeof(count));
+        other_bigcounts[kmer] = count;
+    }
+
+    merge.finish(other_bigcounts);
+}
+
 
 void NibbleStorage::save(std::string outfilename, WordLength ksize)
 {
@@ -783,12 +1708,18 @@ void NibbleStorage::save(std::string outfilename, WordLength ksize)
     ofstream outfile(outfilename.c_str(), ios::binary);
 
     outfile.write(SAVED_SIGNATURE, 4);
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COUNTING_FORMAT_VERSION;
     outfile.write((const char *) &version, 1);
 
     unsigned char ht_type = SAVED_SMALLCOUNT;
     outfile.write((const char *) &ht_type, 1);
 
+    unsigned char flags = 0;
+    if (_conservative) {
+        flags |= SAVED_FLAG_CONSERVATIVE;
+    }
+    outfile.write((const char *) &flags, 1);
+
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
     outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
     outfile.write((const char *) &save_occupied_bins,
@@ -802,6 +1733,44 @@ void NibbleStorage::save(std::string outfilename, WordLength ksize)
     }
 }
 
+void NibbleStorage::update_from(const NibbleStorage& other,
+                                unsigned int n_threads)
+{
+    if (_tablesizes != other._tablesizes) {
+        throw oxli_exception("both tables must have same table sizes");
+    }
+    n_threads = merge_threads(n_threads);
+
+    uint64_t newly_occupied = 0;
+    for (unsigned int table_num = 0; table_num < _n_tables; table_num++) {
+        Byte * me = _counts[table_num];
+        const Byte * ot = other._counts[table_num];
+        const uint64_t tablebytes = _tablesizes[table_num] / 2 + 1;
+
+        #pragma omp parallel for num_threads(n_threads) schedule(static) \
+            reduction(+:newly_occupied) if(tablebytes >= MERGE_PARALLEL_MIN)
+        for (uint64_t index = 0; index < tablebytes; index++) {
+            const Byte other_byte = ot[index];
+            if (!other_byte) {
+                continue;
+            }
+            const Byte my_byte = me[index];
+
+            // two counters per byte, added separately
+            unsigned int hi = (my_byte >> 4) + (other_byte >> 4);
+            unsigned int lo = (my_byte & 15) + (other_byte & 15);
+            if (table_num == 0) {
+                newly_occupied += (!(my_byte >> 4) && (other_byte >> 4)) +
+                                  (!(my_byte & 15) && (other_byte & 15));
+            }
+            hi = std::min<unsigned int>(hi, _max_count);
+            lo = std::min<unsigned int>(lo, _max_count);
+            me[index] = (Byte) ((hi << 4) | lo);
+        }
+    }
+    _occupied_bins += newly_occupied;
+}
+
 void NibbleStorage::load(std::string infilename, WordLength& ksize)
 {
     ifstream infile;
@@ -825,9 +1794,19 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
         throw oxli_file_exception(err);
     }
 
+    load(infile, infilename, ksize);
+}
+
+void NibbleStorage::load(std::istream& infile, const std::string& infilename,
+                         WordLength& ksize)
+{
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit |
+                      std::ifstream::eofbit);
+
     if (_counts) {
         for (unsigned int i = 0; i < _n_tables; i++) {
-            delete[] _counts[i];
+            TableAllocator::release(_counts[i]);
             _counts[i] = NULL;
         }
         delete[] _counts;
@@ -841,7 +1820,7 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
         unsigned long long save_tablesize = 0;
         unsigned long long save_occupied_bins = 0;
         char signature [4];
-        unsigned char version = 0, ht_type = 0;
+        unsigned char version = 0, ht_type = 0, flags = 0;
 
         infile.read(signature, 4);
         infile.read((char *) &version, 1);
@@ -854,12 +1833,9 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
             }
             err << " Should be: " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
-            std::ostringstream err;
-            err << "Incorrect file format version " << (int) version
-                << " while reading k-mer count file from " << infilename
-                << "; should be " << (int) SAVED_FORMAT_VERSION;
-            throw oxli_file_exception(err.str());
+        } else if (!counting_version_ok(version)) {
+            throw oxli_file_exception(counting_version_error(version,
+                                      infilename));
         } else if (!(ht_type == SAVED_SMALLCOUNT)) {
             std::ostringstream err;
             err << "Incorrect file format type " << (int) ht_type
@@ -867,11 +1843,15 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
             throw oxli_file_exception(err.str());
         }
 
+        if (version == SAVED_COUNTING_FORMAT_VERSION) {
+            infile.read((char *) &flags, 1);
+        }
         infile.read((char *) &save_ksize, sizeof(save_ksize));
         infile.read((char *) &save_n_tables, sizeof(save_n_tables));
         infile.read((char *) &save_occupied_bins, sizeof(save_occupied_bins));
 
         ksize = (WordLength) save_ksize;
+        _conservative = flags & SAVED_FLAG_CONSERVATIVE;
         _n_tables = (unsigned int) save_n_tables;
         _occupied_bins = save_occupied_bins;
 
@@ -890,7 +1870,7 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
             tablesize = save_tablesize;
             _tablesizes.push_back(tablesize);
 
-            _counts[i] = new Byte[tablebytes];
+            _counts[i] = TableAllocator::allocate(tablebytes, _alloc_policy);
 
             unsigned long long loaded = 0;
             while (loaded != tablebytes) {
@@ -898,7 +1878,6 @@ void NibbleStorage::load(std::string infilename, WordLength& ksize)
                 loaded += infile.gcount();
             }
         }
-        infile.close();
     } catch (std::ifstream::failure &e) {
         std::string err;
         if (infile.eof()) {
@@ -955,6 +1934,27 @@ void QFStorage::save(std::string outfilename, WordLength ksize)
 }
 
 
+void QFStorage::update_from(const QFStorage& other)
+{
+    if (cf.nslots != other.cf.nslots || cf.range != other.cf.range) {
+        throw oxli_exception("both tables must have same size");
+    }
+
+    // the CQF iterator does not handle an empty filter
+    if (other.cf.noccupied_slots == 0) {
+        return;
+    }
+
+    std::lock_guard<RWSpinLock> g(_lock);
+    QFi it;
+    qf_iterator(&other.cf, &it, 0);
+    do {
+        uint64_t key, value, count;
+        qfi_get(&it, &key, &value, &count);
+        qf_insert(&cf, key, value, count);
+    } while (!qfi_next(&it));
+}
+
 void QFStorage::load(std::string infilename, WordLength &ksize)
 {
     ifstream infile;
@@ -38,18 +38,27 @@ Contact: khmer-project@idyll.org
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <sstream> // IWYU pragma: keep
 #include <map>
 #include <set>
 #include <utility>
+#include <vector>
 
+#include "oxli/batch_pipeline.hh"
 #include "oxli/hashgraph.hh"
 #include "oxli/oxli_exception.hh"
 #include "oxli/read_parsers.hh"
+#include "oxli/sorted_hashes.hh"
 #include "oxli/subset.hh"
 #include "oxli/traversal.hh"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #define IO_BUF_SIZE 250*1000*1000
 #define BIG_TRAVERSALS_ARE 200
 
@@ -112,54 +121,26 @@ void SubsetPartition::count_partitions(
 }
 
 
-size_t SubsetPartition::output_partitioned_file(
-    const std::string	&infilename,
-    const std::string	&outputfile,
+// annotate_partitions: find the partition of each read in the batch, from
+//    the first tag it contains, and format the reads to keep into
+//    batch.output. Only reads partition_map.
+
+uint64_t SubsetPartition::_annotate_partitions(
+    ReadBatch&		batch,
     bool		output_unassigned,
-    CallbackFn		callback,
-    void *		callback_data)
+    PartitionSet&	partitions,
+    size_t&		n_singletons) const
 {
-    auto parser = read_parsers::get_parser<FastxReader>(infilename);
-    ofstream outfile(outputfile.c_str());
-
-    unsigned int total_reads = 0;
-    unsigned int reads_kept = 0;
-    size_t n_singletons = 0;
-
-    PartitionSet partitions;
-
-    Read read;
-    string seq;
-
-    HashIntoType kmer = 0;
-
-    const unsigned int ksize = _ht->ksize();
-
-    //
-    // go through all the reads, and take those with assigned partitions
-    // and output them.
-    //
-
-    while(!parser->is_complete()) {
-        try {
-            read = parser->get_next_read();
-        } catch (NoMoreReadsAvailable &exc) {
-            break;
-        }
+    uint64_t n_kept = 0;
 
+    for (auto& read : batch.reads) {
         read.set_clean_seq();
-        seq = read.cleaned_seq;
 
-        bool found_tag = false;
+        // the first tag found decides the partition; one hash lookup each.
+        PartitionMap::const_iterator tag = partition_map.end();
         KmerHashIteratorPtr kmers = _ht->new_kmer_iterator(read.cleaned_seq);
-        while (!kmers->done()) {
-            kmer = kmers->next();
-
-            // is this a known tag?
-            if (set_contains(partition_map, kmer)) {
-                found_tag = true;
-                break;
-            }
+        while (!kmers->done() && tag == partition_map.end()) {
+            tag = partition_map.find(kmers->next());
         }
 
         // all sequences should have at least one tag in them.
@@ -167,44 +148,133 @@ size_t SubsetPartition::output_partitioned_file(
         // to disable.
 
         PartitionID partition_id = 0;
-        if (found_tag) {
-            PartitionID * partition_p = partition_map[kmer];
-            if (partition_p == NULL ) {
-                partition_id = 0;
+        if (tag != partition_map.end()) {
+            if (tag->second == NULL) {
                 n_singletons++;
             } else {
-                partition_id = *partition_p;
+                partition_id = *(tag->second);
                 partitions.insert(partition_id);
             }
         }
 
         if (partition_id > 0 || output_unassigned) {
-            if (read.quality.length()) { // FASTQ
-                outfile << "@" << read.name << "\t" << partition_id
-                        << "\n";
-                outfile << seq << "\n+\n";
-                outfile << read.quality << "\n";
-            } else {		// FASTA
-                outfile << ">" << read.name << "\t" << partition_id;
-                outfile << "\n" << seq << "\n";
+            bool fastq = read.quality.length() != 0;
+            batch.output += fastq ? '@' : '>';
+            batch.output += read.name;
+            batch.output += '\t';
+            batch.output += std::to_string(partition_id);
+            batch.output += '\n';
+            batch.output += read.cleaned_seq;
+            if (fastq) {
+                batch.output += "\n+\n";
+                batch.output += read.quality;
             }
+            batch.output += '\n';
+            n_kept++;
         }
+    }
 
-        total_reads++;
+    return n_kept;
+}
 
-        // run callback, if specified
-        if (total_reads % CALLBACK_PERIOD == 0 && callback) {
+size_t SubsetPartition::output_partitioned_file(
+    const std::string	&infilename,
+    const std::string	&outputfile,
+    bool		output_unassigned,
+    CallbackFn		callback,
+    void *		callback_data,
+    unsigned int	n_threads)
+{
+    auto parser = read_parsers::get_parser<FastxReader>(infilename);
+    FastxWriter outfile(outputfile);
+
+    ReadBatchPipeline<FastxReader> pipeline(parser, n_threads);
+    std::vector<PartitionSet> partitions(pipeline.n_threads());
+    std::vector<size_t> n_singletons(pipeline.n_threads(), 0);
+
+    //
+    // go through all the reads, and take those with assigned partitions
+    // and output them. partition_map is only read from here on, so any
+    // number of workers can annotate at once.
+    //
+
+    auto annotate = [&](ReadBatch& batch, unsigned int t) -> uint64_t {
+        return _annotate_partitions(batch, output_unassigned, partitions[t],
+                                    n_singletons[t]);
+    };
+
+    unsigned int total_reads = 0;
+    unsigned int reads_kept = 0;
+    auto write = [&](ReadBatch& batch) {
+        outfile.write(batch.output);
+
+        // run callback, if specified; once per CALLBACK_PERIOD reads.
+        unsigned int last_total = total_reads;
+        total_reads += batch.reads.size();
+        reads_kept = pipeline.n_consumed();
+        if (callback && total_reads / CALLBACK_PERIOD
+                != last_total / CALLBACK_PERIOD) {
+            callback("output_partitions", callback_data,
+                     total_reads, reads_kept);
+        }
+    };
+
+    pipeline.run_in_order(annotate, write);
+    outfile.close();
+
+    size_t n = 0;
+    for (unsigned int t = 0; t < pipeline.n_threads(); ++t) {
+        if (t > 0) {
+            partitions[0].insert(partitions[t].begin(), partitions[t].end());
+        }
+        n += n_singletons[t];
+    }
+    return partitions[0].size() + n;
+}
+
+void SubsetPartition::output_partitioned_files(
+    const std::vector<std::string>	&infilenames,
+    const std::vector<std::string>	&outputfilenames,
+    std::vector<size_t>&	n_partitions,
+    bool		output_unassigned,
+    unsigned int	n_threads)
+{
+    if (infilenames.size() != outputfilenames.size()) {
+        throw InvalidValue("need one output filename per input file");
+    }
+    n_partitions.assign(infilenames.size(), 0);
+
+    // With at least as many files as threads, give each file its own
+    // thread; otherwise go file by file with all threads on each.
+    if (n_threads > 1 && infilenames.size() >= n_threads) {
+        std::exception_ptr error;
+
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+        for (size_t i = 0; i < infilenames.size(); ++i) {
             try {
-                callback("output_partitions", callback_data,
-                         total_reads, reads_kept);
+                n_partitions[i] = output_partitioned_file(
+                                      infilenames[i], outputfilenames[i],
+                                      output_unassigned, 0, 0, 1);
             } catch (...) {
-                outfile.close();
-                throw;
+                #pragma omp critical(output_partitioned_files_error)
+                {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
             }
         }
-    }
 
-    return partitions.size() + n_singletons;
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        for (size_t i = 0; i < infilenames.size(); ++i) {
+            n_partitions[i] = output_partitioned_file(
+                                  infilenames[i], outputfilenames[i],
+                                  output_unassigned, 0, 0, n_threads);
+        }
+    }
 }
 
 // find_all_tags: the core of the partitioning code.  finds all tagged k-mers
@@ -884,7 +954,6 @@ void SubsetPartition::_merge_other(
 void SubsetPartition::merge_from_disk(string other_filename)
 {
     ifstream infile;
-    unsigned long long expected_pmap_size;
 
     // configure ifstream to raise exceptions for everything.
     infile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -906,15 +975,17 @@ void SubsetPartition::merge_from_disk(string other_filename)
                           + strerror(errno);
         throw oxli_file_exception(err);
     }
-    infile.seekg(0, infile.end);
-    const int length = infile.tellg();
-    infile.seekg(0, infile.beg);
-    if (length == 18) {
-        std::string err;
-        err = other_filename + " contains only a header and no partition IDs.";
-        throw oxli_file_exception(err);
-    }
 
+    merge_from_disk(infile, other_filename);
+}
+
+void SubsetPartition::merge_from_disk(std::istream& infile,
+                                      const std::string& other_filename)
+{
+    unsigned long long expected_pmap_size;
+
+    // configure the stream to raise exceptions for everything.
+    infile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
     try {
         unsigned int save_ksize = 0;
@@ -933,10 +1004,13 @@ void SubsetPartition::merge_from_disk(string other_filename)
             err << " while reading subset pmap from " << other_filename
                 << " Should be: " << SAVED_SIGNATURE;
             throw oxli_file_exception(err.str());
-        } else if (!(version == SAVED_FORMAT_VERSION)) {
+        } else if (!(version == SAVED_FORMAT_VERSION ||
+                     version == SAVED_COMPACT_FORMAT_VERSION)) {
             std::ostringstream err;
             err << "Incorrect file format version " << (int) version
-                << " while reading subset pmap from " << other_filename;
+                << " while reading subset pmap from " << other_filename
+                << "; should be " << (int) SAVED_FORMAT_VERSION
+                << " or " << (int) SAVED_COMPACT_FORMAT_VERSION;
             throw oxli_file_exception(err.str());
         } else if (!(ht_type == SAVED_SUBSET)) {
             std::ostringstream err;
@@ -953,7 +1027,16 @@ void SubsetPartition::merge_from_disk(string other_filename)
             throw oxli_file_exception(err.str());
         }
 
+        if (version == SAVED_COMPACT_FORMAT_VERSION) {
+            _merge_compact_pmap(infile, other_filename);
+            return;
+        }
+
         infile.read((char *) &expected_pmap_size, sizeof(expected_pmap_size));
+        if (infile.peek() == EOF) {
+            throw oxli_file_exception(other_filename + " contains only a "
+                                      "header and no partition IDs.");
+        }
     } catch (std::ifstream::failure &e) {
         std::string err;
         err = "Unknown error reading header info from: " + other_filename;
@@ -1031,13 +1114,45 @@ void SubsetPartition::merge_from_disk(string other_filename)
     }
 }
 
+// Merge the body of a compact (sorted, delta-encoded) partition map;
+// the header has already been checked by merge_from_disk().
+
+void SubsetPartition::_merge_compact_pmap(std::istream& infile,
+        const std::string& other_filename)
+{
+    std::vector<HashIntoType> tags;
+    std::vector<uint64_t> partitions;
+    read_sorted_hashes(infile, tags, partitions);
+
+    if (tags.empty()) {
+        throw oxli_file_exception(other_filename +
+                                  " contains only a header and no partition IDs.");
+    }
+    if (partitions.size() != tags.size()) {
+        throw oxli_file_exception("error loading partitionmap - "
+                                  "missing partition IDs");
+    }
+
+    partition_map.reserve(partition_map.size() + tags.size());
+
+    PartitionPtrMap diskp_to_pp;
+    for (size_t i = 0; i < tags.size(); ++i) {
+        PartitionID diskp = (PartitionID) partitions[i];
+        if (diskp == 0 || diskp != partitions[i]) {
+            throw oxli_file_exception("error loading partitionmap - "
+                                      "invalid partition ID");
+        }
+        _merge_other(tags[i], diskp, diskp_to_pp);
+    }
+}
+
 // Save a partition map to disk.
 
 void SubsetPartition::save_partitionmap(string pmap_filename)
 {
     ofstream outfile(pmap_filename.c_str(), ios::binary);
 
-    unsigned char version = SAVED_FORMAT_VERSION;
+    unsigned char version = SAVED_COMPACT_FORMAT_VERSION;
     outfile.write(SAVED_SIGNATURE, 4);
     outfile.write((const char *) &version, 1);
 
@@ -1047,53 +1162,33 @@ void SubsetPartition::save_partitionmap(string pmap_filename)
     unsigned int save_ksize = _ht->ksize();
     outfile.write((const char *) &save_ksize, sizeof(save_ksize));
 
-    unsigned long long pmap_size = partition_map.size();
-    outfile.write((const char *) &pmap_size, sizeof(pmap_size));
-
-    ///
+    // Save each tag that has been assigned a partition, with its
+    // partition ID, in tag order.
 
-    char * buf = NULL;
-    buf = new char[IO_BUF_SIZE];
-    unsigned int n_bytes = 0;
-
-    // For each tag in the partition map, save the tag and the associated
-    // partition ID.
-
-    PartitionMap::const_iterator pi = partition_map.begin();
-    for (; pi != partition_map.end(); ++pi) {
-        HashIntoType kmer = pi->first;
-        if (pi->second != NULL) {	// if a partition ID has been
-            /// assigned... save.
-            PartitionID p_id = *(pi->second);
-
-            // each record consists of one tag followed by one PartitionID.
-            HashIntoType * kmer_p = (HashIntoType *) (buf + n_bytes);
-            *kmer_p = kmer;
-            n_bytes += sizeof(HashIntoType);
-
-            PartitionID * pp = (PartitionID *) (buf + n_bytes);
-            *pp = p_id;
-            n_bytes += sizeof(PartitionID);
-
-            // flush to disk
-            if (n_bytes >= IO_BUF_SIZE - sizeof(HashIntoType) -
-                    sizeof(PartitionID)) {
-                outfile.write(buf, n_bytes);
-                n_bytes = 0;
-            }
+    std::vector<std::pair<HashIntoType, uint64_t> > records;
+    records.reserve(partition_map.size());
+    for (PartitionMap::const_iterator pi = partition_map.begin();
+            pi != partition_map.end(); ++pi) {
+        if (pi->second != NULL) {
+            records.push_back(std::make_pair(pi->first, *(pi->second)));
         }
     }
-    // save remainder.
-    if (n_bytes) {
-        outfile.write(buf, n_bytes);
+    std::sort(records.begin(), records.end());
+
+    std::vector<HashIntoType> tags(records.size());
+    std::vector<uint64_t> partitions(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        tags[i] = records[i].first;
+        partitions[i] = records[i].second;
     }
+    records.clear();
+
+    write_sorted_hashes(outfile, tags, partitions);
+
     if (outfile.fail()) {
-        delete[] buf;
         throw oxli_file_exception(strerror(errno));
     }
     outfile.close();
-
-    delete[] buf;
 }
 
 // Load a partition map from disk.
@@ -1391,6 +1486,145 @@ void SubsetPartition::repartition_a_partition(const SeenSet& partition_tags)
     }
 }
 
+void SubsetPartition::largest_partition_tags(SeenSet& partition_tags) const
+{
+    PartitionCountMap cm;
+    unsigned int n_unassigned = 0;
+    partition_sizes(cm, n_unassigned);
+
+    if (cm.empty()) {
+        throw oxli_exception("no partitions to find knots in");
+    }
+
+    // ties go to the highest PID, so that the choice is repeatable.
+    PartitionID biggest_p = 0;
+    unsigned long long biggest = 0;
+    for (PartitionCountMap::const_iterator cmi = cm.begin(); cmi != cm.end();
+            ++cmi) {
+        if (cmi->second > biggest ||
+                (cmi->second == biggest && cmi->first > biggest_p)) {
+            biggest = cmi->second;
+            biggest_p = cmi->first;
+        }
+    }
+
+    partition_tags.clear();
+    for (PartitionMap::const_iterator pi = partition_map.begin();
+            pi != partition_map.end(); ++pi) {
+        if (pi->second && *(pi->second) == biggest_p) {
+            partition_tags.insert(pi->first);
+        }
+    }
+}
+
+unsigned long long SubsetPartition::find_knots(
+    const SeenSet&	partition_tags,
+    unsigned int	distance,
+    unsigned int	threshold,
+    unsigned int	frequency,
+    Countgraph&		counting,
+    unsigned int	n_threads)
+{
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#else
+    n_threads = 1;
+#endif
+    if (n_threads == 0) {
+        n_threads = 1;
+    }
+
+    std::vector<HashIntoType> tags;
+    tags.reserve(partition_tags.size());
+    for (SeenSet::const_iterator si = partition_tags.begin();
+            si != partition_tags.end(); ++si) {
+        if (!set_contains(_ht->repart_small_tags, *si)) {
+            tags.push_back(*si);
+        }
+    }
+
+    // Within a round the stop tags and small tags are only read; each
+    // thread keeps what it finds and the sets are updated between rounds.
+    const size_t n_stop_tags = _ht->stop_tags.size();
+    std::vector<std::vector<HashIntoType> > new_stop_tags(n_threads);
+    std::vector<std::vector<HashIntoType> > new_small_tags(n_threads);
+    std::exception_ptr error;
+
+    for (size_t start = 0; start < tags.size(); start += KNOT_ROUND_SIZE) {
+        const size_t end = std::min(start + KNOT_ROUND_SIZE, tags.size());
+
+        #pragma omp parallel num_threads(n_threads)
+        {
+#ifdef _OPENMP
+            const unsigned int t = omp_get_thread_num();
+#else
+            const unsigned int t = 0;
+#endif
+            KmerSet keeper;
+
+            #pragma omp for schedule(dynamic, 1)
+            for (size_t i = start; i < end; ++i) {
+                try {
+                    keeper.clear();
+                    unsigned int count = _ht->traverse_from_kmer(
+                                             _ht->build_kmer(tags[i]),
+                                             distance, keeper);
+
+                    if (count >= threshold) {
+                        for (KmerSet::const_iterator ti = keeper.begin();
+                                ti != keeper.end(); ++ti) {
+                            if (counting.get_count(*ti) > frequency) {
+                                new_stop_tags[t].push_back((*ti).kmer_u);
+                            } else {
+                                counting.count(*ti);
+                            }
+                        }
+                    } else {
+                        new_small_tags[t].push_back(tags[i]);
+                    }
+                } catch (...) {
+                    #pragma omp critical(find_knots_error)
+                    {
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        for (unsigned int t = 0; t < n_threads; ++t) {
+            _ht->stop_tags.insert(new_stop_tags[t].begin(),
+                                  new_stop_tags[t].end());
+            _ht->repart_small_tags.insert(new_small_tags[t].begin(),
+                                          new_small_tags[t].end());
+            new_stop_tags[t].clear();
+            new_small_tags[t].clear();
+        }
+    }
+
+    return _ht->stop_tags.size() - n_stop_tags;
+}
+
+unsigned long long SubsetPartition::find_knots_in_largest_partition(
+    unsigned int	distance,
+    unsigned int	threshold,
+    unsigned int	frequency,
+    Countgraph&		counting,
+    unsigned int	n_threads)
+{
+    SeenSet bigtags;
+    largest_partition_tags(bigtags);
+    return find_knots(bigtags, distance, threshold, frequency, counting,
+                      n_threads);
+}
+
 // _clear_partition: given a partition ID, identifies all tags that belong
 //    to that partition & (a) clears their PID, and (b) adds them to
 //    the SeenSet partition_tags.  partition_tags is cleared first.
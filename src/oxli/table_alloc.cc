@@ -0,0 +1,323 @@
+/*
+This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+Copyright (C) 2016, The Regents of the University of California.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+    * Neither the name of the University of California nor the names
+      of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written
+      permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+LICENSE (END)
+
+Contact: khmer-project@idyll.org
+*/
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream> // IWYU pragma: keep
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "oxli/table_alloc.hh"
+
+using namespace oxli;
+
+namespace
+{
+
+// Tables smaller than a huge page are not worth a mapping of their own.
+const uint64_t HUGE_PAGE_SIZE = 2ULL << 20;
+const uint64_t HUGE_PAGE_1G_SIZE = 1ULL << 30;
+
+// Below this, zeroing on several threads costs more than it saves.
+const uint64_t PARALLEL_ZERO_MIN = 16ULL << 20;
+
+struct MappedTable {
+    uint64_t length;
+    TablePages pages;
+};
+
+std::mutex alloc_lock;
+TableAllocPolicy default_policy;
+std::unordered_map<const Byte *, MappedTable> mapped_tables;
+
+thread_local bool has_thread_policy = false;
+thread_local TableAllocPolicy thread_policy;
+
+uint64_t round_up(uint64_t n, uint64_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+// Zero a table in one contiguous block per thread, so that under first-touch
+// placement each thread's block lands on its own NUMA node.
+void zero_table(Byte * table, uint64_t nbytes, unsigned int n_threads)
+{
+#ifdef _OPENMP
+    if (n_threads == 0) {
+        n_threads = omp_get_max_threads();
+    }
+#else
+    n_threads = 1;
+#endif
+    if (n_threads <= 1 || nbytes < PARALLEL_ZERO_MIN) {
+        memset(table, 0, nbytes);
+        return;
+    }
+
+    uint64_t block = round_up((nbytes + n_threads - 1) / n_threads,
+                              HUGE_PAGE_SIZE);
+    #pragma omp parallel for num_threads(n_threads) schedule(static)
+    for (unsigned int i = 0; i < n_threads; i++) {
+        uint64_t begin = i * block;
+        if (begin < nbytes) {
+            memset(table + begin, 0, std::min(block, nbytes - begin));
+        }
+    }
+}
+
+#ifdef __linux__
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// from linux/mempolicy.h, which libc does not wrap
+#define OXLI_MPOL_INTERLEAVE 3
+
+// Bitmask of the online NUMA nodes, e.g. from "0-1,3"; empty if there is
+// only one node or the topology is unknown.
+std::vector<unsigned long> online_nodes()
+{
+    const unsigned int word_bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask;
+    unsigned int n_nodes = 0;
+
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!(online >> ranges)) {
+        return mask;
+    }
+
+    std::istringstream parts(ranges);
+    std::string part;
+    while (std::getline(parts, part, ',')) {
+        unsigned int first = 0, last = 0;
+        char dash = 0;
+        std::istringstream range(part);
+        if (!(range >> first)) {
+            return std::vector<unsigned long>();
+        }
+        last = first;
+        if (range >> dash) {
+            if (dash != '-' || !(range >> last) || last < first) {
+                return std::vector<unsigned long>();
+            }
+        }
+        for (unsigned int node = first; node <= last; node++) {
+            if (mask.size() <= node / word_bits) {
+                mask.resize(node / word_bits + 1, 0);
+            }
+            mask[node / word_bits] |= 1UL << (node % word_bits);
+            n_nodes++;
+        }
+    }
+
+    if (n_nodes < 2) {
+        mask.clear();
+    }
+    return mask;
+}
+
+// Best effort: a kernel or container that refuses the policy just leaves the
+// default placement in place.
+void interleave(Byte * table, uint64_t length)
+{
+    static const std::vector<unsigned long> nodes = online_nodes();
+    if (nodes.empty()) {
+        return;
+    }
+    // the kernel reads one bit less than maxnode
+    unsigned long maxnode = nodes.size() * 8 * sizeof(unsigned long) + 1;
+    syscall(SYS_mbind, table, length, OXLI_MPOL_INTERLEAVE, nodes.data(),
+            maxnode, 0);
+}
+
+Byte * map_table(uint64_t nbytes, TablePages pages, MappedTable& mapped)
+{
+    if (pages == TABLE_PAGES_HUGE_1G) {
+        uint64_t length = round_up(nbytes, HUGE_PAGE_1G_SIZE);
+        void * table = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                            MAP_HUGE_1GB, -1, 0);
+        if (table != MAP_FAILED) {
+            mapped.length = length;
+            mapped.pages = TABLE_PAGES_HUGE_1G;
+            return (Byte *) table;
+        }
+        // no 1 GB pages reserved
+        pages = TABLE_PAGES_HUGE;
+    }
+
+    // Map one huge page extra so the table can start on a huge page
+    // boundary, then unmap the slack on either side.
+    uint64_t length = round_up(nbytes, HUGE_PAGE_SIZE);
+    void * region = mmap(NULL, length + HUGE_PAGE_SIZE,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    uintptr_t start = (uintptr_t) region;
+    uintptr_t aligned = round_up(start, HUGE_PAGE_SIZE);
+    if (aligned > start) {
+        munmap(region, aligned - start);
+    }
+    uintptr_t end = start + length + HUGE_PAGE_SIZE;
+    if (end > aligned + length) {
+        munmap((void *) (aligned + length), end - (aligned + length));
+    }
+
+    Byte * table = (Byte *) aligned;
+#ifdef MADV_HUGEPAGE
+    if (pages == TABLE_PAGES_HUGE) {
+        madvise(table, length, MADV_HUGEPAGE);
+    }
+#endif
+    mapped.length = length;
+    mapped.pages = pages;
+    return table;
+}
+
+#endif // __linux__
+
+} // anonymous namespace
+
+TableAllocPolicy TableAllocator::get_default_policy()
+{
+    std::lock_guard<std::mutex> lock(alloc_lock);
+    return default_policy;
+}
+
+void TableAllocator::set_default_policy(const TableAllocPolicy& policy)
+{
+    std::lock_guard<std::mutex> lock(alloc_lock);
+    default_policy = policy;
+}
+
+TableAllocPolicy TableAllocator::current_policy()
+{
+    if (has_thread_policy) {
+        return thread_policy;
+    }
+    return get_default_policy();
+}
+
+Byte * TableAllocator::allocate(uint64_t nbytes,
+                                const TableAllocPolicy& policy)
+{
+#ifdef __linux__
+    bool use_mapping = policy.pages != TABLE_PAGES_DEFAULT ||
+                       policy.numa_interleave;
+    if (use_mapping && nbytes >= HUGE_PAGE_SIZE) {
+        MappedTable mapped;
+        Byte * table = map_table(nbytes, policy.pages, mapped);
+        if (policy.numa_interleave) {
+            interleave(table, mapped.length);
+        }
+        // The mapping reads as zeros already; writing them faults the pages
+        // in now, on the zeroing threads, rather than during counting.
+        zero_table(table, nbytes, policy.n_threads);
+
+        std::lock_guard<std::mutex> lock(alloc_lock);
+        mapped_tables[table] = mapped;
+        return table;
+    }
+#endif
+    Byte * table = new Byte[nbytes];
+    zero_table(table, nbytes, policy.n_threads);
+    return table;
+}
+
+void TableAllocator::release(Byte * table)
+{
+    if (table == NULL) {
+        return;
+    }
+#ifdef __linux__
+    {
+        std::lock_guard<std::mutex> lock(alloc_lock);
+        auto it = mapped_tables.find(table);
+        if (it != mapped_tables.end()) {
+            munmap(table, it->second.length);
+            mapped_tables.erase(it);
+            return;
+        }
+    }
+#endif
+    delete[] table;
+}
+
+TablePages TableAllocator::allocated_pages(const Byte * table)
+{
+    std::lock_guard<std::mutex> lock(alloc_lock);
+    auto it = mapped_tables.find(table);
+    if (it != mapped_tables.end()) {
+        return it->second.pages;
+    }
+    return TABLE_PAGES_DEFAULT;
+}
+
+TableAllocScope::TableAllocScope(const TableAllocPolicy& policy)
+    : _had_policy(has_thread_policy), _saved(thread_policy)
+{
+    has_thread_policy = true;
+    thread_policy = policy;
+}
+
+TableAllocScope::~TableAllocScope()
+{
+    has_thread_policy = _had_policy;
+    thread_policy = _saved;
+}
@@ -332,6 +332,34 @@ def test_median_too_short():
         pass
 
 
+def test_coverage_profile():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    hi = khmer.Countgraph(12, 1e6, 2)
+    hi.consume_seqfile(inpath)
+
+    records = [r for r in screed.open(inpath) if len(r.sequence) >= 12]
+    # small chunks take several passes over the same parser
+    for chunk_size in (100000, 1, 3):
+        profile = list(hi.coverage_profile(inpath, n_threads=4,
+                                           chunk_size=chunk_size))
+
+        assert len(profile) == len(records)
+        for (name, med, avg, dev, length), record in zip(profile, records):
+            seq = record.sequence.upper().replace('N', 'A')
+            assert name == record.name
+            assert length == len(seq)
+            assert (med, avg, dev) == hi.get_median_count(seq)
+
+
+def test_coverage_profile_bad_args():
+    hi = khmer.Countgraph(12, 1e6, 2)
+    with pytest.raises(ValueError):
+        hi.coverage_profile(utils.get_test_data('test-abund-read-2.fa'),
+                            chunk_size=0)
+    with pytest.raises(TypeError):
+        hi.coverage_profile(5)
+
+
 def test_median_at_least():
     hi = khmer.Countgraph(6, 1e6, 2)
 
@@ -692,6 +720,102 @@ def test_save_load():
     assert x == y, (x, y)
 
 
+def test_save_snapshot():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('snapshot.ct')
+
+    hi = khmer.Countgraph(12, 1e5, 3)
+    hi.consume_seqfile(inpath)
+    before = hi.get('AAAAAAAAAAAA')
+
+    snapshot = hi.save_snapshot(savepath)
+
+    # keep counting while the snapshot is written
+    for _ in range(5):
+        hi.count('AAAAAAAAAAAA')
+    snapshot.wait()
+    assert snapshot.is_done()
+    assert snapshot.filename == savepath
+
+    ht = Countgraph.load(savepath)
+    assert ht.get('AAAAAAAAAAAA') == before
+    assert hi.get('AAAAAAAAAAAA') == before + 5
+    # Countgraph files do not store the unique k-mer count
+    assert ht.n_occupied() > 0
+
+
+def test_save_snapshot_bad_path():
+    hi = khmer.Countgraph(12, 1e5, 3)
+    snapshot = hi.save_snapshot('/no/such/dir/snapshot.ct')
+
+    with pytest.raises(OSError):
+        snapshot.wait()
+
+
+def test_update():
+    a = khmer.Countgraph(12, 1e5, 3)
+    b = khmer.Countgraph(12, 1e5, 3)
+    a.set_use_bigcount(True)
+    b.set_use_bigcount(True)
+
+    for _ in range(3):
+        a.count('ACGTACGTACGA')
+    for _ in range(300):
+        a.count('CAGTCAGTCAGG')
+    for _ in range(5):
+        b.count('ACGTACGTACGA')
+        b.count('CAGTCAGTCAGG')
+    for _ in range(250):
+        b.count('GATTACAGATTA')
+    b.count('TTGCATTGCAAC')
+
+    a.update(b, n_threads=2)
+    assert a.get('ACGTACGTACGA') == 8
+    assert a.get('CAGTCAGTCAGG') == 305
+    assert a.get('GATTACAGATTA') == 250
+    assert a.get('TTGCATTGCAAC') == 1
+
+    # k-mers that only overflow once merged saturate at 255
+    a.update(b)
+    assert a.get('GATTACAGATTA') == 255
+
+
+def test_update_from_file():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('update.ct')
+
+    a = khmer.Countgraph(12, 1e5, 3)
+    b = khmer.Countgraph(12, 1e5, 3)
+    c = khmer.Countgraph(12, 1e5, 3)
+    a.consume_seqfile(inpath)
+    b.consume_seqfile(inpath)
+    c.consume_seqfile(inpath)
+    b.save(savepath)
+
+    a.update(b)
+    c.update_from_file(savepath)
+    assert ([t.tolist() for t in a.get_raw_tables()] ==
+            [t.tolist() for t in c.get_raw_tables()])
+    assert c.n_occupied() == b.n_occupied()
+
+    d = khmer.Countgraph(12, 1e4, 3)
+    with pytest.raises(OSError):
+        d.update_from_file(savepath)
+
+
+def test_update_incompatible():
+    a = khmer.Countgraph(12, 1e5, 3)
+
+    with pytest.raises(ValueError):
+        a.update(khmer.Counttable(12, 1e5, 3))
+    with pytest.raises(ValueError):
+        a.update(khmer.Countgraph(13, 1e5, 3))
+    with pytest.raises(ValueError):
+        a.update(khmer.Countgraph(12, 1e4, 3))
+    with pytest.raises(ValueError):
+        khmer.SmallCountgraph(12, 1e5, 3).update_from_file('x.ct')
+
+
 def test_load_truncated():
     inpath = utils.get_test_data('random-20-a.fa')
     savepath = utils.get_temp_filename('save.ht')
@@ -1036,6 +1160,27 @@ def test_bigcount_overflow():
     assert kh.get('GGTTGACGGGGCTCAGGG') == MAX_BIGCOUNT
 
 
+def test_bigcount_abund_dist_saturated():
+    # counts from MAX_BIGCOUNT up land in the last of MAX_BIGCOUNT + 1 bins,
+    # with or without a tracking table
+    kh = khmer.Countgraph(18, 1e7, 4)
+    tracking = khmer.Nodegraph(18, 1e7, 4)
+    kh.set_use_bigcount(True)
+
+    for _ in range(0, 70000):
+        kh.count('GGTTGACGGGGCTCAGGG')
+
+    seqpath = utils.get_temp_filename('saturated.fa')
+    with open(seqpath, 'w') as fp:
+        fp.write('>read\nGGTTGACGGGGCTCAGGG\n')
+
+    for dist in (kh.abundance_distribution(seqpath, tracking),
+                 kh.abundance_distribution(seqpath)):
+        assert len(dist) == MAX_BIGCOUNT + 1
+        assert dist[MAX_BIGCOUNT] == 1
+        assert sum(dist) == 1
+
+
 def test_get_ksize():
     kh = khmer.Countgraph(22, 1, 1)
     assert kh.ksize() == 22
@@ -1497,3 +1642,48 @@ def test_counting_load_bigcount():
         print(i, count_table.count('ATATATATAT'))
     count = count_table.get('ATATATATAT')
     assert count == 500
+
+
+@pytest.mark.parametrize('pages', ['default', 'huge', 'huge-1g'])
+def test_countgraph_table_allocation(pages):
+    alloc = khmer.TableAllocation(pages=pages, numa_interleave=True,
+                                  n_threads=2)
+    # big enough for the tables to be mapped rather than heap allocated
+    countgraph = Countgraph(12, 5e6, 2, alloc=alloc)
+    assert countgraph.n_occupied() == 0
+
+    for _ in range(3):
+        countgraph.count('ACGTACGTACGT')
+    countgraph.count('AAAAAAAAAAAA')
+    assert countgraph.get('ACGTACGTACGT') == 3
+    assert countgraph.get('AAAAAAAAAAAA') == 1
+    assert countgraph.get('CCCCCCCCCCCC') == 0
+
+    outfile = utils.get_temp_filename('alloc.ct')
+    countgraph.save(outfile)
+    loaded = Countgraph.load(outfile, alloc=alloc)
+    assert loaded.get('ACGTACGTACGT') == 3
+    assert loaded.n_occupied() == countgraph.n_occupied()
+
+
+def test_table_allocation_default():
+    saved = khmer.get_table_allocation()
+    assert saved.pages == 'default'
+    try:
+        khmer.set_table_allocation(pages='huge', n_threads=2)
+        current = khmer.get_table_allocation()
+        assert current.pages == 'huge'
+        assert current.n_threads == 2
+        assert not current.numa_interleave
+
+        nodegraph = Nodegraph(12, 5e6, 2)
+        nodegraph.count('ACGTACGTACGT')
+        assert nodegraph.get('ACGTACGTACGT')
+    finally:
+        khmer.set_table_allocation(saved.pages, saved.numa_interleave,
+                                   saved.n_threads)
+
+
+def test_table_allocation_bad_pages():
+    with pytest.raises(ValueError):
+        khmer.TableAllocation(pages='giant')
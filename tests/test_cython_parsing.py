@@ -398,6 +398,63 @@ def test_check_is_left():
         '@HWI-ST412:261:d15khacxx:8:1101:3149:2157 1:N:0:ATCACG')
 
 
+def test_FastxParser_iter_read_pairs():
+    parser = FastxParser(utils.get_test_data('paired.fq'))
+    pairs = list(parser.iter_read_pairs(batch_size=2))
+
+    assert len(pairs) == 3
+    for first, second in pairs:
+        assert check_is_pair(first, second)
+
+
+def test_FastxParser_iter_read_pairs_unpaired():
+    parser = FastxParser(utils.get_test_data('paired-mixed.fq'))
+    with pytest.raises(ValueError):
+        list(parser.iter_read_pairs())
+
+    parser = FastxParser(utils.get_test_data('paired-mixed.fq'))
+    pairs = list(parser.iter_read_pairs(ignore_unpaired=True))
+    assert len(pairs) > 0
+    for first, second in pairs:
+        assert check_is_pair(first, second)
+
+
+@pytest.mark.parametrize('trailing', [[], [Sequence('seq5/1', 'A' * 5),
+                                           Sequence('seq5/2', 'A' * 5)]])
+def test_FastxParser_iter_read_pairs_unpaired_mid_batch(create_fastx,
+                                                        trailing):
+    # the pairs read before a bad one in the same batch still come out
+    reads = [Sequence('seq1/1', 'A' * 5),
+             Sequence('seq1/2', 'A' * 5),
+             Sequence('seq2/1', 'A' * 5),
+             Sequence('seq2/2', 'A' * 5),
+             Sequence('seq3/1', 'A' * 5),
+             Sequence('seq4/2', 'A' * 5)] + trailing
+    parser = FastxParser(create_fastx(reads))
+
+    pairs = []
+    with pytest.raises(ValueError):
+        for pair in parser.iter_read_pairs(batch_size=10):
+            pairs.append(pair)
+
+    assert [(first.name, second.name) for first, second in pairs] == \
+        [('seq1/1', 'seq1/2'), ('seq2/1', 'seq2/2')]
+
+
+def test_SanitizedFastxParser_iter_read_pairs(create_fastx):
+    reads = [Sequence('seq1/1', 'A' * 5),
+             Sequence('seq1/2', 'XXX'),
+             Sequence('seq2/1', 'A' * 5),
+             Sequence('seq2/2', 'A' * 4)]
+    parser = SanitizedFastxParser(create_fastx(reads))
+    pairs = list(parser.iter_read_pairs(batch_size=1))
+
+    assert parser.n_bad == 1
+    assert len(pairs) == 1
+    assert pairs[0][0].name == 'seq2/1'
+    assert pairs[0][1].name == 'seq2/2'
+
+
 class Test_Sequence(object):
 
     name = 'Test'
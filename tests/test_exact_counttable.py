@@ -0,0 +1,205 @@
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=missing-docstring,invalid-name
+import os
+from collections import Counter
+
+import pytest
+
+import khmer
+from khmer import ExactCountBuilder, ExactCounttable, Counttable, ReadParser
+
+from . import khmer_tst_utils as utils
+
+K = 15
+
+
+def _reference_counts(filename, ksize=K):
+    # exact counts by hash, via Counttable's hash function
+    hasher = Counttable(ksize, 1, 1)
+    counts = Counter()
+    for read in ReadParser(filename):
+        seq = read.sequence.upper()
+        for i in range(len(seq) - ksize + 1):
+            counts[hasher.hash(seq[i:i + ksize])] += 1
+    return counts
+
+
+def _build(infiles, n_buckets=8, n_threads=1, **kw):
+    outfile = utils.get_temp_filename('counts.oxli')
+    builder = ExactCountBuilder(K, tmpdir=os.path.dirname(outfile),
+                                n_buckets=n_buckets, n_threads=n_threads, **kw)
+    for infile in infiles:
+        builder.consume_seqfile(infile)
+    n_distinct = builder.write(outfile)
+    return builder, n_distinct, outfile
+
+
+@pytest.mark.parametrize('n_buckets,n_threads', [(1, 1), (8, 1), (8, 2)])
+def test_exact_counts(n_buckets, n_threads):
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    builder, n_distinct, outfile = _build([infile], n_buckets, n_threads)
+    expected = _reference_counts(infile)
+
+    assert builder.n_kmers() == sum(expected.values())
+    assert n_distinct == len(expected)
+
+    table = ExactCounttable.load(outfile)
+    assert table.ksize() == K
+    assert table.n_unique_kmers() == len(expected)
+    for hashval, count in expected.items():
+        assert table.get(hashval) == count
+    missing = next(h for h in range(1000) if h not in expected)
+    assert table.get(missing) == 0
+
+    # temporary files are cleaned up
+    assert os.listdir(os.path.dirname(outfile)) == ['counts.oxli']
+
+
+def test_exact_counts_match_counttable():
+    infile = utils.get_test_data('test-reads.fa')
+    _, _, outfile = _build([infile])
+    table = ExactCounttable.load(outfile)
+
+    counttable = Counttable(K, 1e7, 4)
+    counttable.consume_seqfile(infile)
+
+    for read in ReadParser(infile):
+        exact = table.get_kmer_counts(read.sequence)
+        approx = counttable.get_kmer_counts(read.sequence)
+        # CountMin counts are never low, short of saturating at 255
+        assert all(a >= min(e, 255) for e, a in zip(exact, approx))
+        assert min(exact) >= 1
+
+
+def test_exact_consume_seqfile_returns_counts():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    builder = ExactCountBuilder(K, tmpdir=utils.get_temp_filename('.'))
+    n_reads, n_kmers = builder.consume_seqfile(ReadParser(infile))
+    assert (n_reads, n_kmers) == (builder.n_reads(), builder.n_kmers())
+    assert n_reads == len(list(ReadParser(infile)))
+    assert builder.consume_seqfile(infile) == (n_reads, n_kmers)
+    assert builder.n_kmers() == 2 * n_kmers
+
+
+def test_exact_abundance_distribution():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    _, _, outfile = _build([infile, infile])
+    table = ExactCounttable.load(outfile)
+    expected = Counter(_reference_counts(infile).values())
+
+    dist = table.abundance_distribution()
+    assert len(dist) == 65536
+    assert sum(dist) == table.n_unique_kmers()
+    for count, n_kmers in expected.items():
+        assert dist[2 * count] == n_kmers
+
+
+def test_exact_abundance_distribution_saturated():
+    # a k-mer seen 70000 times lands in the last slot, counts >= 65535
+    infile = utils.get_temp_filename('repeats.fa')
+    with open(infile, 'w') as fp:
+        fp.write('>repeats\n' + 'A' * (K + 70000 - 1) + '\n')
+        fp.write('>other\nACGTACGGTCAGTTAGCATG\n')
+    _, _, outfile = _build([infile])
+    table = ExactCounttable.load(outfile)
+
+    assert table.get('A' * K) == 65535
+    dist = table.abundance_distribution()
+    assert dist[65535] == 1
+    assert sum(dist) == table.n_unique_kmers()
+
+
+@pytest.mark.parametrize('n_threads', [1, 2])
+def test_exact_counts_sorted_in_runs(n_threads):
+    # buckets far over sort_chunk are sorted in runs and merged on disk
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    _, n_distinct, outfile = _build([infile, infile], n_buckets=1,
+                                    n_threads=n_threads, sort_chunk=16)
+    table = ExactCounttable.load(outfile)
+
+    expected = _reference_counts(infile)
+    assert n_distinct == len(expected)
+    for hashval, count in expected.items():
+        assert table.get(hashval) == 2 * count
+
+
+def test_exact_save_load():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    _, _, outfile = _build([infile])
+    table = ExactCounttable.load(outfile)
+
+    savefile = utils.get_temp_filename('saved.oxli')
+    table.save(savefile)
+    table.save(savefile)
+    loaded = ExactCounttable.load(savefile)
+    for hashval, count in _reference_counts(infile).items():
+        assert loaded.get(hashval) == count
+
+
+def test_exact_read_only():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    _, _, outfile = _build([infile])
+    table = ExactCounttable.load(outfile)
+
+    with pytest.raises(Exception):
+        table.add('A' * K)
+    with pytest.raises(Exception):
+        table.consume('A' * 20)
+    assert khmer.calc_expected_collisions(table) == 0
+
+
+def test_exact_builder_errors():
+    with pytest.raises(ValueError):
+        ExactCountBuilder(K, n_buckets=0)
+    with pytest.raises(ValueError):
+        ExactCountBuilder(K, sort_chunk=0)
+    with pytest.raises(OSError):
+        ExactCountBuilder(K, tmpdir='/no/such/directory')
+
+    builder, _, _ = _build([utils.get_test_data('test-abund-read-2.fa')])
+    with pytest.raises(Exception):
+        builder.write(utils.get_temp_filename('again.oxli'))
+
+
+def test_exact_load_bad_file():
+    with pytest.raises(OSError):
+        ExactCounttable.load(utils.get_test_data('test-abund-read-2.fa'))
+    with pytest.raises(OSError):
+        ExactCounttable.load(utils.get_temp_filename('missing.oxli'))
+
+    countfile = utils.get_temp_filename('counttable.ct')
+    Counttable(K, 1000, 2).save(countfile)
+    with pytest.raises(OSError):
+        ExactCounttable.load(countfile)
@@ -122,6 +122,55 @@ def test_filter_abund_2_stdin_gzip_out():
     print(err)
     assert status == 0
 
+def test_filter_abund_2_threaded_gzip_out():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    in_dir = os.path.dirname(infile)
+    outfile = utils.get_temp_filename('out.fa')
+    gzoutfile = utils.get_temp_filename('out.fa.gz')
+
+    counting_ht = _make_counting(infile, K=17)
+
+    script = 'filter-abund.py'
+    args = ['-C', '1', counting_ht, infile, infile, '-o', outfile]
+    utils.runscript(script, args, in_dir)
+
+    # several threads, appending both inputs to one compressed file
+    args = ['-C', '1', '-T', '4', counting_ht, infile, infile,
+            '-o', gzoutfile, '--gzip']
+    utils.runscript(script, args, in_dir)
+
+    expected = [(r.name, r.sequence) for r in screed.open(outfile)]
+    assert len(expected) == 2 * 1001, len(expected)
+    found = [(r.name, r.sequence) for r in screed.open(gzoutfile)]
+    assert found == expected
+
+
+def test_filter_abund_paired():
+    infile = utils.copy_test_data('dn-test-all-paired-all-keep.fa')
+    in_dir = os.path.dirname(infile)
+
+    counting_ht = _make_counting(infile, K=17)
+
+    script = 'filter-abund.py'
+    args = ['-C', '1', '--paired', '-T', '2', counting_ht, infile]
+    utils.runscript(script, args, in_dir)
+
+    outfile = infile + '.abundfilt'
+    names = [r.name for r in screed.open(outfile)]
+    assert names == [r.name for r in screed.open(infile)]
+
+
+def test_filter_abund_paired_fail():
+    infile = utils.copy_test_data('paired-mixed.fa')
+    in_dir = os.path.dirname(infile)
+
+    counting_ht = _make_counting(infile, K=17)
+
+    script = 'filter-abund.py'
+    args = ['--paired', counting_ht, infile]
+    status, out, err = utils.runscript(script, args, in_dir, fail_ok=True)
+    assert status != 0
+
 # make sure that FASTQ records are retained.
 
 
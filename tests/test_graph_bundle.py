@@ -0,0 +1,185 @@
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=missing-docstring,invalid-name
+import pytest
+
+from khmer import GraphBundle, GraphLabels, Countgraph, Nodegraph
+
+from . import khmer_tst_utils as utils
+
+
+def _partitioned_graph():
+    graph = Nodegraph(20, 4 ** 4 + 1, 2)
+    filename = utils.get_test_data('test-graph5.fa')
+    graph.consume_seqfile_and_tag(filename)
+    graph.merge_subset(graph.do_subset_partition(0, 0))
+    graph.add_stop_tag('GAGATCATCAGGTGAATGCA')
+    return graph
+
+
+def test_bundle_roundtrip():
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, partitionmap=True)
+
+    assert GraphBundle.is_bundle(bundlefile)
+    bundle = GraphBundle(bundlefile)
+    assert bundle.sections() == ['table', 'tagset', 'stoptags',
+                                 'partitionmap']
+    assert 'labels' not in bundle
+
+    loaded = bundle.graph
+    assert isinstance(loaded, Nodegraph)
+    assert bundle.graph is loaded
+    assert loaded.ksize() == graph.ksize()
+    assert loaded.n_occupied() == graph.n_occupied()
+
+    assert loaded.n_tags == 0
+    bundle.load_tagset()
+    assert loaded.n_tags == graph.n_tags
+    assert set(loaded.tags()) == set(graph.tags())
+
+    bundle.load_stop_tags()
+    assert loaded.get_stop_tags() == graph.get_stop_tags()
+
+    bundle.load_partitionmap()
+    assert loaded.count_partitions() == graph.count_partitions()
+
+
+def test_bundle_partitionmap_only():
+    # annotate-partitions style: only the partition map is read
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, partitionmap=True)
+
+    bundle = GraphBundle(bundlefile)
+    small = Nodegraph(graph.ksize(), 1, 1)
+    assert bundle.load_partitionmap(small) is small
+
+    filename = utils.get_test_data('test-graph5.fa')
+    expected = utils.get_temp_filename('expected.part')
+    annotated = utils.get_temp_filename('annotated.part')
+    assert (small.output_partitions(filename, annotated) ==
+            graph.output_partitions(filename, expected))
+    with open(expected) as exp, open(annotated) as ann:
+        assert ann.read() == exp.read()
+
+
+@pytest.mark.parametrize('compress', [True, False])
+def test_bundle_compression(compress):
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, compress=compress)
+
+    compressed, stored, length, _ = GraphBundle(bundlefile).section_info(
+        'table')
+    assert compressed == compress
+    if compress:
+        assert stored < length
+    else:
+        assert stored == length
+    assert GraphBundle(bundlefile).graph.n_occupied() == graph.n_occupied()
+
+
+def test_bundle_countgraph_and_labels():
+    labels = GraphLabels.CountGraphLabels(20, 1e5, 4)
+    labels.consume_seqfile_and_tag_with_labels(
+        utils.get_test_data('test-labels.fa'))
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, labels.graph, labels=labels)
+
+    bundle = GraphBundle(bundlefile)
+    assert 'labels' in bundle
+    loaded = bundle.load_labels()
+    assert isinstance(loaded.graph, Countgraph)
+    assert loaded.graph is bundle.graph
+    assert loaded.n_labels == labels.n_labels
+    assert set(loaded.labels()) == set(labels.labels())
+
+
+def test_bundle_checksum_mismatch():
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, compress=False)
+
+    bundle = GraphBundle(bundlefile)
+    _, stored, _, _ = bundle.section_info('table')
+    with open(bundlefile, 'r+b') as fp:
+        # flip a byte in the middle of the table section
+        fp.seek(16 + 32 * len(bundle.sections()) + stored // 2)
+        byte = fp.read(1)
+        fp.seek(-1, 1)
+        fp.write(bytes([byte[0] ^ 0xff]))
+
+    # the other sections are still fine
+    assert GraphBundle(bundlefile).load_tagset(Nodegraph(20, 1, 1)).n_tags
+    with pytest.raises(OSError):
+        GraphBundle(bundlefile).graph
+
+
+def test_bundle_truncated_section():
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, compress=True)
+
+    bundle = GraphBundle(bundlefile)
+    _, stored, _, _ = bundle.section_info('table')
+    with open(bundlefile, 'r+b') as fp:
+        fp.truncate(16 + 32 * len(bundle.sections()) + stored // 2)
+
+    with pytest.raises(OSError) as excinfo:
+        GraphBundle(bundlefile).graph
+    assert 'Truncated' in str(excinfo.value)
+
+
+def test_bundle_missing_section():
+    graph = _partitioned_graph()
+    bundlefile = utils.get_temp_filename('graph.bundle')
+    GraphBundle.write(bundlefile, graph, stop_tags=False)
+
+    bundle = GraphBundle(bundlefile)
+    assert 'stoptags' not in bundle
+    with pytest.raises(KeyError):
+        bundle.load_stop_tags()
+    with pytest.raises(ValueError):
+        'nosuchsection' in bundle
+
+
+def test_not_a_bundle():
+    filename = utils.get_test_data('goodversion-k32.tagset')
+    assert not GraphBundle.is_bundle(filename)
+    with pytest.raises(OSError):
+        GraphBundle(filename)
+    with pytest.raises(OSError):
+        GraphBundle(utils.get_temp_filename('nosuchfile'))
@@ -193,6 +193,21 @@ def test_hll_invalid_base():
     hllcpp.consume_string("ACGTTTCGNAATNNNNN")
 
 
+def test_hll_consume_string_matches_add():
+    # consume_string hashes k-mers in place; it must agree with hashing
+    # each k-mer on its own.
+    seq = "ACGTTTCGNAATNNNNNACGTAAGCTTACGTACGCATGCATGGGACGATCGATTACCA"
+    hll = khmer.HLLCounter(0.01, 5)
+    hll2 = khmer.HLLCounter(0.01, 5)
+
+    n = hll.consume_string(seq)
+    for i in range(len(seq) - 5 + 1):
+        hll2.add(seq[i:i + 5])
+
+    assert n == len(seq) - 5 + 1
+    assert hll.counters == hll2.counters
+
+
 def test_hll_invalid_error_rate():
     # test if error_rate is a valid value
 
@@ -34,6 +34,8 @@
 # Contact: khmer-project@idyll.org
 # pylint: disable=missing-docstring,no-member,protected-access,invalid-name
 
+import pytest
+
 import khmer
 
 from . import khmer_tst_utils as utils
@@ -136,6 +138,57 @@ def test_fakelump_repartitioning():
     assert n_partitions == 6, n_partitions
 
 
+@pytest.mark.parametrize("n_threads", [1, 4])
+def test_fakelump_find_knots(n_threads):
+    fakelump_fa = utils.get_test_data('fakelump.fa')
+    fakelump_fa_foo = utils.get_temp_filename('fakelump.fa.stopfoo')
+
+    ht = khmer.Nodegraph(32, 1e5, 4)
+    ht.consume_seqfile_and_tag(fakelump_fa)
+
+    subset = ht.do_subset_partition(0, 0)
+    ht.merge_subset(subset)
+
+    # same parameters as test_fakelump_repartitioning above
+    counting = khmer.Countgraph(32, 1e5, 4)
+    n_stop_tags = ht.find_knots(counting, 40, 82, 1, n_threads=n_threads)
+    assert n_stop_tags == len(ht.get_stop_tags())
+    assert n_stop_tags > 0
+
+    # the partition map is left alone
+    (n_partitions, _) = ht.count_partitions()
+    assert n_partitions == 1, n_partitions
+
+    ht.save_stop_tags(fakelump_fa_foo)
+
+    ht = khmer.Nodegraph(32, 1e5, 4)
+    ht.consume_seqfile_and_tag(fakelump_fa)
+    ht.load_stop_tags(fakelump_fa_foo)
+
+    subset = ht.do_subset_partition(0, 0, True)
+    ht.merge_subset(subset)
+
+    (n_partitions, _) = ht.count_partitions()
+    assert n_partitions == 6, n_partitions
+
+
+def test_fakelump_find_knots_subset():
+    fakelump_fa = utils.get_test_data('fakelump.fa')
+
+    ht = khmer.Nodegraph(32, 1e5, 4)
+    ht.consume_seqfile_and_tag(fakelump_fa)
+
+    subset = ht.do_subset_partition(0, 0)
+    counting = khmer.Countgraph(32, 1e5, 4)
+    assert ht.find_knots(counting, 40, 82, 1, subs=subset) > 0
+
+    # with no partitions there is nothing to traverse
+    ht = khmer.Nodegraph(32, 1e5, 4)
+    ht.consume_seqfile_and_tag(fakelump_fa)
+    with pytest.raises(ValueError):
+        ht.find_knots(counting, 40, 82, 1)
+
+
 def test_fakelump_load_stop_tags_trunc():
     fakelump_fa = utils.get_test_data('fakelump.fa')
     fakelump_fa_foo = utils.get_temp_filename('fakelump.fa.stopfoo')
@@ -35,6 +35,8 @@
 # pylint: disable=missing-docstring,protected-access,no-member,invalid-name
 
 
+import random
+
 import khmer
 from khmer import Nodegraph, Countgraph
 from khmer import ReadParser
@@ -493,13 +495,13 @@ def test_save_load_tagset():
     nodegraph.load_tagset(outfile)              # implicitly => clear_tags=True
     nodegraph.save_tagset(outfile)
 
-    # if tags have been cleared, then the new tagfile will be larger (34 bytes)
-    # else smaller (26 bytes).
+    # if tags have been cleared, then the new tagfile will hold one tag
+    # (61 bytes); else two tags (69 bytes).
 
     fp = open(outfile, 'rb')
     data = fp.read()
     fp.close()
-    assert len(data) == 30, len(data)
+    assert len(data) == 61, len(data)
 
 
 def test_save_load_tagset_noclear():
@@ -515,13 +517,39 @@ def test_save_load_tagset_noclear():
     nodegraph.load_tagset(outfile, False)  # set clear_tags => False; zero tags
     nodegraph.save_tagset(outfile)
 
-    # if tags have been cleared, then the new tagfile will be large (34 bytes);
-    # else small (26 bytes).
+    # if tags have been cleared, then the new tagfile will hold one tag
+    # (61 bytes); else two tags (69 bytes).
 
     fp = open(outfile, 'rb')
     data = fp.read()
     fp.close()
-    assert len(data) == 38, len(data)
+    assert len(data) == 69, len(data)
+
+
+def test_save_load_tagset_compact():
+    nodegraph = khmer.Nodegraph(20, 1e6, 2)
+    nodegraph.consume_seqfile_and_tag(utils.get_test_data('random-20-a.fa'))
+    tags = sorted(nodegraph.get_tagset())
+    assert len(tags) > 100, len(tags)
+
+    outfile = utils.get_temp_filename('tagset')
+    nodegraph.save_tagset(outfile)
+
+    # sorted, bit-packed tags take well under the 8 bytes/tag of version 4
+    with open(outfile, 'rb') as fp:
+        data = fp.read()
+    assert len(data) < 5 * len(tags), len(data)
+
+    nodegraph2 = khmer.Nodegraph(20, 1e6, 2)
+    nodegraph2.load_tagset(outfile)
+    assert sorted(nodegraph2.get_tagset()) == tags
+
+
+def test_load_tagset_old_version():
+    # version 4 files are still readable
+    nodegraph = khmer.Nodegraph(32, 1, 1)
+    nodegraph.load_tagset(utils.get_test_data('goodversion-k32.tagset'))
+    assert nodegraph.n_tags == 2
 
 
 def test_stop_traverse():
@@ -1182,3 +1210,50 @@ def test_create_matching_nodegraph(ntables, targetsize):
     cg = khmer.Countgraph(31, targetsize, ntables)
     ng = create_matching_nodegraph(cg)
     assert cg.hashsizes() == ng.hashsizes()
+
+
+def _random_kmers(n, ksize, seed=1):
+    rng = random.Random(seed)
+    return [''.join(rng.choice('ACGT') for _ in range(ksize))
+            for _ in range(n)]
+
+
+def test_scalable_nodegraph_grows():
+    kmers = _random_kmers(20000, 21)
+    sng = khmer.ScalableNodegraph(21, 1000, 4, fp_rate=0.01)
+    assert sng.n_slices() == 1
+
+    for kmer in kmers:
+        sng.count(kmer)
+
+    assert sng.n_slices() > 1
+    assert all(sng.get(kmer) == 1 for kmer in kmers)
+    assert sng.estimated_fp_rate() <= 0.01
+
+    fps = sum(sng.get(kmer) for kmer in _random_kmers(5000, 21, seed=2))
+    assert fps < 5000 * 0.03, fps
+
+
+def test_scalable_nodegraph_save_load():
+    kmers = _random_kmers(5000, 21)
+    sng = khmer.ScalableNodegraph(21, 1000, 4, fp_rate=0.01)
+    for kmer in kmers:
+        sng.count(kmer)
+
+    outfile = utils.get_temp_filename('scalable.graph')
+    sng.save(outfile)
+
+    loaded = khmer.ScalableNodegraph.load(outfile)
+    assert loaded.n_slices() == sng.n_slices()
+    assert loaded.n_unique_kmers() == sng.n_unique_kmers()
+    assert all(loaded.get(kmer) == 1 for kmer in kmers)
+
+    # plain Nodegraph loading picks up the scalable layout
+    ng = Nodegraph.load(outfile)
+    assert ng.n_slices() == sng.n_slices()
+    assert all(ng.get(kmer) == 1 for kmer in kmers)
+
+
+def test_scalable_nodegraph_bad_fp_rate():
+    with pytest.raises(ValueError):
+        khmer.ScalableNodegraph(21, 1000, 4, fp_rate=1.5)
@@ -528,6 +528,36 @@ def test_normalize_by_median_no_bigcount():
     print((out, err))
 
 
+def test_normalize_by_median_checkpoint():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    hashfile = utils.get_temp_filename('test-out.ct')
+    in_dir = os.path.dirname(infile)
+
+    script = 'normalize-by-median.py'
+    args = ['-C', '1', '-k', '17', '--savegraph', hashfile,
+            '--checkpoint-frequency', '1', infile]
+    _, _, err = utils.runscript(script, args, in_dir)
+
+    assert 'checkpointing countgraph to' in err, err
+    assert os.path.exists(hashfile)
+    assert not os.path.exists(os.path.join(os.path.dirname(hashfile),
+                                           '.snapshot-test-out.ct'))
+    countgraph = khmer.Countgraph.load(hashfile)
+    assert countgraph.n_occupied() > 0
+
+
+def test_normalize_by_median_checkpoint_needs_savegraph():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    in_dir = os.path.dirname(infile)
+
+    script = 'normalize-by-median.py'
+    args = ['-C', '1', '-k', '17', '--checkpoint-frequency', '1', infile]
+    status, _, err = utils.runscript(script, args, in_dir, fail_ok=True)
+
+    assert status == 1
+    assert '--checkpoint-frequency requires' in err
+
+
 def test_normalize_by_median_empty():
     CUTOFF = '1'
 
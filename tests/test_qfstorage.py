@@ -1,5 +1,6 @@
 
 import random
+import threading
 
 from khmer import QFCounttable
 
@@ -25,3 +26,57 @@ def test_read_write():
     assert qf.ksize() == qf2.ksize()
     for kmer in kmers:
         assert qf.get(kmer) == qf2.get(kmer)
+
+
+def test_process_reads_threaded():
+    # the CQF is not thread-safe itself; shared tables serialize on a lock
+    rng = random.Random(1)
+    reads = ["".join(rng.choice("ACGT") for _ in range(100))
+             for n in range(200)]
+
+    serial = QFCounttable(20, 1024 * 64)
+    serial.process_reads(reads * 4, 'consume')
+
+    shared = QFCounttable(20, 1024 * 64)
+    threads = [threading.Thread(target=shared.process_reads,
+                                args=(reads, 'consume'))
+               for _ in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    hashes, _ = serial.hash_sequences(reads)
+    assert list(shared.get_counts(hashes)) == list(serial.get_counts(hashes))
+
+
+def test_process_reads_threaded_lookups():
+    # lookups share the lock, alongside a thread that keeps inserting
+    rng = random.Random(2)
+    reads = ["".join(rng.choice("ACGT") for _ in range(100))
+             for n in range(200)]
+    more = ["".join(rng.choice("ACGT") for _ in range(100))
+            for n in range(200)]
+
+    qf = QFCounttable(20, 1024 * 64)
+    qf.process_reads(reads, 'consume')
+    expected = qf.process_reads(reads, 'get_min_count')
+
+    results = []
+    readers = [threading.Thread(
+        target=lambda: results.append(qf.process_reads(reads,
+                                                       'get_min_count')))
+        for _ in range(4)]
+    writer = threading.Thread(target=qf.process_reads,
+                              args=(more, 'consume'))
+    for thread in readers + [writer]:
+        thread.start()
+    for thread in readers + [writer]:
+        thread.join()
+
+    # counts only grow while the lookups run
+    assert len(results) == 4
+    for counts in results:
+        assert all(c >= e for c, e in zip(counts, expected))
+    hashes, _ = qf.hash_sequences(more)
+    assert all(c > 0 for c in qf.get_counts(hashes))
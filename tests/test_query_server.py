@@ -0,0 +1,127 @@
+# This file is part of khmer, https://github.com/dib-lab/khmer/, and is
+# Copyright (C) 2016, The Regents of the University of California.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#
+#     * Redistributions in binary form must reproduce the above
+#       copyright notice, this list of conditions and the following
+#       disclaimer in the documentation and/or other materials provided
+#       with the distribution.
+#
+#     * Neither the name of the Michigan State University nor the names
+#       of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written
+#       permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Contact: khmer-project@idyll.org
+# pylint: disable=missing-docstring,invalid-name
+import threading
+
+import pytest
+import screed
+
+import khmer
+from khmer.query_client import QueryClient
+
+from . import khmer_tst_utils as utils
+
+
+def _start_server(graph, n_threads=2):
+    sockpath = utils.get_temp_filename('graph.sock')
+    server = khmer.QueryServer(graph, sockpath, n_threads)
+    thread = threading.Thread(target=server.serve)
+    thread.start()
+    return server, thread
+
+
+def _sequences():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    return [r.sequence for r in screed.open(infile)]
+
+
+def test_query_countgraph():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    cg = khmer.Countgraph(12, 1e5, 3)
+    cg.consume_seqfile(infile)
+    seqs = _sequences()
+
+    server, thread = _start_server(cg)
+    try:
+        with QueryClient(server.socket_path) as client:
+            assert client.ksize() == 12
+
+            kmers = [s[:12] for s in seqs]
+            assert client.get_counts(kmers) == [cg.get(k) for k in kmers]
+
+            medians = client.get_median_counts(seqs)
+            for seq, (med, avg, stddev) in zip(seqs, medians):
+                expected = cg.get_median_count(seq)
+                assert med == expected[0]
+                assert avg == pytest.approx(expected[1])
+                assert stddev == pytest.approx(expected[2])
+
+            trimmed = client.trim_on_abundance(seqs, 3)
+            assert trimmed == [cg.trim_on_abundance(s, 3)[1] for s in seqs]
+
+            assert client.get_counts([]) == []
+    finally:
+        server.stop()
+        thread.join()
+
+
+def test_query_nodegraph_errors():
+    ng = khmer.Nodegraph(12, 1e5, 3)
+    ng.consume('ACGTACGTACGTAC')
+
+    server, thread = _start_server(ng, n_threads=1)
+    try:
+        with QueryClient(server.socket_path) as client:
+            assert client.get_counts(['ACGTACGTACGT', 'CCCCCCCCCCCC']) == \
+                [1, 0]
+
+            with pytest.raises(ValueError):
+                client.get_counts(['ACGT'])
+            with pytest.raises(ValueError):
+                client.get_median_counts(['ACGTACG'])
+
+            # the connection is still usable after an error
+            assert client.get_counts(['ACGTACGTACGT']) == [1]
+    finally:
+        server.stop()
+        thread.join()
+
+
+def test_query_shutdown():
+    ng = khmer.Nodegraph(12, 1e5, 3)
+    server, thread = _start_server(ng)
+
+    client = QueryClient(server.socket_path)
+    client.shutdown()
+    thread.join(10)
+    assert not thread.is_alive()
+
+    with pytest.raises(OSError):
+        QueryClient(server.socket_path)
+
+
+def test_query_server_bad_path():
+    ng = khmer.Nodegraph(12, 1e5, 3)
+    with pytest.raises(OSError):
+        khmer.QueryServer(ng, '/no/such/dir/graph.sock')
@@ -685,3 +685,28 @@ def test_readaligner_load():
         a_scoring_matrix, b_scoring_matrix)
     assert b_transition_probabilities == a_transition_probabilities, (
         a_transition_probabilities, b_transition_probabilities)
+
+
+def test_align_reads_parallel():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    ch = khmer.Countgraph(20, 1048576, 4)
+    ch.consume_seqfile(infile)
+    aligner = khmer.ReadAligner(ch, 2, 1.0)
+
+    outputs = []
+    for n_threads in (1, 4):
+        outfile = utils.get_temp_filename('corrected-%d.fa' % n_threads)
+        total_reads, _ = aligner.align_reads_parallel(infile, outfile,
+                                                      n_threads)
+        assert total_reads == 1001, total_reads
+        with open(outfile) as fp:
+            outputs.append(fp.read())
+
+    # output order must not depend on the number of threads
+    assert outputs[0] == outputs[1]
+
+    with open(infile) as fp:
+        in_names = [line for line in fp if line.startswith('>')]
+    out_names = [line for line in outputs[0].splitlines(True)
+                 if line.startswith('>')]
+    assert in_names == out_names
@@ -37,8 +37,13 @@
 # Tests for the ReadParser and Read classes.
 from khmer import Read
 from khmer import ReadParser
+from khmer import ReservoirSampler
+from khmer import (FastxFilter, FastxInterleaver, FastxPairSplitter,
+                   fastx_stats)
 from screed import Record
 from . import khmer_tst_utils as utils
+import gzip
+import io
 import pytest
 from functools import reduce  # pylint: disable=redefined-builtin
 
@@ -501,5 +506,255 @@ def test_error_file_does_not_exist():
 
     assert e.match("does not exist")
 
+
+def _unit_names(unit):
+    return [line[1:] for line in unit.splitlines()
+            if line.startswith('>')]
+
+
+def test_reservoir_sampler():
+    sampler = ReservoirSampler(100, seed=1)
+    sampler.sample([utils.get_test_data('test-reads.fa')])
+
+    assert sampler.n_reads == 25000
+    assert sampler.n_units < sampler.n_reads
+    assert sampler.n_ranges == 1
+    assert len(sampler) == 100
+
+    units = sampler.get_sample()
+    assert len(units) == 100
+    assert len(set(units)) == 100
+    for unit in units:
+        names = _unit_names(unit)
+        # pairs are sampled together
+        if len(names) == 2:
+            assert names[0][:-2] == names[1][:-2]
+            assert names[0].endswith('/1') and names[1].endswith('/2')
+        else:
+            assert len(names) == 1
+
+
+def test_reservoir_sampler_force_single():
+    sampler = ReservoirSampler(10, force_single=True, seed=1)
+    sampler.sample([utils.get_test_data('test-reads.fa')])
+
+    assert sampler.n_units == sampler.n_reads == 25000
+    for unit in sampler.get_sample():
+        assert len(_unit_names(unit)) == 1
+
+
+def test_reservoir_sampler_samples():
+    sampler = ReservoirSampler(10, n_samples=3, seed=1)
+    sampler.sample([utils.get_test_data('test-reads.fa')])
+
+    samples = [sampler.get_sample(n) for n in range(3)]
+    assert all(len(sample) == 10 for sample in samples)
+    assert samples[0] != samples[1] and samples[1] != samples[2]
+
+    with pytest.raises(ValueError):
+        sampler.get_sample(3)
+
+
+def test_reservoir_sampler_whole_input():
+    # with room for every unit, the sample is the input, in order
+    infile = utils.get_test_data('paired-mixed.fq')
+    outfile = utils.get_temp_filename('sample.fq')
+
+    sampler = ReservoirSampler(1000)
+    sampler.sample([infile])
+    assert sampler.write_sample(0, outfile) == 11
+
+    with open(infile) as fp:
+        expected = fp.read()
+    with open(outfile) as fp:
+        assert fp.read() == expected
+
+
+@pytest.mark.parametrize('n_threads', [1, 4])
+def test_reservoir_sampler_ranges(n_threads):
+    infile = utils.get_test_data('test-reads.fa')
+
+    whole = ReservoirSampler(50, seed=3)
+    whole.sample([infile])
+
+    sampler = ReservoirSampler(50, seed=3, range_size=50000)
+    sampler.sample([infile, infile], n_threads)
+    assert sampler.n_ranges > 2
+    # ranges are cut between pairs
+    assert sampler.n_units == 2 * whole.n_units
+    assert sampler.n_reads == 50000
+
+    serial = ReservoirSampler(50, seed=3, range_size=50000)
+    serial.sample([infile, infile])
+    assert sampler.get_sample() == serial.get_sample()
+
+
+def test_reservoir_sampler_uniform():
+    # units from either half of the input are picked as often
+    infile = utils.get_test_data('test-reads.fa')
+    first_half = 0
+    for seed in range(50):
+        sampler = ReservoirSampler(20, force_single=True, seed=seed,
+                                   range_size=100000)
+        sampler.sample([infile])
+        for unit in sampler.get_sample():
+            first_half += unit in _first_half_units(infile)
+
+    assert 450 <= first_half <= 550
+
+
+_FIRST_HALF = {}
+
+
+def _first_half_units(infile):
+    if infile not in _FIRST_HALF:
+        sampler = ReservoirSampler(25000, force_single=True)
+        sampler.sample([infile])
+        _FIRST_HALF[infile] = set(sampler.get_sample()[:12500])
+    return _FIRST_HALF[infile]
+
+
+@pytest.mark.parametrize('n_threads', [1, 4])
+def test_reservoir_sampler_max_units(n_threads):
+    infile = utils.get_test_data('test-reads.fa')
+    sampler = ReservoirSampler(10, force_single=True, max_units=1000,
+                               seed=1, range_size=20000)
+    sampler.sample([infile], n_threads)
+
+    assert sampler.n_units == 1000
+    first = _first_half_units(infile)
+    # all from the first 1000 reads
+    reads = [read.name for read in ReadParser(infile)][:1000]
+    for unit in sampler.get_sample():
+        assert unit in first
+        assert _unit_names(unit)[0] in reads
+
+
+def test_reservoir_sampler_compressed():
+    infile = utils.get_test_data('test-reads.fq.gz')
+    plainfile = utils.get_temp_filename('test-reads.fq')
+    with gzip.open(infile, 'rb') as fp, open(plainfile, 'wb') as out:
+        out.write(fp.read())
+
+    samples = []
+    for name in (infile, plainfile):
+        sampler = ReservoirSampler(10, seed=1)
+        sampler.sample([name], 4)
+        assert sampler.n_ranges == 1
+        assert sampler.n_reads == 25000
+        samples.append(sampler.get_sample())
+
+    assert samples[0] == samples[1]
+
+    sampler = ReservoirSampler(10, seed=1)
+    sampler.sample([utils.get_test_data('test-reads.fq.bz2')])
+    assert sampler.n_reads == 12500
+
+
+def test_reservoir_sampler_write_compressed():
+    outfile = utils.get_temp_filename('sample.fq.gz')
+    sampler = ReservoirSampler(10, seed=1)
+    sampler.sample([utils.get_test_data('test-reads.fq.gz')])
+    assert sampler.write_sample(0, outfile, 'gzip') == 10
+
+    names = [read.name for read in ReadParser(outfile)]
+    assert len(names) == 10
+
+
+def test_reservoir_sampler_errors():
+    with pytest.raises(ValueError):
+        ReservoirSampler(0)
+
+    badfile = utils.get_temp_filename('badly-formatted.fa')
+    with open(badfile, 'w') as fp:
+        fp.write("not-sequence")
+    with pytest.raises(ValueError):
+        ReservoirSampler(10).sample([badfile])
+
+    with pytest.raises(OSError):
+        ReservoirSampler(10).sample([utils.get_temp_filename('none.fa')])
+
+
+def test_fastx_stats():
+    assert fastx_stats(utils.get_test_data('test-abund-read-2.fa')) == \
+        (1001, 18114)
+    assert fastx_stats(utils.get_test_data('test-reads.fq.gz'))[0] == 25000
+    assert fastx_stats(utils.get_test_data('test-reads.fq.bz2'))[0] == 12500
+
+    emptyfile = utils.get_temp_filename('empty.fa')
+    open(emptyfile, 'w').close()
+    assert fastx_stats(emptyfile) == (0, 0)
+
+    with pytest.raises(OSError):
+        fastx_stats(utils.get_temp_filename('none.fa'))
+
+
+def test_fastx_multiline():
+    infile = utils.get_temp_filename('multiline.fq')
+    with open(infile, 'w') as fp:
+        fp.write("@a 1:N\r\nACGT\r\nAC\r\n+\r\n@@@\r\n@@@\r\n\n"
+                 "@b\nNNNN\n+\n####\n")
+    assert fastx_stats(infile) == (2, 10)
+
+    out = io.BytesIO()
+    FastxFilter(infile).write_to(out)
+    assert out.getvalue() == (b"@a 1:N\nACGTAC\n+\n@@@@@@\n"
+                              b"@b\nNNNN\n+\n####\n")
+
+    out = io.StringIO()
+    fastx_filter = FastxFilter(infile, drop_n=True, to_fasta=True)
+    fastx_filter.write_to(out)
+    assert out.getvalue() == ">a 1:N\nACGTAC\n"
+    assert (fastx_filter.n_read, fastx_filter.n_written) == (2, 1)
+
+
+def test_fastx_filter_min_length():
+    infile = utils.get_test_data('paired-mixed.fq')
+    out = io.BytesIO()
+    fastx_filter = FastxFilter(infile, min_length=100)
+    fastx_filter.write_to(out)
+
+    reads = [read for read in ReadParser(infile)
+             if len(read.sequence) >= 100]
+    assert fastx_filter.n_written == len(reads)
+    assert out.getvalue().decode('ascii') == ''.join(
+        '@%s\n%s\n+\n%s\n' % (r.name, r.sequence, r.quality) for r in reads)
+
+
+def test_fastx_interleaver():
+    out = io.BytesIO()
+    interleaver = FastxInterleaver(utils.get_test_data('paired.fq.1'),
+                                   utils.get_test_data('paired.fq.2'))
+    interleaver.write_to(out)
+    assert interleaver.n_pairs == 3
+    with open(utils.get_test_data('paired.fq'), 'rb') as fp:
+        assert out.getvalue() == fp.read()
+
+    with pytest.raises(ValueError) as err:
+        FastxInterleaver(utils.get_test_data('paired.fq.1'),
+                         utils.get_test_data('paired.fq')).write_to(out)
+    assert 'different number of records' in str(err.value)
+
+    with pytest.raises(ValueError) as err:
+        FastxInterleaver(utils.get_test_data('paired.fq.1'),
+                         utils.get_test_data('paired-slash1.fq.2')).write_to(
+                             out)
+    assert "doesn't look like paired data" in str(err.value)
+
+
+def test_fastx_pair_splitter():
+    infile = utils.get_test_data('paired-mixed-2.fq')
+    left, right, orphans = io.BytesIO(), io.BytesIO(), io.BytesIO()
+    splitter = FastxPairSplitter(infile, allow_orphans=True)
+    splitter.write_to(left, right, orphans)
+    assert (splitter.n_pairs, splitter.n_orphans) == (3, 5)
+    assert left.getvalue().count(b'\n+\n') == 3
+    assert right.getvalue().count(b'\n+\n') == 3
+    assert orphans.getvalue().count(b'\n+\n') == 5
+
+    with pytest.raises(ValueError) as err:
+        FastxPairSplitter(infile).write_to(left, right)
+    assert 'Unpaired reads found starting at' in str(err.value)
+
 # vim: set filetype=python tabstop=4 softtabstop=4 shiftwidth=4 expandtab:
 # vim: set textwidth=79:
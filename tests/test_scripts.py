@@ -37,7 +37,7 @@
 
 import csv
 import json
-import sys
+import glob
 import os
 import stat
 import threading
@@ -481,6 +481,52 @@ def test_count_median():
     assert '895:1:37:17593:9954/1,1,103.803741455,303.702941895,114' in data
 
 
+def test_count_median_threaded():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    outfile = infile + '.counts'
+
+    counting_ht = _make_counting(infile, K=8)
+
+    script = 'count-median.py'
+    args = ['--threads', '4', counting_ht, infile, outfile]
+    utils.runscript(script, args)
+
+    lines = [x.strip() for x in open(outfile).readlines()[1:]]
+    names = [line.split(',')[0] for line in lines]
+    assert names == [r.name for r in screed.open(infile)]
+    assert 'seq,1001,1001.0,0.0,18' in lines, lines
+
+
+def test_merge_countgraphs():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    outfile = utils.get_temp_filename('merged.ct')
+
+    counting_ht = _make_counting(infile, K=8)
+
+    script = 'merge-countgraphs.py'
+    args = ['-o', outfile, counting_ht, counting_ht, counting_ht]
+    utils.runscript(script, args)
+
+    single = khmer.Countgraph.load(counting_ht)
+    merged = khmer.Countgraph.load(outfile)
+    assert merged.get('GGTTGACG') == 3 * single.get('GGTTGACG')
+    assert merged.n_occupied() == single.n_occupied()
+
+
+def test_merge_countgraphs_mismatch():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    outfile = utils.get_temp_filename('merged.ct')
+
+    counting_ht = _make_counting(infile, K=8)
+    other_ht = _make_counting(infile, K=9)
+
+    script = 'merge-countgraphs.py'
+    args = ['-o', outfile, counting_ht, other_ht]
+    (status, out, err) = utils.runscript(script, args, fail_ok=True)
+    assert status != 0
+    assert 'Incorrect k-mer size' in err, err
+
+
 def test_count_median_fq_csv():
     infile = utils.copy_test_data('test-abund-read-2.fq')
     outfile = infile + '.counts'
@@ -871,6 +917,71 @@ def test_partition_graph_1():
     assert x == (1, 0), x          # should be exactly one partition.
 
 
+
+def test_partition_graph_bundle():
+    seqfile = utils.get_test_data('random-20-a.fa')
+    graphbase = utils.get_temp_filename('out')
+    utils.runscript('load-graph.py', ['-x', '1e7', '-N', '2', '-k', '20',
+                                      '--bundle', graphbase, seqfile])
+    assert khmer.GraphBundle.is_bundle(graphbase)
+    assert not os.path.exists(graphbase + '.tagset')
+
+    utils.runscript('partition-graph.py', [graphbase])
+    utils.runscript('merge-partitions.py', [graphbase, '-k', '20'])
+
+    bundle = khmer.GraphBundle(graphbase)
+    ht = bundle.graph
+    bundle.load_tagset()
+    ht.load_partitionmap(graphbase + '.pmap.merged')
+    x = ht.count_partitions()
+    assert x == (1, 0), x          # should be exactly one partition.
+
+    # annotate-partitions only needs the bundled partition map
+    khmer.GraphBundle.write(graphbase, ht, partitionmap=True)
+    os.remove(graphbase + '.pmap.merged')
+    in_dir = os.path.dirname(graphbase)
+    utils.runscript('annotate-partitions.py', ['-k', '20', graphbase,
+                                               seqfile], in_dir)
+
+    partfile = os.path.join(in_dir, 'random-20-a.fa.part')
+    parts = set(r.name.split('\t')[1] for r in screed.open(partfile))
+    assert parts == set(['2'])
+
+
+def test_partition_graph_bundle_no_tagset():
+    seqfile = utils.get_test_data('random-20-a.fa')
+    graphbase = utils.get_temp_filename('out')
+    utils.runscript('load-graph.py', ['-x', '1e7', '-N', '2', '-k', '20',
+                                      '--no-build-tagset', '--bundle',
+                                      graphbase, seqfile])
+    assert 'tagset' not in khmer.GraphBundle(graphbase)
+
+    for script in ('partition-graph.py', 'find-knots.py'):
+        status, out, err = utils.runscript(script, [graphbase], fail_ok=True)
+        assert status == 1, script
+        assert 'has no tagset' in err, err
+
+
+def test_partition_graph_scalable():
+    seqfile = utils.get_test_data('random-20-a.fa')
+    graphbase = utils.get_temp_filename('out')
+    utils.runscript('load-graph.py', ['-x', '1e3', '-N', '2', '-k', '20',
+                                      '--scalable', graphbase, seqfile])
+
+    # the graph outgrew its first slice and is saved with all of them
+    ht = khmer.Nodegraph.load(graphbase)
+    assert ht.n_slices() > 1
+    assert ht.estimated_fp_rate() < 0.1
+
+    utils.runscript('partition-graph.py', [graphbase])
+    utils.runscript('merge-partitions.py', [graphbase, '-k', '20'])
+
+    ht.load_tagset(graphbase + '.tagset')
+    ht.load_partitionmap(graphbase + '.pmap.merged')
+    x = ht.count_partitions()
+    assert x == (1, 0), x          # should be exactly one partition.
+
+
 def test_partition_graph_nojoin_k21():
     # test with K=21
     graphbase = _make_graph(utils.get_test_data('random-20-a.fa'), ksize=21)
@@ -989,6 +1100,33 @@ def test_partition_find_knots_execute():
     assert os.path.exists(stoptags_file)
 
 
+def test_partition_find_knots_threads():
+    graphbase = _make_graph(utils.get_test_data('random-20-a.fa'))
+
+    utils.runscript('partition-graph.py', [graphbase])
+    pmap_files = glob.glob(graphbase + '.subset.*.pmap')
+    assert pmap_files
+
+    (status, out, err) = utils.runscript('find-knots.py',
+                                         ['-T', '2', graphbase])
+    assert 'finding knots on 2 threads' in err, err
+    assert os.path.exists(graphbase + '.stoptags')
+
+    # all pmap files are handled in the one pass
+    for pmap_file in pmap_files:
+        assert not os.path.exists(pmap_file)
+        assert os.path.exists(pmap_file + '.processed')
+
+
+def test_partition_find_knots_no_pmaps():
+    graphbase = _make_graph(utils.get_test_data('random-20-a.fa'))
+
+    (status, out, err) = utils.runscript('find-knots.py', [graphbase],
+                                         fail_ok=True)
+    assert status != 0
+    assert 'no pmap files found' in err, err
+
+
 def test_partition_find_knots_existing_stoptags():
     graphbase = _make_graph(utils.get_test_data('random-20-a.fa'))
 
@@ -1293,6 +1431,36 @@ def test_extract_partitions_multi_groups():
     assert os.path.exists(groupfile3)
 
 
+def test_extract_partitions_threaded():
+    partfile = utils.copy_test_data('random-20-a.fa.part')
+    in_dir = os.path.dirname(partfile)
+
+    script = 'extract-partitions.py'
+    args = ['-m', '1', '-X', '1', '-T', '2', 'extracted', partfile]
+    utils.runscript(script, args, in_dir)
+
+    names = [r.name for r in screed.open(partfile)]
+    groups = {}
+    for name in names:
+        pid = int(name.rsplit('\t', 1)[1])
+        if pid:
+            groups.setdefault(pid, []).append(name)
+
+    group_files = sorted(f for f in os.listdir(in_dir)
+                         if f.startswith('extracted.group'))
+    assert len(group_files) == len([g for g in groups.values()
+                                    if len(g) > 1])
+
+    # each group file holds whole partitions, reads in input order
+    for filename in group_files:
+        found = [r.name for r in screed.open(os.path.join(in_dir, filename))]
+        pids = set(int(n.rsplit('\t', 1)[1]) for n in found)
+        expected = [n for n in names if int(n.rsplit('\t', 1)[1]) in pids]
+        assert found == expected
+
+    assert not [f for f in os.listdir(in_dir) if '.spill' in f]
+
+
 def test_extract_partitions_no_groups():
     empty_file = utils.copy_test_data('empty-file')
     in_dir = os.path.dirname(empty_file)
@@ -1405,6 +1573,25 @@ def test_abundance_dist_threaded():
         assert line == '1001,2,98,1.0', line
 
 
+def test_abundance_dist_exact():
+    infile = utils.copy_test_data('test-abund-read-2.fa')
+    outfile = utils.get_temp_filename('test.dist')
+    in_dir = os.path.dirname(infile)
+
+    htfile = _make_counting(infile, K=17)
+
+    script = 'abundance-dist.py'
+    args = ['-z', '--exact', '--threads', '4', htfile, infile, outfile]
+    utils.runscript(script, args, in_dir)
+
+    with open(outfile) as fp:
+        line = fp.readline().strip()    # skip header
+        line = fp.readline().strip()
+        assert line == '1,96,96,0.98', line
+        line = fp.readline().strip()
+        assert line == '1001,2,98,1.0', line
+
+
 def test_abundance_dist_single_csv():
     infile = utils.copy_test_data('test-abund-read-2.fa')
     outfile = utils.get_temp_filename('test.dist')
@@ -1662,28 +1849,16 @@ def test_sample_reads_randomly():
     seqs = set([r.name for r in screed.open(outfile)])
     print(list(sorted(seqs)))
 
-    if sys.version_info.major == 2:
-        answer = {'850:2:1:1859:11742/1', '850:2:1:1859:11742/2',
-                  '850:2:1:2131:17360/1', '850:2:1:2131:17360/2',
-                  '850:2:1:2416:7565/1', '850:2:1:2416:7565/2',
-                  '850:2:1:2490:13491/1', '850:2:1:2490:13491/2',
-                  '850:2:1:2962:3999/1', '850:2:1:2962:3999/2',
-                  '850:2:1:3096:20321/1', '850:2:1:3096:20321/2',
-                  '850:2:1:3164:6414/1', '850:2:1:3164:6414/2',
-                  '850:2:1:3206:13876/1', '850:2:1:3206:13876/2',
-                  '850:2:1:3631:20919/1', '850:2:1:3631:20919/2',
-                  '850:2:1:3655:15581/1', '850:2:1:3655:15581/2'}
-    else:
-        answer = {'850:2:1:1257:3404/1', '850:2:1:1257:3404/2',
-                  '850:2:1:1362:19357/1', '850:2:1:1362:19357/2',
-                  '850:2:1:1396:5659/1', '850:2:1:1396:5659/2',
-                  '850:2:1:2063:11124/1', '850:2:1:2063:11124/2',
-                  '850:2:1:2121:12070/1', '850:2:1:2121:12070/2',
-                  '850:2:1:2528:15779/1', '850:2:1:2528:15779/2',
-                  '850:2:1:2581:12886/1', '850:2:1:2581:12886/2',
-                  '850:2:1:2864:8505/1', '850:2:1:2864:8505/2',
-                  '850:2:1:3000:2015/1', '850:2:1:3000:2015/2',
-                  '850:2:1:3302:5025/1', '850:2:1:3302:5025/2'}
+    answer = {'850:2:1:1875:16323/1', '850:2:1:1875:16323/2',
+              '850:2:1:2218:11075/1', '850:2:1:2218:11075/2',
+              '850:2:1:2264:9254/1', '850:2:1:2264:9254/2',
+              '850:2:1:2328:2619/1', '850:2:1:2328:2619/2',
+              '850:2:1:2632:8915/1', '850:2:1:2632:8915/2',
+              '850:2:1:3073:15421/1', '850:2:1:3073:15421/2',
+              '850:2:1:3128:5803/1', '850:2:1:3128:5803/2',
+              '850:2:1:3252:10834/1', '850:2:1:3252:10834/2',
+              '850:2:1:3405:1199/1', '850:2:1:3405:1199/2',
+              '850:2:1:3499:6522/1', '850:2:1:3499:6522/2'}
 
     assert seqs == answer
 
@@ -1704,28 +1879,16 @@ def test_sample_reads_randomly_force_single():
     seqs = set([r.name for r in screed.open(outfile)])
     print(list(sorted(seqs)))
 
-    if sys.version_info.major == 2:
-        answer = {'850:2:1:2399:20086/2',
-                  '850:2:1:2273:13309/1',
-                  '850:2:1:2065:16816/1',
-                  '850:2:1:1984:7162/2',
-                  '850:2:1:2691:14602/1',
-                  '850:2:1:1762:5439/1',
-                  '850:2:1:2503:4494/2',
-                  '850:2:1:2263:11143/2',
-                  '850:2:1:1792:15774/2',
-                  '850:2:1:2084:17145/1'}
-    else:
-        answer = {'850:2:1:1199:4197/1',
-                  '850:2:1:1251:16575/2',
-                  '850:2:1:1267:6790/2',
-                  '850:2:1:1601:4443/1',
-                  '850:2:1:1625:19325/1',
-                  '850:2:1:1832:14607/2',
-                  '850:2:1:1946:20852/2',
-                  '850:2:1:2401:4896/2',
-                  '850:2:1:2562:1308/1',
-                  '850:2:1:3123:15968/2'}
+    answer = {'850:2:1:1514:9880/1',
+              '850:2:1:1672:9328/1',
+              '850:2:1:1694:6985/2',
+              '850:2:1:1725:10158/1',
+              '850:2:1:1851:5606/2',
+              '850:2:1:2024:6784/2',
+              '850:2:1:2049:1936/2',
+              '850:2:1:2103:15626/2',
+              '850:2:1:2172:2146/2',
+              '850:2:1:2208:13926/2'}
 
     assert seqs == answer
 
@@ -1748,28 +1911,16 @@ def test_sample_reads_randomly_force_single_outfile():
     seqs = set([r.name for r in screed.open(outfile)])
     print(list(sorted(seqs)))
 
-    if sys.version_info.major == 2:
-        answer = {'850:2:1:2399:20086/2',
-                  '850:2:1:2273:13309/1',
-                  '850:2:1:2065:16816/1',
-                  '850:2:1:1984:7162/2',
-                  '850:2:1:2691:14602/1',
-                  '850:2:1:1762:5439/1',
-                  '850:2:1:2503:4494/2',
-                  '850:2:1:2263:11143/2',
-                  '850:2:1:1792:15774/2',
-                  '850:2:1:2084:17145/1'}
-    else:
-        answer = {'850:2:1:1199:4197/1',
-                  '850:2:1:1251:16575/2',
-                  '850:2:1:1267:6790/2',
-                  '850:2:1:1601:4443/1',
-                  '850:2:1:1625:19325/1',
-                  '850:2:1:1832:14607/2',
-                  '850:2:1:1946:20852/2',
-                  '850:2:1:2401:4896/2',
-                  '850:2:1:2562:1308/1',
-                  '850:2:1:3123:15968/2'}
+    answer = {'850:2:1:1514:9880/1',
+              '850:2:1:1672:9328/1',
+              '850:2:1:1694:6985/2',
+              '850:2:1:1725:10158/1',
+              '850:2:1:1851:5606/2',
+              '850:2:1:2024:6784/2',
+              '850:2:1:2049:1936/2',
+              '850:2:1:2103:15626/2',
+              '850:2:1:2172:2146/2',
+              '850:2:1:2208:13926/2'}
 
     assert seqs == answer
 
@@ -1787,34 +1938,40 @@ def test_sample_reads_randomly_fq():
     outfile = infile + '.subset'
     assert os.path.exists(outfile), outfile
 
-    if sys.version_info.major == 2:
-        answer = {'850:2:1:2399:20086/2',
-                  '850:2:1:1762:5439 1::FOO',
-                  '850:2:1:2065:16816/1',
-                  '850:2:1:2263:11143/2',
-                  '850:2:1:1792:15774/2',
-                  '850:2:1:2691:14602/1',
-                  '850:2:1:2503:4494 1::FOO',
-                  '850:2:1:2084:17145/1',
-                  '850:2:1:1984:7162 1::FOO',
-                  '850:2:1:2273:13309 1::FOO'}
-    else:
-        answer = {'850:2:1:1199:4197 1::FOO',
-                  '850:2:1:1251:16575/2',
-                  '850:2:1:1267:6790/2',
-                  '850:2:1:1601:4443 1::FOO',
-                  '850:2:1:1625:1932 1::FOO1',
-                  '850:2:1:1832:14607 1::FOO',
-                  '850:2:1:1946:20852 1::FOO',
-                  '850:2:1:2401:4896/2',
-                  '850:2:1:2562:1308/1',
-                  '850:2:1:3123:15968/2'}
+    answer = {'850:2:1:1514:9880/1',
+              '850:2:1:1672:9328 1::FOO',
+              '850:2:1:1694:6985/2',
+              '850:2:1:1725:10158 1::FOO',
+              '850:2:1:1851:5606 1::FOO',
+              '850:2:1:2024:6784 1::FOO',
+              '850:2:1:2049:1936 1::FOO',
+              '850:2:1:2103:15626 1::FOO',
+              '850:2:1:2172:2146/2',
+              '850:2:1:2208:13926/2'}
 
     seqs = set([r.name for r in screed.open(outfile)])
     print(list(sorted(seqs)))
     assert seqs == answer
 
 
+def test_sample_reads_randomly_threads():
+    infile = utils.copy_test_data('test-reads.fa')
+    in_dir = os.path.dirname(infile)
+
+    script = 'sample-reads-randomly.py'
+    outputs = []
+    for threads in ('1', '4'):
+        outfile = os.path.join(in_dir, 'randreads.%s' % threads)
+        args = ['-N', '100', '-R', '2', '-T', threads, '-o', outfile,
+                infile]
+        utils.runscript(script, args, in_dir)
+        with open(outfile) as fp:
+            outputs.append(fp.read())
+
+    assert outputs[0] == outputs[1]
+    assert outputs[0].count('>') >= 100
+
+
 def test_sample_reads_randomly_stdin_no_out():
     script = 'sample-reads-randomly.py'
     args = ['-']
@@ -2035,20 +2192,11 @@ def test_sample_reads_randomly_S():
     seqs = set([r.name for r in screed.open(outfile, parse_description=True)])
     print(list(sorted(seqs)))
 
-    print(seqs)
-    if sys.version_info.major == 2:
-        answer = {'895:1:1:1303:14389', '895:1:1:1347:3237',
-                  '895:1:1:1295:6189', '895:1:1:1308:20421',
-                  '895:1:1:1320:11648', '895:1:1:1352:5369',
-                  '895:1:1:1318:10532', '895:1:1:1363:11839',
-                  '895:1:1:1355:13535', '895:1:1:1349:15165'}
-    else:
-        answer = {'895:1:1:1290:11501', '895:1:1:1303:14389',
-                  '895:1:1:1307:4308', '895:1:1:1308:2539',
-                  '895:1:1:1331:1766', '895:1:1:1333:2512',
-                  '895:1:1:1347:3237', '895:1:1:1363:11839',
-                  '895:1:1:1378:18986', '895:1:1:1383:3089'}
-
+    answer = {'895:1:1:1255:18861', '895:1:1:1287:13756',
+              '895:1:1:1294:5882', '895:1:1:1303:14389',
+              '895:1:1:1303:6251', '895:1:1:1307:4308',
+              '895:1:1:1308:2539', '895:1:1:1340:19387',
+              '895:1:1:1353:6642', '895:1:1:1382:5012'}
     assert seqs == answer
 
     outfile = infile + '.subset.1'
@@ -2057,37 +2205,24 @@ def test_sample_reads_randomly_S():
     seqs = set([r.name for r in screed.open(outfile, parse_description=True)])
     print(list(sorted(seqs)))
 
-    if sys.version_info.major == 2:
-        answer = set(['895:1:1:1303:14389', '895:1:1:1373:4848',
-                      '895:1:1:1357:19736', '895:1:1:1347:3237',
-                      '895:1:1:1338:7557', '895:1:1:1388:11093',
-                      '895:1:1:1296:1784', '895:1:1:1290:11501',
-                      '895:1:1:1355:13535', '895:1:1:1303:6251'])
-    else:
-        answer = {'895:1:1:1255:18861', '895:1:1:1276:16426',
-                  '895:1:1:1303:6251', '895:1:1:1308:20421',
-                  '895:1:1:1314:10430', '895:1:1:1351:14718',
-                  '895:1:1:1355:13535', '895:1:1:1358:4953',
-                  '895:1:1:1362:3983', '895:1:1:1363:9988'}
+    answer = {'895:1:1:1283:17864', '895:1:1:1307:4308',
+              '895:1:1:1318:10532', '895:1:1:1338:15407',
+              '895:1:1:1338:6614', '895:1:1:1349:21156',
+              '895:1:1:1363:11839', '895:1:1:1376:16513',
+              '895:1:1:1381:7062', '895:1:1:1384:20217'}
     assert seqs == answer
 
+    outfile = infile + '.subset.2'
+    assert os.path.exists(outfile), outfile
+
     seqs = set([r.name for r in screed.open(outfile, parse_description=True)])
     print(list(sorted(seqs)))
 
-    if sys.version_info.major == 2:
-        answer = {'895:1:1:1303:14389', '895:1:1:1373:4848',
-                  '895:1:1:1357:19736', '895:1:1:1347:3237',
-                  '895:1:1:1338:7557', '895:1:1:1388:11093',
-                  '895:1:1:1296:1784', '895:1:1:1290:11501',
-                  '895:1:1:1355:13535', '895:1:1:1303:6251'}
-
-    else:
-        answer = {'895:1:1:1362:3983', '895:1:1:1363:9988',
-                  '895:1:1:1314:10430', '895:1:1:1255:18861',
-                  '895:1:1:1308:20421', '895:1:1:1358:4953',
-                  '895:1:1:1351:14718', '895:1:1:1303:6251',
-                  '895:1:1:1276:16426', '895:1:1:1355:13535'}
-
+    answer = {'895:1:1:1248:9583', '895:1:1:1264:15854',
+              '895:1:1:1273:17782', '895:1:1:1276:16426',
+              '895:1:1:1295:5208', '895:1:1:1300:2738',
+              '895:1:1:1312:10985', '895:1:1:1328:3708',
+              '895:1:1:1334:19532', '895:1:1:1376:16513'}
     assert seqs == answer
 
 
@@ -583,6 +583,22 @@ def test_unique_kmers_stream_out_fasta():
     assert "ATACGCCACTCGACTTGGCTCGCCCTCGATCTAAAATAGCGGTCGTGTTGGGTTAACAA" in out
 
 
+def test_unique_kmers_stream_out_in_order():
+    # records are processed in batches on several threads, but must still be
+    # streamed out in input order
+    infile = utils.get_test_data('test-reads.fa')
+
+    cmd = "{scripts}/unique-kmers.py -k 20 -e 0.01 --stream-records {infile}"
+    cmd = cmd.format(scripts=scriptpath(), infile=infile)
+
+    (_, out, err) = run_shell_cmd(cmd)
+
+    names = [line for line in out.splitlines() if line.startswith('>')]
+    expected = [line.rstrip() for line in open(infile)
+                if line.startswith('>')]
+    assert names == expected
+
+
 def test_unique_kmers_stream_out_fastq_with_N():
     infile = utils.get_test_data('test-filter-abund-Ns.fq')
 
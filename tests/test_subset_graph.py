@@ -40,6 +40,7 @@ from khmer._oxli.legacy_partitioning import SubsetPartition, PrePartitionInfo
 import screed
 
 import os
+import pytest
 from . import khmer_tst_utils as utils
 
 
@@ -203,7 +204,7 @@ class Test_RandomData(object):
 
         savefile_ht = utils.get_temp_filename('ht')
         savefile_tags = utils.get_temp_filename('tags')
-        outfile = filename + utils.get_temp_filename('out')
+        outfile = utils.get_temp_filename('out')
 
         ht.consume_seqfile_and_tag(filename)
 
@@ -614,6 +615,70 @@ def test_small_real_partitions():
 
 test_small_real_partitions.runme = True
 
+
+def test_output_partitions_threaded():
+    filename = utils.get_test_data('random-20-a.fa')
+
+    ht = khmer.Nodegraph(21, 1e5, 4)
+    ht.consume_seqfile_and_tag(filename)
+
+    subset = ht.do_subset_partition(0, 0)
+    ht.merge_subset(subset)
+
+    outfile = utils.get_temp_filename('part')
+    n_partitions = ht.output_partitions(filename, outfile, True)
+    expected = open(outfile).read()
+    assert len(expected)
+
+    threaded = utils.get_temp_filename('part.threaded')
+    assert ht.output_partitions(filename, threaded, True, 4) == n_partitions
+    assert open(threaded).read() == expected
+
+    outfiles = [utils.get_temp_filename('part%d' % i) for i in range(3)]
+    counts = ht.output_partitions_multi([filename] * 3, outfiles, True, 2)
+    assert counts == [n_partitions] * 3, counts
+    for name in outfiles:
+        assert open(name).read() == expected
+
+
+def test_output_partitions_unwritable():
+    # an output file that cannot be opened is an error, rather than nothing
+    # being written
+    filename = utils.get_test_data('random-20-a.fa')
+
+    ht = khmer.Nodegraph(21, 1e5, 4)
+    ht.consume_seqfile_and_tag(filename)
+    ht.merge_subset(ht.do_subset_partition(0, 0))
+
+    outfile = os.path.join(filename, 'out')
+    with pytest.raises(OSError):
+        ht.output_partitions(filename, outfile)
+    with pytest.raises(OSError):
+        ht.output_partitions_multi([filename], [outfile], False, 2)
+
+
+def test_partition_extractor_sort_budget():
+    # one bucket far over a tiny sort budget is sorted in spilled runs and
+    # merged back, giving the same group files as an in-memory sort.
+    partfile = utils.copy_test_data('random-20-a.fa.part')
+    in_dir = os.path.dirname(partfile)
+
+    outputs = []
+    for name, budget in (('inmem', 1 << 30), ('runs', 256)):
+        prefix = os.path.join(in_dir, name)
+        extractor = khmer.PartitionExtractor(prefix, min_size=1, max_size=1,
+                                             n_buckets=1, sort_budget=budget)
+        extractor.consume([partfile])
+        assert extractor.develop_groups() > 1
+        extractor.output_groups(2)
+
+        groups = sorted(f for f in os.listdir(in_dir)
+                        if f.startswith(name + '.group'))
+        outputs.append([open(os.path.join(in_dir, f)).read() for f in groups])
+
+    assert outputs[0] == outputs[1]
+    assert not [f for f in os.listdir(in_dir) if '.spill' in f]
+
 first = """\
 CAGACTTGGAAGCTGAGAGTCCGACGTCACTGCCTCAACTCGCGCAAATGTTCCCGCCAA\
 ATTGTATCCTAGGGATCTTCCATAAGCTTATATACGGGGGTTTCCAAGGCCCTGATGCCA\
@@ -16,7 +16,10 @@ code...
 """
 
 import math
+import random
 import sys
+import threading
+from array import array
 import pytest
 
 from . import khmer_tst_utils as utils
@@ -397,6 +400,22 @@ def test_consume_seqfile(AnyTabletype):
     assert kh.get('CCGGC') == kh2.get('CCGGC')
 
 
+def test_consume_seqfile_write_combining(AnyTabletype):
+    infile = utils.get_test_data('test-fastq-reads.fq')
+    kh = AnyTabletype(12)
+    kh2 = AnyTabletype(12)
+    assert not kh2.get_write_combining()
+    kh2.set_write_combining(True)
+    assert kh2.get_write_combining()
+
+    assert kh.consume_seqfile(infile) == kh2.consume_seqfile(infile)
+    for read in ReadParser(infile):
+        assert kh.get_kmer_counts(read.sequence) == \
+            kh2.get_kmer_counts(read.sequence)
+    assert kh.n_unique_kmers() == kh2.n_unique_kmers()
+    assert kh.n_occupied() == kh2.n_occupied()
+
+
 def test_save_load(Tabletype):
     kh = Tabletype(5)
     ttype = type(kh)
@@ -466,3 +485,279 @@ def test_abund_dist_A_readparser(AnyTabletype):
     print(dist[:10])
     assert sum(dist) == 1
     assert dist[0] == 0
+
+
+def test_batch_add_get_counts(AnyTabletype):
+    tt = AnyTabletype(12)
+    seqs = ['ACGTACGTACGTAC', 'GGGGGGGGGGGGGG', 'ACG']
+    hashes, offsets = tt.hash_sequences(seqs)
+
+    assert list(offsets) == [0, 3, 6, 6]
+    assert list(hashes[:3]) == tt.get_kmer_hashes(seqs[0])
+
+    n_new = tt.add_hashes(hashes)
+    assert n_new == len(set(hashes))
+
+    counts = tt.get_counts(hashes)
+    assert len(counts) == len(hashes)
+    assert list(counts) == [tt.get(h) for h in hashes]
+    assert len(tt.get_counts(array('Q'))) == 0
+
+
+def test_batch_get_kmer_counts_into(AnyTabletype):
+    tt = AnyTabletype(12)
+    seq = 'ACGTACGTACGTACGGT'
+    tt.consume(seq)
+
+    out = array('H', [0] * 10)
+    n_kmers = tt.get_kmer_counts_into(seq, out)
+    assert n_kmers == len(seq) - 12 + 1
+    assert list(out[:n_kmers]) == tt.get_kmer_counts(seq)
+
+    with pytest.raises(ValueError):
+        tt.get_kmer_counts_into(seq, array('H', [0] * 2))
+
+
+def _random_reads(n_reads, length=100, seed=1):
+    rng = random.Random(seed)
+    return [''.join(rng.choice('ACGT') for _ in range(length))
+            for _ in range(n_reads)]
+
+
+def test_process_reads(AnyTabletype):
+    tt = AnyTabletype(12)
+    reads = _random_reads(20, length=30)
+
+    assert tt.process_reads(reads, 'consume') == [19] * len(reads)
+    tt.consume(reads[0])
+
+    expected = AnyTabletype(12)
+    for read in reads + reads[:1]:
+        expected.consume(read)
+
+    for op in ('get_min_count', 'get_max_count', 'get_median_count'):
+        assert tt.process_reads(reads, op) == \
+            [getattr(expected, op)(read) for read in reads]
+    for op in ('median_at_least', 'trim_on_abundance',
+               'trim_below_abundance'):
+        assert tt.process_reads(reads, op, 2) == \
+            [getattr(expected, op)(read, 2) for read in reads]
+    assert tt.process_reads([], 'consume') == []
+
+
+def test_process_reads_bad_input(AnyTabletype):
+    tt = AnyTabletype(12)
+    with pytest.raises(ValueError):
+        tt.process_reads(['ACGTACGTACGTACGT'], 'no_such_op')
+    with pytest.raises(ValueError):
+        tt.process_reads(['ACGTACGTACGTACGT', 'ACGT'], 'consume')
+    # nothing is consumed if any read is invalid
+    assert tt.get('ACGTACGTACGT') == 0
+
+
+def test_per_read_methods_release_gil():
+    # with the switch interval pushed out, a waiting Python thread only gets
+    # to run once process_reads lets go of the GIL; holding it for the whole
+    # call would leave the thread waiting until after the call returned
+    tt = Countgraph(21, 1e6, 4)
+    reads = _random_reads(500) * 40
+    go = threading.Event()
+    returned = []
+    ran_during_call = []
+
+    def worker():
+        go.wait()
+        ran_during_call.append(not returned)
+
+    interval = sys.getswitchinterval()
+    thread = threading.Thread(target=worker)
+    sys.setswitchinterval(1000)
+    try:
+        thread.start()
+        go.set()
+        tt.process_reads(reads, 'consume')
+        returned.append(True)
+    finally:
+        sys.setswitchinterval(interval)
+        thread.join()
+
+    assert ran_during_call == [True]
+
+
+def test_per_read_methods_threaded():
+    # concurrent consumers end up with the same counts as a single one
+    reads = _random_reads(400)
+    serial = Countgraph(21, 1e6, 4)
+    serial.process_reads(reads * 4, 'consume')
+
+    shared = Countgraph(21, 1e6, 4)
+    threads = [threading.Thread(target=shared.process_reads,
+                                args=(reads, 'consume'))
+               for _ in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    hashes, _ = serial.hash_sequences(reads)
+    assert list(shared.get_counts(hashes)) == list(serial.get_counts(hashes))
+
+
+CONSERVATIVE_TYPES = [Counttable, Countgraph, SmallCounttable,
+                      SmallCountgraph]
+
+
+def _true_counts(table, reads):
+    counts = {}
+    for read in reads:
+        for hashval in table.get_kmer_hashes(read):
+            counts[hashval] = counts.get(hashval, 0) + 1
+    return counts
+
+
+@pytest.mark.parametrize('tabletype', CONSERVATIVE_TYPES)
+def test_conservative_update(tabletype):
+    # tables small enough for k-mers to share counters
+    reads = _random_reads(100) * 3
+    standard = tabletype(21, 4000, 4)
+    conservative = tabletype(21, 4000, 4, conservative=True)
+    assert not standard.get_conservative_update()
+    assert conservative.get_conservative_update()
+
+    standard.process_reads(reads, 'consume')
+    conservative.process_reads(reads, 'consume')
+
+    truth = _true_counts(standard, reads)
+    max_count = 15 if 'Small' in tabletype.__name__ else 255
+    std_error = cons_error = 0
+    for hashval, count in truth.items():
+        count = min(count, max_count)
+        std_count = standard.get(hashval)
+        cons_count = conservative.get(hashval)
+        # never an undercount, and never worse than the plain update
+        assert count <= cons_count <= std_count
+        std_error += std_count - count
+        cons_error += cons_count - count
+
+    assert cons_error < std_error
+    assert conservative.n_unique_kmers() <= len(truth)
+
+
+@pytest.mark.parametrize('tabletype', CONSERVATIVE_TYPES)
+def test_conservative_update_save_load(tabletype):
+    tt = tabletype(21, 4000, 4, conservative=True)
+    reads = _random_reads(50)
+    tt.process_reads(reads, 'consume')
+    savefile = utils.get_temp_filename('conservative.out')
+    tt.save(savefile)
+
+    loaded = tabletype.load(savefile)
+    assert loaded.get_conservative_update()
+    assert loaded.n_tables() == 4
+    hashes, _ = tt.hash_sequences(reads)
+    assert list(loaded.get_counts(hashes)) == list(tt.get_counts(hashes))
+
+    # loading a plain table resets the mode
+    plain = tabletype(21, 4000, 4)
+    plain.save(savefile)
+    assert not tabletype.load(savefile).get_conservative_update()
+
+
+@pytest.mark.parametrize('tabletype', CONSERVATIVE_TYPES)
+def test_conservative_update_header(tabletype):
+    # both backends keep the mode in the flags byte after the table type
+    savefile = utils.get_temp_filename('conservative.out')
+    tabletype(21, 4000, 4, conservative=True).save(savefile)
+    with open(savefile, 'rb') as fp:
+        header = fp.read(12)
+    assert header[4] == 6
+    assert header[6] & 2
+    assert header[11] == 4
+
+    info = khmer.extract_countgraph_info(savefile)
+    assert info.version == 6
+    assert info.ksize == 21
+    assert info.n_tables == 4
+
+
+def test_load_version_4_smallcount():
+    # version 4 small count tables have no flags byte
+    tt = SmallCountgraph(21, 4000, 4)
+    reads = _random_reads(20)
+    tt.process_reads(reads, 'consume')
+    savefile = utils.get_temp_filename('smallcount.out')
+    tt.save(savefile)
+    with open(savefile, 'rb') as fp:
+        data = bytearray(fp.read())
+    data[4] = 4
+    del data[6]
+    with open(savefile, 'wb') as fp:
+        fp.write(data)
+
+    info = khmer.extract_countgraph_info(savefile)
+    assert info.version == 4
+    assert info.n_tables == 4
+
+    loaded = SmallCountgraph.load(savefile)
+    assert not loaded.get_conservative_update()
+    hashes, _ = tt.hash_sequences(reads)
+    assert list(loaded.get_counts(hashes)) == list(tt.get_counts(hashes))
+
+
+def test_load_version_4_countgraph():
+    # version 4 byte tables only ever set the bigcount flag
+    countgraph = Countgraph.load(utils.get_test_data('normC20k20.ct'))
+    assert not countgraph.get_conservative_update()
+    assert countgraph.ksize() == 20
+
+
+@pytest.mark.parametrize('tabletype', CONSERVATIVE_TYPES)
+def test_conservative_update_threaded_occupancy(tabletype):
+    # k-mers sharing a bin must not each count it as newly occupied
+    reads = _random_reads(400)
+    serial = tabletype(21, 2000, 4, conservative=True)
+    serial.process_reads(reads, 'consume')
+
+    shared = tabletype(21, 2000, 4, conservative=True)
+    threads = [threading.Thread(target=shared.process_reads,
+                                args=(reads[i::4], 'consume'))
+               for i in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert shared.n_occupied() == serial.n_occupied()
+
+
+def test_conservative_update_bigcount():
+    tt = Countgraph(12, 1e4, 4, conservative=True)
+    tt.set_use_bigcount(True)
+    for _ in range(300):
+        tt.add('G' * 12)
+    assert tt.get('G' * 12) == 300
+
+
+def test_conservative_update_unsupported():
+    for tt in (Nodegraph(12, 1e4, 4), Nodetable(12, 1e4, 4)):
+        with pytest.raises(ValueError):
+            tt.set_conservative_update(True)
+
+
+@pytest.mark.parametrize('tabletype', CONSERVATIVE_TYPES)
+def test_conservative_update_threaded(tabletype):
+    # concurrent adds of the same k-mers must not lose increments
+    reads = _random_reads(200)
+    tt = tabletype(21, 4000, 4, conservative=True)
+    threads = [threading.Thread(target=tt.process_reads,
+                                args=(reads, 'consume'))
+               for _ in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    max_count = 15 if 'Small' in tabletype.__name__ else 255
+    truth = _true_counts(tt, reads * 4)
+    for hashval, count in truth.items():
+        assert tt.get(hashval) >= min(count, max_count)